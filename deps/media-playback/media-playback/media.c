@@ -363,6 +363,32 @@ static void mp_media_next_audio(mp_media_t *m)
 	m->a_cb(m->opaque, &audio);
 }
 
+static void release_frame_ref(void *param)
+{
+	AVFrame *ref = param;
+	av_frame_free(&ref);
+}
+
+/* hands the decoded picture over without a copy by taking a reference to
+ * it.  frames converted by swscale or transferred from the GPU have their
+ * buffers overwritten by the next frame, so those go through v_cb */
+static void mp_media_output_video(mp_media_t *m, struct mp_decode *d,
+				  struct obs_source_frame *frame)
+{
+	AVFrame *f = d->frame;
+
+	if (m->v_ref_cb && !m->swscale && f->buf[0] &&
+	    !(d->hw && f == d->sw_frame)) {
+		AVFrame *ref = av_frame_clone(f);
+		if (ref) {
+			m->v_ref_cb(m->opaque, frame, release_frame_ref, ref);
+			return;
+		}
+	}
+
+	m->v_cb(m->opaque, frame);
+}
+
 static void mp_media_next_video(mp_media_t *m, bool preload)
 {
 	struct mp_decode *d = &m->v;
@@ -480,7 +506,7 @@ static void mp_media_next_video(mp_media_t *m, bool preload)
 			m->v_preload_cb(m->opaque, frame);
 		}
 	} else {
-		m->v_cb(m->opaque, frame);
+		mp_media_output_video(m, d, frame);
 	}
 }
 
@@ -865,6 +891,7 @@ bool mp_media_init(mp_media_t *media, const struct mp_media_info *info)
 	pthread_mutex_init_value(&media->mutex);
 	media->opaque = info->opaque;
 	media->v_cb = info->v_cb;
+	media->v_ref_cb = info->v_ref_cb;
 	media->a_cb = info->a_cb;
 	media->stop_cb = info->stop_cb;
 	media->v_seek_cb = info->v_seek_cb;
@@ -39,6 +39,9 @@ extern "C" {
 #endif
 
 typedef void (*mp_video_cb)(void *opaque, struct obs_source_frame *frame);
+typedef void (*mp_video_ref_cb)(void *opaque, struct obs_source_frame *frame,
+				obs_source_frame_release_t release,
+				void *param);
 typedef void (*mp_audio_cb)(void *opaque, struct obs_source_audio *audio);
 typedef void (*mp_stop_cb)(void *opaque);
 
@@ -49,6 +52,7 @@ struct mp_media {
 	mp_video_cb v_seek_cb;
 	mp_stop_cb stop_cb;
 	mp_video_cb v_cb;
+	mp_video_ref_cb v_ref_cb;
 	mp_audio_cb a_cb;
 	void *opaque;
 
@@ -117,6 +121,10 @@ struct mp_media_info {
 	mp_audio_cb a_cb;
 	mp_stop_cb stop_cb;
 
+	/* optional, called instead of v_cb with frames that reference the
+	 * decoded picture, which stays valid until release is called */
+	mp_video_ref_cb v_ref_cb;
+
 	const char *path;
 	const char *format;
 	int buffering;
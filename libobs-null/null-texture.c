@@ -0,0 +1,430 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <util/bmem.h>
+#include <graphics/vec4.h>
+#include "null-subsystem.h"
+
+static void copy_rows(uint8_t *dst, uint32_t dst_linesize, const uint8_t *src,
+		      uint32_t src_linesize, uint32_t row_size, uint32_t rows)
+{
+	if (dst_linesize == src_linesize && row_size == src_linesize) {
+		memcpy(dst, src, (size_t)row_size * rows);
+		return;
+	}
+
+	for (uint32_t y = 0; y < rows; y++) {
+		memcpy(dst, src, row_size);
+		dst += dst_linesize;
+		src += src_linesize;
+	}
+}
+
+gs_texture_t *device_texture_create(gs_device_t *device, uint32_t width,
+				    uint32_t height,
+				    enum gs_color_format color_format,
+				    uint32_t levels, const uint8_t **data,
+				    uint32_t flags)
+{
+	struct gs_texture *tex = bzalloc(sizeof(struct gs_texture));
+	tex->device = device;
+	tex->type = GS_TEXTURE_2D;
+	tex->format = color_format;
+	tex->width = width;
+	tex->height = height;
+	tex->depth = 1;
+	tex->levels = levels;
+	tex->is_dynamic = (flags & GS_DYNAMIC) != 0;
+	tex->is_render_target = (flags & GS_RENDER_TARGET) != 0;
+	tex->linesize = null_get_linesize(color_format, width);
+	tex->data = bzalloc((size_t)tex->linesize * height);
+
+	if (data && data[0]) {
+		uint32_t row_size = width * gs_get_format_bpp(color_format) / 8;
+		copy_rows(tex->data, tex->linesize, data[0], row_size,
+			  row_size, height);
+	}
+
+	return tex;
+}
+
+gs_texture_t *device_cubetexture_create(gs_device_t *device, uint32_t size,
+					enum gs_color_format color_format,
+					uint32_t levels, const uint8_t **data,
+					uint32_t flags)
+{
+	struct gs_texture *tex = bzalloc(sizeof(struct gs_texture));
+	tex->device = device;
+	tex->type = GS_TEXTURE_CUBE;
+	tex->format = color_format;
+	tex->width = size;
+	tex->height = size;
+	tex->depth = 1;
+	tex->levels = levels;
+	tex->is_dynamic = (flags & GS_DYNAMIC) != 0;
+	tex->is_render_target = (flags & GS_RENDER_TARGET) != 0;
+
+	UNUSED_PARAMETER(data);
+	return tex;
+}
+
+gs_texture_t *device_voltexture_create(gs_device_t *device, uint32_t width,
+				       uint32_t height, uint32_t depth,
+				       enum gs_color_format color_format,
+				       uint32_t levels,
+				       const uint8_t *const *data,
+				       uint32_t flags)
+{
+	struct gs_texture *tex = bzalloc(sizeof(struct gs_texture));
+	tex->device = device;
+	tex->type = GS_TEXTURE_3D;
+	tex->format = color_format;
+	tex->width = width;
+	tex->height = height;
+	tex->depth = depth;
+	tex->levels = levels;
+	tex->is_dynamic = (flags & GS_DYNAMIC) != 0;
+
+	UNUSED_PARAMETER(data);
+	return tex;
+}
+
+enum gs_texture_type device_get_texture_type(const gs_texture_t *texture)
+{
+	return texture->type;
+}
+
+static void release_texture(gs_texture_t *tex)
+{
+	gs_device_t *device;
+
+	if (!tex)
+		return;
+
+	device = tex->device;
+	if (device->cur_render_target == tex)
+		device->cur_render_target = NULL;
+	for (size_t i = 0; i < GS_MAX_TEXTURES; i++) {
+		if (device->cur_textures[i] == tex)
+			device->cur_textures[i] = NULL;
+	}
+
+	bfree(tex->data);
+	bfree(tex);
+}
+
+void gs_texture_destroy(gs_texture_t *tex)
+{
+	release_texture(tex);
+}
+
+uint32_t gs_texture_get_width(const gs_texture_t *tex)
+{
+	return tex->width;
+}
+
+uint32_t gs_texture_get_height(const gs_texture_t *tex)
+{
+	return tex->height;
+}
+
+enum gs_color_format gs_texture_get_color_format(const gs_texture_t *tex)
+{
+	return tex->format;
+}
+
+bool gs_texture_map(gs_texture_t *tex, uint8_t **ptr, uint32_t *linesize)
+{
+	if (tex->type != GS_TEXTURE_2D || !tex->is_dynamic) {
+		blog(LOG_ERROR, "gs_texture_map (null) failed: Texture is not "
+				"a dynamic 2D texture");
+		return false;
+	}
+
+	*ptr = tex->data;
+	*linesize = tex->linesize;
+	return true;
+}
+
+void gs_texture_unmap(gs_texture_t *tex)
+{
+	UNUSED_PARAMETER(tex);
+}
+
+bool gs_texture_is_rect(const gs_texture_t *tex)
+{
+	UNUSED_PARAMETER(tex);
+	return false;
+}
+
+void *gs_texture_get_obj(gs_texture_t *tex)
+{
+	return tex->data;
+}
+
+void gs_cubetexture_destroy(gs_texture_t *cubetex)
+{
+	release_texture(cubetex);
+}
+
+uint32_t gs_cubetexture_get_size(const gs_texture_t *cubetex)
+{
+	return cubetex->width;
+}
+
+enum gs_color_format
+gs_cubetexture_get_color_format(const gs_texture_t *cubetex)
+{
+	return cubetex->format;
+}
+
+void gs_voltexture_destroy(gs_texture_t *voltex)
+{
+	release_texture(voltex);
+}
+
+uint32_t gs_voltexture_get_width(const gs_texture_t *voltex)
+{
+	return voltex->width;
+}
+
+uint32_t gs_voltexture_get_height(const gs_texture_t *voltex)
+{
+	return voltex->height;
+}
+
+uint32_t gs_voltexture_get_depth(const gs_texture_t *voltex)
+{
+	return voltex->depth;
+}
+
+enum gs_color_format gs_voltexture_get_color_format(const gs_texture_t *voltex)
+{
+	return voltex->format;
+}
+
+gs_stagesurf_t *device_stagesurface_create(gs_device_t *device, uint32_t width,
+					   uint32_t height,
+					   enum gs_color_format color_format)
+{
+	struct gs_stage_surface *surf;
+
+	surf = bzalloc(sizeof(struct gs_stage_surface));
+	surf->device = device;
+	surf->format = color_format;
+	surf->width = width;
+	surf->height = height;
+	surf->linesize = null_get_linesize(color_format, width);
+	surf->data = bzalloc((size_t)surf->linesize * height);
+	return surf;
+}
+
+void gs_stagesurface_destroy(gs_stagesurf_t *stagesurf)
+{
+	if (stagesurf) {
+		bfree(stagesurf->data);
+		bfree(stagesurf);
+	}
+}
+
+uint32_t gs_stagesurface_get_width(const gs_stagesurf_t *stagesurf)
+{
+	return stagesurf->width;
+}
+
+uint32_t gs_stagesurface_get_height(const gs_stagesurf_t *stagesurf)
+{
+	return stagesurf->height;
+}
+
+enum gs_color_format
+gs_stagesurface_get_color_format(const gs_stagesurf_t *stagesurf)
+{
+	return stagesurf->format;
+}
+
+bool gs_stagesurface_map(gs_stagesurf_t *stagesurf, uint8_t **data,
+			 uint32_t *linesize)
+{
+	*data = stagesurf->data;
+	*linesize = stagesurf->linesize;
+	return true;
+}
+
+void gs_stagesurface_unmap(gs_stagesurf_t *stagesurf)
+{
+	UNUSED_PARAMETER(stagesurf);
+}
+
+gs_zstencil_t *device_zstencil_create(gs_device_t *device, uint32_t width,
+				      uint32_t height,
+				      enum gs_zstencil_format format)
+{
+	struct gs_zstencil_buffer *zs =
+		bzalloc(sizeof(struct gs_zstencil_buffer));
+	zs->device = device;
+	zs->format = format;
+	zs->width = width;
+	zs->height = height;
+	return zs;
+}
+
+void gs_zstencil_destroy(gs_zstencil_t *zstencil)
+{
+	if (!zstencil)
+		return;
+
+	if (zstencil->device->cur_zstencil_buffer == zstencil)
+		zstencil->device->cur_zstencil_buffer = NULL;
+
+	bfree(zstencil);
+}
+
+gs_samplerstate_t *
+device_samplerstate_create(gs_device_t *device,
+			   const struct gs_sampler_info *info)
+{
+	struct gs_sampler_state *ss = bzalloc(sizeof(struct gs_sampler_state));
+	ss->device = device;
+	ss->info = *info;
+	return ss;
+}
+
+void gs_samplerstate_destroy(gs_samplerstate_t *samplerstate)
+{
+	if (!samplerstate)
+		return;
+
+	for (size_t i = 0; i < GS_MAX_TEXTURES; i++) {
+		if (samplerstate->device->cur_samplers[i] == samplerstate)
+			samplerstate->device->cur_samplers[i] = NULL;
+	}
+
+	bfree(samplerstate);
+}
+
+void device_copy_texture_region(gs_device_t *device, gs_texture_t *dst,
+				uint32_t dst_x, uint32_t dst_y,
+				gs_texture_t *src, uint32_t src_x,
+				uint32_t src_y, uint32_t src_w, uint32_t src_h)
+{
+	uint32_t bytes_per_pixel;
+	uint32_t nw, nh;
+
+	UNUSED_PARAMETER(device);
+
+	if (!src || !dst || !src->data || !dst->data) {
+		blog(LOG_ERROR, "device_copy_texture_region (null): Source and "
+				"destination must be valid 2D textures");
+		return;
+	}
+
+	if (dst->format != src->format) {
+		blog(LOG_ERROR, "Source and destination formats do not match");
+		return;
+	}
+
+	nw = src_w ? src_w : (src->width - src_x);
+	nh = src_h ? src_h : (src->height - src_y);
+
+	if (dst->width - dst_x < nw || dst->height - dst_y < nh) {
+		blog(LOG_ERROR, "Destination texture region is not big "
+				"enough to hold the source region");
+		return;
+	}
+
+	bytes_per_pixel = gs_get_format_bpp(src->format) / 8;
+	copy_rows(dst->data + dst_y * dst->linesize + dst_x * bytes_per_pixel,
+		  dst->linesize,
+		  src->data + src_y * src->linesize + src_x * bytes_per_pixel,
+		  src->linesize, nw * bytes_per_pixel, nh);
+}
+
+void device_copy_texture(gs_device_t *device, gs_texture_t *dst,
+			 gs_texture_t *src)
+{
+	device_copy_texture_region(device, dst, 0, 0, src, 0, 0, 0, 0);
+}
+
+void device_stage_texture(gs_device_t *device, gs_stagesurf_t *dst,
+			  gs_texture_t *src)
+{
+	UNUSED_PARAMETER(device);
+
+	if (!src || !dst || !src->data) {
+		blog(LOG_ERROR, "device_stage_texture (null): Source must be "
+				"a valid 2D texture");
+		return;
+	}
+
+	if (src->format != dst->format || src->width != dst->width ||
+	    src->height != dst->height) {
+		blog(LOG_ERROR, "Source and destination formats and "
+				"dimensions must match");
+		return;
+	}
+
+	copy_rows(dst->data, dst->linesize, src->data, src->linesize,
+		  src->linesize, src->height);
+}
+
+static inline uint8_t color_byte(float val)
+{
+	if (val <= 0.0f)
+		return 0;
+	if (val >= 1.0f)
+		return 255;
+	return (uint8_t)(val * 255.0f + 0.5f);
+}
+
+/* fills 8-bit RGBA/BGRA render targets with the clear color, other formats
+ * are cleared to zero */
+void device_clear(gs_device_t *device, uint32_t clear_flags,
+		  const struct vec4 *color, float depth, uint8_t stencil)
+{
+	gs_texture_t *tex = device->cur_render_target;
+	uint8_t pixel[4];
+
+	UNUSED_PARAMETER(depth);
+	UNUSED_PARAMETER(stencil);
+
+	if ((clear_flags & GS_CLEAR_COLOR) == 0 || !tex || !tex->data)
+		return;
+
+	switch (tex->format) {
+	case GS_RGBA:
+		pixel[0] = color_byte(color->x);
+		pixel[1] = color_byte(color->y);
+		pixel[2] = color_byte(color->z);
+		pixel[3] = color_byte(color->w);
+		break;
+	case GS_BGRX:
+	case GS_BGRA:
+		pixel[0] = color_byte(color->z);
+		pixel[1] = color_byte(color->y);
+		pixel[2] = color_byte(color->x);
+		pixel[3] = color_byte(color->w);
+		break;
+	default:
+		memset(tex->data, 0, (size_t)tex->linesize * tex->height);
+		return;
+	}
+
+	for (uint32_t x = 0; x < tex->width; x++)
+		memcpy(tex->data + x * 4, pixel, 4);
+	for (uint32_t y = 1; y < tex->height; y++)
+		memcpy(tex->data + y * tex->linesize, tex->data,
+		       tex->width * 4);
+}
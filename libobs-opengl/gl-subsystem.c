@@ -157,6 +157,9 @@ static bool gl_init_extensions(struct gs_device *device)
 	else
 		device->copy_type = COPY_TYPE_FBO_BLIT;
 
+	device->persistent_mapping = GLAD_GL_VERSION_4_4 ||
+				     GLAD_GL_ARB_buffer_storage;
+
 	return true;
 }
 
@@ -562,13 +562,26 @@ struct gs_texture {
 	struct fbo_info *fbo;
 };
 
+/* dynamic 2D textures cycle through a ring of unpack buffers so that a new
+ * frame can be written while the GPU is still reading the previous ones */
+#define NUM_UNPACK_BUFFERS 3
+
+struct gs_unpack_buffer {
+	GLuint buffer;
+	GLsync fence;
+	uint8_t *persistent_ptr;
+};
+
 struct gs_texture_2d {
 	struct gs_texture base;
 
 	uint32_t width;
 	uint32_t height;
 	bool gen_mipmaps;
-	GLuint unpack_buffer;
+
+	struct gs_unpack_buffer unpack[NUM_UNPACK_BUFFERS];
+	GLsizeiptr unpack_size;
+	size_t cur_unpack;
 };
 
 struct gs_texture_3d {
@@ -638,6 +651,7 @@ static inline void fbo_info_destroy(struct fbo_info *fbo)
 struct gs_device {
 	struct gl_platform *plat;
 	enum copy_type copy_type;
+	bool persistent_mapping;
 
 	GLuint empty_vao;
 	gs_samplerstate_t *raw_load_sampler;
@@ -15,6 +15,8 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 ******************************************************************************/
 
+#include <util/profiler.h>
+
 #include "gl-subsystem.h"
 
 static bool upload_texture_2d(struct gs_texture_2d *tex, const uint8_t **data)
@@ -45,18 +47,10 @@ static bool upload_texture_2d(struct gs_texture_2d *tex, const uint8_t **data)
 	return success;
 }
 
-static bool create_pixel_unpack_buffer(struct gs_texture_2d *tex)
+static GLsizeiptr get_unpack_size(const struct gs_texture_2d *tex)
 {
-	GLsizeiptr size;
-	bool success = true;
-
-	if (!gl_gen_buffers(1, &tex->unpack_buffer))
-		return false;
+	GLsizeiptr size = tex->width * gs_get_format_bpp(tex->base.format);
 
-	if (!gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, tex->unpack_buffer))
-		return false;
-
-	size = tex->width * gs_get_format_bpp(tex->base.format);
 	if (!gs_is_compressed_format(tex->base.format)) {
 		size /= 8;
 		size = (size + 3) & 0xFFFFFFFC;
@@ -66,16 +60,73 @@ static bool create_pixel_unpack_buffer(struct gs_texture_2d *tex)
 		size /= 8;
 	}
 
-	glBufferData(GL_PIXEL_UNPACK_BUFFER, size, 0, GL_DYNAMIC_DRAW);
-	if (!gl_success("glBufferData"))
-		success = false;
+	return size;
+}
 
-	if (!gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0))
-		success = false;
+static bool init_unpack_buffer(struct gs_texture_2d *tex,
+			       struct gs_unpack_buffer *unpack)
+{
+	const GLbitfield persistent_flags =
+		GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	if (!tex->base.device->persistent_mapping) {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, tex->unpack_size, 0,
+			     GL_STREAM_DRAW);
+		return gl_success("glBufferData");
+	}
+
+	glBufferStorage(GL_PIXEL_UNPACK_BUFFER, tex->unpack_size, NULL,
+			persistent_flags);
+	if (!gl_success("glBufferStorage"))
+		return false;
+
+	unpack->persistent_ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+						  tex->unpack_size,
+						  persistent_flags);
+	return gl_success("glMapBufferRange") && unpack->persistent_ptr;
+}
+
+static bool create_pixel_unpack_buffers(struct gs_texture_2d *tex)
+{
+	bool success = true;
+
+	tex->unpack_size = get_unpack_size(tex);
+
+	for (size_t i = 0; i < NUM_UNPACK_BUFFERS; i++) {
+		struct gs_unpack_buffer *unpack = &tex->unpack[i];
+
+		if (!gl_gen_buffers(1, &unpack->buffer))
+			return false;
+
+		if (!gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, unpack->buffer))
+			return false;
+
+		if (!init_unpack_buffer(tex, unpack))
+			success = false;
+
+		if (!gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0))
+			success = false;
+		if (!success)
+			break;
+	}
 
 	return success;
 }
 
+static void destroy_pixel_unpack_buffers(struct gs_texture_2d *tex)
+{
+	for (size_t i = 0; i < NUM_UNPACK_BUFFERS; i++) {
+		struct gs_unpack_buffer *unpack = &tex->unpack[i];
+
+		if (unpack->fence)
+			glDeleteSync(unpack->fence);
+
+		/* deleting a buffer also releases a persistent mapping */
+		if (unpack->buffer)
+			gl_delete_buffers(1, &unpack->buffer);
+	}
+}
+
 gs_texture_t *device_texture_create(gs_device_t *device, uint32_t width,
 				    uint32_t height,
 				    enum gs_color_format color_format,
@@ -102,7 +153,7 @@ gs_texture_t *device_texture_create(gs_device_t *device, uint32_t width,
 		goto fail;
 
 	if (!tex->base.is_dummy) {
-		if (tex->base.is_dynamic && !create_pixel_unpack_buffer(tex))
+		if (tex->base.is_dynamic && !create_pixel_unpack_buffers(tex))
 			goto fail;
 		if (!upload_texture_2d(tex, data))
 			goto fail;
@@ -153,10 +204,8 @@ void gs_texture_destroy(gs_texture_t *tex)
 
 	if (!tex->is_dummy && tex->is_dynamic) {
 		if (tex->type == GS_TEXTURE_2D) {
-			struct gs_texture_2d *tex2d =
-				(struct gs_texture_2d *)tex;
-			if (tex2d->unpack_buffer)
-				gl_delete_buffers(1, &tex2d->unpack_buffer);
+			destroy_pixel_unpack_buffers(
+				(struct gs_texture_2d *)tex);
 		} else if (tex->type == GS_TEXTURE_3D) {
 			struct gs_texture_3d *tex3d =
 				(struct gs_texture_3d *)tex;
@@ -197,9 +246,44 @@ enum gs_color_format gs_texture_get_color_format(const gs_texture_t *tex)
 	return tex->format;
 }
 
+static const char *upload_stall_name = "gs_texture_map: upload stall";
+
+/* waits until the GPU has finished reading the buffer from its last upload.
+ * with enough buffers in the ring this normally never blocks, so only actual
+ * stalls are reported to the profiler */
+static bool wait_unpack_buffer(struct gs_unpack_buffer *unpack)
+{
+	GLenum status;
+
+	if (!unpack->fence)
+		return true;
+
+	status = glClientWaitSync(unpack->fence, 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED) {
+		profile_start(upload_stall_name);
+		status = glClientWaitSync(unpack->fence,
+					  GL_SYNC_FLUSH_COMMANDS_BIT,
+					  1000000000ULL);
+		profile_end(upload_stall_name);
+	}
+
+	glDeleteSync(unpack->fence);
+	unpack->fence = NULL;
+
+	if (status == GL_WAIT_FAILED) {
+		gl_success("glClientWaitSync");
+		return false;
+	}
+	if (status == GL_TIMEOUT_EXPIRED)
+		blog(LOG_WARNING, "gs_texture_map: timed out waiting for "
+				  "a previous upload to finish");
+	return true;
+}
+
 bool gs_texture_map(gs_texture_t *tex, uint8_t **ptr, uint32_t *linesize)
 {
 	struct gs_texture_2d *tex2d = (struct gs_texture_2d *)tex;
+	struct gs_unpack_buffer *unpack;
 
 	if (!is_texture_2d(tex, "gs_texture_map"))
 		goto fail;
@@ -209,20 +293,34 @@ bool gs_texture_map(gs_texture_t *tex, uint8_t **ptr, uint32_t *linesize)
 		goto fail;
 	}
 
-	if (!gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, tex2d->unpack_buffer))
+	unpack = &tex2d->unpack[tex2d->cur_unpack];
+	if (!wait_unpack_buffer(unpack))
 		goto fail;
 
-	*ptr = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
-	if (!gl_success("glMapBuffer"))
-		goto fail;
+	if (unpack->persistent_ptr) {
+		*ptr = unpack->persistent_ptr;
+	} else {
+		if (!gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, unpack->buffer))
+			goto fail;
 
-	gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		/* the fence guarantees the GPU is done with this buffer */
+		*ptr = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+					tex2d->unpack_size,
+					GL_MAP_WRITE_BIT |
+						GL_MAP_INVALIDATE_BUFFER_BIT |
+						GL_MAP_UNSYNCHRONIZED_BIT);
+		if (!gl_success("glMapBufferRange") || !*ptr)
+			goto fail;
+
+		gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
 
 	*linesize = tex2d->width * gs_get_format_bpp(tex->format) / 8;
 	*linesize = (*linesize + 3) & 0xFFFFFFFC;
 	return true;
 
 fail:
+	gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
 	blog(LOG_ERROR, "gs_texture_map (GL) failed");
 	return false;
 }
@@ -230,22 +328,33 @@ fail:
 void gs_texture_unmap(gs_texture_t *tex)
 {
 	struct gs_texture_2d *tex2d = (struct gs_texture_2d *)tex;
+	struct gs_unpack_buffer *unpack;
+
 	if (!is_texture_2d(tex, "gs_texture_unmap"))
 		goto failed;
 
-	if (!gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, tex2d->unpack_buffer))
-		goto failed;
+	unpack = &tex2d->unpack[tex2d->cur_unpack];
+	tex2d->cur_unpack = (tex2d->cur_unpack + 1) % NUM_UNPACK_BUFFERS;
 
-	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
-	if (!gl_success("glUnmapBuffer"))
+	if (!gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, unpack->buffer))
 		goto failed;
 
+	if (!unpack->persistent_ptr) {
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		if (!gl_success("glUnmapBuffer"))
+			goto failed;
+	}
+
 	if (!gl_bind_texture(GL_TEXTURE_2D, tex2d->base.texture))
 		goto failed;
 
-	glTexImage2D(GL_TEXTURE_2D, 0, tex->gl_internal_format, tex2d->width,
-		     tex2d->height, 0, tex->gl_format, tex->gl_type, 0);
-	if (!gl_success("glTexImage2D"))
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tex2d->width, tex2d->height,
+			tex->gl_format, tex->gl_type, 0);
+	if (!gl_success("glTexSubImage2D"))
+		goto failed;
+
+	unpack->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	if (!gl_success("glFenceSync"))
 		goto failed;
 
 	gl_bind_buffer(GL_PIXEL_UNPACK_BUFFER, 0);
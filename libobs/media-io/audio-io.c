@@ -27,6 +27,7 @@
 
 #include "audio-io.h"
 #include "audio-resampler.h"
+#include "audio-simd.h"
 
 #ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
@@ -76,6 +77,13 @@ struct audio_output {
 	void *input_param;
 	pthread_mutex_t input_mutex;
 	struct audio_mix mixes[MAX_AUDIO_MIXES];
+
+	/* mixes that must be rendered even without any connected input,
+	 * for example tracks that are being monitored */
+	uint32_t pinned_mixes;
+
+	pthread_mutex_t stats_mutex;
+	struct audio_output_stats stats;
 };
 
 /* ------------------------------------------------------------------------- */
@@ -128,7 +136,8 @@ static inline void do_audio_output(struct audio_output *audio, size_t mix_idx,
 	pthread_mutex_unlock(&audio->input_mutex);
 }
 
-static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
+static inline void clamp_audio_output(struct audio_output *audio, size_t bytes,
+				      uint32_t active_mixes)
 {
 	size_t float_size = bytes / sizeof(float);
 
@@ -136,27 +145,39 @@ static inline void clamp_audio_output(struct audio_output *audio, size_t bytes)
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
 		/* do not process mixing if a specific mix is inactive */
-		if (!mix->inputs.num)
+		if ((active_mixes & (1 << mix_idx)) == 0 || !mix->inputs.num)
 			continue;
 
-		for (size_t plane = 0; plane < audio->planes; plane++) {
-			float *mix_data = mix->buffer[plane];
-			float *mix_end = &mix_data[float_size];
+		for (size_t plane = 0; plane < audio->planes; plane++)
+			audio_simd_clamp(mix->buffer[plane], float_size);
+	}
+}
 
-			while (mix_data < mix_end) {
-				float val = *mix_data;
-				val = (val > 1.0f) ? 1.0f : val;
-				val = (val < -1.0f) ? -1.0f : val;
-				*(mix_data++) = val;
-			}
-		}
+static inline uint32_t get_active_mixes(const struct audio_output *audio)
+{
+	uint32_t active_mixes = audio->pinned_mixes;
+
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		if (audio->mixes[i].inputs.num)
+			active_mixes |= (1 << i);
 	}
+
+	return active_mixes;
 }
 
+static const char *input_audio_data_name = "input_audio_data";
+static const char *output_audio_data_name = "output_audio_data";
+
+struct audio_tick_times {
+	uint64_t input_ns;
+	uint64_t output_ns;
+};
+
 static void input_and_output(struct audio_output *audio, uint64_t audio_time,
-			     uint64_t prev_time)
+			     uint64_t prev_time, struct audio_tick_times *times)
 {
-	size_t bytes = AUDIO_OUTPUT_FRAMES * audio->block_size;
+	uint32_t frames = audio->info.frames_per_tick;
+	size_t bytes = frames * audio->block_size;
 	struct audio_output_data data[MAX_AUDIO_MIXES];
 	uint32_t active_mixes = 0;
 	uint64_t new_ts = 0;
@@ -171,33 +192,96 @@ static void input_and_output(struct audio_output *audio, uint64_t audio_time,
 
 	/* get mixers */
 	pthread_mutex_lock(&audio->input_mutex);
-	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
-		active_mixes |= (1 << i);
-	}
+	active_mixes = get_active_mixes(audio);
 	pthread_mutex_unlock(&audio->input_mutex);
 
-	/* clear mix buffers */
+	/* clear mix buffers, only the planes of live mixes are touched */
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		struct audio_mix *mix = &audio->mixes[mix_idx];
 
-		memset(mix->buffer, 0, sizeof(mix->buffer));
+		if ((active_mixes & (1 << mix_idx)) == 0)
+			continue;
 
-		for (size_t i = 0; i < audio->planes; i++)
+		for (size_t i = 0; i < audio->planes; i++) {
+			memset(mix->buffer[i], 0, bytes);
 			data[mix_idx].data[i] = mix->buffer[i];
+		}
 	}
 
 	/* get new audio data */
+	uint64_t start = os_gettime_ns();
+	profile_start(input_audio_data_name);
 	success = audio->input_cb(audio->input_param, prev_time, audio_time,
 				  &new_ts, active_mixes, data);
+	profile_end(input_audio_data_name);
+	times->input_ns = os_gettime_ns() - start;
 	if (!success)
 		return;
 
 	/* clamps audio data to -1.0..1.0 */
-	clamp_audio_output(audio, bytes);
+	clamp_audio_output(audio, bytes, active_mixes);
 
 	/* output */
-	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++)
-		do_audio_output(audio, i, new_ts, AUDIO_OUTPUT_FRAMES);
+	start = os_gettime_ns();
+	profile_start(output_audio_data_name);
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		if ((active_mixes & (1 << i)) != 0)
+			do_audio_output(audio, i, new_ts, frames);
+	}
+	profile_end(output_audio_data_name);
+	times->output_ns = os_gettime_ns() - start;
+}
+
+static inline void add_stage_time(struct audio_stage_stats *stage,
+				  uint64_t ns)
+{
+	stage->total_ns += ns;
+	if (ns > stage->max_ns)
+		stage->max_ns = ns;
+}
+
+static void record_tick(struct audio_output *audio, uint64_t lateness,
+			const struct audio_tick_times *times, bool missed)
+{
+	struct audio_output_stats *stats = &audio->stats;
+	size_t bucket = 0;
+
+	while (bucket < AUDIO_LATENESS_BUCKETS - 1 &&
+	       lateness >= audio_lateness_bucket_limit(bucket))
+		bucket++;
+
+	pthread_mutex_lock(&audio->stats_mutex);
+	stats->ticks++;
+	stats->lateness[bucket]++;
+	if (lateness > stats->max_lateness_ns)
+		stats->max_lateness_ns = lateness;
+	if (missed)
+		stats->missed_deadlines++;
+	add_stage_time(&stats->input, times->input_ns);
+	add_stage_time(&stats->output, times->output_ns);
+	pthread_mutex_unlock(&audio->stats_mutex);
+}
+
+/* kept below the priorities of the audio servers (rtkit allows up to 20 by
+ * default) so that device I/O still comes first */
+#define AUDIO_THREAD_RT_PRIORITY 15
+
+/* realtime is whether the thread already has real-time scheduling, which
+ * is the case with MMCSS on Windows */
+static void set_realtime_priority(struct audio_output *audio, bool realtime)
+{
+	if (audio->info.realtime_priority) {
+		bool raised = os_set_thread_realtime(AUDIO_THREAD_RT_PRIORITY);
+
+		blog(raised ? LOG_INFO : LOG_WARNING,
+		     "audio-io: %s real-time scheduling for '%s'",
+		     raised ? "using" : "could not get", audio->info.name);
+		realtime = realtime || raised;
+	}
+
+	pthread_mutex_lock(&audio->stats_mutex);
+	audio->stats.realtime = realtime;
+	pthread_mutex_unlock(&audio->stats_mutex);
 }
 
 static void *audio_thread(void *param)
@@ -213,12 +297,16 @@ static void *audio_thread(void *param)
 	uint64_t start_time = os_gettime_ns();
 	uint64_t prev_time = start_time;
 	uint64_t audio_time = prev_time;
-	uint32_t audio_wait_time =
-		(uint32_t)(audio_frames_to_ns(rate, AUDIO_OUTPUT_FRAMES) /
-			   1000000);
+	uint32_t frames = audio->info.frames_per_tick;
 
 	os_set_thread_name("audio-io: audio thread");
 
+#ifdef _WIN32
+	set_realtime_priority(audio, handle != NULL);
+#else
+	set_realtime_priority(audio, false);
+#endif
+
 	const char *audio_thread_name =
 		profile_store_name(obs_get_profiler_name_store(),
 				   "audio_thread(%s)", audio->info.name);
@@ -226,18 +314,27 @@ static void *audio_thread(void *param)
 	while (os_event_try(audio->stop_event) == EAGAIN) {
 		uint64_t cur_time;
 
-		os_sleep_ms(audio_wait_time);
+		/* wait until the last mixed tick has elapsed, whole
+		 * milliseconds are too coarse for the smaller ticks */
+		os_sleepto_ns(audio_time);
 
 		profile_start(audio_thread_name);
 
 		cur_time = os_gettime_ns();
 		while (audio_time <= cur_time) {
-			samples += AUDIO_OUTPUT_FRAMES;
+			struct audio_tick_times times = {0};
+			uint64_t due = audio_time;
+			uint64_t tick_start = os_gettime_ns();
+
+			samples += frames;
 			audio_time =
 				start_time + audio_frames_to_ns(rate, samples);
 
-			input_and_output(audio, audio_time, prev_time);
+			input_and_output(audio, audio_time, prev_time, &times);
 			prev_time = audio_time;
+
+			record_tick(audio, tick_start - due, &times,
+				    os_gettime_ns() > audio_time);
 		}
 
 		profile_end(audio_thread_name);
@@ -361,12 +458,44 @@ void audio_output_disconnect(audio_t *audio, size_t mix_idx,
 	pthread_mutex_unlock(&audio->input_mutex);
 }
 
+void audio_output_set_pinned_mixes(audio_t *audio, uint32_t mixes)
+{
+	if (!audio)
+		return;
+
+	mixes &= (1 << MAX_AUDIO_MIXES) - 1;
+
+	pthread_mutex_lock(&audio->input_mutex);
+	audio->pinned_mixes = mixes;
+	pthread_mutex_unlock(&audio->input_mutex);
+}
+
+uint32_t audio_output_get_active_mixes(audio_t *audio)
+{
+	uint32_t active_mixes;
+
+	if (!audio)
+		return 0;
+
+	pthread_mutex_lock(&audio->input_mutex);
+	active_mixes = get_active_mixes(audio);
+	pthread_mutex_unlock(&audio->input_mutex);
+
+	return active_mixes;
+}
+
 static inline bool valid_audio_params(const struct audio_output_info *info)
 {
 	return info->format && info->name && info->samples_per_sec > 0 &&
 	       info->speakers > 0;
 }
 
+static inline bool valid_frames_per_tick(uint32_t frames)
+{
+	return frames >= AUDIO_OUTPUT_MIN_FRAMES &&
+	       frames <= AUDIO_OUTPUT_FRAMES && (frames & (frames - 1)) == 0;
+}
+
 int audio_output_open(audio_t **audio, struct audio_output_info *info)
 {
 	struct audio_output *out;
@@ -374,12 +503,17 @@ int audio_output_open(audio_t **audio, struct audio_output_info *info)
 
 	if (!valid_audio_params(info))
 		return AUDIO_OUTPUT_INVALIDPARAM;
+	if (info->frames_per_tick &&
+	    !valid_frames_per_tick(info->frames_per_tick))
+		return AUDIO_OUTPUT_INVALIDPARAM;
 
 	out = bzalloc(sizeof(struct audio_output));
 	if (!out)
 		goto fail0;
 
 	memcpy(&out->info, info, sizeof(struct audio_output_info));
+	if (!out->info.frames_per_tick)
+		out->info.frames_per_tick = AUDIO_OUTPUT_FRAMES;
 	out->channels = get_audio_channels(info->speakers);
 	out->planes = planar ? out->channels : 1;
 	out->input_cb = info->input_callback;
@@ -389,17 +523,21 @@ int audio_output_open(audio_t **audio, struct audio_output_info *info)
 
 	if (pthread_mutex_init_recursive(&out->input_mutex) != 0)
 		goto fail0;
-	if (os_event_init(&out->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
+	if (pthread_mutex_init(&out->stats_mutex, NULL) != 0)
 		goto fail1;
-	if (pthread_create(&out->thread, NULL, audio_thread, out) != 0)
+	if (os_event_init(&out->stop_event, OS_EVENT_TYPE_MANUAL) != 0)
 		goto fail2;
+	if (pthread_create(&out->thread, NULL, audio_thread, out) != 0)
+		goto fail3;
 
 	out->initialized = true;
 	*audio = out;
 	return AUDIO_OUTPUT_SUCCESS;
 
-fail2:
+fail3:
 	os_event_destroy(out->stop_event);
+fail2:
+	pthread_mutex_destroy(&out->stats_mutex);
 fail1:
 	pthread_mutex_destroy(&out->input_mutex);
 fail0:
@@ -407,6 +545,23 @@ fail0:
 	return AUDIO_OUTPUT_FAIL;
 }
 
+static void log_stats(const struct audio_output *audio)
+{
+	const struct audio_output_stats *stats = &audio->stats;
+
+	if (!stats->ticks)
+		return;
+
+	blog(LOG_INFO,
+	     "audio-io: '%s' ran %" PRIu64 " ticks, %" PRIu64
+	     " missed deadlines, max lateness %.3f ms, "
+	     "avg input %.3f ms, avg output %.3f ms",
+	     audio->info.name, stats->ticks, stats->missed_deadlines,
+	     (double)stats->max_lateness_ns / 1000000.0,
+	     (double)stats->input.total_ns / (double)stats->ticks / 1000000.0,
+	     (double)stats->output.total_ns / (double)stats->ticks / 1000000.0);
+}
+
 void audio_output_close(audio_t *audio)
 {
 	void *thread_ret;
@@ -417,7 +572,9 @@ void audio_output_close(audio_t *audio)
 	if (audio->initialized) {
 		os_event_signal(audio->stop_event);
 		pthread_join(audio->thread, &thread_ret);
+		log_stats(audio);
 		os_event_destroy(audio->stop_event);
+		pthread_mutex_destroy(&audio->stats_mutex);
 		pthread_mutex_destroy(&audio->input_mutex);
 	}
 
@@ -471,3 +628,20 @@ uint32_t audio_output_get_sample_rate(const audio_t *audio)
 {
 	return audio ? audio->info.samples_per_sec : 0;
 }
+
+uint32_t audio_output_get_frames_per_tick(const audio_t *audio)
+{
+	return audio ? audio->info.frames_per_tick : 0;
+}
+
+void audio_output_get_stats(audio_t *audio, struct audio_output_stats *stats)
+{
+	if (!audio) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	pthread_mutex_lock(&audio->stats_mutex);
+	*stats = audio->stats;
+	pthread_mutex_unlock(&audio->stats_mutex);
+}
@@ -28,6 +28,7 @@ extern "C" {
 #define MAX_AUDIO_MIXES 6
 #define MAX_AUDIO_CHANNELS 24
 #define AUDIO_OUTPUT_FRAMES 1024
+#define AUDIO_OUTPUT_MIN_FRAMES 128
 
 #define TOTAL_AUDIO_SIZE                                              \
 	(MAX_AUDIO_MIXES * MAX_AUDIO_CHANNELS * AUDIO_OUTPUT_FRAMES * \
@@ -126,6 +127,61 @@ struct audio_output_info {
 	audio_input_callback_t input_callback;
 	void *input_param;
 	struct audio_data audio_out;
+
+	/* frames mixed per tick, a power of two from AUDIO_OUTPUT_MIN_FRAMES
+	 * to AUDIO_OUTPUT_FRAMES, 0 for AUDIO_OUTPUT_FRAMES.  mix buffers are
+	 * always sized for AUDIO_OUTPUT_FRAMES */
+	uint32_t frames_per_tick;
+
+	/* try to give the mixing thread real-time scheduling.  on Windows
+	 * the thread always uses MMCSS, this raises it to time critical */
+	bool realtime_priority;
+};
+
+#define AUDIO_LATENESS_BUCKETS 8
+
+/* upper bound of a tick lateness bucket, the last one is unbounded */
+static inline uint64_t audio_lateness_bucket_limit(size_t bucket)
+{
+	switch (bucket) {
+	case 0:
+		return 100000ULL;
+	case 1:
+		return 250000ULL;
+	case 2:
+		return 500000ULL;
+	case 3:
+		return 1000000ULL;
+	case 4:
+		return 2000000ULL;
+	case 5:
+		return 5000000ULL;
+	case 6:
+		return 10000000ULL;
+	}
+
+	return UINT64_MAX;
+}
+
+struct audio_stage_stats {
+	uint64_t total_ns;
+	uint64_t max_ns;
+};
+
+struct audio_output_stats {
+	bool realtime;
+
+	uint64_t ticks;
+
+	/* ticks that finished after the next one was due */
+	uint64_t missed_deadlines;
+
+	/* how long after being due each tick started */
+	uint64_t lateness[AUDIO_LATENESS_BUCKETS];
+	uint64_t max_lateness_ns;
+
+	struct audio_stage_stats input;
+	struct audio_stage_stats output;
 };
 
 struct audio_convert_info {
@@ -276,10 +332,20 @@ EXPORT void audio_output_disconnect(audio_t *video, size_t mix_idx,
 
 EXPORT bool audio_output_active(const audio_t *audio);
 
+/**
+ * Keeps the given mixes (bitmask) rendered even when no output is connected
+ * to them.  Mixes with connected outputs are always active.
+ */
+EXPORT void audio_output_set_pinned_mixes(audio_t *audio, uint32_t mixes);
+EXPORT uint32_t audio_output_get_active_mixes(audio_t *audio);
+
 EXPORT size_t audio_output_get_block_size(const audio_t *audio);
 EXPORT size_t audio_output_get_planes(const audio_t *audio);
 EXPORT size_t audio_output_get_channels(const audio_t *audio);
 EXPORT uint32_t audio_output_get_sample_rate(const audio_t *audio);
+EXPORT uint32_t audio_output_get_frames_per_tick(const audio_t *audio);
+EXPORT void audio_output_get_stats(audio_t *audio,
+				   struct audio_output_stats *stats);
 EXPORT const struct audio_output_info *
 audio_output_get_info(const audio_t *audio);
 
@@ -0,0 +1,248 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <string.h>
+
+#include "../util/base.h"
+#include "../util/bmem.h"
+#include "../util/threading.h"
+#include "audio-ring.h"
+
+static inline unsigned long load_pos(volatile long *pos)
+{
+	return (unsigned long)os_atomic_load_long(pos);
+}
+
+static inline void store_pos(volatile long *pos, unsigned long val)
+{
+	os_atomic_store_long(pos, (long)val);
+}
+
+static struct audio_ring_buffer *buffer_create(size_t frames)
+{
+	struct audio_ring_buffer *buf = bzalloc(sizeof(*buf));
+	buf->frames = frames;
+	return buf;
+}
+
+static void buffer_destroy(struct audio_ring_buffer *buf)
+{
+	if (!buf)
+		return;
+
+	for (size_t ch = 0; ch < MAX_AUDIO_CHANNELS; ch++)
+		bfree(buf->planes[ch]);
+	bfree(buf);
+}
+
+/* the end of the planes is skipped if the data does not fit there, to keep
+ * the data of a message contiguous */
+static inline size_t get_skip(size_t size, unsigned long head, size_t frames)
+{
+	size_t pos = head % size;
+	return pos + frames > size ? size - pos : 0;
+}
+
+static inline bool data_fits(size_t size, unsigned long head,
+			     unsigned long used, size_t frames)
+{
+	return frames <= size / 2 &&
+	       used + get_skip(size, head, frames) + frames <= size;
+}
+
+static struct audio_ring_msg *next_msg(struct audio_ring *ring)
+{
+	unsigned long head = (unsigned long)ring->msg_head;
+
+	if (head - load_pos(&ring->msg_tail) >= AUDIO_RING_MESSAGES)
+		return NULL;
+
+	return &ring->msgs[head % AUDIO_RING_MESSAGES];
+}
+
+static inline void publish_msg(struct audio_ring *ring)
+{
+	store_pos(&ring->msg_head, (unsigned long)ring->msg_head + 1);
+}
+
+bool audio_ring_push_data(struct audio_ring *ring, const uint8_t *const *data,
+			  uint32_t channels, uint32_t frames,
+			  uint64_t timestamp, bool push_back)
+{
+	struct audio_ring_msg *msg = next_msg(ring);
+	struct audio_ring_buffer *buf = ring->buf;
+	unsigned long head = (unsigned long)ring->data_head;
+	unsigned long used = head - load_pos(&ring->data_tail);
+	size_t size = buf ? buf->frames : AUDIO_RING_FRAMES;
+	size_t pos;
+
+	if (channels > MAX_AUDIO_CHANNELS)
+		channels = MAX_AUDIO_CHANNELS;
+
+	/* rather than dropping a burst, switch to a larger buffer.  data still
+	 * queued in the old one counts as used until it has been consumed */
+	while (size < AUDIO_RING_MAX_FRAMES &&
+	       !data_fits(size, head, used, frames))
+		size *= 2;
+
+	if (!msg || !data_fits(size, head, used, frames)) {
+		os_atomic_inc_long(&ring->dropped);
+		return false;
+	}
+
+	if (!buf || buf->frames != size) {
+		if (buf)
+			blog(LOG_DEBUG, "audio ring: growing to %zu frames",
+			     size);
+		buf = ring->buf = buffer_create(size);
+	}
+
+	pos = (head + get_skip(size, head, frames)) % size;
+
+	for (size_t ch = 0; ch < channels; ch++) {
+		if (!buf->planes[ch])
+			buf->planes[ch] = bmalloc(size * sizeof(float));
+
+		memcpy(buf->planes[ch] + pos, data[ch], frames * sizeof(float));
+	}
+
+	head += get_skip(size, head, frames) + frames;
+
+	msg->type = AUDIO_RING_DATA;
+	msg->push_back = push_back;
+	msg->channels = channels;
+	msg->frames = frames;
+	msg->timestamp = timestamp;
+	msg->buf = buf;
+	msg->offset = pos;
+	msg->data_end = head;
+
+	ring->data_head = (long)head;
+	publish_msg(ring);
+	return true;
+}
+
+void audio_ring_push_reset(struct audio_ring *ring, uint64_t timestamp)
+{
+	unsigned long seq = (unsigned long)ring->reset_seq;
+
+	store_pos(&ring->reset_seq, seq + 1);
+	store_pos(&ring->reset_pos, (unsigned long)ring->msg_head);
+	store_pos(&ring->reset_ts_lo, (unsigned long)(timestamp & 0xFFFFFFFF));
+	store_pos(&ring->reset_ts_hi, (unsigned long)(timestamp >> 32));
+	store_pos(&ring->reset_seq, seq + 2);
+}
+
+/* returns true once the consumer has reached a reset it hasn't taken yet.
+ * while the producer replaces the reset, the consumer stops until the next
+ * drain rather than risk passing the position of the new one */
+static bool take_reset(struct audio_ring *ring, unsigned long tail,
+		       bool *retry)
+{
+	long seq = os_atomic_load_long(&ring->reset_seq);
+	unsigned long pos;
+	uint64_t ts;
+
+	if (seq == ring->reset_taken)
+		return false;
+	if (seq & 1) {
+		*retry = true;
+		return false;
+	}
+
+	pos = load_pos(&ring->reset_pos);
+	ts = (uint64_t)(uint32_t)load_pos(&ring->reset_ts_lo) |
+	     ((uint64_t)(uint32_t)load_pos(&ring->reset_ts_hi) << 32);
+
+	if (os_atomic_load_long(&ring->reset_seq) != seq) {
+		*retry = true;
+		return false;
+	}
+	/* a reset the consumer has already moved past (it was published
+	 * while the consumer was busy with the message at its position) is
+	 * just as due as one at the tail */
+	if ((long)(tail - pos) < 0)
+		return false;
+
+	memset(&ring->reset_msg, 0, sizeof(ring->reset_msg));
+	ring->reset_msg.type = AUDIO_RING_RESET;
+	ring->reset_msg.timestamp = ts;
+	ring->reset_taken = seq;
+	return true;
+}
+
+const struct audio_ring_msg *audio_ring_peek(struct audio_ring *ring)
+{
+	unsigned long tail = (unsigned long)ring->msg_tail;
+	bool retry = false;
+
+	/* the head is loaded before the reset: a reset that isn't seen yet
+	 * then belongs to a position past every message that is returned
+	 * before the next peek */
+	unsigned long head = load_pos(&ring->msg_head);
+
+	if (!ring->reset_peeked)
+		ring->reset_peeked = take_reset(ring, tail, &retry);
+	if (ring->reset_peeked)
+		return &ring->reset_msg;
+	if (retry || tail == head)
+		return NULL;
+
+	return &ring->msgs[tail % AUDIO_RING_MESSAGES];
+}
+
+void audio_ring_pop(struct audio_ring *ring)
+{
+	unsigned long tail = (unsigned long)ring->msg_tail;
+	const struct audio_ring_msg *msg =
+		&ring->msgs[tail % AUDIO_RING_MESSAGES];
+
+	if (ring->reset_peeked) {
+		ring->reset_peeked = false;
+		return;
+	}
+
+	/* every message of the previous buffer has been consumed */
+	if (msg->buf != ring->read_buf) {
+		buffer_destroy(ring->read_buf);
+		ring->read_buf = msg->buf;
+	}
+
+	store_pos(&ring->data_tail, msg->data_end);
+	store_pos(&ring->msg_tail, tail + 1);
+}
+
+void audio_ring_free(struct audio_ring *ring)
+{
+	unsigned long tail = (unsigned long)ring->msg_tail;
+	unsigned long head = (unsigned long)ring->msg_head;
+	struct audio_ring_buffer *last = ring->read_buf;
+
+	/* buffers that were replaced before the consumer got to them */
+	for (; tail != head; tail++) {
+		struct audio_ring_buffer *buf =
+			ring->msgs[tail % AUDIO_RING_MESSAGES].buf;
+		if (buf != last) {
+			buffer_destroy(last);
+			last = buf;
+		}
+	}
+
+	if (last != ring->buf)
+		buffer_destroy(last);
+	buffer_destroy(ring->buf);
+
+	memset(ring, 0, sizeof(*ring));
+}
@@ -0,0 +1,128 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+#include "audio-io.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Lock-free single producer, single consumer queue of planar float audio
+ * messages.  The producer (a source's capture thread) never waits for the
+ * consumer (the audio thread) and vice versa: when the queue is full, new
+ * audio is dropped and counted instead.
+ *
+ * Each message either carries audio data with the timestamp it belongs to,
+ * or tells the consumer to reset its buffered audio to a new timestamp.
+ * Data of a message is always contiguous in each plane.
+ *
+ * Resets never take a queue slot, so they can't be dropped: the latest one
+ * is kept aside together with the queue position it belongs to, which is
+ * enough because a reset discards everything queued before it anyway.
+ *
+ * The data buffer starts small and is doubled by the producer when a burst
+ * doesn't fit, up to about the limit of the source's own input buffer.
+ * Messages point to the buffer their data is in, and the consumer frees a
+ * replaced buffer once it has moved past its last message.
+ */
+
+#define AUDIO_RING_MESSAGES 256
+#define AUDIO_RING_FRAMES (16 * 1024)
+#define AUDIO_RING_MAX_FRAMES (1024 * 1024)
+
+enum audio_ring_msg_type {
+	AUDIO_RING_DATA,
+	AUDIO_RING_RESET,
+};
+
+struct audio_ring_buffer {
+	/* allocated by the producer on first use of each plane */
+	float *planes[MAX_AUDIO_CHANNELS];
+	size_t frames;
+};
+
+struct audio_ring_msg {
+	enum audio_ring_msg_type type;
+	bool push_back;
+	uint32_t channels;
+	uint32_t frames;
+	uint64_t timestamp;
+
+	/* buffer and frame offset of the data */
+	struct audio_ring_buffer *buf;
+	size_t offset;
+	/* data position to release once the message has been consumed */
+	unsigned long data_end;
+};
+
+struct audio_ring {
+	struct audio_ring_msg msgs[AUDIO_RING_MESSAGES];
+
+	/* free running positions, only ever compared as differences */
+	volatile long msg_head;
+	volatile long msg_tail;
+	volatile long data_head;
+	volatile long data_tail;
+
+	volatile long dropped;
+
+	/* buffer new data is written to, only used by the producer */
+	struct audio_ring_buffer *buf;
+	/* buffer of the last consumed message, only used by the consumer */
+	struct audio_ring_buffer *read_buf;
+
+	/* the pending reset: reset_seq is odd while the producer writes it,
+	 * and advances by two with every reset.  the timestamp is split so
+	 * that each half can be accessed atomically */
+	volatile long reset_seq;
+	volatile long reset_pos;
+	volatile long reset_ts_lo;
+	volatile long reset_ts_hi;
+
+	/* consumer side of the reset */
+	long reset_taken;
+	bool reset_peeked;
+	struct audio_ring_msg reset_msg;
+};
+
+/* producer side */
+EXPORT bool audio_ring_push_data(struct audio_ring *ring,
+				 const uint8_t *const *data, uint32_t channels,
+				 uint32_t frames, uint64_t timestamp,
+				 bool push_back);
+EXPORT void audio_ring_push_reset(struct audio_ring *ring, uint64_t timestamp);
+
+/* consumer side, a peeked message stays valid until it is popped */
+EXPORT const struct audio_ring_msg *audio_ring_peek(struct audio_ring *ring);
+EXPORT void audio_ring_pop(struct audio_ring *ring);
+
+static inline const float *audio_ring_plane(const struct audio_ring *ring,
+					    const struct audio_ring_msg *msg,
+					    size_t channel)
+{
+	UNUSED_PARAMETER(ring);
+	return msg->buf->planes[channel] + msg->offset;
+}
+
+/* neither side may be active anymore */
+EXPORT void audio_ring_free(struct audio_ring *ring);
+
+#ifdef __cplusplus
+}
+#endif
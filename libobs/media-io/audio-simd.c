@@ -0,0 +1,503 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <string.h>
+
+#include "../util/threading.h"
+#include "simd-dispatch.h"
+#include "../util/sse-intrin.h"
+#include "audio-simd.h"
+
+/* ------------------------------------------------------------------------- */
+/* scalar reference                                                          */
+
+static void mix_scalar(float *dst, const float *src, float gain, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] += src[i] * gain;
+}
+
+static void mix_buf_scalar(float *dst, const float *src, const float *gain,
+			   size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] += src[i] * gain[i];
+}
+
+static void gain_scalar(float *dst, float gain, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] *= gain;
+}
+
+static void gain_buf_scalar(float *dst, const float *gain, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] *= gain[i];
+}
+
+static void copy_scaled_scalar(float *dst, const float *src, float gain,
+			       size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		dst[i] = src[i] * gain;
+}
+
+static void clamp_scalar(float *dst, size_t count)
+{
+	for (size_t i = 0; i < count; i++) {
+		float val = dst[i];
+		val = (val > 1.0f) ? 1.0f : val;
+		val = (val < -1.0f) ? -1.0f : val;
+		dst[i] = val;
+	}
+}
+
+/* sums the inputs that contribute to an output in input order, starting
+ * with the first product, so that every level gives the same result */
+static void matrix_row_scalar(float *dst, const float *const *src,
+			      const float *row, size_t src_channels,
+			      size_t start, size_t count)
+{
+	for (size_t i = start; i < count; i++) {
+		float val = 0.0f;
+		bool first = true;
+
+		for (size_t c = 0; c < src_channels; c++) {
+			if (!src[c] || row[c] == 0.0f)
+				continue;
+
+			float prod = src[c][i] * row[c];
+			val = first ? prod : val + prod;
+			first = false;
+		}
+
+		dst[i] = val;
+	}
+}
+
+typedef void (*matrix_row_t)(float *dst, const float *const *src,
+			     const float *row, size_t src_channels,
+			     size_t start, size_t count);
+
+static inline void matrix_mix_rows(matrix_row_t row_func, float *const *dst,
+				   size_t dst_channels,
+				   const float *const *src,
+				   size_t src_channels, const float *matrix,
+				   size_t count)
+{
+	for (size_t out = 0; out < dst_channels; out++) {
+		if (dst[out])
+			row_func(dst[out], src, matrix + out * src_channels,
+				 src_channels, 0, count);
+	}
+}
+
+static void matrix_mix_scalar(float *const *dst, size_t dst_channels,
+			      const float *const *src, size_t src_channels,
+			      const float *matrix, size_t count)
+{
+	matrix_mix_rows(matrix_row_scalar, dst, dst_channels, src,
+			src_channels, matrix, count);
+}
+
+static const struct audio_simd_funcs funcs_scalar = {
+	.mix = mix_scalar,
+	.mix_buf = mix_buf_scalar,
+	.gain = gain_scalar,
+	.gain_buf = gain_buf_scalar,
+	.copy_scaled = copy_scaled_scalar,
+	.clamp = clamp_scalar,
+	.matrix_mix = matrix_mix_scalar,
+};
+
+/* ------------------------------------------------------------------------- */
+/* SSE2 (NEON through simde on ARM)                                          */
+
+static void mix_sse2(float *dst, const float *src, float gain, size_t count)
+{
+	__m128 g = _mm_set1_ps(gain);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 d = _mm_loadu_ps(dst + i);
+		__m128 s = _mm_loadu_ps(src + i);
+		_mm_storeu_ps(dst + i, _mm_add_ps(d, _mm_mul_ps(s, g)));
+	}
+
+	mix_scalar(dst + i, src + i, gain, count - i);
+}
+
+static void mix_buf_sse2(float *dst, const float *src, const float *gain,
+			 size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 d = _mm_loadu_ps(dst + i);
+		__m128 s = _mm_loadu_ps(src + i);
+		__m128 g = _mm_loadu_ps(gain + i);
+		_mm_storeu_ps(dst + i, _mm_add_ps(d, _mm_mul_ps(s, g)));
+	}
+
+	mix_buf_scalar(dst + i, src + i, gain + i, count - i);
+}
+
+static void gain_sse2(float *dst, float gain, size_t count)
+{
+	__m128 g = _mm_set1_ps(gain);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 d = _mm_loadu_ps(dst + i);
+		_mm_storeu_ps(dst + i, _mm_mul_ps(d, g));
+	}
+
+	gain_scalar(dst + i, gain, count - i);
+}
+
+static void gain_buf_sse2(float *dst, const float *gain, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 d = _mm_loadu_ps(dst + i);
+		__m128 g = _mm_loadu_ps(gain + i);
+		_mm_storeu_ps(dst + i, _mm_mul_ps(d, g));
+	}
+
+	gain_buf_scalar(dst + i, gain + i, count - i);
+}
+
+static void copy_scaled_sse2(float *dst, const float *src, float gain,
+			     size_t count)
+{
+	__m128 g = _mm_set1_ps(gain);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 s = _mm_loadu_ps(src + i);
+		_mm_storeu_ps(dst + i, _mm_mul_ps(s, g));
+	}
+
+	copy_scaled_scalar(dst + i, src + i, gain, count - i);
+}
+
+/* min/max return the second operand if either is NaN, so keeping the value
+ * as the second operand passes NaNs through just like the scalar version */
+static void clamp_sse2(float *dst, size_t count)
+{
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 neg_one = _mm_set1_ps(-1.0f);
+	size_t i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 d = _mm_loadu_ps(dst + i);
+		d = _mm_min_ps(one, d);
+		d = _mm_max_ps(neg_one, d);
+		_mm_storeu_ps(dst + i, d);
+	}
+
+	clamp_scalar(dst + i, count - i);
+}
+
+/* the output is accumulated in a register over all inputs, and stored once */
+static void matrix_row_sse2(float *dst, const float *const *src,
+			    const float *row, size_t src_channels,
+			    size_t start, size_t count)
+{
+	size_t i = start;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128 val = _mm_setzero_ps();
+		bool first = true;
+
+		for (size_t c = 0; c < src_channels; c++) {
+			if (!src[c] || row[c] == 0.0f)
+				continue;
+
+			__m128 prod = _mm_mul_ps(_mm_loadu_ps(src[c] + i),
+						 _mm_set1_ps(row[c]));
+			val = first ? prod : _mm_add_ps(val, prod);
+			first = false;
+		}
+
+		_mm_storeu_ps(dst + i, val);
+	}
+
+	matrix_row_scalar(dst, src, row, src_channels, i, count);
+}
+
+static void matrix_mix_sse2(float *const *dst, size_t dst_channels,
+			    const float *const *src, size_t src_channels,
+			    const float *matrix, size_t count)
+{
+	matrix_mix_rows(matrix_row_sse2, dst, dst_channels, src, src_channels,
+			matrix, count);
+}
+
+static const struct audio_simd_funcs funcs_sse2 = {
+	.mix = mix_sse2,
+	.mix_buf = mix_buf_sse2,
+	.gain = gain_sse2,
+	.gain_buf = gain_buf_sse2,
+	.copy_scaled = copy_scaled_sse2,
+	.clamp = clamp_sse2,
+	.matrix_mix = matrix_mix_sse2,
+};
+
+/* ------------------------------------------------------------------------- */
+/* AVX2                                                                      */
+
+#ifdef SIMD_X86
+AVX2_TARGET static void mix_avx2(float *dst, const float *src, float gain,
+				 size_t count)
+{
+	__m256 g = _mm256_set1_ps(gain);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 d = _mm256_loadu_ps(dst + i);
+		__m256 s = _mm256_loadu_ps(src + i);
+		__m256 val = _mm256_add_ps(d, _mm256_mul_ps(s, g));
+		_mm256_storeu_ps(dst + i, val);
+	}
+
+	mix_scalar(dst + i, src + i, gain, count - i);
+}
+
+AVX2_TARGET static void mix_buf_avx2(float *dst, const float *src,
+				     const float *gain, size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 d = _mm256_loadu_ps(dst + i);
+		__m256 s = _mm256_loadu_ps(src + i);
+		__m256 g = _mm256_loadu_ps(gain + i);
+		__m256 val = _mm256_add_ps(d, _mm256_mul_ps(s, g));
+		_mm256_storeu_ps(dst + i, val);
+	}
+
+	mix_buf_scalar(dst + i, src + i, gain + i, count - i);
+}
+
+AVX2_TARGET static void gain_avx2(float *dst, float gain, size_t count)
+{
+	__m256 g = _mm256_set1_ps(gain);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 d = _mm256_loadu_ps(dst + i);
+		_mm256_storeu_ps(dst + i, _mm256_mul_ps(d, g));
+	}
+
+	gain_scalar(dst + i, gain, count - i);
+}
+
+AVX2_TARGET static void gain_buf_avx2(float *dst, const float *gain,
+				      size_t count)
+{
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 d = _mm256_loadu_ps(dst + i);
+		__m256 g = _mm256_loadu_ps(gain + i);
+		_mm256_storeu_ps(dst + i, _mm256_mul_ps(d, g));
+	}
+
+	gain_buf_scalar(dst + i, gain + i, count - i);
+}
+
+AVX2_TARGET static void copy_scaled_avx2(float *dst, const float *src,
+					 float gain, size_t count)
+{
+	__m256 g = _mm256_set1_ps(gain);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 s = _mm256_loadu_ps(src + i);
+		_mm256_storeu_ps(dst + i, _mm256_mul_ps(s, g));
+	}
+
+	copy_scaled_scalar(dst + i, src + i, gain, count - i);
+}
+
+AVX2_TARGET static void clamp_avx2(float *dst, size_t count)
+{
+	__m256 one = _mm256_set1_ps(1.0f);
+	__m256 neg_one = _mm256_set1_ps(-1.0f);
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 d = _mm256_loadu_ps(dst + i);
+		d = _mm256_min_ps(one, d);
+		d = _mm256_max_ps(neg_one, d);
+		_mm256_storeu_ps(dst + i, d);
+	}
+
+	clamp_scalar(dst + i, count - i);
+}
+
+AVX2_TARGET static void matrix_row_avx2(float *dst, const float *const *src,
+					const float *row, size_t src_channels,
+					size_t start, size_t count)
+{
+	size_t i = start;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256 val = _mm256_setzero_ps();
+		bool first = true;
+
+		for (size_t c = 0; c < src_channels; c++) {
+			if (!src[c] || row[c] == 0.0f)
+				continue;
+
+			__m256 prod = _mm256_mul_ps(_mm256_loadu_ps(src[c] + i),
+						    _mm256_set1_ps(row[c]));
+			val = first ? prod : _mm256_add_ps(val, prod);
+			first = false;
+		}
+
+		_mm256_storeu_ps(dst + i, val);
+	}
+
+	matrix_row_scalar(dst, src, row, src_channels, i, count);
+}
+
+static void matrix_mix_avx2(float *const *dst, size_t dst_channels,
+			    const float *const *src, size_t src_channels,
+			    const float *matrix, size_t count)
+{
+	matrix_mix_rows(matrix_row_avx2, dst, dst_channels, src, src_channels,
+			matrix, count);
+}
+
+static const struct audio_simd_funcs funcs_avx2 = {
+	.mix = mix_avx2,
+	.mix_buf = mix_buf_avx2,
+	.gain = gain_avx2,
+	.gain_buf = gain_buf_avx2,
+	.copy_scaled = copy_scaled_avx2,
+	.clamp = clamp_avx2,
+	.matrix_mix = matrix_mix_avx2,
+};
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+static pthread_once_t select_once = PTHREAD_ONCE_INIT;
+static const struct audio_simd_funcs *cur_funcs = NULL;
+static enum audio_simd_level cur_level = AUDIO_SIMD_SCALAR;
+
+const struct audio_simd_funcs *audio_simd_get_funcs(enum audio_simd_level level)
+{
+	switch (level) {
+	case AUDIO_SIMD_SCALAR:
+		return &funcs_scalar;
+	case AUDIO_SIMD_SSE2:
+		return &funcs_sse2;
+	case AUDIO_SIMD_AVX2:
+#ifdef SIMD_X86
+		return simd_cpu_has_avx2() ? &funcs_avx2 : NULL;
+#else
+		return NULL;
+#endif
+	}
+
+	return NULL;
+}
+
+static void select_funcs(void)
+{
+	enum audio_simd_level level = AUDIO_SIMD_AVX2;
+	const struct audio_simd_funcs *funcs;
+
+	while (!(funcs = audio_simd_get_funcs(level)))
+		level--;
+
+	cur_level = level;
+	cur_funcs = funcs;
+}
+
+static inline const struct audio_simd_funcs *get_funcs(void)
+{
+	pthread_once(&select_once, select_funcs);
+	return cur_funcs;
+}
+
+enum audio_simd_level audio_simd_get_level(void)
+{
+	get_funcs();
+	return cur_level;
+}
+
+const char *audio_simd_level_name(enum audio_simd_level level)
+{
+	switch (level) {
+	case AUDIO_SIMD_SCALAR:
+		return "scalar";
+	case AUDIO_SIMD_SSE2:
+#ifdef SIMD_X86
+		return "SSE2";
+#else
+		return "SSE2 (simde)";
+#endif
+	case AUDIO_SIMD_AVX2:
+		return "AVX2";
+	}
+
+	return "unknown";
+}
+
+void audio_simd_mix(float *dst, const float *src, float gain, size_t count)
+{
+	get_funcs()->mix(dst, src, gain, count);
+}
+
+void audio_simd_mix_buf(float *dst, const float *src, const float *gain,
+			size_t count)
+{
+	get_funcs()->mix_buf(dst, src, gain, count);
+}
+
+void audio_simd_gain(float *dst, float gain, size_t count)
+{
+	get_funcs()->gain(dst, gain, count);
+}
+
+void audio_simd_gain_buf(float *dst, const float *gain, size_t count)
+{
+	get_funcs()->gain_buf(dst, gain, count);
+}
+
+void audio_simd_copy_scaled(float *dst, const float *src, float gain,
+			    size_t count)
+{
+	get_funcs()->copy_scaled(dst, src, gain, count);
+}
+
+void audio_simd_clamp(float *dst, size_t count)
+{
+	get_funcs()->clamp(dst, count);
+}
+
+void audio_simd_matrix_mix(float *const *dst, size_t dst_channels,
+			   const float *const *src, size_t src_channels,
+			   const float *matrix, size_t count)
+{
+	get_funcs()->matrix_mix(dst, dst_channels, src, src_channels, matrix,
+				count);
+}
@@ -0,0 +1,94 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "../util/c99defs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Vector kernels for the planar float audio loops of the mixer, scenes and
+ * audio filters.  The best implementation for the running CPU is selected at
+ * runtime:  AVX2 on x86 CPUs that support it, SSE2 otherwise (mapped to NEON
+ * through simde on ARM), and plain C as the reference implementation.
+ *
+ * All kernels produce the same results as the scalar loops they replace;
+ * none of them use fused multiply-add.
+ */
+
+enum audio_simd_level {
+	AUDIO_SIMD_SCALAR,
+	AUDIO_SIMD_SSE2,
+	AUDIO_SIMD_AVX2,
+};
+
+struct audio_simd_funcs {
+	/* dst[i] += src[i] * gain */
+	void (*mix)(float *dst, const float *src, float gain, size_t count);
+	/* dst[i] += src[i] * gain[i] */
+	void (*mix_buf)(float *dst, const float *src, const float *gain,
+			size_t count);
+	/* dst[i] *= gain */
+	void (*gain)(float *dst, float gain, size_t count);
+	/* dst[i] *= gain[i] */
+	void (*gain_buf)(float *dst, const float *gain, size_t count);
+	/* dst[i] = src[i] * gain */
+	void (*copy_scaled)(float *dst, const float *src, float gain,
+			    size_t count);
+	/* dst[i] = clamp(dst[i], -1.0, 1.0) */
+	void (*clamp)(float *dst, size_t count);
+	/* see audio_simd_matrix_mix() */
+	void (*matrix_mix)(float *const *dst, size_t dst_channels,
+			   const float *const *src, size_t src_channels,
+			   const float *matrix, size_t count);
+};
+
+/** Returns the kernels of a specific level, or NULL if the CPU lacks it */
+EXPORT const struct audio_simd_funcs *
+audio_simd_get_funcs(enum audio_simd_level level);
+
+/** Returns the level that the audio_simd_* functions below dispatch to */
+EXPORT enum audio_simd_level audio_simd_get_level(void);
+EXPORT const char *audio_simd_level_name(enum audio_simd_level level);
+
+EXPORT void audio_simd_mix(float *dst, const float *src, float gain,
+			   size_t count);
+EXPORT void audio_simd_mix_buf(float *dst, const float *src, const float *gain,
+			       size_t count);
+EXPORT void audio_simd_gain(float *dst, float gain, size_t count);
+EXPORT void audio_simd_gain_buf(float *dst, const float *gain, size_t count);
+EXPORT void audio_simd_copy_scaled(float *dst, const float *src, float gain,
+				   size_t count);
+EXPORT void audio_simd_clamp(float *dst, size_t count);
+
+/**
+ * Mixes planar input channels into planar output channels:
+ *
+ *   dst[o][i] = sum(src[c][i] * matrix[o * src_channels + c])
+ *
+ * Zero coefficients and NULL input planes are skipped, NULL output planes
+ * are left out, and output planes without any contribution are cleared.
+ * dst must not alias src.
+ */
+EXPORT void audio_simd_matrix_mix(float *const *dst, size_t dst_channels,
+				  const float *const *src, size_t src_channels,
+				  const float *matrix, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
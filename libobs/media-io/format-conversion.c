@@ -16,7 +16,12 @@
 ******************************************************************************/
 
 #include "format-conversion.h"
+#include "simd-dispatch.h"
 
+#include <math.h>
+#include <string.h>
+
+#include "../util/threading.h"
 #include "../util/sse-intrin.h"
 
 /* ...surprisingly, if I don't use a macro to force inlining, it causes the
@@ -316,3 +321,1102 @@ void decompress_422(const uint8_t *input, uint32_t in_linesize,
 		}
 	}
 }
+
+/* ------------------------------------------------------------------------- */
+/* scalar reference                                                          */
+
+/*
+ * The kernels below take the first column to convert, so that the vector
+ * implementations can hand the remainder of each row over to them.
+ */
+
+static FORCE_INLINE uint8_t clamp_u8(int32_t val)
+{
+	return val < 0 ? 0 : (val > 255 ? 255 : (uint8_t)val);
+}
+
+static FORCE_INLINE uint8_t rgbx_luma(const struct format_conversion_matrix *m,
+				      const uint8_t *px)
+{
+	int32_t val = m->y[0] * px[0] + m->y[1] * px[1] + m->y[2] * px[2] +
+		      m->y_offset;
+	return clamp_u8(val >> 14);
+}
+
+static void rgbx_to_nv12_cols(const uint8_t *const input[],
+			      const uint32_t in_linesize[], uint32_t start_x,
+			      uint32_t width, uint32_t start_y, uint32_t end_y,
+			      uint8_t *const output[],
+			      const uint32_t out_linesize[],
+			      const struct format_conversion_matrix *m)
+{
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		const uint8_t *row0 = input[0] + y * in_linesize[0];
+		const uint8_t *row1 = row0 + in_linesize[0];
+		uint8_t *lum0 = output[0] + y * out_linesize[0];
+		uint8_t *lum1 = lum0 + out_linesize[0];
+		uint8_t *uv = output[1] + (y / 2) * out_linesize[1];
+
+		for (uint32_t x = start_x; x < width; x += 2) {
+			const uint8_t *p00 = row0 + x * 4;
+			const uint8_t *p10 = row1 + x * 4;
+			int32_t sum[3];
+
+			lum0[x] = rgbx_luma(m, p00);
+			lum0[x + 1] = rgbx_luma(m, p00 + 4);
+			lum1[x] = rgbx_luma(m, p10);
+			lum1[x + 1] = rgbx_luma(m, p10 + 4);
+
+			for (int c = 0; c < 3; c++)
+				sum[c] = p00[c] + p00[c + 4] + p10[c] +
+					 p10[c + 4];
+
+			uv[x] = clamp_u8((m->u[0] * sum[0] + m->u[1] * sum[1] +
+					  m->u[2] * sum[2] + m->u_offset) >>
+					 16);
+			uv[x + 1] =
+				clamp_u8((m->v[0] * sum[0] + m->v[1] * sum[1] +
+					  m->v[2] * sum[2] + m->v_offset) >>
+					 16);
+		}
+	}
+}
+
+static void yuy2_to_nv12_cols(const uint8_t *const input[],
+			      const uint32_t in_linesize[], uint32_t start_x,
+			      uint32_t width, uint32_t start_y, uint32_t end_y,
+			      uint8_t *const output[],
+			      const uint32_t out_linesize[])
+{
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		const uint8_t *row0 = input[0] + y * in_linesize[0];
+		const uint8_t *row1 = row0 + in_linesize[0];
+		uint8_t *lum0 = output[0] + y * out_linesize[0];
+		uint8_t *lum1 = lum0 + out_linesize[0];
+		uint8_t *uv = output[1] + (y / 2) * out_linesize[1];
+
+		for (uint32_t x = start_x; x < width; x++) {
+			lum0[x] = row0[x * 2];
+			lum1[x] = row1[x * 2];
+			uv[x] = (uint8_t)((row0[x * 2 + 1] + row1[x * 2 + 1] +
+					   1) >>
+					  1);
+		}
+	}
+}
+
+static void nv12_to_yuy2_cols(const uint8_t *const input[],
+			      const uint32_t in_linesize[], uint32_t start_x,
+			      uint32_t width, uint32_t start_y, uint32_t end_y,
+			      uint8_t *const output[],
+			      const uint32_t out_linesize[])
+{
+	for (uint32_t y = start_y; y < end_y; y++) {
+		const uint8_t *lum = input[0] + y * in_linesize[0];
+		const uint8_t *uv = input[1] + (y / 2) * in_linesize[1];
+		uint8_t *out = output[0] + y * out_linesize[0];
+
+		for (uint32_t x = start_x; x < width; x++) {
+			out[x * 2] = lum[x];
+			out[x * 2 + 1] = uv[x];
+		}
+	}
+}
+
+static void i010_to_p010_cols(const uint8_t *const input[],
+			      const uint32_t in_linesize[], uint32_t start_x,
+			      uint32_t width, uint32_t start_y, uint32_t end_y,
+			      uint8_t *const output[],
+			      const uint32_t out_linesize[])
+{
+	for (uint32_t y = start_y; y < end_y; y++) {
+		const uint16_t *in = (const uint16_t *)(input[0] +
+							 y * in_linesize[0]);
+		uint16_t *out = (uint16_t *)(output[0] + y * out_linesize[0]);
+
+		for (uint32_t x = start_x; x < width; x++)
+			out[x] = (uint16_t)(in[x] << 6);
+	}
+
+	for (uint32_t y = start_y / 2; y < end_y / 2; y++) {
+		const uint16_t *u = (const uint16_t *)(input[1] +
+							y * in_linesize[1]);
+		const uint16_t *v = (const uint16_t *)(input[2] +
+							y * in_linesize[2]);
+		uint16_t *uv = (uint16_t *)(output[1] + y * out_linesize[1]);
+
+		for (uint32_t x = start_x / 2; x < width / 2; x++) {
+			uv[x * 2] = (uint16_t)(u[x] << 6);
+			uv[x * 2 + 1] = (uint16_t)(v[x] << 6);
+		}
+	}
+}
+
+static void p010_to_i010_cols(const uint8_t *const input[],
+			      const uint32_t in_linesize[], uint32_t start_x,
+			      uint32_t width, uint32_t start_y, uint32_t end_y,
+			      uint8_t *const output[],
+			      const uint32_t out_linesize[])
+{
+	for (uint32_t y = start_y; y < end_y; y++) {
+		const uint16_t *in = (const uint16_t *)(input[0] +
+							 y * in_linesize[0]);
+		uint16_t *out = (uint16_t *)(output[0] + y * out_linesize[0]);
+
+		for (uint32_t x = start_x; x < width; x++)
+			out[x] = in[x] >> 6;
+	}
+
+	for (uint32_t y = start_y / 2; y < end_y / 2; y++) {
+		const uint16_t *uv = (const uint16_t *)(input[1] +
+							 y * in_linesize[1]);
+		uint16_t *u = (uint16_t *)(output[1] + y * out_linesize[1]);
+		uint16_t *v = (uint16_t *)(output[2] + y * out_linesize[2]);
+
+		for (uint32_t x = start_x / 2; x < width / 2; x++) {
+			u[x] = uv[x * 2] >> 6;
+			v[x] = uv[x * 2 + 1] >> 6;
+		}
+	}
+}
+
+static void i422_to_nv12_cols(const uint8_t *const input[],
+			      const uint32_t in_linesize[], uint32_t start_x,
+			      uint32_t width, uint32_t start_y, uint32_t end_y,
+			      uint8_t *const output[],
+			      const uint32_t out_linesize[])
+{
+	for (uint32_t y = start_y; y < end_y; y++)
+		memcpy(output[0] + y * out_linesize[0] + start_x,
+		       input[0] + y * in_linesize[0] + start_x,
+		       width - start_x);
+
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		const uint8_t *u0 = input[1] + y * in_linesize[1];
+		const uint8_t *u1 = u0 + in_linesize[1];
+		const uint8_t *v0 = input[2] + y * in_linesize[2];
+		const uint8_t *v1 = v0 + in_linesize[2];
+		uint8_t *uv = output[1] + (y / 2) * out_linesize[1];
+
+		for (uint32_t x = start_x / 2; x < width / 2; x++) {
+			uv[x * 2] = (uint8_t)((u0[x] + u1[x] + 1) >> 1);
+			uv[x * 2 + 1] = (uint8_t)((v0[x] + v1[x] + 1) >> 1);
+		}
+	}
+}
+
+static void rgbx_to_nv12_scalar(const uint8_t *const input[],
+				const uint32_t in_linesize[], uint32_t width,
+				uint32_t start_y, uint32_t end_y,
+				uint8_t *const output[],
+				const uint32_t out_linesize[],
+				const struct format_conversion_matrix *m)
+{
+	rgbx_to_nv12_cols(input, in_linesize, 0, width, start_y, end_y, output,
+			  out_linesize, m);
+}
+
+#define SCALAR_KERNEL(name)                                                    \
+	static void name##_scalar(const uint8_t *const input[],                \
+				  const uint32_t in_linesize[],                \
+				  uint32_t width, uint32_t start_y,            \
+				  uint32_t end_y, uint8_t *const output[],     \
+				  const uint32_t out_linesize[],               \
+				  const struct format_conversion_matrix *m)    \
+	{                                                                      \
+		UNUSED_PARAMETER(m);                                           \
+		name##_cols(input, in_linesize, 0, width, start_y, end_y,      \
+			    output, out_linesize);                             \
+	}
+
+SCALAR_KERNEL(yuy2_to_nv12)
+SCALAR_KERNEL(nv12_to_yuy2)
+SCALAR_KERNEL(i010_to_p010)
+SCALAR_KERNEL(p010_to_i010)
+SCALAR_KERNEL(i422_to_nv12)
+
+static const struct format_conversion_funcs funcs_scalar = {
+	.rgbx_to_nv12 = rgbx_to_nv12_scalar,
+	.yuy2_to_nv12 = yuy2_to_nv12_scalar,
+	.nv12_to_yuy2 = nv12_to_yuy2_scalar,
+	.i010_to_p010 = i010_to_p010_scalar,
+	.p010_to_i010 = p010_to_i010_scalar,
+	.i422_to_nv12 = i422_to_nv12_scalar,
+};
+
+/* ------------------------------------------------------------------------- */
+/* SSE2                                                                      */
+
+/* sums the adjacent 32bit products of two madd results:
+ * [a0+a1 a2+a3 b0+b1 b2+b3] */
+static FORCE_INLINE __m128i hadd_pairs_sse2(__m128i a, __m128i b)
+{
+	__m128 fa = _mm_castsi128_ps(a);
+	__m128 fb = _mm_castsi128_ps(b);
+	__m128i even = _mm_castps_si128(
+		_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0)));
+	__m128i odd = _mm_castps_si128(
+		_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1)));
+	return _mm_add_epi32(even, odd);
+}
+
+/* p01/p23 hold two 16bit pixels each */
+static FORCE_INLINE uint32_t rgbx_luma4_sse2(__m128i p01, __m128i p23,
+					     __m128i coef, __m128i offset)
+{
+	__m128i sum = hadd_pairs_sse2(_mm_madd_epi16(p01, coef),
+				      _mm_madd_epi16(p23, coef));
+	sum = _mm_srai_epi32(_mm_add_epi32(sum, offset), 14);
+	sum = _mm_packs_epi32(sum, sum);
+	sum = _mm_packus_epi16(sum, sum);
+	return (uint32_t)_mm_cvtsi128_si32(sum);
+}
+
+/* blocks holds the 16bit channel sums of two 2x2 blocks, returns U0V0U1V1 */
+static FORCE_INLINE uint32_t rgbx_chroma2_sse2(__m128i blocks, __m128i u_coef,
+					       __m128i v_coef, __m128i offset)
+{
+	__m128i sum = hadd_pairs_sse2(_mm_madd_epi16(blocks, u_coef),
+				      _mm_madd_epi16(blocks, v_coef));
+	sum = _mm_shuffle_epi32(sum, _MM_SHUFFLE(3, 1, 2, 0));
+	sum = _mm_srai_epi32(_mm_add_epi32(sum, offset), 16);
+	sum = _mm_packs_epi32(sum, sum);
+	sum = _mm_packus_epi16(sum, sum);
+	return (uint32_t)_mm_cvtsi128_si32(sum);
+}
+
+static void rgbx_to_nv12_sse2(const uint8_t *const input[],
+			      const uint32_t in_linesize[], uint32_t width,
+			      uint32_t start_y, uint32_t end_y,
+			      uint8_t *const output[],
+			      const uint32_t out_linesize[],
+			      const struct format_conversion_matrix *m)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i y_coef = _mm_setr_epi16(m->y[0], m->y[1], m->y[2], 0,
+					      m->y[0], m->y[1], m->y[2], 0);
+	const __m128i u_coef = _mm_setr_epi16(m->u[0], m->u[1], m->u[2], 0,
+					      m->u[0], m->u[1], m->u[2], 0);
+	const __m128i v_coef = _mm_setr_epi16(m->v[0], m->v[1], m->v[2], 0,
+					      m->v[0], m->v[1], m->v[2], 0);
+	const __m128i y_offset = _mm_set1_epi32(m->y_offset);
+	const __m128i uv_offset = _mm_setr_epi32(m->u_offset, m->v_offset,
+						 m->u_offset, m->v_offset);
+	uint32_t simd_width = width & ~3;
+
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		const uint8_t *row0 = input[0] + y * in_linesize[0];
+		const uint8_t *row1 = row0 + in_linesize[0];
+		uint8_t *lum0 = output[0] + y * out_linesize[0];
+		uint8_t *lum1 = lum0 + out_linesize[0];
+		uint8_t *uv = output[1] + (y / 2) * out_linesize[1];
+
+		for (uint32_t x = 0; x < simd_width; x += 4) {
+			__m128i a = _mm_loadu_si128(
+				(const __m128i *)(row0 + x * 4));
+			__m128i b = _mm_loadu_si128(
+				(const __m128i *)(row1 + x * 4));
+			__m128i a01 = _mm_unpacklo_epi8(a, zero);
+			__m128i a23 = _mm_unpackhi_epi8(a, zero);
+			__m128i b01 = _mm_unpacklo_epi8(b, zero);
+			__m128i b23 = _mm_unpackhi_epi8(b, zero);
+			__m128i s01 = _mm_add_epi16(a01, b01);
+			__m128i s23 = _mm_add_epi16(a23, b23);
+
+			*(uint32_t *)(lum0 + x) =
+				rgbx_luma4_sse2(a01, a23, y_coef, y_offset);
+			*(uint32_t *)(lum1 + x) =
+				rgbx_luma4_sse2(b01, b23, y_coef, y_offset);
+
+			s01 = _mm_add_epi16(s01, _mm_srli_si128(s01, 8));
+			s23 = _mm_add_epi16(s23, _mm_srli_si128(s23, 8));
+			*(uint32_t *)(uv + x) = rgbx_chroma2_sse2(
+				_mm_unpacklo_epi64(s01, s23), u_coef, v_coef,
+				uv_offset);
+		}
+	}
+
+	if (simd_width < width)
+		rgbx_to_nv12_cols(input, in_linesize, simd_width, width,
+				  start_y, end_y, output, out_linesize, m);
+}
+
+static void yuy2_to_nv12_sse2(const uint8_t *const input[],
+			      const uint32_t in_linesize[], uint32_t width,
+			      uint32_t start_y, uint32_t end_y,
+			      uint8_t *const output[],
+			      const uint32_t out_linesize[],
+			      const struct format_conversion_matrix *m)
+{
+	const __m128i lum_mask = _mm_set1_epi16(0x00FF);
+	uint32_t simd_width = width & ~15;
+
+	UNUSED_PARAMETER(m);
+
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		const uint8_t *row0 = input[0] + y * in_linesize[0];
+		const uint8_t *row1 = row0 + in_linesize[0];
+		uint8_t *lum0 = output[0] + y * out_linesize[0];
+		uint8_t *lum1 = lum0 + out_linesize[0];
+		uint8_t *uv = output[1] + (y / 2) * out_linesize[1];
+
+		for (uint32_t x = 0; x < simd_width; x += 16) {
+			const __m128i *in0 = (const __m128i *)(row0 + x * 2);
+			const __m128i *in1 = (const __m128i *)(row1 + x * 2);
+			__m128i a0 = _mm_loadu_si128(in0);
+			__m128i a1 = _mm_loadu_si128(in0 + 1);
+			__m128i b0 = _mm_loadu_si128(in1);
+			__m128i b1 = _mm_loadu_si128(in1 + 1);
+			__m128i c0 = _mm_avg_epu8(a0, b0);
+			__m128i c1 = _mm_avg_epu8(a1, b1);
+
+			_mm_storeu_si128((__m128i *)(lum0 + x),
+					 _mm_packus_epi16(
+						 _mm_and_si128(a0, lum_mask),
+						 _mm_and_si128(a1, lum_mask)));
+			_mm_storeu_si128((__m128i *)(lum1 + x),
+					 _mm_packus_epi16(
+						 _mm_and_si128(b0, lum_mask),
+						 _mm_and_si128(b1, lum_mask)));
+			_mm_storeu_si128(
+				(__m128i *)(uv + x),
+				_mm_packus_epi16(_mm_srli_epi16(c0, 8),
+						 _mm_srli_epi16(c1, 8)));
+		}
+	}
+
+	if (simd_width < width)
+		yuy2_to_nv12_cols(input, in_linesize, simd_width, width,
+				  start_y, end_y, output, out_linesize);
+}
+
+static void nv12_to_yuy2_sse2(const uint8_t *const input[],
+			      const uint32_t in_linesize[], uint32_t width,
+			      uint32_t start_y, uint32_t end_y,
+			      uint8_t *const output[],
+			      const uint32_t out_linesize[],
+			      const struct format_conversion_matrix *m)
+{
+	uint32_t simd_width = width & ~15;
+
+	UNUSED_PARAMETER(m);
+
+	for (uint32_t y = start_y; y < end_y; y++) {
+		const uint8_t *lum = input[0] + y * in_linesize[0];
+		const uint8_t *uv = input[1] + (y / 2) * in_linesize[1];
+		uint8_t *out = output[0] + y * out_linesize[0];
+
+		for (uint32_t x = 0; x < simd_width; x += 16) {
+			__m128i l = _mm_loadu_si128((const __m128i *)(lum + x));
+			__m128i c = _mm_loadu_si128((const __m128i *)(uv + x));
+			__m128i *dst = (__m128i *)(out + x * 2);
+
+			_mm_storeu_si128(dst, _mm_unpacklo_epi8(l, c));
+			_mm_storeu_si128(dst + 1, _mm_unpackhi_epi8(l, c));
+		}
+	}
+
+	if (simd_width < width)
+		nv12_to_yuy2_cols(input, in_linesize, simd_width, width,
+				  start_y, end_y, output, out_linesize);
+}
+
+static void i010_to_p010_sse2(const uint8_t *const input[],
+			      const uint32_t in_linesize[], uint32_t width,
+			      uint32_t start_y, uint32_t end_y,
+			      uint8_t *const output[],
+			      const uint32_t out_linesize[],
+			      const struct format_conversion_matrix *m)
+{
+	uint32_t simd_width = width & ~15;
+
+	UNUSED_PARAMETER(m);
+
+	for (uint32_t y = start_y; y < end_y; y++) {
+		const uint16_t *in = (const uint16_t *)(input[0] +
+							 y * in_linesize[0]);
+		uint16_t *out = (uint16_t *)(output[0] + y * out_linesize[0]);
+
+		for (uint32_t x = 0; x < simd_width; x += 8) {
+			__m128i val =
+				_mm_loadu_si128((const __m128i *)(in + x));
+			_mm_storeu_si128((__m128i *)(out + x),
+					 _mm_slli_epi16(val, 6));
+		}
+	}
+
+	for (uint32_t y = start_y / 2; y < end_y / 2; y++) {
+		const uint16_t *u = (const uint16_t *)(input[1] +
+							y * in_linesize[1]);
+		const uint16_t *v = (const uint16_t *)(input[2] +
+							y * in_linesize[2]);
+		uint16_t *uv = (uint16_t *)(output[1] + y * out_linesize[1]);
+
+		for (uint32_t x = 0; x < simd_width / 2; x += 8) {
+			__m128i uval = _mm_slli_epi16(
+				_mm_loadu_si128((const __m128i *)(u + x)), 6);
+			__m128i vval = _mm_slli_epi16(
+				_mm_loadu_si128((const __m128i *)(v + x)), 6);
+			__m128i *dst = (__m128i *)(uv + x * 2);
+
+			_mm_storeu_si128(dst, _mm_unpacklo_epi16(uval, vval));
+			_mm_storeu_si128(dst + 1,
+					 _mm_unpackhi_epi16(uval, vval));
+		}
+	}
+
+	if (simd_width < width)
+		i010_to_p010_cols(input, in_linesize, simd_width, width,
+				  start_y, end_y, output, out_linesize);
+}
+
+static void p010_to_i010_sse2(const uint8_t *const input[],
+			      const uint32_t in_linesize[], uint32_t width,
+			      uint32_t start_y, uint32_t end_y,
+			      uint8_t *const output[],
+			      const uint32_t out_linesize[],
+			      const struct format_conversion_matrix *m)
+{
+	const __m128i low_mask = _mm_set1_epi32(0x0000FFFF);
+	uint32_t simd_width = width & ~15;
+
+	UNUSED_PARAMETER(m);
+
+	for (uint32_t y = start_y; y < end_y; y++) {
+		const uint16_t *in = (const uint16_t *)(input[0] +
+							 y * in_linesize[0]);
+		uint16_t *out = (uint16_t *)(output[0] + y * out_linesize[0]);
+
+		for (uint32_t x = 0; x < simd_width; x += 8) {
+			__m128i val =
+				_mm_loadu_si128((const __m128i *)(in + x));
+			_mm_storeu_si128((__m128i *)(out + x),
+					 _mm_srli_epi16(val, 6));
+		}
+	}
+
+	for (uint32_t y = start_y / 2; y < end_y / 2; y++) {
+		const uint16_t *uv = (const uint16_t *)(input[1] +
+							 y * in_linesize[1]);
+		uint16_t *u = (uint16_t *)(output[1] + y * out_linesize[1]);
+		uint16_t *v = (uint16_t *)(output[2] + y * out_linesize[2]);
+
+		for (uint32_t x = 0; x < simd_width / 2; x += 8) {
+			const __m128i *src = (const __m128i *)(uv + x * 2);
+			__m128i a = _mm_srli_epi16(_mm_loadu_si128(src), 6);
+			__m128i b = _mm_srli_epi16(_mm_loadu_si128(src + 1), 6);
+
+			/* 10bit values, so the signed saturation is a no-op */
+			_mm_storeu_si128((__m128i *)(u + x),
+					 _mm_packs_epi32(
+						 _mm_and_si128(a, low_mask),
+						 _mm_and_si128(b, low_mask)));
+			_mm_storeu_si128(
+				(__m128i *)(v + x),
+				_mm_packs_epi32(_mm_srli_epi32(a, 16),
+						_mm_srli_epi32(b, 16)));
+		}
+	}
+
+	if (simd_width < width)
+		p010_to_i010_cols(input, in_linesize, simd_width, width,
+				  start_y, end_y, output, out_linesize);
+}
+
+static void i422_to_nv12_sse2(const uint8_t *const input[],
+			      const uint32_t in_linesize[], uint32_t width,
+			      uint32_t start_y, uint32_t end_y,
+			      uint8_t *const output[],
+			      const uint32_t out_linesize[],
+			      const struct format_conversion_matrix *m)
+{
+	uint32_t simd_width = width & ~31;
+
+	UNUSED_PARAMETER(m);
+
+	for (uint32_t y = start_y; y < end_y; y++)
+		memcpy(output[0] + y * out_linesize[0],
+		       input[0] + y * in_linesize[0], simd_width);
+
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		const uint8_t *u0 = input[1] + y * in_linesize[1];
+		const uint8_t *u1 = u0 + in_linesize[1];
+		const uint8_t *v0 = input[2] + y * in_linesize[2];
+		const uint8_t *v1 = v0 + in_linesize[2];
+		uint8_t *uv = output[1] + (y / 2) * out_linesize[1];
+
+		for (uint32_t x = 0; x < simd_width / 2; x += 16) {
+			__m128i u = _mm_avg_epu8(
+				_mm_loadu_si128((const __m128i *)(u0 + x)),
+				_mm_loadu_si128((const __m128i *)(u1 + x)));
+			__m128i v = _mm_avg_epu8(
+				_mm_loadu_si128((const __m128i *)(v0 + x)),
+				_mm_loadu_si128((const __m128i *)(v1 + x)));
+			__m128i *dst = (__m128i *)(uv + x * 2);
+
+			_mm_storeu_si128(dst, _mm_unpacklo_epi8(u, v));
+			_mm_storeu_si128(dst + 1, _mm_unpackhi_epi8(u, v));
+		}
+	}
+
+	if (simd_width < width)
+		i422_to_nv12_cols(input, in_linesize, simd_width, width,
+				  start_y, end_y, output, out_linesize);
+}
+
+static const struct format_conversion_funcs funcs_sse2 = {
+	.rgbx_to_nv12 = rgbx_to_nv12_sse2,
+	.yuy2_to_nv12 = yuy2_to_nv12_sse2,
+	.nv12_to_yuy2 = nv12_to_yuy2_sse2,
+	.i010_to_p010 = i010_to_p010_sse2,
+	.p010_to_i010 = p010_to_i010_sse2,
+	.i422_to_nv12 = i422_to_nv12_sse2,
+};
+
+/* ------------------------------------------------------------------------- */
+/* AVX2                                                                      */
+
+#ifdef SIMD_X86
+/* per 128bit lane:  [a0+a1 a2+a3 b0+b1 b2+b3] */
+AVX2_TARGET static inline __m256i hadd_pairs_avx2(__m256i a, __m256i b)
+{
+	__m256 fa = _mm256_castsi256_ps(a);
+	__m256 fb = _mm256_castsi256_ps(b);
+	__m256i even = _mm256_castps_si256(
+		_mm256_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0)));
+	__m256i odd = _mm256_castps_si256(
+		_mm256_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1)));
+	return _mm256_add_epi32(even, odd);
+}
+
+/* packs the low 32bit words of both lanes into 8 bytes */
+AVX2_TARGET static inline uint64_t pack_lanes_avx2(__m256i val)
+{
+	uint32_t lo = (uint32_t)_mm_cvtsi128_si32(_mm256_castsi256_si128(val));
+	uint32_t hi = (uint32_t)_mm_cvtsi128_si32(
+		_mm256_extracti128_si256(val, 1));
+	return (uint64_t)lo | ((uint64_t)hi << 32);
+}
+
+AVX2_TARGET static inline uint64_t rgbx_luma8_avx2(__m256i p01, __m256i p23,
+						   __m256i coef, __m256i offset)
+{
+	__m256i sum = hadd_pairs_avx2(_mm256_madd_epi16(p01, coef),
+				      _mm256_madd_epi16(p23, coef));
+	sum = _mm256_srai_epi32(_mm256_add_epi32(sum, offset), 14);
+	sum = _mm256_packs_epi32(sum, sum);
+	sum = _mm256_packus_epi16(sum, sum);
+	return pack_lanes_avx2(sum);
+}
+
+AVX2_TARGET static inline uint64_t rgbx_chroma4_avx2(__m256i blocks,
+						     __m256i u_coef,
+						     __m256i v_coef,
+						     __m256i offset)
+{
+	__m256i sum = hadd_pairs_avx2(_mm256_madd_epi16(blocks, u_coef),
+				      _mm256_madd_epi16(blocks, v_coef));
+	sum = _mm256_shuffle_epi32(sum, _MM_SHUFFLE(3, 1, 2, 0));
+	sum = _mm256_srai_epi32(_mm256_add_epi32(sum, offset), 16);
+	sum = _mm256_packs_epi32(sum, sum);
+	sum = _mm256_packus_epi16(sum, sum);
+	return pack_lanes_avx2(sum);
+}
+
+AVX2_TARGET static void
+rgbx_to_nv12_avx2(const uint8_t *const input[], const uint32_t in_linesize[],
+		  uint32_t width, uint32_t start_y, uint32_t end_y,
+		  uint8_t *const output[], const uint32_t out_linesize[],
+		  const struct format_conversion_matrix *m)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i y_coef = _mm256_setr_epi16(
+		m->y[0], m->y[1], m->y[2], 0, m->y[0], m->y[1], m->y[2], 0,
+		m->y[0], m->y[1], m->y[2], 0, m->y[0], m->y[1], m->y[2], 0);
+	const __m256i u_coef = _mm256_setr_epi16(
+		m->u[0], m->u[1], m->u[2], 0, m->u[0], m->u[1], m->u[2], 0,
+		m->u[0], m->u[1], m->u[2], 0, m->u[0], m->u[1], m->u[2], 0);
+	const __m256i v_coef = _mm256_setr_epi16(
+		m->v[0], m->v[1], m->v[2], 0, m->v[0], m->v[1], m->v[2], 0,
+		m->v[0], m->v[1], m->v[2], 0, m->v[0], m->v[1], m->v[2], 0);
+	const __m256i y_offset = _mm256_set1_epi32(m->y_offset);
+	const __m256i uv_offset = _mm256_setr_epi32(
+		m->u_offset, m->v_offset, m->u_offset, m->v_offset,
+		m->u_offset, m->v_offset, m->u_offset, m->v_offset);
+	uint32_t simd_width = width & ~7;
+
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		const uint8_t *row0 = input[0] + y * in_linesize[0];
+		const uint8_t *row1 = row0 + in_linesize[0];
+		uint8_t *lum0 = output[0] + y * out_linesize[0];
+		uint8_t *lum1 = lum0 + out_linesize[0];
+		uint8_t *uv = output[1] + (y / 2) * out_linesize[1];
+
+		for (uint32_t x = 0; x < simd_width; x += 8) {
+			/* pixels 0-3 in the low lane, 4-7 in the high lane */
+			__m256i a = _mm256_loadu_si256(
+				(const __m256i *)(row0 + x * 4));
+			__m256i b = _mm256_loadu_si256(
+				(const __m256i *)(row1 + x * 4));
+			__m256i a01 = _mm256_unpacklo_epi8(a, zero);
+			__m256i a23 = _mm256_unpackhi_epi8(a, zero);
+			__m256i b01 = _mm256_unpacklo_epi8(b, zero);
+			__m256i b23 = _mm256_unpackhi_epi8(b, zero);
+			__m256i s01 = _mm256_add_epi16(a01, b01);
+			__m256i s23 = _mm256_add_epi16(a23, b23);
+
+			*(uint64_t *)(lum0 + x) =
+				rgbx_luma8_avx2(a01, a23, y_coef, y_offset);
+			*(uint64_t *)(lum1 + x) =
+				rgbx_luma8_avx2(b01, b23, y_coef, y_offset);
+
+			s01 = _mm256_add_epi16(s01, _mm256_srli_si256(s01, 8));
+			s23 = _mm256_add_epi16(s23, _mm256_srli_si256(s23, 8));
+			*(uint64_t *)(uv + x) = rgbx_chroma4_avx2(
+				_mm256_unpacklo_epi64(s01, s23), u_coef, v_coef,
+				uv_offset);
+		}
+	}
+
+	if (simd_width < width)
+		rgbx_to_nv12_cols(input, in_linesize, simd_width, width,
+				  start_y, end_y, output, out_linesize, m);
+}
+
+AVX2_TARGET static void
+yuy2_to_nv12_avx2(const uint8_t *const input[], const uint32_t in_linesize[],
+		  uint32_t width, uint32_t start_y, uint32_t end_y,
+		  uint8_t *const output[], const uint32_t out_linesize[],
+		  const struct format_conversion_matrix *m)
+{
+	const __m256i lum_mask = _mm256_set1_epi16(0x00FF);
+	uint32_t simd_width = width & ~31;
+
+	UNUSED_PARAMETER(m);
+
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		const uint8_t *row0 = input[0] + y * in_linesize[0];
+		const uint8_t *row1 = row0 + in_linesize[0];
+		uint8_t *lum0 = output[0] + y * out_linesize[0];
+		uint8_t *lum1 = lum0 + out_linesize[0];
+		uint8_t *uv = output[1] + (y / 2) * out_linesize[1];
+
+		for (uint32_t x = 0; x < simd_width; x += 32) {
+			const __m256i *in0 = (const __m256i *)(row0 + x * 2);
+			const __m256i *in1 = (const __m256i *)(row1 + x * 2);
+			__m256i a0 = _mm256_loadu_si256(in0);
+			__m256i a1 = _mm256_loadu_si256(in0 + 1);
+			__m256i b0 = _mm256_loadu_si256(in1);
+			__m256i b1 = _mm256_loadu_si256(in1 + 1);
+			__m256i c0 = _mm256_avg_epu8(a0, b0);
+			__m256i c1 = _mm256_avg_epu8(a1, b1);
+			__m256i l0, l1, c;
+
+			/* packus works per lane, so the 64bit quarters come
+			 * out as a0.lo a1.lo a0.hi a1.hi */
+			l0 = _mm256_packus_epi16(
+				_mm256_and_si256(a0, lum_mask),
+				_mm256_and_si256(a1, lum_mask));
+			l1 = _mm256_packus_epi16(
+				_mm256_and_si256(b0, lum_mask),
+				_mm256_and_si256(b1, lum_mask));
+			c = _mm256_packus_epi16(_mm256_srli_epi16(c0, 8),
+						_mm256_srli_epi16(c1, 8));
+
+			_mm256_storeu_si256(
+				(__m256i *)(lum0 + x),
+				_mm256_permute4x64_epi64(
+					l0, _MM_SHUFFLE(3, 1, 2, 0)));
+			_mm256_storeu_si256(
+				(__m256i *)(lum1 + x),
+				_mm256_permute4x64_epi64(
+					l1, _MM_SHUFFLE(3, 1, 2, 0)));
+			_mm256_storeu_si256(
+				(__m256i *)(uv + x),
+				_mm256_permute4x64_epi64(
+					c, _MM_SHUFFLE(3, 1, 2, 0)));
+		}
+	}
+
+	if (simd_width < width)
+		yuy2_to_nv12_cols(input, in_linesize, simd_width, width,
+				  start_y, end_y, output, out_linesize);
+}
+
+AVX2_TARGET static void
+nv12_to_yuy2_avx2(const uint8_t *const input[], const uint32_t in_linesize[],
+		  uint32_t width, uint32_t start_y, uint32_t end_y,
+		  uint8_t *const output[], const uint32_t out_linesize[],
+		  const struct format_conversion_matrix *m)
+{
+	uint32_t simd_width = width & ~31;
+
+	UNUSED_PARAMETER(m);
+
+	for (uint32_t y = start_y; y < end_y; y++) {
+		const uint8_t *lum = input[0] + y * in_linesize[0];
+		const uint8_t *uv = input[1] + (y / 2) * in_linesize[1];
+		uint8_t *out = output[0] + y * out_linesize[0];
+
+		for (uint32_t x = 0; x < simd_width; x += 32) {
+			__m256i l = _mm256_loadu_si256(
+				(const __m256i *)(lum + x));
+			__m256i c = _mm256_loadu_si256(
+				(const __m256i *)(uv + x));
+			__m256i lo = _mm256_unpacklo_epi8(l, c);
+			__m256i hi = _mm256_unpackhi_epi8(l, c);
+			__m256i *dst = (__m256i *)(out + x * 2);
+
+			_mm256_storeu_si256(dst,
+					    _mm256_permute2x128_si256(lo, hi,
+								      0x20));
+			_mm256_storeu_si256(dst + 1,
+					    _mm256_permute2x128_si256(lo, hi,
+								      0x31));
+		}
+	}
+
+	if (simd_width < width)
+		nv12_to_yuy2_cols(input, in_linesize, simd_width, width,
+				  start_y, end_y, output, out_linesize);
+}
+
+AVX2_TARGET static void
+i010_to_p010_avx2(const uint8_t *const input[], const uint32_t in_linesize[],
+		  uint32_t width, uint32_t start_y, uint32_t end_y,
+		  uint8_t *const output[], const uint32_t out_linesize[],
+		  const struct format_conversion_matrix *m)
+{
+	uint32_t simd_width = width & ~31;
+
+	UNUSED_PARAMETER(m);
+
+	for (uint32_t y = start_y; y < end_y; y++) {
+		const uint16_t *in = (const uint16_t *)(input[0] +
+							 y * in_linesize[0]);
+		uint16_t *out = (uint16_t *)(output[0] + y * out_linesize[0]);
+
+		for (uint32_t x = 0; x < simd_width; x += 16) {
+			__m256i val =
+				_mm256_loadu_si256((const __m256i *)(in + x));
+			_mm256_storeu_si256((__m256i *)(out + x),
+					    _mm256_slli_epi16(val, 6));
+		}
+	}
+
+	for (uint32_t y = start_y / 2; y < end_y / 2; y++) {
+		const uint16_t *u = (const uint16_t *)(input[1] +
+							y * in_linesize[1]);
+		const uint16_t *v = (const uint16_t *)(input[2] +
+							y * in_linesize[2]);
+		uint16_t *uv = (uint16_t *)(output[1] + y * out_linesize[1]);
+
+		for (uint32_t x = 0; x < simd_width / 2; x += 16) {
+			__m256i uval = _mm256_slli_epi16(
+				_mm256_loadu_si256((const __m256i *)(u + x)),
+				6);
+			__m256i vval = _mm256_slli_epi16(
+				_mm256_loadu_si256((const __m256i *)(v + x)),
+				6);
+			__m256i lo = _mm256_unpacklo_epi16(uval, vval);
+			__m256i hi = _mm256_unpackhi_epi16(uval, vval);
+			__m256i *dst = (__m256i *)(uv + x * 2);
+
+			_mm256_storeu_si256(dst,
+					    _mm256_permute2x128_si256(lo, hi,
+								      0x20));
+			_mm256_storeu_si256(dst + 1,
+					    _mm256_permute2x128_si256(lo, hi,
+								      0x31));
+		}
+	}
+
+	if (simd_width < width)
+		i010_to_p010_cols(input, in_linesize, simd_width, width,
+				  start_y, end_y, output, out_linesize);
+}
+
+AVX2_TARGET static void
+p010_to_i010_avx2(const uint8_t *const input[], const uint32_t in_linesize[],
+		  uint32_t width, uint32_t start_y, uint32_t end_y,
+		  uint8_t *const output[], const uint32_t out_linesize[],
+		  const struct format_conversion_matrix *m)
+{
+	const __m256i low_mask = _mm256_set1_epi32(0x0000FFFF);
+	uint32_t simd_width = width & ~31;
+
+	UNUSED_PARAMETER(m);
+
+	for (uint32_t y = start_y; y < end_y; y++) {
+		const uint16_t *in = (const uint16_t *)(input[0] +
+							 y * in_linesize[0]);
+		uint16_t *out = (uint16_t *)(output[0] + y * out_linesize[0]);
+
+		for (uint32_t x = 0; x < simd_width; x += 16) {
+			__m256i val =
+				_mm256_loadu_si256((const __m256i *)(in + x));
+			_mm256_storeu_si256((__m256i *)(out + x),
+					    _mm256_srli_epi16(val, 6));
+		}
+	}
+
+	for (uint32_t y = start_y / 2; y < end_y / 2; y++) {
+		const uint16_t *uv = (const uint16_t *)(input[1] +
+							 y * in_linesize[1]);
+		uint16_t *u = (uint16_t *)(output[1] + y * out_linesize[1]);
+		uint16_t *v = (uint16_t *)(output[2] + y * out_linesize[2]);
+
+		for (uint32_t x = 0; x < simd_width / 2; x += 16) {
+			const __m256i *src = (const __m256i *)(uv + x * 2);
+			__m256i a =
+				_mm256_srli_epi16(_mm256_loadu_si256(src), 6);
+			__m256i b = _mm256_srli_epi16(
+				_mm256_loadu_si256(src + 1), 6);
+			__m256i uval = _mm256_packs_epi32(
+				_mm256_and_si256(a, low_mask),
+				_mm256_and_si256(b, low_mask));
+			__m256i vval = _mm256_packs_epi32(
+				_mm256_srli_epi32(a, 16),
+				_mm256_srli_epi32(b, 16));
+
+			_mm256_storeu_si256((__m256i *)(u + x),
+					    _mm256_permute4x64_epi64(
+						    uval,
+						    _MM_SHUFFLE(3, 1, 2, 0)));
+			_mm256_storeu_si256((__m256i *)(v + x),
+					    _mm256_permute4x64_epi64(
+						    vval,
+						    _MM_SHUFFLE(3, 1, 2, 0)));
+		}
+	}
+
+	if (simd_width < width)
+		p010_to_i010_cols(input, in_linesize, simd_width, width,
+				  start_y, end_y, output, out_linesize);
+}
+
+AVX2_TARGET static void
+i422_to_nv12_avx2(const uint8_t *const input[], const uint32_t in_linesize[],
+		  uint32_t width, uint32_t start_y, uint32_t end_y,
+		  uint8_t *const output[], const uint32_t out_linesize[],
+		  const struct format_conversion_matrix *m)
+{
+	uint32_t simd_width = width & ~63;
+
+	UNUSED_PARAMETER(m);
+
+	for (uint32_t y = start_y; y < end_y; y++)
+		memcpy(output[0] + y * out_linesize[0],
+		       input[0] + y * in_linesize[0], simd_width);
+
+	for (uint32_t y = start_y; y < end_y; y += 2) {
+		const uint8_t *u0 = input[1] + y * in_linesize[1];
+		const uint8_t *u1 = u0 + in_linesize[1];
+		const uint8_t *v0 = input[2] + y * in_linesize[2];
+		const uint8_t *v1 = v0 + in_linesize[2];
+		uint8_t *uv = output[1] + (y / 2) * out_linesize[1];
+
+		for (uint32_t x = 0; x < simd_width / 2; x += 32) {
+			__m256i u = _mm256_avg_epu8(
+				_mm256_loadu_si256((const __m256i *)(u0 + x)),
+				_mm256_loadu_si256((const __m256i *)(u1 + x)));
+			__m256i v = _mm256_avg_epu8(
+				_mm256_loadu_si256((const __m256i *)(v0 + x)),
+				_mm256_loadu_si256((const __m256i *)(v1 + x)));
+			__m256i lo = _mm256_unpacklo_epi8(u, v);
+			__m256i hi = _mm256_unpackhi_epi8(u, v);
+			__m256i *dst = (__m256i *)(uv + x * 2);
+
+			_mm256_storeu_si256(dst,
+					    _mm256_permute2x128_si256(lo, hi,
+								      0x20));
+			_mm256_storeu_si256(dst + 1,
+					    _mm256_permute2x128_si256(lo, hi,
+								      0x31));
+		}
+	}
+
+	if (simd_width < width)
+		i422_to_nv12_cols(input, in_linesize, simd_width, width,
+				  start_y, end_y, output, out_linesize);
+}
+
+static const struct format_conversion_funcs funcs_avx2 = {
+	.rgbx_to_nv12 = rgbx_to_nv12_avx2,
+	.yuy2_to_nv12 = yuy2_to_nv12_avx2,
+	.nv12_to_yuy2 = nv12_to_yuy2_avx2,
+	.i010_to_p010 = i010_to_p010_avx2,
+	.p010_to_i010 = p010_to_i010_avx2,
+	.i422_to_nv12 = i422_to_nv12_avx2,
+};
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+static pthread_once_t select_once = PTHREAD_ONCE_INIT;
+static const struct format_conversion_funcs *cur_funcs = NULL;
+static enum format_conversion_level cur_level = FORMAT_CONVERSION_SCALAR;
+
+const struct format_conversion_funcs *
+format_conversion_get_funcs(enum format_conversion_level level)
+{
+	switch (level) {
+	case FORMAT_CONVERSION_SCALAR:
+		return &funcs_scalar;
+	case FORMAT_CONVERSION_SSE2:
+		return &funcs_sse2;
+	case FORMAT_CONVERSION_AVX2:
+#ifdef SIMD_X86
+		return simd_cpu_has_avx2() ? &funcs_avx2 : NULL;
+#else
+		return NULL;
+#endif
+	}
+
+	return NULL;
+}
+
+static void select_funcs(void)
+{
+	enum format_conversion_level level = FORMAT_CONVERSION_AVX2;
+	const struct format_conversion_funcs *funcs;
+
+	while (!(funcs = format_conversion_get_funcs(level)))
+		level--;
+
+	cur_level = level;
+	cur_funcs = funcs;
+}
+
+static inline const struct format_conversion_funcs *get_funcs(void)
+{
+	pthread_once(&select_once, select_funcs);
+	return cur_funcs;
+}
+
+enum format_conversion_level format_conversion_get_level(void)
+{
+	get_funcs();
+	return cur_level;
+}
+
+const char *format_conversion_level_name(enum format_conversion_level level)
+{
+	switch (level) {
+	case FORMAT_CONVERSION_SCALAR:
+		return "scalar";
+	case FORMAT_CONVERSION_SSE2:
+#ifdef SIMD_X86
+		return "SSE2";
+#else
+		return "SSE2 (simde)";
+#endif
+	case FORMAT_CONVERSION_AVX2:
+		return "AVX2";
+	}
+
+	return "unknown";
+}
+
+format_conversion_func format_conversion_find(enum video_format src,
+					      enum video_format dst)
+{
+	const struct format_conversion_funcs *funcs = get_funcs();
+
+	switch (src) {
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_BGRX:
+	case VIDEO_FORMAT_RGBA:
+		return dst == VIDEO_FORMAT_NV12 ? funcs->rgbx_to_nv12 : NULL;
+	case VIDEO_FORMAT_YUY2:
+		return dst == VIDEO_FORMAT_NV12 ? funcs->yuy2_to_nv12 : NULL;
+	case VIDEO_FORMAT_NV12:
+		return dst == VIDEO_FORMAT_YUY2 ? funcs->nv12_to_yuy2 : NULL;
+	case VIDEO_FORMAT_I010:
+		return dst == VIDEO_FORMAT_P010 ? funcs->i010_to_p010 : NULL;
+	case VIDEO_FORMAT_P010:
+		return dst == VIDEO_FORMAT_I010 ? funcs->p010_to_i010 : NULL;
+	case VIDEO_FORMAT_I422:
+		return dst == VIDEO_FORMAT_NV12 ? funcs->i422_to_nv12 : NULL;
+	default:
+		return NULL;
+	}
+}
+
+static inline int32_t to_fixed(double val, int bits)
+{
+	return (int32_t)floor(val * (double)(1 << bits) + 0.5);
+}
+
+bool format_conversion_init_matrix(struct format_conversion_matrix *matrix,
+				   enum video_format src,
+				   enum video_colorspace color_space,
+				   enum video_range_type range)
+{
+	float yuv_to_rgb[16];
+	double inv[3][3];
+	double offset[3];
+	double det;
+	int channel[3];
+
+	switch (src) {
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_BGRX:
+		channel[0] = 2;
+		channel[1] = 1;
+		channel[2] = 0;
+		break;
+	case VIDEO_FORMAT_RGBA:
+		channel[0] = 0;
+		channel[1] = 1;
+		channel[2] = 2;
+		break;
+	default:
+		return false;
+	}
+
+	if (!video_format_get_parameters_for_format(color_space, range,
+						    VIDEO_FORMAT_NV12,
+						    yuv_to_rgb, NULL, NULL))
+		return false;
+
+	/* rows of yuv_to_rgb are R, G and B, the columns Y, U, V and the
+	 * offset, all on values normalized to 0-1.  invert the 3x3 part with
+	 * its cofactors */
+#define M(r, c) ((double)yuv_to_rgb[(r)*4 + (c)])
+	inv[0][0] = M(1, 1) * M(2, 2) - M(1, 2) * M(2, 1);
+	inv[0][1] = M(0, 2) * M(2, 1) - M(0, 1) * M(2, 2);
+	inv[0][2] = M(0, 1) * M(1, 2) - M(0, 2) * M(1, 1);
+	inv[1][0] = M(1, 2) * M(2, 0) - M(1, 0) * M(2, 2);
+	inv[1][1] = M(0, 0) * M(2, 2) - M(0, 2) * M(2, 0);
+	inv[1][2] = M(0, 2) * M(1, 0) - M(0, 0) * M(1, 2);
+	inv[2][0] = M(1, 0) * M(2, 1) - M(1, 1) * M(2, 0);
+	inv[2][1] = M(0, 1) * M(2, 0) - M(0, 0) * M(2, 1);
+	inv[2][2] = M(0, 0) * M(1, 1) - M(0, 1) * M(1, 0);
+
+	det = M(0, 0) * inv[0][0] + M(0, 1) * inv[1][0] + M(0, 2) * inv[2][0];
+	if (fabs(det) < 1e-9)
+		return false;
+
+	for (int i = 0; i < 3; i++) {
+		offset[i] = 0.0;
+		for (int j = 0; j < 3; j++) {
+			inv[i][j] /= det;
+			offset[i] -= inv[i][j] * M(j, 3) * 255.0;
+		}
+	}
+#undef M
+
+	memset(matrix, 0, sizeof(*matrix));
+
+	for (int c = 0; c < 3; c++) {
+		matrix->y[channel[c]] = (int16_t)to_fixed(inv[0][c], 14);
+		matrix->u[channel[c]] = (int16_t)to_fixed(inv[1][c], 14);
+		matrix->v[channel[c]] = (int16_t)to_fixed(inv[2][c], 14);
+	}
+
+	matrix->y_offset = to_fixed(offset[0], 14) + (1 << 13);
+	matrix->u_offset = to_fixed(offset[1], 16) + (1 << 15);
+	matrix->v_offset = to_fixed(offset[2], 16) + (1 << 15);
+	return true;
+}
@@ -18,6 +18,7 @@
 #pragma once
 
 #include "../util/c99defs.h"
+#include "video-io.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -56,6 +57,77 @@ EXPORT void decompress_422(const uint8_t *input, uint32_t in_linesize,
 			   uint32_t start_y, uint32_t end_y, uint8_t *output,
 			   uint32_t out_linesize, bool leading_lum);
 
+/*
+ * Runtime dispatched conversions between formats of the same size, used by
+ * raw outputs instead of swscale when no resizing is needed.  The best
+ * implementation for the running CPU is selected at runtime:  AVX2 on x86
+ * CPUs that support it, SSE2 otherwise (mapped to NEON through simde on ARM),
+ * and plain C as the reference implementation.  Every level produces exactly
+ * the same output as the scalar kernels.
+ *
+ * Widths must be even, and start_y/end_y as well for 4:2:0 outputs.  Chroma
+ * is averaged over each 2x2 (or 2x1 for 4:2:2 sources) block, and duplicated
+ * when upsampling to 4:2:2.
+ */
+
+enum format_conversion_level {
+	FORMAT_CONVERSION_SCALAR,
+	FORMAT_CONVERSION_SSE2,
+	FORMAT_CONVERSION_AVX2,
+};
+
+/* RGB to YUV coefficients in the byte order of the source pixels */
+struct format_conversion_matrix {
+	/* Q14, applied to single pixels */
+	int16_t y[4];
+	/* Q14, applied to the sum of a 2x2 block of pixels */
+	int16_t u[4];
+	int16_t v[4];
+	/* Q14 and Q16 respectively, including rounding */
+	int32_t y_offset;
+	int32_t u_offset;
+	int32_t v_offset;
+};
+
+typedef void (*format_conversion_func)(
+	const uint8_t *const input[], const uint32_t in_linesize[],
+	uint32_t width, uint32_t start_y, uint32_t end_y,
+	uint8_t *const output[], const uint32_t out_linesize[],
+	const struct format_conversion_matrix *matrix);
+
+struct format_conversion_funcs {
+	/* BGRA/BGRX/RGBA to NV12, the only kernel that uses the matrix */
+	format_conversion_func rgbx_to_nv12;
+	format_conversion_func yuy2_to_nv12;
+	format_conversion_func nv12_to_yuy2;
+	format_conversion_func i010_to_p010;
+	format_conversion_func p010_to_i010;
+	format_conversion_func i422_to_nv12;
+};
+
+/** Returns the kernels of a specific level, or NULL if the CPU lacks it */
+EXPORT const struct format_conversion_funcs *
+format_conversion_get_funcs(enum format_conversion_level level);
+
+/** Returns the level that format_conversion_find dispatches to */
+EXPORT enum format_conversion_level format_conversion_get_level(void);
+EXPORT const char *
+format_conversion_level_name(enum format_conversion_level level);
+
+/** Returns the kernel converting src to dst, or NULL if there is none */
+EXPORT format_conversion_func
+format_conversion_find(enum video_format src, enum video_format dst);
+
+/**
+ * Computes the RGB to YUV matrix for an RGB source format, the inverse of
+ * the matrix returned by video_format_get_parameters.
+ */
+EXPORT bool
+format_conversion_init_matrix(struct format_conversion_matrix *matrix,
+			      enum video_format src,
+			      enum video_colorspace color_space,
+			      enum video_range_type range);
+
 #ifdef __cplusplus
 }
 #endif
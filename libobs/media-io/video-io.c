@@ -31,30 +31,99 @@
 
 extern profiler_name_store_t *obs_get_profiler_name_store(void);
 
-#define MAX_CONVERT_BUFFERS 3
 #define MAX_CACHE_SIZE 16
+#define MAX_INPUT_BACKLOG (MAX_CACHE_SIZE / 2)
 
 struct cached_frame_info {
 	struct video_data frame;
+	struct video_frame buffer;
 	int skipped;
 	int count;
+
+	/* number of frames queued to inputs that still point to this entry,
+	 * it can only be reused once it is dispatched and unreferenced */
+	long refs;
+	bool dispatched;
+
+	/* bumped every time the entry is filled with a new frame */
+	uint64_t generation;
+
+	/* set for frames queued by video_output_submit_frame, whose planes
+	 * belong to the caller until released */
+	video_frame_release_t release;
+	void *release_param;
 };
 
-struct video_input {
+struct input_frame {
+	size_t cache_idx;
+	uint64_t generation;
+	uint64_t timestamp;
+};
+
+/* inputs that request the same conversion share one scaler, and every cached
+ * frame is converted at most once for all of them.  converted frames are kept
+ * per cache entry and stay valid for as long as the entry is referenced */
+struct video_convert_group {
 	struct video_scale_info conversion;
 	video_scaler_t *scaler;
-	struct video_frame frame[MAX_CONVERT_BUFFERS];
-	int cur_frame;
+
+	/* set instead of scaler for same-size conversions between formats
+	 * with a dedicated kernel */
+	format_conversion_func direct;
+	struct format_conversion_matrix matrix;
+	pthread_mutex_t mutex;
+	volatile long refs;
+
+	/* inputs connected with this conversion, protected by input_mutex */
+	size_t num_inputs;
+
+	struct video_frame frame[MAX_CACHE_SIZE];
+	uint64_t generation[MAX_CACHE_SIZE];
+};
+
+static void convert_group_release(struct video_convert_group *group)
+{
+	if (!group || os_atomic_dec_long(&group->refs) != 0)
+		return;
+
+	for (size_t i = 0; i < MAX_CACHE_SIZE; i++)
+		video_frame_free(&group->frame[i]);
+	video_scaler_destroy(group->scaler);
+	pthread_mutex_destroy(&group->mutex);
+	bfree(group);
+}
+
+/* every input runs its callback on its own thread, so that a slow encoder
+ * only makes its own backlog overflow instead of delaying the others */
+struct video_input {
+	struct video_scale_info conversion;
+	struct video_convert_group *group;
 
 	void (*callback)(void *param, struct video_data *frame);
 	void *param;
+
+	struct video_output *video;
+	pthread_t thread;
+	os_sem_t *semaphore;
+	bool thread_active;
+	bool detached;
+	volatile bool stop;
+
+	/* protected by video_output::data_mutex */
+	struct input_frame backlog[MAX_INPUT_BACKLOG];
+	size_t backlog_start;
+	size_t backlog_num;
+	size_t max_backlog;
+
+	volatile long skipped_frames;
+	volatile long total_frames;
 };
 
 static inline void video_input_free(struct video_input *input)
 {
-	for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-		video_frame_free(&input->frame[i]);
-	video_scaler_destroy(input->scaler);
+	convert_group_release(input->group);
+	os_sem_destroy(input->semaphore);
+	bfree(input);
 }
 
 struct video_output {
@@ -72,13 +141,22 @@ struct video_output {
 	bool initialized;
 
 	pthread_mutex_t input_mutex;
-	DARRAY(struct video_input) inputs;
+	DARRAY(struct video_input *) inputs;
+	DARRAY(struct video_convert_group *) convert_groups;
+
+	volatile long conversions;
+	volatile long shared_conversions;
 
 	size_t available_frames;
 	size_t first_added;
 	size_t last_added;
 	struct cached_frame_info cache[MAX_CACHE_SIZE];
 
+	/* frames skipped while the newest cached frame was already dispatched
+	 * are repeated with the next frame that is added instead */
+	uint64_t carried_timestamp;
+	int carried_count;
+
 	volatile bool raw_active;
 	volatile long gpu_refs;
 };
@@ -86,87 +164,237 @@ struct video_output {
 /* ------------------------------------------------------------------------- */
 
 static inline bool scale_video_output(struct video_input *input,
+				      const struct input_frame *in_frame,
 				      struct video_data *data)
 {
+	struct video_convert_group *group = input->group;
+	struct video_frame *frame;
+	size_t idx = in_frame->cache_idx;
 	bool success = true;
 
-	if (input->scaler) {
-		struct video_frame *frame;
-
-		if (++input->cur_frame == MAX_CONVERT_BUFFERS)
-			input->cur_frame = 0;
+	if (!group)
+		return true;
 
-		frame = &input->frame[input->cur_frame];
+	pthread_mutex_lock(&group->mutex);
+
+	frame = &group->frame[idx];
+
+	if (group->generation[idx] != in_frame->generation) {
+		if (!frame->data[0])
+			video_frame_init(frame, group->conversion.format,
+					 group->conversion.width,
+					 group->conversion.height);
+
+		if (group->direct)
+			group->direct((const uint8_t *const *)data->data,
+				      data->linesize, group->conversion.width,
+				      0, group->conversion.height, frame->data,
+				      frame->linesize, &group->matrix);
+		else
+			success = video_scaler_scale(
+				group->scaler, frame->data, frame->linesize,
+				(const uint8_t *const *)data->data,
+				data->linesize);
+		if (success) {
+			group->generation[idx] = in_frame->generation;
+			os_atomic_inc_long(&input->video->conversions);
+		}
+	} else {
+		os_atomic_inc_long(&input->video->shared_conversions);
+	}
 
-		success = video_scaler_scale(input->scaler, frame->data,
-					     frame->linesize,
-					     (const uint8_t *const *)data->data,
-					     data->linesize);
+	pthread_mutex_unlock(&group->mutex);
 
-		if (success) {
-			for (size_t i = 0; i < MAX_AV_PLANES; i++) {
-				data->data[i] = frame->data[i];
-				data->linesize[i] = frame->linesize[i];
-			}
-		} else {
-			blog(LOG_WARNING, "video-io: Could not scale frame!");
+	if (success) {
+		for (size_t i = 0; i < MAX_AV_PLANES; i++) {
+			data->data[i] = frame->data[i];
+			data->linesize[i] = frame->linesize[i];
 		}
+	} else {
+		blog(LOG_WARNING, "video-io: Could not scale frame!");
 	}
 
 	return success;
 }
 
+/* frees the oldest cache entries in order once every input is done with
+ * them, must be called with data_mutex locked.  the release callbacks of
+ * submitted frames are returned to be called after unlocking */
+static size_t free_done_frames(struct video_output *video,
+			       struct cached_frame_info *released)
+{
+	size_t num_released = 0;
+
+	while (video->available_frames < video->info.cache_size) {
+		size_t oldest = (video->last_added + 1 +
+				 video->available_frames) %
+				video->info.cache_size;
+		struct cached_frame_info *cfi = &video->cache[oldest];
+
+		if (!cfi->dispatched || cfi->refs)
+			break;
+
+		if (cfi->release) {
+			released[num_released++] = *cfi;
+			cfi->release = NULL;
+			cfi->release_param = NULL;
+		}
+		cfi->dispatched = false;
+
+		if (++video->available_frames == video->info.cache_size)
+			video->last_added = video->first_added;
+	}
+
+	return num_released;
+}
+
+static inline void call_release(struct cached_frame_info *released,
+				size_t num)
+{
+	for (size_t i = 0; i < num; i++)
+		released[i].release(released[i].release_param);
+}
+
+static void unref_cache_frame(struct video_output *video, size_t cache_idx)
+{
+	struct cached_frame_info released[MAX_CACHE_SIZE];
+	size_t num;
+
+	pthread_mutex_lock(&video->data_mutex);
+	video->cache[cache_idx].refs--;
+	num = free_done_frames(video, released);
+	pthread_mutex_unlock(&video->data_mutex);
+
+	call_release(released, num);
+}
+
+static void *input_thread(void *param)
+{
+	struct video_input *input = param;
+	struct video_output *video = input->video;
+
+	os_set_thread_name("video-io: input thread");
+
+	const char *input_thread_name =
+		profile_store_name(obs_get_profiler_name_store(),
+				   "video_input_thread(%s)", video->info.name);
+
+	while (os_sem_wait(input->semaphore) == 0) {
+		struct input_frame in_frame;
+		struct video_data frame;
+
+		if (input->stop)
+			break;
+
+		pthread_mutex_lock(&video->data_mutex);
+
+		in_frame = input->backlog[input->backlog_start];
+		if (++input->backlog_start == MAX_INPUT_BACKLOG)
+			input->backlog_start = 0;
+		input->backlog_num--;
+
+		frame = video->cache[in_frame.cache_idx].frame;
+		frame.timestamp = in_frame.timestamp;
+
+		pthread_mutex_unlock(&video->data_mutex);
+
+		profile_start(input_thread_name);
+		if (scale_video_output(input, &in_frame, &frame))
+			input->callback(input->param, &frame);
+		profile_end(input_thread_name);
+
+		unref_cache_frame(video, in_frame.cache_idx);
+
+		profile_reenable_thread();
+	}
+
+	/* disconnected from within its own callback */
+	if (input->detached)
+		video_input_free(input);
+
+	return NULL;
+}
+
+/* must be called with data_mutex locked */
+static bool queue_input_frame(struct video_output *video,
+			      struct video_input *input, size_t cache_idx,
+			      uint64_t timestamp)
+{
+	struct input_frame *in_frame;
+	size_t idx;
+
+	os_atomic_inc_long(&input->total_frames);
+
+	if (input->stop || input->backlog_num == input->max_backlog) {
+		os_atomic_inc_long(&input->skipped_frames);
+		return false;
+	}
+
+	idx = (input->backlog_start + input->backlog_num) % MAX_INPUT_BACKLOG;
+	in_frame = &input->backlog[idx];
+	in_frame->cache_idx = cache_idx;
+	in_frame->generation = video->cache[cache_idx].generation;
+	in_frame->timestamp = timestamp;
+	input->backlog_num++;
+
+	video->cache[cache_idx].refs++;
+	os_sem_post(input->semaphore);
+	return true;
+}
+
 static inline bool video_output_cur_frame(struct video_output *video)
 {
+	struct cached_frame_info released[MAX_CACHE_SIZE];
 	struct cached_frame_info *frame_info;
+	size_t num_released = 0;
+	bool input_skipped = false;
 	bool complete;
 	bool skipped;
 
 	/* -------------------------------- */
 
+	pthread_mutex_lock(&video->input_mutex);
 	pthread_mutex_lock(&video->data_mutex);
 
 	frame_info = &video->cache[video->first_added];
 
-	pthread_mutex_unlock(&video->data_mutex);
-
-	/* -------------------------------- */
-
-	pthread_mutex_lock(&video->input_mutex);
-
 	for (size_t i = 0; i < video->inputs.num; i++) {
-		struct video_input *input = video->inputs.array + i;
-		struct video_data frame = frame_info->frame;
-
-		if (scale_video_output(input, &frame))
-			input->callback(input->param, &frame);
+		if (!queue_input_frame(video, video->inputs.array[i],
+				       video->first_added,
+				       frame_info->frame.timestamp))
+			input_skipped = true;
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
 
 	/* -------------------------------- */
 
-	pthread_mutex_lock(&video->data_mutex);
-
 	frame_info->frame.timestamp += video->frame_time;
 	complete = --frame_info->count == 0;
 	skipped = frame_info->skipped > 0;
 
 	if (complete) {
+		frame_info->dispatched = true;
+
 		if (++video->first_added == video->info.cache_size)
 			video->first_added = 0;
 
-		if (++video->available_frames == video->info.cache_size)
-			video->last_added = video->first_added;
+		num_released = free_done_frames(video, released);
 	} else if (skipped) {
 		--frame_info->skipped;
 		os_atomic_inc_long(&video->skipped_frames);
+		input_skipped = false;
 	}
 
+	if (input_skipped)
+		os_atomic_inc_long(&video->skipped_frames);
+
 	pthread_mutex_unlock(&video->data_mutex);
 
 	/* -------------------------------- */
 
+	call_release(released, num_released);
+
 	return complete;
 }
 
@@ -211,14 +439,8 @@ static inline void init_cache(struct video_output *video)
 	if (video->info.cache_size > MAX_CACHE_SIZE)
 		video->info.cache_size = MAX_CACHE_SIZE;
 
-	for (size_t i = 0; i < video->info.cache_size; i++) {
-		struct video_frame *frame;
-		frame = (struct video_frame *)&video->cache[i];
-
-		video_frame_init(frame, video->info.format, video->info.width,
-				 video->info.height);
-	}
-
+	/* frame buffers are allocated on first use by video_output_lock_frame,
+	 * outputs that only submit frames never need them */
 	video->available_frames = video->info.cache_size;
 }
 
@@ -272,11 +494,17 @@ void video_output_close(video_t *video)
 	video_output_stop(video);
 
 	for (size_t i = 0; i < video->inputs.num; i++)
-		video_input_free(&video->inputs.array[i]);
+		video_input_free(video->inputs.array[i]);
 	da_free(video->inputs);
+	da_free(video->convert_groups);
 
-	for (size_t i = 0; i < video->info.cache_size; i++)
-		video_frame_free((struct video_frame *)&video->cache[i]);
+	for (size_t i = 0; i < video->info.cache_size; i++) {
+		struct cached_frame_info *cfi = &video->cache[i];
+
+		if (cfi->release)
+			cfi->release(cfi->release_param);
+		video_frame_free(&cfi->buffer);
+	}
 
 	bfree(video);
 }
@@ -287,7 +515,7 @@ static size_t video_get_input_idx(const video_t *video,
 				  void *param)
 {
 	for (size_t i = 0; i < video->inputs.num; i++) {
-		struct video_input *input = video->inputs.array + i;
+		struct video_input *input = video->inputs.array[i];
 		if (input->callback == callback && input->param == param)
 			return i;
 	}
@@ -295,38 +523,203 @@ static size_t video_get_input_idx(const video_t *video,
 	return DARRAY_INVALID;
 }
 
+static bool video_input_start(struct video_input *input,
+			      struct video_output *video)
+{
+	input->video = video;
+	input->max_backlog = video->info.cache_size / 2;
+	if (input->max_backlog == 0)
+		input->max_backlog = 1;
+
+	if (os_sem_init(&input->semaphore, 0) != 0)
+		return false;
+	if (pthread_create(&input->thread, NULL, input_thread, input) != 0)
+		return false;
+
+	input->thread_active = true;
+	return true;
+}
+
+/* stops the input thread and drops the frames left in its backlog.  when
+ * called from the input's own callback, the thread frees the input itself
+ * once the callback returns */
+static void video_input_stop(struct video_input *input)
+{
+	struct video_output *video = input->video;
+	struct cached_frame_info released[MAX_CACHE_SIZE];
+	size_t num_released;
+
+	if (!input->thread_active)
+		return;
+
+	pthread_mutex_lock(&video->data_mutex);
+	input->stop = true;
+	pthread_mutex_unlock(&video->data_mutex);
+
+	/* wakes the thread either way, a detached thread still has to get
+	 * past os_sem_wait to see that it was stopped and free the input */
+	os_sem_post(input->semaphore);
+
+	if (pthread_equal(pthread_self(), input->thread)) {
+		input->detached = true;
+		pthread_detach(input->thread);
+	} else {
+		pthread_join(input->thread, NULL);
+	}
+
+	input->thread_active = false;
+
+	pthread_mutex_lock(&video->data_mutex);
+
+	while (input->backlog_num) {
+		size_t idx = input->backlog[input->backlog_start].cache_idx;
+		video->cache[idx].refs--;
+
+		if (++input->backlog_start == MAX_INPUT_BACKLOG)
+			input->backlog_start = 0;
+		input->backlog_num--;
+	}
+
+	num_released = free_done_frames(video, released);
+
+	pthread_mutex_unlock(&video->data_mutex);
+
+	call_release(released, num_released);
+}
+
+static void log_input_skipped(struct video_input *input)
+{
+	long skipped = os_atomic_load_long(&input->skipped_frames);
+	long total = os_atomic_load_long(&input->total_frames);
+
+	if (skipped)
+		blog(LOG_INFO,
+		     "video-io: Video input disconnected, number of frames "
+		     "it skipped due to lag: %ld/%ld (%0.1f%%)",
+		     skipped, total, (double)skipped / (double)total * 100.0);
+}
+
+static inline bool same_conversion(const struct video_scale_info *a,
+				   const struct video_scale_info *b)
+{
+	return a->format == b->format && a->width == b->width &&
+	       a->height == b->height && a->range == b->range &&
+	       a->colorspace == b->colorspace;
+}
+
+static format_conversion_func
+find_direct_conversion(const struct video_scale_info *to,
+		       const struct video_scale_info *from,
+		       struct format_conversion_matrix *matrix)
+{
+	format_conversion_func func;
+
+	if (to->width != from->width || to->height != from->height ||
+	    (to->width & 1) != 0 || (to->height & 1) != 0)
+		return NULL;
+
+	func = format_conversion_find(from->format, to->format);
+	if (!func)
+		return NULL;
+
+	/* the kernels only repack YUV, any range or matrix change between
+	 * YUV formats is left to swscale */
+	if (format_is_yuv(from->format))
+		return from->range == to->range &&
+				       from->colorspace == to->colorspace
+			       ? func
+			       : NULL;
+
+	return format_conversion_init_matrix(matrix, from->format,
+					     to->colorspace, to->range)
+		       ? func
+		       : NULL;
+}
+
+static struct video_convert_group *
+get_convert_group(struct video_output *video,
+		  const struct video_scale_info *conversion)
+{
+	struct video_convert_group *group;
+
+	for (size_t i = 0; i < video->convert_groups.num; i++) {
+		group = video->convert_groups.array[i];
+		if (same_conversion(&group->conversion, conversion)) {
+			os_atomic_inc_long(&group->refs);
+			group->num_inputs++;
+			return group;
+		}
+	}
+
+	struct video_scale_info from = {.format = video->info.format,
+					.width = video->info.width,
+					.height = video->info.height,
+					.range = video->info.range,
+					.colorspace = video->info.colorspace};
+
+	group = bzalloc(sizeof(*group));
+	group->conversion = *conversion;
+	group->refs = 1;
+	group->num_inputs = 1;
+
+	if (pthread_mutex_init(&group->mutex, NULL) != 0) {
+		bfree(group);
+		return NULL;
+	}
+
+	group->direct = find_direct_conversion(conversion, &from,
+					       &group->matrix);
+	if (group->direct) {
+		blog(LOG_DEBUG,
+		     "video-io: Converting %s to %s without swscale (%s)",
+		     get_video_format_name(from.format),
+		     get_video_format_name(conversion->format),
+		     format_conversion_level_name(
+			     format_conversion_get_level()));
+		da_push_back(video->convert_groups, &group);
+		return group;
+	}
+
+	/* large conversions are split into slices converted in parallel, the
+	 * per-frame cost of this otherwise lands on the input's thread */
+	int ret = video_scaler_create_threaded(&group->scaler, conversion,
+					       &from,
+					       VIDEO_SCALE_FAST_BILINEAR, 0);
+	if (ret != VIDEO_SCALER_SUCCESS) {
+		if (ret == VIDEO_SCALER_BAD_CONVERSION)
+			blog(LOG_ERROR, "video_input_init: Bad "
+					"scale conversion type");
+		else
+			blog(LOG_ERROR, "video_input_init: Failed to "
+					"create scaler");
+
+		convert_group_release(group);
+		return NULL;
+	}
+
+	da_push_back(video->convert_groups, &group);
+	return group;
+}
+
+/* must be called with input_mutex locked */
+static void leave_convert_group(struct video_output *video,
+				struct video_input *input)
+{
+	struct video_convert_group *group = input->group;
+
+	if (group && --group->num_inputs == 0)
+		da_erase_item(video->convert_groups, &group);
+}
+
 static inline bool video_input_init(struct video_input *input,
 				    struct video_output *video)
 {
 	if (input->conversion.width != video->info.width ||
 	    input->conversion.height != video->info.height ||
 	    input->conversion.format != video->info.format) {
-		struct video_scale_info from = {.format = video->info.format,
-						.width = video->info.width,
-						.height = video->info.height,
-						.range = video->info.range,
-						.colorspace =
-							video->info.colorspace};
-
-		int ret = video_scaler_create(&input->scaler,
-					      &input->conversion, &from,
-					      VIDEO_SCALE_FAST_BILINEAR);
-		if (ret != VIDEO_SCALER_SUCCESS) {
-			if (ret == VIDEO_SCALER_BAD_CONVERSION)
-				blog(LOG_ERROR, "video_input_init: Bad "
-						"scale conversion type");
-			else
-				blog(LOG_ERROR, "video_input_init: Failed to "
-						"create scaler");
-
+		input->group = get_convert_group(video, &input->conversion);
+		if (!input->group)
 			return false;
-		}
-
-		for (size_t i = 0; i < MAX_CONVERT_BUFFERS; i++)
-			video_frame_init(&input->frame[i],
-					 input->conversion.format,
-					 input->conversion.width,
-					 input->conversion.height);
 	}
 
 	return true;
@@ -336,6 +729,8 @@ static inline void reset_frames(video_t *video)
 {
 	os_atomic_set_long(&video->skipped_frames, 0);
 	os_atomic_set_long(&video->total_frames, 0);
+	os_atomic_set_long(&video->conversions, 0);
+	os_atomic_set_long(&video->shared_conversions, 0);
 }
 
 bool video_output_connect(
@@ -350,26 +745,26 @@ bool video_output_connect(
 	pthread_mutex_lock(&video->input_mutex);
 
 	if (video_get_input_idx(video, callback, param) == DARRAY_INVALID) {
-		struct video_input input;
-		memset(&input, 0, sizeof(input));
+		struct video_input *input = bzalloc(sizeof(*input));
 
-		input.callback = callback;
-		input.param = param;
+		input->callback = callback;
+		input->param = param;
 
 		if (conversion) {
-			input.conversion = *conversion;
+			input->conversion = *conversion;
 		} else {
-			input.conversion.format = video->info.format;
-			input.conversion.width = video->info.width;
-			input.conversion.height = video->info.height;
+			input->conversion.format = video->info.format;
+			input->conversion.width = video->info.width;
+			input->conversion.height = video->info.height;
 		}
 
-		if (input.conversion.width == 0)
-			input.conversion.width = video->info.width;
-		if (input.conversion.height == 0)
-			input.conversion.height = video->info.height;
+		if (input->conversion.width == 0)
+			input->conversion.width = video->info.width;
+		if (input->conversion.height == 0)
+			input->conversion.height = video->info.height;
 
-		success = video_input_init(&input, video);
+		success = video_input_init(input, video) &&
+			  video_input_start(input, video);
 		if (success) {
 			if (video->inputs.num == 0) {
 				if (!os_atomic_load_long(&video->gpu_refs)) {
@@ -378,6 +773,9 @@ bool video_output_connect(
 				os_atomic_set_bool(&video->raw_active, true);
 			}
 			da_push_back(video->inputs, &input);
+		} else {
+			leave_convert_group(video, input);
+			video_input_free(input);
 		}
 	}
 
@@ -411,12 +809,15 @@ void video_output_disconnect(video_t *video,
 	if (!video || !callback)
 		return;
 
+	struct video_input *input = NULL;
+
 	pthread_mutex_lock(&video->input_mutex);
 
 	size_t idx = video_get_input_idx(video, callback, param);
 	if (idx != DARRAY_INVALID) {
-		video_input_free(video->inputs.array + idx);
+		input = video->inputs.array[idx];
 		da_erase(video->inputs, idx);
+		leave_convert_group(video, input);
 
 		if (video->inputs.num == 0) {
 			os_atomic_set_bool(&video->raw_active, false);
@@ -427,6 +828,36 @@ void video_output_disconnect(video_t *video,
 	}
 
 	pthread_mutex_unlock(&video->input_mutex);
+
+	/* the input thread is stopped outside of input_mutex in case its
+	 * callback is currently waiting on it */
+	if (input) {
+		log_input_skipped(input);
+		video_input_stop(input);
+		if (!input->detached)
+			video_input_free(input);
+	}
+}
+
+uint32_t video_output_get_input_skipped_frames(
+	video_t *video, void (*callback)(void *param, struct video_data *frame),
+	void *param)
+{
+	uint32_t skipped = 0;
+
+	if (!video || !callback)
+		return 0;
+
+	pthread_mutex_lock(&video->input_mutex);
+
+	size_t idx = video_get_input_idx(video, callback, param);
+	if (idx != DARRAY_INVALID)
+		skipped = (uint32_t)os_atomic_load_long(
+			&video->inputs.array[idx]->skipped_frames);
+
+	pthread_mutex_unlock(&video->input_mutex);
+
+	return skipped;
 }
 
 bool video_output_active(const video_t *video)
@@ -441,41 +872,71 @@ const struct video_output_info *video_output_get_info(const video_t *video)
 	return video ? &video->info : NULL;
 }
 
+static struct cached_frame_info *next_cache_frame(video_t *video, int count,
+						  uint64_t timestamp)
+{
+	struct cached_frame_info *cfi;
+
+	if (video->available_frames == 0) {
+		cfi = &video->cache[video->last_added];
+		if (cfi->dispatched) {
+			if (!video->carried_count)
+				video->carried_timestamp = timestamp;
+			video->carried_count += count;
+		} else {
+			cfi->count += count;
+			cfi->skipped += count;
+		}
+		return NULL;
+	}
+
+	if (video->available_frames != video->info.cache_size) {
+		if (++video->last_added == video->info.cache_size)
+			video->last_added = 0;
+	}
+
+	cfi = &video->cache[video->last_added];
+	cfi->frame.timestamp = timestamp;
+	cfi->count = count;
+	cfi->skipped = 0;
+	cfi->generation++;
+
+	if (video->carried_count) {
+		cfi->frame.timestamp = video->carried_timestamp;
+		cfi->count += video->carried_count;
+		cfi->skipped = video->carried_count;
+		video->carried_count = 0;
+	}
+
+	return cfi;
+}
+
 bool video_output_lock_frame(video_t *video, struct video_frame *frame,
 			     int count, uint64_t timestamp)
 {
 	struct cached_frame_info *cfi;
-	bool locked;
 
 	if (!video)
 		return false;
 
 	pthread_mutex_lock(&video->data_mutex);
 
-	if (video->available_frames == 0) {
-		video->cache[video->last_added].count += count;
-		video->cache[video->last_added].skipped += count;
-		locked = false;
-
-	} else {
-		if (video->available_frames != video->info.cache_size) {
-			if (++video->last_added == video->info.cache_size)
-				video->last_added = 0;
-		}
-
-		cfi = &video->cache[video->last_added];
-		cfi->frame.timestamp = timestamp;
-		cfi->count = count;
-		cfi->skipped = 0;
-
-		memcpy(frame, &cfi->frame, sizeof(*frame));
-
-		locked = true;
+	cfi = next_cache_frame(video, count, timestamp);
+	if (cfi) {
+		if (!cfi->buffer.data[0])
+			video_frame_init(&cfi->buffer, video->info.format,
+					 video->info.width, video->info.height);
+
+		memcpy(cfi->frame.data, cfi->buffer.data,
+		       sizeof(cfi->frame.data));
+		memcpy(cfi->frame.linesize, cfi->buffer.linesize,
+		       sizeof(cfi->frame.linesize));
+		memcpy(frame, &cfi->buffer, sizeof(*frame));
 	}
 
 	pthread_mutex_unlock(&video->data_mutex);
 
-	return locked;
+	return cfi != NULL;
 }
 
 void video_output_unlock_frame(video_t *video)
@@ -491,6 +952,34 @@ void video_output_unlock_frame(video_t *video)
 	pthread_mutex_unlock(&video->data_mutex);
 }
 
+bool video_output_submit_frame(video_t *video, const struct video_data *frame,
+			       int count, video_frame_release_t release,
+			       void *param)
+{
+	struct cached_frame_info *cfi;
+
+	if (!video)
+		return false;
+
+	pthread_mutex_lock(&video->data_mutex);
+
+	cfi = next_cache_frame(video, count, frame->timestamp);
+	if (cfi) {
+		memcpy(cfi->frame.data, frame->data, sizeof(cfi->frame.data));
+		memcpy(cfi->frame.linesize, frame->linesize,
+		       sizeof(cfi->frame.linesize));
+		cfi->release = release;
+		cfi->release_param = param;
+
+		video->available_frames--;
+		os_sem_post(video->update_semaphore);
+	}
+
+	pthread_mutex_unlock(&video->data_mutex);
+
+	return cfi != NULL;
+}
+
 uint64_t video_output_get_frame_time(const video_t *video)
 {
 	return video ? video->frame_time : 0;
@@ -508,6 +997,10 @@ void video_output_stop(video_t *video)
 		video->stop = true;
 		os_sem_post(video->update_semaphore);
 		pthread_join(video->thread, &thread_ret);
+
+		for (size_t i = 0; i < video->inputs.num; i++)
+			video_input_stop(video->inputs.array[i]);
+
 		os_sem_destroy(video->update_semaphore);
 		pthread_mutex_destroy(&video->data_mutex);
 		pthread_mutex_destroy(&video->input_mutex);
@@ -555,6 +1048,27 @@ uint32_t video_output_get_total_frames(const video_t *video)
 	return (uint32_t)os_atomic_load_long(&video->total_frames);
 }
 
+void video_output_get_conversion_stats(video_t *video,
+				       struct video_conversion_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+
+	if (!video)
+		return;
+
+	pthread_mutex_lock(&video->input_mutex);
+	stats->inputs = (uint32_t)video->inputs.num;
+	stats->groups = (uint32_t)video->convert_groups.num;
+	pthread_mutex_unlock(&video->input_mutex);
+
+	stats->conversions =
+		(uint32_t)os_atomic_load_long(&video->conversions);
+	stats->shared_conversions =
+		(uint32_t)os_atomic_load_long(&video->shared_conversions);
+	stats->total_frames =
+		(uint32_t)os_atomic_load_long(&video->total_frames);
+}
+
 /* Note: These four functions below are a very slight bit of a hack.  If the
  * texture encoder thread is active while the raw encoder thread is active, the
  * total frame count will just be doubled while they're both active.  Which is
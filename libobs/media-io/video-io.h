@@ -271,6 +271,11 @@ EXPORT void video_output_disconnect(video_t *video,
 						     struct video_data *frame),
 				    void *param);
 
+/** Frames a connected callback skipped because its own backlog was full */
+EXPORT uint32_t video_output_get_input_skipped_frames(
+	video_t *video, void (*callback)(void *param, struct video_data *frame),
+	void *param);
+
 EXPORT bool video_output_active(const video_t *video);
 
 EXPORT const struct video_output_info *
@@ -278,6 +283,22 @@ video_output_get_info(const video_t *video);
 EXPORT bool video_output_lock_frame(video_t *video, struct video_frame *frame,
 				    int count, uint64_t timestamp);
 EXPORT void video_output_unlock_frame(video_t *video);
+
+typedef void (*video_frame_release_t)(void *param);
+
+/**
+ * Queues a frame whose planes are owned by the caller (e.g. mapped staging
+ * memory) so that they reach the video inputs without being copied.  The
+ * planes must stay valid until release(param) is called from a video-io
+ * thread, once the frame and all of its duplicates have been output.
+ *
+ * Returns false if the cache is full, in which case the frame counts as
+ * skipped like with video_output_lock_frame, and release is not called.
+ */
+EXPORT bool video_output_submit_frame(video_t *video,
+				      const struct video_data *frame,
+				      int count, video_frame_release_t release,
+				      void *param);
 EXPORT uint64_t video_output_get_frame_time(const video_t *video);
 EXPORT void video_output_stop(video_t *video);
 EXPORT bool video_output_stopped(video_t *video);
@@ -290,6 +311,22 @@ EXPORT double video_output_get_frame_rate(const video_t *video);
 EXPORT uint32_t video_output_get_skipped_frames(const video_t *video);
 EXPORT uint32_t video_output_get_total_frames(const video_t *video);
 
+struct video_conversion_stats {
+	/* connected raw inputs */
+	uint32_t inputs;
+	/* distinct conversions among them, inputs that request the output
+	 * format itself do not need one */
+	uint32_t groups;
+	/* frames converted, and frames handed to an input from a conversion
+	 * that had already run for another input or a duplicated frame */
+	uint32_t conversions;
+	uint32_t shared_conversions;
+	uint32_t total_frames;
+};
+
+EXPORT void video_output_get_conversion_stats(
+	video_t *video, struct video_conversion_stats *stats);
+
 extern void video_output_inc_texture_encoders(video_t *video);
 extern void video_output_dec_texture_encoders(video_t *video);
 extern void video_output_inc_texture_frames(video_t *video);
@@ -16,17 +16,37 @@
 ******************************************************************************/
 
 #include "../util/bmem.h"
+#include "../util/platform.h"
 #include "video-scaler.h"
 
 #include <libavutil/imgutils.h>
+#include <libavutil/opt.h>
 #include <libswscale/swscale.h>
 
+/* swscale can split the output into slices processed by its own worker
+ * threads since the frame based API was added */
+#if LIBSWSCALE_VERSION_INT >= AV_VERSION_INT(6, 1, 100)
+#define SWS_SLICE_THREADS 1
+#else
+#define SWS_SLICE_THREADS 0
+#endif
+
+/* frames below this size are not worth the thread synchronization */
+#define MIN_THREADED_PIXELS (1280 * 720)
+
 struct video_scaler {
 	struct SwsContext *swscale;
 	int src_height;
 	int dst_heights[4];
 	uint8_t *dst_pointers[4];
 	int dst_linesizes[4];
+
+	int threads;
+#if SWS_SLICE_THREADS
+	AVFrame *src_frame;
+	AVFrame *dst_frame;
+	AVBufferRef *dst_buf;
+#endif
 };
 
 static inline enum AVPixelFormat
@@ -131,10 +151,103 @@ static inline int get_ffmpeg_range_type(enum video_range_type type)
 
 #define FIXED_1_0 (1 << 16)
 
+static int get_auto_threads(const struct video_scale_info *dst,
+			    const struct video_scale_info *src)
+{
+	uint64_t src_pixels = (uint64_t)src->width * src->height;
+	uint64_t dst_pixels = (uint64_t)dst->width * dst->height;
+	int cores;
+
+	if (src_pixels < MIN_THREADED_PIXELS &&
+	    dst_pixels < MIN_THREADED_PIXELS)
+		return 1;
+
+	cores = os_get_physical_cores();
+	if (cores < 1)
+		cores = 1;
+	return cores > VIDEO_SCALER_AUTO_THREADS ? VIDEO_SCALER_AUTO_THREADS
+						 : cores;
+}
+
+#if SWS_SLICE_THREADS
+static void noop_free(void *opaque, uint8_t *data)
+{
+	UNUSED_PARAMETER(opaque);
+	UNUSED_PARAMETER(data);
+}
+
+static struct SwsContext *create_threaded_context(
+	const struct video_scale_info *dst, const struct video_scale_info *src,
+	enum AVPixelFormat format_dst, enum AVPixelFormat format_src,
+	int scale_type, int threads)
+{
+	struct SwsContext *ctx = sws_alloc_context();
+	if (!ctx)
+		return NULL;
+
+	av_opt_set_int(ctx, "srcw", src->width, 0);
+	av_opt_set_int(ctx, "srch", src->height, 0);
+	av_opt_set_int(ctx, "src_format", format_src, 0);
+	av_opt_set_int(ctx, "dstw", dst->width, 0);
+	av_opt_set_int(ctx, "dsth", dst->height, 0);
+	av_opt_set_int(ctx, "dst_format", format_dst, 0);
+	av_opt_set_int(ctx, "sws_flags", scale_type, 0);
+	av_opt_set_int(ctx, "threads", threads, 0);
+
+	if (sws_init_context(ctx, NULL, NULL) < 0) {
+		sws_freeContext(ctx);
+		return NULL;
+	}
+
+	return ctx;
+}
+
+static bool init_frames(struct video_scaler *scaler,
+			const struct video_scale_info *dst,
+			const struct video_scale_info *src,
+			enum AVPixelFormat format_dst,
+			enum AVPixelFormat format_src, int dst_size)
+{
+	scaler->src_frame = av_frame_alloc();
+	scaler->dst_frame = av_frame_alloc();
+	if (!scaler->src_frame || !scaler->dst_frame)
+		return false;
+
+	/* the destination is the scaler's own image, wrapped in a buffer
+	 * reference so that swscale does not allocate a new one */
+	scaler->dst_buf = av_buffer_create(scaler->dst_pointers[0], dst_size,
+					   noop_free, NULL, 0);
+	if (!scaler->dst_buf)
+		return false;
+
+	scaler->src_frame->format = format_src;
+	scaler->src_frame->width = src->width;
+	scaler->src_frame->height = src->height;
+
+	scaler->dst_frame->format = format_dst;
+	scaler->dst_frame->width = dst->width;
+	scaler->dst_frame->height = dst->height;
+	for (size_t i = 0; i < 4; i++) {
+		scaler->dst_frame->data[i] = scaler->dst_pointers[i];
+		scaler->dst_frame->linesize[i] = scaler->dst_linesizes[i];
+	}
+
+	return true;
+}
+#endif
+
 int video_scaler_create(video_scaler_t **scaler_out,
 			const struct video_scale_info *dst,
 			const struct video_scale_info *src,
 			enum video_scale_type type)
+{
+	return video_scaler_create_threaded(scaler_out, dst, src, type, 1);
+}
+
+int video_scaler_create_threaded(video_scaler_t **scaler_out,
+				 const struct video_scale_info *dst,
+				 const struct video_scale_info *src,
+				 enum video_scale_type type, int threads)
 {
 	enum AVPixelFormat format_src = get_ffmpeg_video_format(src->format);
 	enum AVPixelFormat format_dst = get_ffmpeg_video_format(dst->format);
@@ -144,6 +257,7 @@ int video_scaler_create(video_scaler_t **scaler_out,
 	int range_src = get_ffmpeg_range_type(src->range);
 	int range_dst = get_ffmpeg_range_type(dst->range);
 	struct video_scaler *scaler;
+	int dst_size;
 	int ret;
 
 	if (!scaler_out)
@@ -152,8 +266,14 @@ int video_scaler_create(video_scaler_t **scaler_out,
 	if (format_src == AV_PIX_FMT_NONE || format_dst == AV_PIX_FMT_NONE)
 		return VIDEO_SCALER_BAD_CONVERSION;
 
+	if (threads <= 0)
+		threads = get_auto_threads(dst, src);
+	if (!SWS_SLICE_THREADS)
+		threads = 1;
+
 	scaler = bzalloc(sizeof(struct video_scaler));
 	scaler->src_height = src->height;
+	scaler->threads = threads;
 
 	const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format_dst);
 	bool has_plane[4] = {0};
@@ -177,10 +297,27 @@ int video_scaler_create(video_scaler_t **scaler_out,
 		goto fail;
 	}
 
-	scaler->swscale = sws_getCachedContext(NULL, src->width, src->height,
-					       format_src, dst->width,
-					       dst->height, format_dst,
-					       scale_type, NULL, NULL, NULL);
+	dst_size = ret;
+
+#if SWS_SLICE_THREADS
+	if (threads > 1) {
+		scaler->swscale = create_threaded_context(dst, src, format_dst,
+							  format_src,
+							  scale_type, threads);
+		if (scaler->swscale &&
+		    !init_frames(scaler, dst, src, format_dst, format_src,
+				 dst_size)) {
+			blog(LOG_ERROR, "video_scaler_create: Could not "
+					"allocate frames");
+			goto fail;
+		}
+	} else
+#endif
+	{
+		scaler->swscale = sws_getCachedContext(
+			NULL, src->width, src->height, format_src, dst->width,
+			dst->height, format_dst, scale_type, NULL, NULL, NULL);
+	}
 	if (!scaler->swscale) {
 		blog(LOG_ERROR, "video_scaler_create: Could not create "
 				"swscale");
@@ -206,6 +343,11 @@ fail:
 void video_scaler_destroy(video_scaler_t *scaler)
 {
 	if (scaler) {
+#if SWS_SLICE_THREADS
+		av_frame_free(&scaler->src_frame);
+		av_frame_free(&scaler->dst_frame);
+		av_buffer_unref(&scaler->dst_buf);
+#endif
 		sws_freeContext(scaler->swscale);
 
 		if (scaler->dst_pointers[0])
@@ -215,6 +357,44 @@ void video_scaler_destroy(video_scaler_t *scaler)
 	}
 }
 
+int video_scaler_get_threads(const video_scaler_t *scaler)
+{
+	return scaler ? scaler->threads : 0;
+}
+
+#if SWS_SLICE_THREADS
+/* the frame based API runs the slices on swscale's worker threads.  the
+ * input planes are wrapped without copying, they only need to stay valid
+ * until sws_scale_frame returns */
+static int scale_threaded(struct video_scaler *scaler,
+			  const uint8_t *const input[],
+			  const uint32_t in_linesize[])
+{
+	AVFrame *src = scaler->src_frame;
+	AVFrame *dst = scaler->dst_frame;
+	int ret;
+
+	for (size_t i = 0; i < 4; i++) {
+		src->data[i] = (uint8_t *)input[i];
+		src->linesize[i] = (int)in_linesize[i];
+	}
+
+	src->buf[0] = av_buffer_create(src->data[0],
+				       src->linesize[0] * scaler->src_height,
+				       noop_free, NULL, 0);
+	dst->buf[0] = av_buffer_ref(scaler->dst_buf);
+	if (!src->buf[0] || !dst->buf[0]) {
+		ret = AVERROR(ENOMEM);
+	} else {
+		ret = sws_scale_frame(scaler->swscale, dst, src);
+	}
+
+	av_buffer_unref(&src->buf[0]);
+	av_buffer_unref(&dst->buf[0]);
+	return ret;
+}
+#endif
+
 bool video_scaler_scale(video_scaler_t *scaler, uint8_t *output[],
 			const uint32_t out_linesize[],
 			const uint8_t *const input[],
@@ -223,10 +403,19 @@ bool video_scaler_scale(video_scaler_t *scaler, uint8_t *output[],
 	if (!scaler)
 		return false;
 
+#if SWS_SLICE_THREADS
+	int ret = scaler->threads > 1
+			  ? scale_threaded(scaler, input, in_linesize)
+			  : sws_scale(scaler->swscale, input,
+				      (const int *)in_linesize, 0,
+				      scaler->src_height, scaler->dst_pointers,
+				      scaler->dst_linesizes);
+#else
 	int ret = sws_scale(scaler->swscale, input, (const int *)in_linesize, 0,
 			    scaler->src_height, scaler->dst_pointers,
 			    scaler->dst_linesizes);
-	if (ret <= 0) {
+#endif
+	if (ret < 0 || (ret == 0 && scaler->threads == 1)) {
 		blog(LOG_ERROR, "video_scaler_scale: sws_scale failed: %d",
 		     ret);
 		return false;
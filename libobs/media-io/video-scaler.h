@@ -35,8 +35,26 @@ EXPORT int video_scaler_create(video_scaler_t **scaler,
 			       const struct video_scale_info *dst,
 			       const struct video_scale_info *src,
 			       enum video_scale_type type);
+
+/* thread count used by video_scaler_create_threaded when threads is 0 */
+#define VIDEO_SCALER_AUTO_THREADS 4
+
+/**
+ * Creates a scaler that splits each frame into horizontal slices processed in
+ * parallel, when supported by the FFmpeg version in use.  A thread count of 0
+ * picks one based on the frame size and CPU, 1 is the same as
+ * video_scaler_create.
+ */
+EXPORT int video_scaler_create_threaded(video_scaler_t **scaler,
+					const struct video_scale_info *dst,
+					const struct video_scale_info *src,
+					enum video_scale_type type,
+					int threads);
 EXPORT void video_scaler_destroy(video_scaler_t *scaler);
 
+/** Returns the number of threads the scaler actually uses */
+EXPORT int video_scaler_get_threads(const video_scaler_t *scaler);
+
 EXPORT bool video_scaler_scale(video_scaler_t *scaler, uint8_t *output[],
 			       const uint32_t out_linesize[],
 			       const uint8_t *const input[],
@@ -18,6 +18,13 @@
 #include <inttypes.h>
 #include "obs-internal.h"
 #include "util/util_uint64.h"
+#include "media-io/audio-simd.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <avrt.h>
+#endif
 
 struct ts_info {
 	uint64_t start;
@@ -40,17 +47,102 @@ static void push_audio_tree(obs_source_t *parent, obs_source_t *source, void *p)
 	UNUSED_PARAMETER(parent);
 }
 
+static inline void release_audio_sources(struct obs_core_audio *audio)
+{
+	for (size_t i = 0; i < audio->render_order.num; i++)
+		obs_source_release(audio->render_order.array[i]);
+}
+
+static void build_render_order(struct obs_core_audio *audio,
+			       struct obs_core_data *data)
+{
+	for (uint32_t i = 0; i < MAX_CHANNELS; i++) {
+		obs_source_t *source = obs_get_output_source(i);
+		if (source) {
+			obs_source_enum_active_tree(source, push_audio_tree,
+						    audio);
+			push_audio_tree(NULL, source, audio);
+			da_push_back(audio->root_nodes, &source);
+			obs_source_release(source);
+		}
+	}
+
+	pthread_mutex_lock(&data->audio_sources_mutex);
+
+	struct obs_source *source = data->first_audio_source;
+	while (source) {
+		push_audio_tree(NULL, source, audio);
+		source = (struct obs_source *)source->next_audio_source;
+	}
+
+	pthread_mutex_unlock(&data->audio_sources_mutex);
+}
+
+static void cache_render_order(struct obs_core_audio *audio, long version)
+{
+	for (size_t i = 0; i < audio->render_order_cache.num; i++)
+		obs_weak_source_release(audio->render_order_cache.array[i]);
+	da_resize(audio->render_order_cache, 0);
+	da_resize(audio->root_nodes_cache, 0);
+
+	for (size_t i = 0; i < audio->render_order.num; i++) {
+		obs_source_t *source = audio->render_order.array[i];
+		obs_weak_source_t *weak = obs_source_get_weak_source(source);
+		da_push_back(audio->render_order_cache, &weak);
+	}
+
+	/* root nodes are always part of the render order */
+	for (size_t i = 0; i < audio->root_nodes.num; i++) {
+		size_t idx = da_find(audio->render_order,
+				     &audio->root_nodes.array[i], 0);
+		da_push_back(audio->root_nodes_cache, &idx);
+	}
+
+	audio->render_order_version = version;
+	audio->render_order_cached = true;
+}
+
+/* fills render_order and root_nodes from the cache, fails if the graph
+ * changed or a cached source is being destroyed */
+static bool use_cached_render_order(struct obs_core_audio *audio,
+				    long version)
+{
+	if (!audio->render_order_cached ||
+	    audio->render_order_version != version)
+		return false;
+
+	for (size_t i = 0; i < audio->render_order_cache.num; i++) {
+		obs_source_t *source = obs_weak_source_get_source(
+			audio->render_order_cache.array[i]);
+		if (!source) {
+			release_audio_sources(audio);
+			da_resize(audio->render_order, 0);
+			return false;
+		}
+
+		da_push_back(audio->render_order, &source);
+	}
+
+	for (size_t i = 0; i < audio->root_nodes_cache.num; i++) {
+		size_t idx = audio->root_nodes_cache.array[i];
+		obs_source_t *source = audio->render_order.array[idx];
+		da_push_back(audio->root_nodes, &source);
+	}
+
+	return true;
+}
+
 static inline size_t convert_time_to_frames(size_t sample_rate, uint64_t t)
 {
 	return (size_t)util_mul_div64(t, sample_rate, 1000000000ULL);
 }
 
 static inline void mix_audio(struct audio_output_data *mixes,
-			     obs_source_t *source, size_t channels,
-			     size_t sample_rate, struct ts_info *ts,
-			     float *vol_data, bool *muted)
+			     obs_source_t *source, uint32_t mixers,
+			     size_t channels, size_t sample_rate, size_t frames,
+			     struct ts_info *ts, float *vol_data, bool *muted)
 {
-	size_t total_floats = AUDIO_OUTPUT_FRAMES;
+	size_t total_floats = frames;
 	size_t start_point = 0;
 
 	if (!(obs_source_get_sends(source)) || source->audio_ts < ts->start ||
@@ -60,41 +152,46 @@ static inline void mix_audio(struct audio_output_data *mixes,
 	if (source->audio_ts != ts->start) {
 		start_point = convert_time_to_frames(
 			sample_rate, source->audio_ts - ts->start);
-		if (start_point == AUDIO_OUTPUT_FRAMES)
+		if (start_point >= frames)
 			return;
 
 		total_floats -= start_point;
 	}
 
+	/* sources without a custom audio render callback leave the mixes they
+	 * do not send to silent, so those can be skipped as well */
+	if (!source->info.audio_render)
+		mixers &= source->audio_mixers;
+
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
-		for (size_t ch = 0; ch < channels; ch++) {
-			register float *mix = mixes[mix_idx].data[ch];
-			register float *aud =
-				source->audio_output_buf[mix_idx][ch];
-			register float *end;
+		if ((mixers & (1 << mix_idx)) == 0)
+			continue;
+
+		float gain = muted[mix_idx] ? 0.0f : vol_data[mix_idx];
 
-			mix += start_point;
-			end = aud + total_floats;
+		for (size_t ch = 0; ch < channels; ch++) {
+			float *mix = mixes[mix_idx].data[ch] + start_point;
+			float *aud = source->audio_output_buf[mix_idx][ch];
 
-			float gain = muted[mix_idx] ? 0.0f : vol_data[mix_idx];
-			while (aud < end)
-				*(mix++) += *(aud++) * gain;
+			audio_simd_mix(mix, aud, gain, total_floats);
 		}
 	}
 }
 
 static inline void process_gain(struct audio_output_data *mixes,
-				size_t channels, float *vol_data, bool *muted)
+				uint32_t mixers, size_t channels, size_t frames,
+				float *vol_data, bool *muted)
 {
-	size_t total_floats = AUDIO_OUTPUT_FRAMES;
+	size_t total_floats = frames;
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
-		for (size_t ch = 0; ch < channels; ch++) {
-			register float *mix = mixes[mix_idx].data[ch];
-			register float *end = mix + total_floats;
-			float gain = muted[mix_idx] ? 0.0f : vol_data[mix_idx];
-			while (mix < end)
-				*(mix++) *= gain;
-		}
+		if ((mixers & (1 << mix_idx)) == 0)
+			continue;
+
+		float gain = muted[mix_idx] ? 0.0f : vol_data[mix_idx];
+
+		for (size_t ch = 0; ch < channels; ch++)
+			audio_simd_gain(mixes[mix_idx].data[ch], gain,
+					total_floats);
 	}
 }
 
@@ -210,16 +307,12 @@ static bool discard_if_stopped(obs_source_t *source, size_t channels)
 	}
 }
 
-#define MAX_AUDIO_SIZE (AUDIO_OUTPUT_FRAMES * sizeof(float))
-
 static inline void discard_audio(struct obs_core_audio *audio,
 				 obs_source_t *source, size_t channels,
 				 size_t sample_rate, struct ts_info *ts)
 {
-	size_t total_floats = AUDIO_OUTPUT_FRAMES;
+	size_t total_floats = audio->frames_per_tick;
 	size_t size;
-	/* debug assert only */
-	UNUSED_PARAMETER(audio);
 
 #if DEBUG_AUDIO == 1
 	bool is_audio_source = source->info.output_flags & OBS_SOURCE_AUDIO;
@@ -243,7 +336,8 @@ static inline void discard_audio(struct obs_core_audio *audio,
 
 	if (source->audio_ts < (ts->start - 1)) {
 		if (source->audio_pending &&
-		    source->audio_input_buf[0].size < MAX_AUDIO_SIZE &&
+		    source->audio_input_buf[0].size <
+			    audio->frames_per_tick * sizeof(float) &&
 		    discard_if_stopped(source, channels))
 			return;
 
@@ -270,7 +364,7 @@ static inline void discard_audio(struct obs_core_audio *audio,
 	    source->audio_ts != (ts->start - 1)) {
 		size_t start_point = convert_time_to_frames(
 			sample_rate, source->audio_ts - ts->start);
-		if (start_point == AUDIO_OUTPUT_FRAMES) {
+		if (start_point >= audio->frames_per_tick) {
 #if DEBUG_AUDIO == 1
 			if (is_audio_source)
 				blog(LOG_DEBUG, "can't discard, start point is "
@@ -332,9 +426,9 @@ static void set_fixed_audio_buffering(struct obs_core_audio *audio,
 	ticks = audio->max_buffering_ticks - audio->total_buffering_ticks;
 	audio->total_buffering_ticks += ticks;
 
-	ms = ticks * AUDIO_OUTPUT_FRAMES * 1000 / sample_rate;
-	total_ms = audio->total_buffering_ticks * AUDIO_OUTPUT_FRAMES * 1000 /
-		   sample_rate;
+	ms = ticks * audio->frames_per_tick * 1000 / sample_rate;
+	total_ms = audio->total_buffering_ticks * audio->frames_per_tick *
+		   1000 / sample_rate;
 
 	blog(LOG_INFO,
 	     "\n"
@@ -346,7 +440,7 @@ static void set_fixed_audio_buffering(struct obs_core_audio *audio,
 	new_ts.start =
 		audio->buffered_ts -
 		audio_frames_to_ns(sample_rate, audio->buffering_wait_ticks *
-							AUDIO_OUTPUT_FRAMES);
+							audio->frames_per_tick);
 
 	while (ticks--) {
 		const uint64_t cur_ticks = ++audio->buffering_wait_ticks;
@@ -355,7 +449,7 @@ static void set_fixed_audio_buffering(struct obs_core_audio *audio,
 		new_ts.start =
 			audio->buffered_ts -
 			audio_frames_to_ns(sample_rate,
-					   cur_ticks * AUDIO_OUTPUT_FRAMES);
+					   cur_ticks * audio->frames_per_tick);
 
 #if DEBUG_AUDIO == 1
 		blog(LOG_DEBUG, "add buffered ts: %" PRIu64 "-%" PRIu64,
@@ -388,7 +482,8 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 
 	offset = ts->start - min_ts;
 	frames = ns_to_audio_frames(sample_rate, offset);
-	ticks = (int)((frames + AUDIO_OUTPUT_FRAMES - 1) / AUDIO_OUTPUT_FRAMES);
+	ticks = (int)((frames + audio->frames_per_tick - 1) /
+		      audio->frames_per_tick);
 
 	audio->total_buffering_ticks += ticks;
 
@@ -399,9 +494,9 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 		blog(LOG_WARNING, "Max audio buffering reached!");
 	}
 
-	ms = ticks * AUDIO_OUTPUT_FRAMES * 1000 / sample_rate;
-	total_ms = audio->total_buffering_ticks * AUDIO_OUTPUT_FRAMES * 1000 /
-		   sample_rate;
+	ms = ticks * audio->frames_per_tick * 1000 / sample_rate;
+	total_ms = audio->total_buffering_ticks * audio->frames_per_tick *
+		   1000 / sample_rate;
 
 	blog(LOG_INFO,
 	     "adding %d milliseconds of audio buffering, total "
@@ -420,7 +515,7 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 	new_ts.start =
 		audio->buffered_ts -
 		audio_frames_to_ns(sample_rate, audio->buffering_wait_ticks *
-							AUDIO_OUTPUT_FRAMES);
+							audio->frames_per_tick);
 
 	while (ticks--) {
 		const uint64_t cur_ticks = ++audio->buffering_wait_ticks;
@@ -429,7 +524,7 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 		new_ts.start =
 			audio->buffered_ts -
 			audio_frames_to_ns(sample_rate,
-					   cur_ticks * AUDIO_OUTPUT_FRAMES);
+					   cur_ticks * audio->frames_per_tick);
 
 #if DEBUG_AUDIO == 1
 		blog(LOG_DEBUG, "add buffered ts: %" PRIu64 "-%" PRIu64,
@@ -444,9 +539,10 @@ static void add_audio_buffering(struct obs_core_audio *audio,
 }
 
 static bool audio_buffer_insuffient(struct obs_source *source,
-				    size_t sample_rate, uint64_t min_ts)
+				    size_t sample_rate, size_t frames,
+				    uint64_t min_ts)
 {
-	size_t total_floats = AUDIO_OUTPUT_FRAMES;
+	size_t total_floats = frames;
 	size_t size;
 
 	if (source->info.audio_render || source->audio_pending ||
@@ -457,7 +553,7 @@ static bool audio_buffer_insuffient(struct obs_source *source,
 	if (source->audio_ts != min_ts && source->audio_ts != (min_ts - 1)) {
 		size_t start_point = convert_time_to_frames(
 			sample_rate, source->audio_ts - min_ts);
-		if (start_point >= AUDIO_OUTPUT_FRAMES)
+		if (start_point >= frames)
 			return false;
 
 		total_floats -= start_point;
@@ -491,14 +587,15 @@ static inline const char *find_min_ts(struct obs_core_data *data,
 }
 
 static inline bool mark_invalid_sources(struct obs_core_data *data,
-					size_t sample_rate, uint64_t min_ts)
+					size_t sample_rate, size_t frames,
+					uint64_t min_ts)
 {
 	bool recalculate = false;
 
 	struct obs_source *source = data->first_audio_source;
 	while (source) {
-		recalculate |=
-			audio_buffer_insuffient(source, sample_rate, min_ts);
+		recalculate |= audio_buffer_insuffient(source, sample_rate,
+						       frames, min_ts);
 		source = (struct obs_source *)source->next_audio_source;
 	}
 
@@ -506,18 +603,34 @@ static inline bool mark_invalid_sources(struct obs_core_data *data,
 }
 
 static inline const char *calc_min_ts(struct obs_core_data *data,
-				      size_t sample_rate, uint64_t *min_ts)
+				      size_t sample_rate, size_t frames,
+				      uint64_t *min_ts)
 {
 	const char *buffering_name = find_min_ts(data, min_ts);
-	if (mark_invalid_sources(data, sample_rate, *min_ts))
+	if (mark_invalid_sources(data, sample_rate, frames, *min_ts))
 		buffering_name = find_min_ts(data, min_ts);
 	return buffering_name;
 }
 
-static inline void release_audio_sources(struct obs_core_audio *audio)
+/* a track that is being monitored still has to be mixed and run through its
+ * filters even if no output is connected to it */
+static inline void update_pinned_mixes(struct obs_core_audio *audio,
+				       struct obs_core_data *data)
 {
-	for (size_t i = 0; i < audio->render_order.num; i++)
-		obs_source_release(audio->render_order.array[i]);
+	uint32_t pinned = 0;
+
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		obs_source_t *track =
+			(obs_source_t *)data->audio_mixes.tracks[i];
+
+		if (track && track->monitoring_type != OBS_MONITORING_TYPE_NONE)
+			pinned |= (1 << i);
+	}
+
+	if (pinned != audio->pinned_mixes) {
+		audio->pinned_mixes = pinned;
+		audio_output_set_pinned_mixes(audio->audio, pinned);
+	}
 }
 
 static inline void execute_audio_tasks(void)
@@ -537,6 +650,208 @@ static inline void execute_audio_tasks(void)
 	}
 }
 
+/* ------------------------------------------------------------------------- */
+/* track filters                                                             */
+
+static void process_track_job(struct audio_track_job *job)
+{
+	struct obs_audio_data *o;
+	size_t size = job->audio.frames * sizeof(float);
+
+	o = obs_source_output_audio_track(job->track, &job->audio);
+
+	for (size_t j = 0; j < job->channels; j++) {
+		if (o) {
+			memcpy(job->out[j], o->data[j], size);
+			memcpy(job->mix->data[j], o->data[j], size);
+
+			/* Mute output */
+		} else {
+			memset(job->out[j], 0, size);
+			memset(job->mix->data[j], 0, size);
+		}
+	}
+}
+
+static void *audio_track_thread(void *param)
+{
+#ifdef _WIN32
+	DWORD unused = 0;
+	const HANDLE handle = AvSetMmThreadCharacteristics(L"Audio", &unused);
+#endif
+
+	struct audio_track_worker *worker = param;
+	struct audio_track_pool *pool = worker->pool;
+
+	os_set_thread_name("libobs: audio track filter thread");
+
+	while (os_sem_wait(worker->start) == 0) {
+		if (os_atomic_load_bool(&pool->stop))
+			break;
+
+		/* the audio thread waits for the workers every tick, so they
+		 * need its priority or they would hold it up under load */
+		if (!worker->scheduled) {
+			if (!os_copy_thread_scheduling(pool->audio_thread))
+				blog(LOG_DEBUG,
+				     "audio track filters: could not get "
+				     "real-time scheduling");
+			worker->scheduled = true;
+		}
+
+		profile_start(worker->profile_name);
+
+		for (size_t i = 0; i < worker->num_jobs; i++)
+			process_track_job(worker->jobs[i]);
+
+		profile_end(worker->profile_name);
+
+		if (os_atomic_dec_long(&pool->workers_remaining) == 0)
+			os_event_signal(pool->done_event);
+
+		profile_reenable_thread();
+	}
+
+#ifdef _WIN32
+	if (handle)
+		AvRevertMmThreadCharacteristics(handle);
+#endif
+
+	return NULL;
+}
+
+/* jobs are spread over the audio thread and the workers, the audio thread
+ * takes the first one and then waits until every worker has finished */
+static void run_track_jobs(struct audio_track_pool *pool, size_t num_jobs)
+{
+	size_t executors = pool->num_workers + 1;
+	size_t used_workers;
+	size_t own_jobs = 0;
+	struct audio_track_job *own[MAX_AUDIO_MIXES];
+
+	if (!pool->audio_thread_known) {
+		pool->audio_thread = pthread_self();
+		pool->audio_thread_known = true;
+	}
+
+	for (size_t i = 0; i < pool->num_workers; i++)
+		pool->workers[i].num_jobs = 0;
+
+	for (size_t i = 0; i < num_jobs; i++) {
+		size_t executor = i % executors;
+
+		if (executor == 0) {
+			own[own_jobs++] = &pool->jobs[i];
+		} else {
+			struct audio_track_worker *w =
+				&pool->workers[executor - 1];
+			w->jobs[w->num_jobs++] = &pool->jobs[i];
+		}
+	}
+
+	used_workers = num_jobs > executors ? executors - 1 : num_jobs - 1;
+	os_atomic_set_long(&pool->workers_remaining, (long)used_workers);
+
+	for (size_t i = 0; i < used_workers; i++)
+		os_sem_post(pool->workers[i].start);
+
+	for (size_t i = 0; i < own_jobs; i++)
+		process_track_job(own[i]);
+
+	if (used_workers)
+		os_event_wait(pool->done_event);
+}
+
+bool audio_track_pool_init(struct audio_track_pool *pool, size_t channels,
+			   uint64_t tick_ns)
+{
+	int cores = os_get_logical_cores();
+	size_t num_workers = cores > 1 ? (size_t)cores - 1 : 0;
+
+	if (num_workers > MAX_AUDIO_MIXES - 1)
+		num_workers = MAX_AUDIO_MIXES - 1;
+
+	pool->out_data = bmalloc(MAX_AUDIO_MIXES * channels *
+				 AUDIO_OUTPUT_FRAMES * sizeof(float));
+
+	for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+		struct audio_track_job *job = &pool->jobs[i];
+		size_t offset = i * channels * AUDIO_OUTPUT_FRAMES;
+
+		for (size_t j = 0; j < channels; j++)
+			job->out[j] = pool->out_data + offset +
+				      j * AUDIO_OUTPUT_FRAMES;
+		job->channels = channels;
+	}
+
+	if (os_event_init(&pool->done_event, OS_EVENT_TYPE_AUTO) != 0) {
+		bfree(pool->out_data);
+		pool->out_data = NULL;
+		return false;
+	}
+
+	for (size_t i = 0; i < num_workers; i++) {
+		struct audio_track_worker *worker = &pool->workers[i];
+
+		worker->pool = pool;
+		worker->profile_name =
+			profile_store_name(obs_get_profiler_name_store(),
+					   "audio_track_thread(%d)", (int)i);
+		profile_register_root(worker->profile_name, tick_ns);
+
+		if (os_sem_init(&worker->start, 0) != 0)
+			break;
+		if (pthread_create(&worker->thread, NULL, audio_track_thread,
+				   worker) != 0) {
+			os_sem_destroy(worker->start);
+			break;
+		}
+
+		pool->num_workers++;
+	}
+
+	blog(LOG_INFO, "audio track filters: %d worker thread(s)",
+	     (int)pool->num_workers);
+	return true;
+}
+
+void audio_track_pool_free(struct audio_track_pool *pool)
+{
+	os_atomic_set_bool(&pool->stop, true);
+
+	for (size_t i = 0; i < pool->num_workers; i++) {
+		struct audio_track_worker *worker = &pool->workers[i];
+
+		os_sem_post(worker->start);
+		pthread_join(worker->thread, NULL);
+		os_sem_destroy(worker->start);
+	}
+
+	os_event_destroy(pool->done_event);
+	bfree(pool->out_data);
+	memset(pool, 0, sizeof(*pool));
+}
+
+/* ------------------------------------------------------------------------- */
+
+static const char *render_audio_name = "render_audio";
+static const char *mix_audio_name = "mix_audio";
+static const char *track_filters_name = "audio_track_filters";
+
+static void record_stage_times(struct obs_core_audio *audio,
+			       const uint64_t *stage_ns)
+{
+	pthread_mutex_lock(&audio->stats_mutex);
+	for (size_t i = 0; i < OBS_AUDIO_STAGE_OUTPUT; i++) {
+		struct audio_stage_stats *stage = &audio->stage_stats[i];
+
+		stage->total_ns += stage_ns[i];
+		if (stage_ns[i] > stage->max_ns)
+			stage->max_ns = stage_ns[i];
+	}
+	pthread_mutex_unlock(&audio->stats_mutex);
+}
+
 bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 		    uint64_t *out_ts, uint32_t mixers,
 		    struct audio_output_data *mixes)
@@ -547,8 +862,11 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 	const struct audio_output_info *obs_info;
 	size_t sample_rate = audio_output_get_sample_rate(audio->audio);
 	size_t channels = audio_output_get_channels(audio->audio);
+	size_t frames = audio->frames_per_tick;
 	obs_info = audio_output_get_info(audio->audio);
 	struct ts_info ts = {start_ts_in, end_ts_in};
+	uint64_t stage_ns[OBS_AUDIO_STAGE_OUTPUT] = {0};
+	uint64_t stage_start;
 	size_t audio_size;
 	uint64_t min_ts;
 
@@ -559,7 +877,7 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 	circlebuf_peek_front(&audio->buffered_timestamps, &ts, sizeof(ts));
 	min_ts = ts.start;
 
-	audio_size = AUDIO_OUTPUT_FRAMES * sizeof(float);
+	audio_size = frames * sizeof(float);
 
 #if DEBUG_AUDIO == 1
 	blog(LOG_DEBUG, "ts %llu-%llu", ts.start, ts.end);
@@ -568,31 +886,21 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 	/* ------------------------------------------------ */
 	/* build audio render order
 	 * NOTE: these are source channels, not audio channels */
-	for (uint32_t i = 0; i < MAX_CHANNELS; i++) {
-		obs_source_t *source = obs_get_output_source(i);
-		if (source) {
-			obs_source_enum_active_tree(source, push_audio_tree,
-						    audio);
-			push_audio_tree(NULL, source, audio);
-			da_push_back(audio->root_nodes, &source);
-			obs_source_release(source);
-		}
-	}
-
-	pthread_mutex_lock(&data->audio_sources_mutex);
+	long graph_version = os_atomic_load_long(&audio->graph_version);
 
-	source = data->first_audio_source;
-	while (source) {
-		push_audio_tree(NULL, source, audio);
-		source = (struct obs_source *)source->next_audio_source;
+	if (!use_cached_render_order(audio, graph_version)) {
+		build_render_order(audio, data);
+		cache_render_order(audio, graph_version);
 	}
 
-	pthread_mutex_unlock(&data->audio_sources_mutex);
-
 	/* ------------------------------------------------ */
 	/* render audio data */
+	stage_start = os_gettime_ns();
+	profile_start(render_audio_name);
+
 	for (size_t i = 0; i < audio->render_order.num; i++) {
 		obs_source_t *source = audio->render_order.array[i];
+		obs_source_drain_audio_input(source, channels);
 		obs_source_audio_render(source, mixers, channels, sample_rate,
 					audio_size);
 
@@ -613,11 +921,9 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 				assert(false);
 #endif
 			} else {
-				pthread_mutex_lock(&source->audio_buf_mutex);
 				bool rerender = ignore_audio(source, channels,
 							     sample_rate,
 							     ts.start);
-				pthread_mutex_unlock(&source->audio_buf_mutex);
 
 				/* if we (potentially) recovered, re-render */
 				if (rerender)
@@ -629,10 +935,14 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 		}
 	}
 
+	profile_end(render_audio_name);
+	stage_ns[OBS_AUDIO_STAGE_RENDER] = os_gettime_ns() - stage_start;
+
 	/* ------------------------------------------------ */
 	/* get minimum audio timestamp */
 	pthread_mutex_lock(&data->audio_sources_mutex);
-	const char *buffering_name = calc_min_ts(data, sample_rate, &min_ts);
+	const char *buffering_name = calc_min_ts(data, sample_rate, frames,
+						 &min_ts);
 	pthread_mutex_unlock(&data->audio_sources_mutex);
 
 	/* ------------------------------------------------ */
@@ -649,66 +959,73 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 	/* ------------------------------------------------ */
 	/* mix audio */
 	if (!audio->buffering_wait_ticks) {
+		stage_start = os_gettime_ns();
+		profile_start(mix_audio_name);
+
 		for (size_t i = 0; i < audio->root_nodes.num; i++) {
 			obs_source_t *source = audio->root_nodes.array[i];
 
 			if (source->audio_pending)
 				continue;
 
-			pthread_mutex_lock(&source->audio_buf_mutex);
-
 			if (source->audio_output_buf[0][0] && source->audio_ts)
-				mix_audio(mixes, source, channels, sample_rate,
-					  &ts, &data->audio_mixes.volume[0],
+				mix_audio(mixes, source, mixers, channels,
+					  sample_rate, frames, &ts,
+					  &data->audio_mixes.volume[0],
 					  &data->audio_mixes.muted[0]);
-
-			pthread_mutex_unlock(&source->audio_buf_mutex);
 		}
 
-		struct audio_data audio_out = obs_info->audio_out;
-		audio_out.timestamp = start_ts_in;
+		profile_end(mix_audio_name);
+		stage_ns[OBS_AUDIO_STAGE_MIX] = os_gettime_ns() - stage_start;
+
+		/* run the track filter chains, each track is independent so
+		 * they are processed in parallel */
+		stage_start = os_gettime_ns();
+		profile_start(track_filters_name);
+
+		struct audio_track_pool *pool = &audio->track_pool;
+		size_t num_jobs = 0;
 
-		struct obs_audio_data *o = NULL;
 		for (size_t i = 0; i < MAX_AUDIO_MIXES; i++) {
+			if ((mixers & (1 << i)) == 0)
+				continue;
+
+			struct audio_track_job *job = &pool->jobs[num_jobs++];
+			struct obs_source_audio *s = &job->audio;
+
+			/* the track copies its input before filtering, so it
+			 * can read straight from the mix */
+			s->format = obs_info->format;
+			s->frames = (uint32_t)frames;
+			s->samples_per_sec = (uint32_t)sample_rate;
+			s->speakers = obs_info->speakers;
+			s->timestamp = start_ts_in;
 			for (size_t j = 0; j < channels; j++)
-				memcpy(audio_out.data[j], mixes[i].data[j],
-				       AUDIO_OUTPUT_FRAMES * sizeof(float));
-			struct obs_source_audio s;
-			s.format = obs_info->format;
-			s.frames = AUDIO_OUTPUT_FRAMES;
-			s.samples_per_sec = (uint32_t)sample_rate;
-			s.speakers = obs_info->speakers;
-			s.timestamp = start_ts_in;
-			for (size_t j = 0; j < channels; j++)
-				s.data[j] = audio_out.data[j];
+				s->data[j] = (const uint8_t *)mixes[i].data[j];
 			for (size_t j = channels; j < MAX_AV_PLANES; j++)
-				s.data[j] = NULL;
-
-			o = obs_source_output_audio_track(
-				(obs_source_t *)data->audio_mixes.tracks[i],
-				&s);
-
-			if (o) {
-				for (size_t j = 0; j < channels; j++) {
-					memcpy(audio_out.data[j], o->data[j],
-					       AUDIO_OUTPUT_FRAMES *
-						       sizeof(float));
-					memcpy(mixes[i].data[j], o->data[j],
-					       AUDIO_OUTPUT_FRAMES *
-						       sizeof(float));
-				}
-
-				/* Mute output */
-			} else {
-				for (size_t j = 0; j < channels; j++) {
-					memset(audio_out.data[j], 0,
-					       AUDIO_OUTPUT_FRAMES *
-						       sizeof(float));
-					memset(mixes[i].data[j], 0,
-					       AUDIO_OUTPUT_FRAMES *
-						       sizeof(float));
-				}
-			}
+				s->data[j] = NULL;
+
+			job->track =
+				(obs_source_t *)data->audio_mixes.tracks[i];
+			job->mix = &mixes[i];
+		}
+
+		if (num_jobs)
+			run_track_jobs(pool, num_jobs);
+
+		/* meter the filtered tracks */
+		struct audio_data audio_out = {0};
+		audio_out.frames = (uint32_t)frames;
+		audio_out.timestamp = start_ts_in;
+
+		for (size_t i = 0, job_idx = 0; i < MAX_AUDIO_MIXES; i++) {
+			if ((mixers & (1 << i)) == 0)
+				continue;
+
+			struct audio_track_job *job = &pool->jobs[job_idx++];
+			for (size_t j = 0; j < channels; j++)
+				audio_out.data[j] = (uint8_t *)job->out[j];
+
 			obs_audio_mix_lock();
 			volmeter_data_received(data->audio_mixes.meters[i],
 					       &audio_out,
@@ -716,9 +1033,16 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 			obs_audio_mix_unlock();
 		}
 
+		profile_end(track_filters_name);
+		stage_ns[OBS_AUDIO_STAGE_TRACK_FILTERS] =
+			os_gettime_ns() - stage_start;
+
 		/* Process Gain */
-		process_gain(mixes, channels, &data->audio_mixes.volume[0],
+		stage_start = os_gettime_ns();
+		process_gain(mixes, mixers, channels, frames,
+			     &data->audio_mixes.volume[0],
 			     &data->audio_mixes.muted[0]);
+		stage_ns[OBS_AUDIO_STAGE_MIX] += os_gettime_ns() - stage_start;
 	}
 
 	/* ------------------------------------------------ */
@@ -727,9 +1051,7 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 
 	source = data->first_audio_source;
 	while (source) {
-		pthread_mutex_lock(&source->audio_buf_mutex);
 		discard_audio(audio, source, channels, sample_rate, &ts);
-		pthread_mutex_unlock(&source->audio_buf_mutex);
 
 		source = (struct obs_source *)source->next_audio_source;
 	}
@@ -742,6 +1064,12 @@ bool audio_callback(void *param, uint64_t start_ts_in, uint64_t end_ts_in,
 
 	circlebuf_pop_front(&audio->buffered_timestamps, NULL, sizeof(ts));
 
+	/* ------------------------------------------------ */
+	/* keep monitored tracks alive for the next tick    */
+	update_pinned_mixes(audio, data);
+
+	record_stage_times(audio, stage_ns);
+
 	*out_ts = ts.start;
 
 	if (audio->buffering_wait_ticks) {
@@ -19,6 +19,7 @@
 
 #include "obs.h"
 #include "obs-nal.h"
+#include "obs-internal.h"
 #include "util/array-serializer.h"
 
 bool obs_avc_keyframe(const uint8_t *data, size_t size)
@@ -56,11 +57,14 @@ static inline int get_drop_priority(int priority)
 	return priority;
 }
 
-static void serialize_avc_data(struct serializer *s, const uint8_t *data,
-			       size_t size, bool *is_keyframe, int *priority)
+/* converts the start codes to 4 byte sizes.  returns the size of the
+ * result, which is only measured if out is NULL */
+static size_t convert_avc_data(uint8_t *out, const uint8_t *data, size_t size,
+			       bool *is_keyframe, int *priority)
 {
 	const uint8_t *nal_start, *nal_end;
 	const uint8_t *end = data + size;
+	size_t out_size = 0;
 	int type;
 
 	nal_start = obs_avc_find_startcode(data, end);
@@ -81,29 +85,38 @@ static void serialize_avc_data(struct serializer *s, const uint8_t *data,
 		}
 
 		nal_end = obs_avc_find_startcode(nal_start, end);
-		s_wb32(s, (uint32_t)(nal_end - nal_start));
-		s_write(s, nal_start, nal_end - nal_start);
+
+		size_t nal_size = nal_end - nal_start;
+		if (out) {
+			uint8_t *p = out + out_size;
+			p[0] = (uint8_t)(nal_size >> 24);
+			p[1] = (uint8_t)(nal_size >> 16);
+			p[2] = (uint8_t)(nal_size >> 8);
+			p[3] = (uint8_t)nal_size;
+			memcpy(p + 4, nal_start, nal_size);
+		}
+
+		out_size += 4 + nal_size;
 		nal_start = nal_end;
 	}
+
+	return out_size;
 }
 
 void obs_parse_avc_packet(struct encoder_packet *avc_packet,
 			  const struct encoder_packet *src)
 {
-	struct array_output_data output;
-	struct serializer s;
-	long ref = 1;
-
-	array_output_serializer_init(&s, &output);
-	*avc_packet = *src;
+	struct encoder_packet parsed = *src;
+	size_t size;
 
-	serialize(&s, &ref, sizeof(ref));
-	serialize_avc_data(&s, src->data, src->size, &avc_packet->keyframe,
-			   &avc_packet->priority);
+	/* measured first so that the result can be written straight into a
+	 * packet instance from the pool of the source packet */
+	size = convert_avc_data(NULL, src->data, src->size, &parsed.keyframe,
+				&parsed.priority);
+	parsed.drop_priority = get_drop_priority(parsed.priority);
 
-	avc_packet->data = output.bytes.array + sizeof(ref);
-	avc_packet->size = output.bytes.num - sizeof(ref);
-	avc_packet->drop_priority = get_drop_priority(avc_packet->priority);
+	obs_encoder_packet_create_derived(avc_packet, &parsed, size);
+	convert_avc_data(avc_packet->data, src->data, src->size, NULL, NULL);
 }
 
 static inline bool has_start_code(const uint8_t *data)
@@ -43,6 +43,121 @@ const char *obs_encoder_get_display_name(const char *id)
 	return ei ? ei->get_name(ei->type_data) : NULL;
 }
 
+/* ------------------------------------------------------------------------- */
+/* packet storage */
+
+/* encoder packet data is preceded by this header.  packets are reference
+ * counted so that every output of an encoder shares the same data, and data
+ * allocated from an encoder's pool is recycled once all outputs are done with
+ * it, so encoding a frame costs a constant number of allocations no matter
+ * how many outputs are attached. */
+struct packet_header {
+	struct encoder_packet_pool *pool;
+	size_t capacity;
+	volatile long refs;
+};
+
+#define MAX_POOLED_PACKETS 16
+
+struct encoder_packet_pool {
+	pthread_mutex_t mutex;
+	DARRAY(struct packet_header *) free_packets;
+
+	/* one for the encoder, plus one per packet in use */
+	volatile long refs;
+};
+
+static inline struct packet_header *get_packet_header(const void *data)
+{
+	return ((struct packet_header *)data) - 1;
+}
+
+static struct encoder_packet_pool *packet_pool_create(void)
+{
+	struct encoder_packet_pool *pool = bzalloc(sizeof(*pool));
+
+	if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
+		bfree(pool);
+		return NULL;
+	}
+
+	pool->refs = 1;
+	return pool;
+}
+
+static void packet_pool_release(struct encoder_packet_pool *pool)
+{
+	if (!pool || os_atomic_dec_long(&pool->refs) != 0)
+		return;
+
+	for (size_t i = 0; i < pool->free_packets.num; i++)
+		bfree(pool->free_packets.array[i]);
+
+	da_free(pool->free_packets);
+	pthread_mutex_destroy(&pool->mutex);
+	bfree(pool);
+}
+
+static struct packet_header *packet_alloc(struct encoder_packet_pool *pool,
+					  size_t size)
+{
+	struct packet_header *header = NULL;
+
+	if (pool) {
+		pthread_mutex_lock(&pool->mutex);
+		size_t num = pool->free_packets.num;
+		if (num) {
+			header = pool->free_packets.array[num - 1];
+			da_pop_back(pool->free_packets);
+		}
+		pthread_mutex_unlock(&pool->mutex);
+
+		os_atomic_inc_long(&pool->refs);
+	}
+
+	if (!header || header->capacity < size) {
+		header = brealloc(header, sizeof(*header) + size);
+		header->capacity = size;
+	}
+
+	header->pool = pool;
+	header->refs = 1;
+	return header;
+}
+
+static void packet_free(struct packet_header *header)
+{
+	struct encoder_packet_pool *pool = header->pool;
+
+	if (!pool) {
+		bfree(header);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->mutex);
+	if (pool->free_packets.num < MAX_POOLED_PACKETS) {
+		da_push_back(pool->free_packets, &header);
+		header = NULL;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+
+	bfree(header);
+	packet_pool_release(pool);
+}
+
+static void packet_create_instance(struct encoder_packet_pool *pool,
+				   struct encoder_packet *dst,
+				   const struct encoder_packet *src)
+{
+	struct packet_header *header = packet_alloc(pool, src->size);
+
+	*dst = *src;
+	dst->data = (uint8_t *)(header + 1);
+	memcpy(dst->data, src->data, src->size);
+}
+
+/* ------------------------------------------------------------------------- */
+
 static bool init_encoder(struct obs_encoder *encoder, const char *name,
 			 obs_data_t *settings, obs_data_t *hotkey_data)
 {
@@ -63,6 +178,10 @@ static bool init_encoder(struct obs_encoder *encoder, const char *name,
 	if (pthread_mutex_init(&encoder->pause.mutex, NULL) != 0)
 		return false;
 
+	encoder->packet_pool = packet_pool_create();
+	if (!encoder->packet_pool)
+		return false;
+
 	if (encoder->orig_info.get_defaults) {
 		encoder->orig_info.get_defaults(encoder->context.settings);
 	}
@@ -266,6 +385,7 @@ static void obs_encoder_actually_destroy(obs_encoder_t *encoder)
 		if (encoder->context.data)
 			encoder->info.destroy(encoder->context.data);
 		da_free(encoder->callbacks);
+		packet_pool_release(encoder->packet_pool);
 		pthread_mutex_destroy(&encoder->init_mutex);
 		pthread_mutex_destroy(&encoder->callbacks_mutex);
 		pthread_mutex_destroy(&encoder->outputs_mutex);
@@ -869,6 +989,7 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 				    struct encoder_callback *cb,
 				    struct encoder_packet *packet)
 {
+	struct encoder_packet sei_packet;
 	struct encoder_packet first_packet;
 	DARRAY(uint8_t) data;
 	uint8_t *sei;
@@ -889,13 +1010,16 @@ static void send_first_video_packet(struct obs_encoder *encoder,
 	da_push_back_array(data, sei, size);
 	da_push_back_array(data, packet->data, packet->size);
 
-	first_packet = *packet;
-	first_packet.data = data.array;
-	first_packet.size = data.num;
+	sei_packet = *packet;
+	sei_packet.data = data.array;
+	sei_packet.size = data.num;
+	packet_create_instance(encoder->packet_pool, &first_packet,
+			       &sei_packet);
 
 	cb->new_packet(cb->param, &first_packet);
 	cb->sent_first_packet = true;
 
+	obs_encoder_packet_release(&first_packet);
 	da_free(data);
 }
 
@@ -964,10 +1088,20 @@ void send_off_encoder_packet(obs_encoder_t *encoder, bool success,
 
 		pthread_mutex_lock(&encoder->callbacks_mutex);
 
-		for (size_t i = encoder->callbacks.num; i > 0; i--) {
-			struct encoder_callback *cb;
-			cb = encoder->callbacks.array + (i - 1);
-			send_packet(encoder, cb, pkt);
+		if (encoder->callbacks.num) {
+			/* one copy of the encoder's output, shared by
+			 * reference between all outputs */
+			struct encoder_packet shared;
+			packet_create_instance(encoder->packet_pool, &shared,
+					       pkt);
+
+			for (size_t i = encoder->callbacks.num; i > 0; i--) {
+				struct encoder_callback *cb;
+				cb = encoder->callbacks.array + (i - 1);
+				send_packet(encoder, cb, &shared);
+			}
+
+			obs_encoder_packet_release(&shared);
 		}
 
 		pthread_mutex_unlock(&encoder->callbacks_mutex);
@@ -1336,13 +1470,29 @@ void obs_encoder_remove_output(struct obs_encoder *encoder,
 void obs_encoder_packet_create_instance(struct encoder_packet *dst,
 					const struct encoder_packet *src)
 {
-	long *p_refs;
+	packet_create_instance(NULL, dst, src);
+}
+
+struct encoder_packet_pool *obs_packet_pool_create(void)
+{
+	return packet_pool_create();
+}
+
+void obs_packet_pool_release(struct encoder_packet_pool *pool)
+{
+	packet_pool_release(pool);
+}
+
+void obs_encoder_packet_create_derived(struct encoder_packet *dst,
+				       const struct encoder_packet *src,
+				       size_t size)
+{
+	/* src isn't necessarily an instance, so this uses the core pool */
+	struct encoder_packet_pool *pool = obs ? obs->data.packet_pool : NULL;
 
 	*dst = *src;
-	p_refs = bmalloc(src->size + sizeof(long));
-	dst->data = (void *)(p_refs + 1);
-	*p_refs = 1;
-	memcpy(dst->data, src->data, src->size);
+	dst->data = (uint8_t *)(packet_alloc(pool, size) + 1);
+	dst->size = size;
 }
 
 /* OBS_DEPRECATED */
@@ -1364,10 +1514,8 @@ void obs_encoder_packet_ref(struct encoder_packet *dst,
 	if (!src)
 		return;
 
-	if (src->data) {
-		long *p_refs = ((long *)src->data) - 1;
-		os_atomic_inc_long(p_refs);
-	}
+	if (src->data)
+		os_atomic_inc_long(&get_packet_header(src->data)->refs);
 
 	*dst = *src;
 }
@@ -1378,9 +1526,9 @@ void obs_encoder_packet_release(struct encoder_packet *pkt)
 		return;
 
 	if (pkt->data) {
-		long *p_refs = ((long *)pkt->data) - 1;
-		if (os_atomic_dec_long(p_refs) == 0)
-			bfree(p_refs);
+		struct packet_header *header = get_packet_header(pkt->data);
+		if (os_atomic_dec_long(&header->refs) == 0)
+			packet_free(header);
 	}
 
 	memset(pkt, 0, sizeof(struct encoder_packet));
@@ -0,0 +1,279 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "util/circlebuf.h"
+#include "obs.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Packet interleave queue.  Each track (video, then one per audio mix) has
+ * its own FIFO, and a small min-heap of track indices keyed on the front
+ * packet of each FIFO yields the packets in interleaved order.  Encoders
+ * emit monotonic DTS per track, so each FIFO is already sorted and inserts
+ * and removals are O(log tracks) instead of a scan of every queued packet.
+ *
+ * Packets are ordered by dts_usec.  On equal timestamps video comes first,
+ * and any remaining ties are ordered by arrival.
+ */
+
+#define INTERLEAVE_MAX_TRACKS (MAX_AUDIO_MIXES + 1)
+
+struct interleaved_packet {
+	struct encoder_packet packet;
+	uint64_t order;
+};
+
+struct interleave_queue {
+	struct circlebuf tracks[INTERLEAVE_MAX_TRACKS];
+	size_t heap[INTERLEAVE_MAX_TRACKS];
+	size_t heap_size;
+	uint64_t next_order;
+};
+
+static inline size_t interleave_track(const struct encoder_packet *packet)
+{
+	return packet->type == OBS_ENCODER_VIDEO ? 0 : packet->track_idx + 1;
+}
+
+static inline bool interleaved_before(const struct interleaved_packet *a,
+				      const struct interleaved_packet *b)
+{
+	bool a_video = a->packet.type == OBS_ENCODER_VIDEO;
+	bool b_video = b->packet.type == OBS_ENCODER_VIDEO;
+
+	if (a->packet.dts_usec != b->packet.dts_usec)
+		return a->packet.dts_usec < b->packet.dts_usec;
+	if (a_video != b_video)
+		return a_video;
+	return a->order < b->order;
+}
+
+static inline size_t interleave_queue_count(const struct interleave_queue *iq,
+					    size_t track)
+{
+	return iq->tracks[track].size / sizeof(struct interleaved_packet);
+}
+
+/** Returns the packet at idx of a track's FIFO, or NULL if out of range */
+static inline struct interleaved_packet *
+interleave_queue_peek(struct interleave_queue *iq, size_t track, size_t idx)
+{
+	return (struct interleaved_packet *)circlebuf_data(
+		&iq->tracks[track], idx * sizeof(struct interleaved_packet));
+}
+
+static inline struct interleaved_packet *
+interleave_queue_track_front(struct interleave_queue *iq, size_t track)
+{
+	return interleave_queue_peek(iq, track, 0);
+}
+
+static inline struct interleaved_packet *
+interleave_queue_track_back(struct interleave_queue *iq, size_t track)
+{
+	size_t count = interleave_queue_count(iq, track);
+	return count ? interleave_queue_peek(iq, track, count - 1) : NULL;
+}
+
+static inline bool interleave_heap_less(struct interleave_queue *iq,
+					size_t a, size_t b)
+{
+	return interleaved_before(
+		interleave_queue_track_front(iq, iq->heap[a]),
+		interleave_queue_track_front(iq, iq->heap[b]));
+}
+
+static inline void interleave_heap_swap(struct interleave_queue *iq, size_t a,
+					size_t b)
+{
+	size_t track = iq->heap[a];
+	iq->heap[a] = iq->heap[b];
+	iq->heap[b] = track;
+}
+
+static inline void interleave_heap_up(struct interleave_queue *iq, size_t idx)
+{
+	while (idx > 0) {
+		size_t parent = (idx - 1) / 2;
+		if (!interleave_heap_less(iq, idx, parent))
+			break;
+
+		interleave_heap_swap(iq, idx, parent);
+		idx = parent;
+	}
+}
+
+static inline void interleave_heap_down(struct interleave_queue *iq,
+					size_t idx)
+{
+	for (;;) {
+		size_t left = idx * 2 + 1;
+		size_t right = left + 1;
+		size_t smallest = idx;
+
+		if (left < iq->heap_size &&
+		    interleave_heap_less(iq, left, smallest))
+			smallest = left;
+		if (right < iq->heap_size &&
+		    interleave_heap_less(iq, right, smallest))
+			smallest = right;
+		if (smallest == idx)
+			break;
+
+		interleave_heap_swap(iq, idx, smallest);
+		idx = smallest;
+	}
+}
+
+/** Rebuilds the heap from scratch, needed after the packets have changed
+ * in a way that can reorder the tracks (e.g. after offsetting timestamps) */
+static inline void interleave_queue_rebuild(struct interleave_queue *iq)
+{
+	iq->heap_size = 0;
+
+	for (size_t i = 0; i < INTERLEAVE_MAX_TRACKS; i++) {
+		if (iq->tracks[i].size)
+			iq->heap[iq->heap_size++] = i;
+	}
+
+	for (size_t i = iq->heap_size / 2; i > 0; i--)
+		interleave_heap_down(iq, i - 1);
+}
+
+/** Renumbers the arrival order of all queued packets to match their current
+ * interleaved order, so ties keep resolving the same way after the packet
+ * timestamps are changed */
+static inline void interleave_queue_renumber(struct interleave_queue *iq)
+{
+	size_t pos[INTERLEAVE_MAX_TRACKS] = {0};
+	uint64_t order = 0;
+
+	for (;;) {
+		struct interleaved_packet *next = NULL;
+		size_t next_track = 0;
+
+		for (size_t i = 0; i < INTERLEAVE_MAX_TRACKS; i++) {
+			struct interleaved_packet *packet =
+				interleave_queue_peek(iq, i, pos[i]);
+
+			if (!packet)
+				continue;
+			if (!next || interleaved_before(packet, next)) {
+				next = packet;
+				next_track = i;
+			}
+		}
+
+		if (!next)
+			break;
+
+		next->order = order++;
+		pos[next_track]++;
+	}
+
+	iq->next_order = order;
+}
+
+static inline void interleave_queue_free(struct interleave_queue *iq)
+{
+	for (size_t i = 0; i < INTERLEAVE_MAX_TRACKS; i++)
+		circlebuf_free(&iq->tracks[i]);
+
+	iq->heap_size = 0;
+	iq->next_order = 0;
+}
+
+static inline bool interleave_queue_empty(const struct interleave_queue *iq)
+{
+	return iq->heap_size == 0;
+}
+
+/** Returns the next packet in interleaved order, or NULL if empty */
+static inline struct interleaved_packet *
+interleave_queue_front(struct interleave_queue *iq)
+{
+	return iq->heap_size ? interleave_queue_track_front(iq, iq->heap[0])
+			     : NULL;
+}
+
+/** Queues a packet at the back of its track.  The queue takes ownership of
+ * the packet's data, and the packet must not be earlier than the packets
+ * already queued on the same track. */
+static inline void interleave_queue_push(struct interleave_queue *iq,
+					 const struct encoder_packet *packet)
+{
+	size_t track = interleave_track(packet);
+	struct interleaved_packet entry = {*packet, iq->next_order++};
+	bool was_empty = iq->tracks[track].size == 0;
+
+	circlebuf_push_back(&iq->tracks[track], &entry, sizeof(entry));
+
+	if (was_empty) {
+		iq->heap[iq->heap_size] = track;
+		interleave_heap_up(iq, iq->heap_size++);
+	}
+}
+
+/** Removes the front packet of a track.  Ownership of the packet data goes
+ * to the caller. */
+static inline void interleave_queue_pop_track(struct interleave_queue *iq,
+					      size_t track,
+					      struct encoder_packet *packet)
+{
+	struct interleaved_packet entry;
+	size_t idx;
+
+	circlebuf_pop_front(&iq->tracks[track], &entry, sizeof(entry));
+	if (packet)
+		*packet = entry.packet;
+
+	for (idx = 0; idx < iq->heap_size; idx++) {
+		if (iq->heap[idx] == track)
+			break;
+	}
+
+	if (!iq->tracks[track].size) {
+		iq->heap[idx] = iq->heap[--iq->heap_size];
+		if (idx == iq->heap_size)
+			return;
+	}
+
+	/* the track's new front can only be later than its old one, but a
+	 * replacement moved in from the bottom of the heap can go either
+	 * way */
+	interleave_heap_up(iq, idx);
+	interleave_heap_down(iq, idx);
+}
+
+/** Removes the next packet in interleaved order.  Ownership of the packet
+ * data goes to the caller. */
+static inline bool interleave_queue_pop(struct interleave_queue *iq,
+					struct encoder_packet *packet)
+{
+	if (!iq->heap_size)
+		return false;
+
+	interleave_queue_pop_track(iq, iq->heap[0], packet);
+	return true;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -32,15 +32,18 @@
 #include "graphics/matrix4.h"
 
 #include "media-io/audio-resampler.h"
+#include "media-io/audio-ring.h"
 #include "media-io/video-io.h"
 #include "media-io/audio-io.h"
 
 #include "obs.h"
+#include "obs-interleave.h"
 
 #include <caption/caption.h>
 
 #define NUM_TEXTURES 2
 #define NUM_CHANNELS 3
+#define NUM_COPY_SURFACES 8
 #define MICROSECOND_DEN 1000000
 #define NUM_ENCODE_TEXTURES 3
 #define NUM_ENCODE_TEXTURE_FRAMES_TO_WAIT 1
@@ -248,10 +251,11 @@ struct obs_task_info {
 struct obs_core_video {
 	graphics_t *graphics;
 	gs_stagesurf_t *active_copy_surfaces[NUM_TEXTURES][NUM_CHANNELS];
-	gs_stagesurf_t *copy_surfaces[NUM_TEXTURES][NUM_CHANNELS];
+	int active_copy_set[NUM_TEXTURES];
+	gs_stagesurf_t *copy_surfaces[NUM_COPY_SURFACES][NUM_CHANNELS];
 	gs_texture_t *convert_textures[NUM_CHANNELS];
 #ifdef _WIN32
-	gs_stagesurf_t *copy_surfaces_encode[NUM_TEXTURES];
+	gs_stagesurf_t *copy_surfaces_encode[NUM_COPY_SURFACES];
 	gs_texture_t *convert_textures_encode[NUM_CHANNELS];
 #endif
 	gs_texture_t *render_texture;
@@ -259,11 +263,14 @@ struct obs_core_video {
 	enum gs_color_space render_space;
 	bool texture_rendered;
 	bool textures_copied[NUM_TEXTURES];
+	/* set when there was no free copy surface to stage a texture to */
+	bool textures_dropped[NUM_TEXTURES];
 	bool texture_converted;
 	bool using_nv12_tex;
 	bool using_p010_tex;
 	struct circlebuf vframe_info_buffer;
 	struct circlebuf vframe_info_buffer_gpu;
+	struct obs_vframe_info skipped_vframe_info;
 	gs_effect_t *default_effect;
 	gs_effect_t *default_rect_effect;
 	gs_effect_t *opaque_effect;
@@ -276,8 +283,15 @@ struct obs_core_video {
 	gs_effect_t *bilinear_lowres_effect;
 	gs_effect_t *premultiplied_alpha_effect;
 	gs_samplerstate_t *point_sampler;
-	gs_stagesurf_t *mapped_surfaces[NUM_CHANNELS];
 	int cur_texture;
+
+	/* staging sets are busy from staging until the video thread releases
+	 * their mapped memory, and are only unmapped on the graphics thread */
+	size_t num_copy_surfaces;
+	bool copy_surfaces_busy[NUM_COPY_SURFACES];
+	volatile bool copy_surfaces_released[NUM_COPY_SURFACES];
+	gs_stagesurf_t *mapped_surfaces[NUM_COPY_SURFACES][NUM_CHANNELS];
+
 	volatile long raw_active;
 	volatile long gpu_encoder_active;
 	pthread_mutex_t gpu_encoder_mutex;
@@ -334,18 +348,67 @@ struct obs_core_video {
 
 struct audio_monitor;
 
+struct audio_track_job {
+	struct obs_source *track;
+	struct obs_source_audio audio;
+	struct audio_output_data *mix;
+	float *out[MAX_AUDIO_CHANNELS];
+	size_t channels;
+};
+
+struct audio_track_worker {
+	pthread_t thread;
+	os_sem_t *start;
+	struct audio_track_job *jobs[MAX_AUDIO_MIXES];
+	size_t num_jobs;
+	struct audio_track_pool *pool;
+	const char *profile_name;
+	bool scheduled;
+};
+
+/* runs the filter chains of the track sources in parallel */
+struct audio_track_pool {
+	struct audio_track_worker workers[MAX_AUDIO_MIXES - 1];
+	size_t num_workers;
+	volatile bool stop;
+
+	/* the thread that runs the jobs, the workers take on its scheduling
+	 * as it waits for them */
+	pthread_t audio_thread;
+	bool audio_thread_known;
+
+	struct audio_track_job jobs[MAX_AUDIO_MIXES];
+	volatile long workers_remaining;
+	os_event_t *done_event;
+
+	/* filtered track output, used for metering */
+	float *out_data;
+};
+
 struct obs_core_audio {
 	audio_t *audio;
 
 	DARRAY(struct obs_source *) render_order;
 	DARRAY(struct obs_source *) root_nodes;
 
+	/* render_order and root_nodes are only rebuilt from the source trees
+	 * when graph_version changed since they were cached */
+	volatile long graph_version;
+	long render_order_version;
+	bool render_order_cached;
+	DARRAY(obs_weak_source_t *) render_order_cache;
+	DARRAY(size_t) root_nodes_cache;
+
+	/* at most AUDIO_OUTPUT_FRAMES, buffers stay sized for that */
+	uint32_t frames_per_tick;
+
 	uint64_t buffered_ts;
 	struct circlebuf buffered_timestamps;
 	uint64_t buffering_wait_ticks;
 	int total_buffering_ticks;
 	int max_buffering_ticks;
 	bool fixed_buffer;
+	uint32_t pinned_mixes;
 
 	float user_volume;
 
@@ -356,6 +419,13 @@ struct obs_core_audio {
 
 	pthread_mutex_t task_mutex;
 	struct circlebuf tasks;
+
+	struct audio_track_pool track_pool;
+
+	/* stages timed by audio_callback, the output stage is timed by the
+	 * audio output itself */
+	pthread_mutex_t stats_mutex;
+	struct audio_stage_stats stage_stats[OBS_AUDIO_STAGE_OUTPUT];
 };
 
 struct obs_volumeter;
@@ -394,6 +464,13 @@ struct obs_core_data {
 
 	long long unnamed_index;
 
+	/* stamps handed out to sources when their content changes */
+	volatile long content_generation;
+
+	/* storage for packets derived from other packets, such as parsed AVC
+	 * packets, which outlives the core while any of them are in use */
+	struct encoder_packet_pool *packet_pool;
+
 	obs_data_t *private_data;
 
 	volatile bool valid;
@@ -472,6 +549,14 @@ struct obs_core {
 
 extern struct obs_core *obs;
 
+/* call whenever the set of active sources or the way they are nested may
+ * have changed */
+static inline void obs_audio_graph_changed(void)
+{
+	if (obs)
+		os_atomic_inc_long(&obs->audio.graph_version);
+}
+
 struct obs_graphics_context {
 	uint64_t last_time;
 	uint64_t interval;
@@ -495,10 +580,14 @@ obs_graphics_thread_loop_autorelease(struct obs_graphics_context *context);
 #endif
 
 extern gs_effect_t *obs_load_effect(gs_effect_t **effect, const char *file);
+extern bool obs_init_copy_surfaces(size_t set);
 
 extern bool audio_callback(void *param, uint64_t start_ts_in,
 			   uint64_t end_ts_in, uint64_t *out_ts,
 			   uint32_t mixers, struct audio_output_data *mixes);
+extern bool audio_track_pool_init(struct audio_track_pool *pool,
+				  size_t channels, uint64_t tick_ns);
+extern void audio_track_pool_free(struct audio_track_pool *pool);
 
 extern void
 start_raw_video(video_t *video, const struct video_scale_info *conversion,
@@ -616,6 +705,17 @@ struct async_frame {
 	bool used;
 };
 
+/* frames output with obs_source_output_video_nocopy.  the planes belong to
+ * the source, and are handed back once the last reference is dropped */
+struct async_external_frame {
+	struct obs_source_frame frame;
+	obs_source_frame_release_t release;
+	void *param;
+};
+
+/* set in the flags of async_external_frame, never set by sources */
+#define OBS_SOURCE_FRAME_EXTERNAL (1 << 7)
+
 enum audio_action_type {
 	AUDIO_ACTION_VOL,
 	AUDIO_ACTION_MUTE,
@@ -712,6 +812,11 @@ struct obs_source {
 	struct obs_source *next_audio_source;
 	struct obs_source **prev_next_audio_source;
 	uint64_t audio_ts;
+
+	/* capture threads only ever write to audio_input_ring, the audio
+	 * thread moves its contents into audio_input_buf every tick and is
+	 * the only one touching audio_input_buf and audio_ts */
+	struct audio_ring *audio_input_ring;
 	struct circlebuf audio_input_buf[MAX_AUDIO_CHANNELS];
 	size_t last_audio_input_buf_size;
 	DARRAY(struct audio_action) audio_actions;
@@ -720,6 +825,7 @@ struct obs_source {
 	struct resample_info sample_info;
 	audio_resampler_t *resampler;
 	pthread_mutex_t audio_actions_mutex;
+	/* serializes the writers of audio_input_ring */
 	pthread_mutex_t audio_buf_mutex;
 	pthread_mutex_t audio_mutex;
 	pthread_mutex_t audio_cb_mutex;
@@ -779,12 +885,18 @@ struct obs_source {
 	bool deinterlace_top_first;
 	bool deinterlace_rendered;
 
+	/* render cache */
+	volatile long content_generation;
+	volatile long render_cache_hits;
+	volatile long render_cache_misses;
+
 	/* filters */
 	struct obs_source *filter_parent;
 	struct obs_source *filter_target;
 	DARRAY(struct obs_source *) filters;
 	pthread_mutex_t filter_mutex;
 	gs_texrender_t *filter_texrender;
+	long filter_render_generation;
 	enum obs_allow_direct_render allow_direct;
 	bool rendering_filter;
 	bool filter_bypass_active;
@@ -935,12 +1047,21 @@ extern void obs_source_set_texcoords_centered(obs_source_t *source,
 extern void obs_source_activate(obs_source_t *source, enum view_type type);
 extern void obs_source_deactivate(obs_source_t *source, enum view_type type);
 extern void obs_source_video_tick(obs_source_t *source, float seconds);
+extern void obs_source_video_render_culled(obs_source_t *source);
+extern long obs_source_get_render_generation(obs_source_t *source);
+extern bool obs_source_check_render_cache(obs_source_t *source,
+					  gs_texrender_t *texrender,
+					  long generation,
+					  long *cached_generation, uint32_t cx,
+					  uint32_t cy);
 extern float obs_source_get_target_volume(obs_source_t *source,
 					  obs_source_t *target);
 
 extern void obs_source_audio_render(obs_source_t *source, uint32_t mixers,
 				    size_t channels, size_t sample_rate,
 				    size_t size);
+extern void obs_source_drain_audio_input(obs_source_t *source,
+					 size_t channels);
 
 extern void add_alignment(struct vec2 *v, uint32_t align, int cx, int cy);
 
@@ -1025,7 +1146,7 @@ struct obs_output {
 	pthread_t end_data_capture_thread;
 	os_event_t *stopping_event;
 	pthread_mutex_t interleaved_mutex;
-	DARRAY(struct encoder_packet) interleaved_packets;
+	struct interleave_queue interleaved_packets;
 	int stop_code;
 
 	int reconnect_retry_sec;
@@ -1120,6 +1241,15 @@ extern void obs_output_remove_encoder(struct obs_output *output,
 extern void
 obs_encoder_packet_create_instance(struct encoder_packet *dst,
 				   const struct encoder_packet *src);
+
+/* creates an uninitialized instance of size bytes for data derived from
+ * src, allocated from the core packet pool, with the rest of src copied */
+extern void obs_encoder_packet_create_derived(struct encoder_packet *dst,
+					      const struct encoder_packet *src,
+					      size_t size);
+
+extern struct encoder_packet_pool *obs_packet_pool_create(void);
+extern void obs_packet_pool_release(struct encoder_packet_pool *pool);
 void obs_output_destroy(obs_output_t *output);
 
 /* ------------------------------------------------------------------------- */
@@ -1194,6 +1324,9 @@ struct obs_encoder {
 	pthread_mutex_t callbacks_mutex;
 	DARRAY(struct encoder_callback) callbacks;
 
+	/* recycled storage for the packets shared by all outputs */
+	struct encoder_packet_pool *packet_pool;
+
 	struct pause_data pause;
 
 	const char *profile_encoder_encode_name;
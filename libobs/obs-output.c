@@ -168,10 +168,11 @@ fail:
 
 static inline void free_packets(struct obs_output *output)
 {
-	for (size_t i = 0; i < output->interleaved_packets.num; i++)
-		obs_encoder_packet_release(output->interleaved_packets.array +
-					   i);
-	da_free(output->interleaved_packets);
+	struct encoder_packet packet;
+
+	while (interleave_queue_pop(&output->interleaved_packets, &packet))
+		obs_encoder_packet_release(&packet);
+	interleave_queue_free(&output->interleaved_packets);
 }
 
 static inline void clear_audio_buffers(obs_output_t *output)
@@ -1213,7 +1214,6 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 	sei_t sei;
 	uint8_t *data;
 	size_t size;
-	long ref = 1;
 
 	DARRAY(uint8_t) out_data;
 
@@ -1223,7 +1223,6 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 	sei_init(&sei, 0.0);
 
 	da_init(out_data);
-	da_push_back_array(out_data, (uint8_t *)&ref, sizeof(ref));
 	da_push_back_array(out_data, out->data, out->size);
 
 	if (output->caption_data.size > 0) {
@@ -1290,12 +1289,15 @@ static bool add_caption(struct obs_output *output, struct encoder_packet *out)
 	da_push_back_array(out_data, data, size);
 	free(data);
 
-	obs_encoder_packet_release(out);
+	/* the packet data is shared with other outputs, so the captioned
+	 * packet gets its own copy */
+	backup.data = out_data.array;
+	backup.size = out_data.num;
 
-	*out = backup;
-	out->data = (uint8_t *)out_data.array + sizeof(ref);
-	out->size = out_data.num - sizeof(ref);
+	obs_encoder_packet_release(out);
+	obs_encoder_packet_create_instance(out, &backup);
 
+	da_free(out_data);
 	sei_free(&sei);
 
 	return true;
@@ -1305,7 +1307,8 @@ double last_caption_timestamp = 0;
 
 static inline void send_interleaved(struct obs_output *output)
 {
-	struct encoder_packet out = output->interleaved_packets.array[0];
+	struct encoder_packet out =
+		interleave_queue_front(&output->interleaved_packets)->packet;
 
 	/* do not send an interleaved packet if there's no packet of the
 	 * opposing type of a higher timestamp in the interleave buffer.
@@ -1313,7 +1316,7 @@ static inline void send_interleaved(struct obs_output *output)
 	if (!has_higher_opposing_ts(output, &out))
 		return;
 
-	da_erase(output->interleaved_packets, 0);
+	interleave_queue_pop(&output->interleaved_packets, NULL);
 
 	if (out.type == OBS_ENCODER_VIDEO) {
 		output->total_frames++;
@@ -1365,184 +1368,176 @@ static inline void set_higher_ts(struct obs_output *output,
 
 static inline struct encoder_packet *
 find_first_packet_type(struct obs_output *output, enum obs_encoder_type type,
-		       size_t audio_idx);
-static int find_first_packet_type_idx(struct obs_output *output,
-				      enum obs_encoder_type type,
-				      size_t audio_idx);
+		       size_t audio_idx)
+{
+	size_t track = type == OBS_ENCODER_VIDEO ? 0 : audio_idx + 1;
+	struct interleaved_packet *packet = interleave_queue_track_front(
+		&output->interleaved_packets, track);
+	return packet ? &packet->packet : NULL;
+}
+
+static inline struct encoder_packet *
+find_last_packet_type(struct obs_output *output, enum obs_encoder_type type,
+		      size_t audio_idx)
+{
+	size_t track = type == OBS_ENCODER_VIDEO ? 0 : audio_idx + 1;
+	struct interleaved_packet *packet = interleave_queue_track_back(
+		&output->interleaved_packets, track);
+	return packet ? &packet->packet : NULL;
+}
 
 /* gets the point where audio and video are closest together */
-static size_t get_interleaved_start_idx(struct obs_output *output)
+static struct interleaved_packet *
+get_interleaved_start(struct obs_output *output)
 {
+	struct interleave_queue *iq = &output->interleaved_packets;
+	struct interleaved_packet *first_video;
+	struct interleaved_packet *closest = NULL;
 	int64_t closest_diff = 0x7FFFFFFFFFFFFFFFLL;
-	struct encoder_packet *first_video =
-		find_first_packet_type(output, OBS_ENCODER_VIDEO, 0);
-	size_t video_idx = DARRAY_INVALID;
-	size_t idx = 0;
-
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		int64_t diff;
-
-		if (packet->type != OBS_ENCODER_AUDIO) {
-			if (packet == first_video)
-				video_idx = i;
-			continue;
-		}
 
-		diff = llabs(packet->dts_usec - first_video->dts_usec);
-		if (diff < closest_diff) {
-			closest_diff = diff;
-			idx = i;
+	first_video = interleave_queue_track_front(iq, 0);
+
+	for (size_t track = 1; track < INTERLEAVE_MAX_TRACKS; track++) {
+		size_t count = interleave_queue_count(iq, track);
+
+		for (size_t i = 0; i < count; i++) {
+			struct interleaved_packet *audio =
+				interleave_queue_peek(iq, track, i);
+			int64_t diff = llabs(audio->packet.dts_usec -
+					     first_video->packet.dts_usec);
+
+			if (diff < closest_diff ||
+			    (diff == closest_diff && closest &&
+			     interleaved_before(audio, closest))) {
+				closest_diff = diff;
+				closest = audio;
+			}
 		}
 	}
 
-	return video_idx < idx ? video_idx : idx;
+	if (!closest)
+		return NULL;
+
+	return interleaved_before(first_video, closest) ? first_video
+							: closest;
 }
 
-static int prune_premature_packets(struct obs_output *output)
+static int prune_premature_packets(struct obs_output *output,
+				   struct interleaved_packet *last)
 {
+	struct interleave_queue *iq = &output->interleaved_packets;
 	size_t audio_mixes = num_audio_mixes(output);
-	struct encoder_packet *video;
-	int video_idx;
-	int max_idx;
+	struct interleaved_packet *video;
+	struct interleaved_packet *max;
 	int64_t duration_usec;
 	int64_t max_diff = 0;
 	int64_t diff = 0;
 
-	video_idx = find_first_packet_type_idx(output, OBS_ENCODER_VIDEO, 0);
-	if (video_idx == -1) {
+	video = interleave_queue_track_front(iq, 0);
+	if (!video) {
 		output->received_video = false;
 		return -1;
 	}
 
-	max_idx = video_idx;
-	video = &output->interleaved_packets.array[video_idx];
-	duration_usec = video->timebase_num * 1000000LL / video->timebase_den;
+	max = video;
+	duration_usec = video->packet.timebase_num * 1000000LL /
+			video->packet.timebase_den;
 
 	for (size_t i = 0; i < audio_mixes; i++) {
-		struct encoder_packet *audio;
-		int audio_idx;
+		struct interleaved_packet *audio;
 
-		audio_idx = find_first_packet_type_idx(output,
-						       OBS_ENCODER_AUDIO, i);
-		if (audio_idx == -1) {
+		audio = interleave_queue_track_front(iq, i + 1);
+		if (!audio) {
 			output->received_audio = false;
 			return -1;
 		}
 
-		audio = &output->interleaved_packets.array[audio_idx];
-		if (audio_idx > max_idx)
-			max_idx = audio_idx;
+		if (interleaved_before(max, audio))
+			max = audio;
 
-		diff = audio->dts_usec - video->dts_usec;
+		diff = audio->packet.dts_usec - video->packet.dts_usec;
 		if (diff > max_diff)
 			max_diff = diff;
 	}
 
-	return diff > duration_usec ? max_idx + 1 : 0;
+	if (diff <= duration_usec)
+		return 0;
+
+	*last = *max;
+	return 1;
 }
 
-static void discard_to_idx(struct obs_output *output, size_t idx)
+/* releases every packet before the given one in interleaved order, or up to
+ * and including it if inclusive is set */
+static void discard_to_packet(struct obs_output *output,
+			      const struct interleaved_packet *packet,
+			      bool inclusive)
 {
-	for (size_t i = 0; i < idx; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		obs_encoder_packet_release(packet);
-	}
+	struct interleave_queue *iq = &output->interleaved_packets;
+	struct interleaved_packet stop = *packet;
+	struct interleaved_packet *front;
+	struct encoder_packet discarded;
+
+	while ((front = interleave_queue_front(iq)) != NULL) {
+		bool is_stop = front->order == stop.order;
+
+		if (!interleaved_before(front, &stop) &&
+		    !(inclusive && is_stop))
+			break;
+
+		interleave_queue_pop(iq, &discarded);
+		obs_encoder_packet_release(&discarded);
 
-	da_erase_range(output->interleaved_packets, 0, idx);
+		if (is_stop)
+			break;
+	}
 }
 
 #define DEBUG_STARTING_PACKETS 0
 
 static bool prune_interleaved_packets(struct obs_output *output)
 {
-	size_t start_idx = 0;
-	int prune_start = prune_premature_packets(output);
+	struct interleaved_packet *start;
+	struct interleaved_packet last;
+	int prune_start = prune_premature_packets(output, &last);
 
 #if DEBUG_STARTING_PACKETS == 1
 	blog(LOG_DEBUG, "--------- Pruning! %d ---------", prune_start);
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		blog(LOG_DEBUG, "packet: %s %d, ts: %lld, pruned = %s",
-		     packet->type == OBS_ENCODER_AUDIO ? "audio" : "video",
-		     (int)packet->track_idx, packet->dts_usec,
-		     (int)i < prune_start ? "true" : "false");
+	struct interleave_queue *iq = &output->interleaved_packets;
+
+	for (size_t track = 0; track < INTERLEAVE_MAX_TRACKS; track++) {
+		size_t count = interleave_queue_count(iq, track);
+
+		for (size_t i = 0; i < count; i++) {
+			struct interleaved_packet *packet =
+				interleave_queue_peek(iq, track, i);
+			bool pruned = prune_start == 1 &&
+				      !interleaved_before(&last, packet);
+
+			blog(LOG_DEBUG, "packet: %s %d, ts: %lld, pruned = %s",
+			     packet->packet.type == OBS_ENCODER_AUDIO
+				     ? "audio"
+				     : "video",
+			     (int)packet->packet.track_idx,
+			     packet->packet.dts_usec,
+			     pruned ? "true" : "false");
+		}
 	}
 #endif
 
 	/* prunes the first video packet if it's too far away from audio */
 	if (prune_start == -1)
 		return false;
-	else if (prune_start != 0)
-		start_idx = (size_t)prune_start;
-	else
-		start_idx = get_interleaved_start_idx(output);
-
-	if (start_idx)
-		discard_to_idx(output, start_idx);
-
-	return true;
-}
-
-static int find_first_packet_type_idx(struct obs_output *output,
-				      enum obs_encoder_type type,
-				      size_t audio_idx)
-{
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-
-		if (packet->type == type) {
-			if (type == OBS_ENCODER_AUDIO &&
-			    packet->track_idx != audio_idx) {
-				continue;
-			}
 
-			return (int)i;
-		}
-	}
-
-	return -1;
-}
-
-static int find_last_packet_type_idx(struct obs_output *output,
-				     enum obs_encoder_type type,
-				     size_t audio_idx)
-{
-	for (size_t i = output->interleaved_packets.num; i > 0; i--) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i - 1];
-
-		if (packet->type == type) {
-			if (type == OBS_ENCODER_AUDIO &&
-			    packet->track_idx != audio_idx) {
-				continue;
-			}
-
-			return (int)(i - 1);
-		}
+	if (prune_start != 0) {
+		discard_to_packet(output, &last, true);
+	} else {
+		start = get_interleaved_start(output);
+		if (start)
+			discard_to_packet(output, start, false);
 	}
 
-	return -1;
-}
-
-static inline struct encoder_packet *
-find_first_packet_type(struct obs_output *output, enum obs_encoder_type type,
-		       size_t audio_idx)
-{
-	int idx = find_first_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
-}
-
-static inline struct encoder_packet *
-find_last_packet_type(struct obs_output *output, enum obs_encoder_type type,
-		      size_t audio_idx)
-{
-	int idx = find_last_packet_type_idx(output, type, audio_idx);
-	return (idx != -1) ? &output->interleaved_packets.array[idx] : NULL;
+	return true;
 }
 
 static bool get_audio_and_video_packets(struct obs_output *output,
@@ -1571,11 +1566,12 @@ static bool get_audio_and_video_packets(struct obs_output *output,
 
 static bool initialize_interleaved_packets(struct obs_output *output)
 {
+	struct interleave_queue *iq = &output->interleaved_packets;
 	struct encoder_packet *video;
 	struct encoder_packet *audio[MAX_AUDIO_MIXES];
 	struct encoder_packet *last_audio[MAX_AUDIO_MIXES];
+	struct interleaved_packet *start;
 	size_t audio_mixes = num_audio_mixes(output);
-	size_t start_idx;
 
 	if (!get_audio_and_video_packets(output, &video, audio, audio_mixes))
 		return false;
@@ -1593,9 +1589,9 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	}
 
 	/* clear out excess starting audio if it hasn't been already */
-	start_idx = get_interleaved_start_idx(output);
-	if (start_idx) {
-		discard_to_idx(output, start_idx);
+	start = get_interleaved_start(output);
+	if (start && start != interleave_queue_front(iq)) {
+		discard_to_packet(output, start, false);
 		if (!get_audio_and_video_packets(output, &video, audio,
 						 audio_mixes))
 			return false;
@@ -1621,11 +1617,20 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 	output->highest_audio_ts -= audio[0]->dts_usec;
 	output->highest_video_ts -= video->dts_usec;
 
+	/* the offsets shift each track differently, so lock in the current
+	 * order for ties before the timestamps change */
+	interleave_queue_renumber(iq);
+
 	/* apply new offsets to all existing packet DTS/PTS values */
-	for (size_t i = 0; i < output->interleaved_packets.num; i++) {
-		struct encoder_packet *packet =
-			&output->interleaved_packets.array[i];
-		apply_interleaved_packet_offset(output, packet);
+	for (size_t track = 0; track < INTERLEAVE_MAX_TRACKS; track++) {
+		size_t count = interleave_queue_count(iq, track);
+
+		for (size_t i = 0; i < count; i++) {
+			struct interleaved_packet *packet =
+				interleave_queue_peek(iq, track, i);
+			apply_interleaved_packet_offset(output,
+							&packet->packet);
+		}
 	}
 
 	return true;
@@ -1634,51 +1639,28 @@ static bool initialize_interleaved_packets(struct obs_output *output)
 static inline void insert_interleaved_packet(struct obs_output *output,
 					     struct encoder_packet *out)
 {
-	size_t idx;
-	for (idx = 0; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *cur_packet;
-		cur_packet = output->interleaved_packets.array + idx;
-
-		if (out->dts_usec == cur_packet->dts_usec &&
-		    out->type == OBS_ENCODER_VIDEO) {
-			break;
-		} else if (out->dts_usec < cur_packet->dts_usec) {
-			break;
-		}
-	}
-
-	da_insert(output->interleaved_packets, idx, out);
+	interleave_queue_push(&output->interleaved_packets, out);
 }
 
 static void resort_interleaved_packets(struct obs_output *output)
 {
-	DARRAY(struct encoder_packet) old_array;
-
-	old_array.da = output->interleaved_packets.da;
-	memset(&output->interleaved_packets, 0,
-	       sizeof(output->interleaved_packets));
-
-	for (size_t i = 0; i < old_array.num; i++)
-		insert_interleaved_packet(output, &old_array.array[i]);
-
-	da_free(old_array);
+	interleave_queue_rebuild(&output->interleaved_packets);
 }
 
 static void discard_unused_audio_packets(struct obs_output *output,
 					 int64_t dts_usec)
 {
-	size_t idx = 0;
-
-	for (; idx < output->interleaved_packets.num; idx++) {
-		struct encoder_packet *p =
-			&output->interleaved_packets.array[idx];
+	struct interleave_queue *iq = &output->interleaved_packets;
+	struct interleaved_packet *front;
+	struct encoder_packet packet;
 
-		if (p->dts_usec >= dts_usec)
+	while ((front = interleave_queue_front(iq)) != NULL) {
+		if (front->packet.dts_usec >= dts_usec)
 			break;
-	}
 
-	if (idx)
-		discard_to_idx(output, idx);
+		interleave_queue_pop(iq, &packet);
+		obs_encoder_packet_release(&packet);
+	}
 }
 
 static void interleave_packets(void *data, struct encoder_packet *packet)
@@ -1711,7 +1693,7 @@ static void interleave_packets(void *data, struct encoder_packet *packet)
 	if (output->active_delay_ns)
 		out = *packet;
 	else
-		obs_encoder_packet_create_instance(&out, packet);
+		obs_encoder_packet_ref(&out, packet);
 
 	if (was_started)
 		apply_interleaved_packet_offset(output, &out);
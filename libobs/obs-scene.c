@@ -19,6 +19,7 @@
 #include "util/threading.h"
 #include "util/util_uint64.h"
 #include "graphics/math-defs.h"
+#include "media-io/audio-simd.h"
 #include "obs-scene.h"
 #include "obs-internal.h"
 
@@ -323,6 +324,7 @@ static inline void detach_sceneitem(struct obs_scene_item *item)
 		item->next->prev = item->prev;
 
 	item->parent = NULL;
+	obs_audio_graph_changed();
 }
 
 static inline void attach_sceneitem(struct obs_scene *parent,
@@ -343,6 +345,8 @@ static inline void attach_sceneitem(struct obs_scene *parent,
 			parent->first_item->prev = item;
 		parent->first_item = item;
 	}
+
+	obs_audio_graph_changed();
 }
 
 void add_alignment(struct vec2 *v, uint32_t align, int cx, int cy)
@@ -445,6 +449,9 @@ static void update_item_transform(struct obs_scene_item *item, bool update_tex)
 	item->last_width = width;
 	item->last_height = height;
 
+	/* crop changes the cached item texture without changing the source */
+	item->item_render_generation = 0;
+
 	width = cx;
 	height = cy;
 
@@ -761,6 +768,16 @@ static inline void render_item(struct obs_scene_item *item)
 
 		uint32_t cx = calc_cx(item, width);
 		uint32_t cy = calc_cy(item, height);
+		long gen = 0;
+
+		if (!transition_active(item->show_transition) &&
+		    !transition_active(item->hide_transition))
+			gen = obs_source_get_render_generation(item->source);
+
+		obs_source_check_render_cache(item->source, item->item_render,
+					      gen,
+					      &item->item_render_generation,
+					      cx, cy);
 
 		if (cx && cy &&
 		    gs_texrender_begin_with_color_space(item->item_render, cx,
@@ -850,7 +867,8 @@ static void scene_video_tick(void *data, float seconds)
 	video_lock(scene);
 	item = scene->first_item;
 	while (item) {
-		if (item->item_render)
+		/* cached item textures are checked when the item renders */
+		if (item->item_render && !item->item_render_generation)
 			gs_texrender_reset(item->item_render);
 		item = item->next;
 	}
@@ -905,11 +923,137 @@ update_transforms_and_prune_sources(obs_scene_t *scene,
 		resize_group(group_sceneitem);
 }
 
+/* ------------------------------------------------------------------------- */
+/* culling */
+
+static inline bool item_rendering(const struct obs_scene_item *item)
+{
+	return item->user_visible || transition_active(item->hide_transition);
+}
+
+/* nested scenes and transitions do work in their render callbacks that has to
+ * happen every frame, so they are never culled */
+static inline bool item_cullable(const struct obs_scene_item *item)
+{
+	return !item_is_scene(item) &&
+	       item->source->info.type != OBS_SOURCE_TYPE_TRANSITION &&
+	       !transition_active(item->show_transition) &&
+	       !transition_active(item->hide_transition);
+}
+
+/* axis-aligned bounds of the area the item draws to, in scene space */
+static void get_item_draw_bounds(const struct obs_scene_item *item,
+				 struct vec2 *min, struct vec2 *max)
+{
+	uint32_t width = obs_source_get_width(item->source);
+	uint32_t height = obs_source_get_height(item->source);
+	float cx = width ? (float)calc_cx(item, width) : 0.0f;
+	float cy = height ? (float)calc_cy(item, height) : 0.0f;
+
+	vec2_set(min, M_INFINITE, M_INFINITE);
+	vec2_set(max, -M_INFINITE, -M_INFINITE);
+
+	for (int i = 0; i < 4; i++) {
+		struct vec3 v;
+		vec3_set(&v, (i & 1) ? cx : 0.0f, (i & 2) ? cy : 0.0f, 0.0f);
+		vec3_transform(&v, &v, &item->draw_transform);
+
+		vec2_set(min, fminf(min->x, v.x), fminf(min->y, v.y));
+		vec2_set(max, fmaxf(max->x, v.x), fmaxf(max->y, v.y));
+	}
+}
+
+static inline bool async_format_opaque(enum video_format format)
+{
+	switch (format) {
+	case VIDEO_FORMAT_I420:
+	case VIDEO_FORMAT_NV12:
+	case VIDEO_FORMAT_YVYU:
+	case VIDEO_FORMAT_YUY2:
+	case VIDEO_FORMAT_UYVY:
+	case VIDEO_FORMAT_BGRX:
+	case VIDEO_FORMAT_Y800:
+	case VIDEO_FORMAT_I444:
+	case VIDEO_FORMAT_BGR3:
+	case VIDEO_FORMAT_I422:
+	case VIDEO_FORMAT_I010:
+	case VIDEO_FORMAT_P010:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static inline bool source_has_filters(obs_source_t *source)
+{
+	bool has_filters;
+
+	pthread_mutex_lock(&source->filter_mutex);
+	has_filters = source->filters.num != 0;
+	pthread_mutex_unlock(&source->filter_mutex);
+
+	return has_filters;
+}
+
+static bool source_opaque(obs_source_t *source)
+{
+	const uint32_t flags = source->info.output_flags;
+
+	if (!source->enabled || source_has_filters(source))
+		return false;
+	if ((flags & OBS_SOURCE_OPAQUE) != 0)
+		return true;
+	if (source->info.is_opaque)
+		return source->context.data &&
+		       source->info.is_opaque(source->context.data);
+
+	return (flags & OBS_SOURCE_ASYNC) != 0 && source->async_active &&
+	       source->async_textures[0] &&
+	       async_format_opaque(source->async_format);
+}
+
+/* whether the item fully replaces everything beneath it on the canvas */
+static bool item_occludes_canvas(const struct obs_scene_item *item, float cx,
+				 float cy)
+{
+	struct vec2 min, max;
+
+	if (!item->user_visible || !item_cullable(item) ||
+	    !default_blending_enabled(item) || !source_opaque(item->source))
+		return false;
+
+	/* only axis-aligned items can cover the canvas exactly */
+	if (!close_float(fmodf(item->rot, 90.0f), 0.0f, EPSILON))
+		return false;
+
+	get_item_draw_bounds(item, &min, &max);
+	return min.x <= 0.01f && min.y <= 0.01f && max.x >= cx - 0.01f &&
+	       max.y >= cy - 0.01f;
+}
+
+/* whether the item draws nothing visible on the canvas */
+static bool item_outside_canvas(const struct obs_scene_item *item, float cx,
+				float cy)
+{
+	struct vec2 min, max;
+
+	if (!item_cullable(item))
+		return false;
+
+	get_item_draw_bounds(item, &min, &max);
+	return close_float(min.x, max.x, EPSILON) ||
+	       close_float(min.y, max.y, EPSILON) || max.x <= 0.0f ||
+	       max.y <= 0.0f || min.x >= cx || min.y >= cy;
+}
+
 static void scene_video_render(void *data, gs_effect_t *effect)
 {
 	DARRAY(struct obs_scene_item *) remove_items;
 	struct obs_scene *scene = data;
 	struct obs_scene_item *item;
+	struct obs_scene_item *occluder;
+	bool occluded;
+	float cx, cy;
 
 	da_init(remove_items);
 
@@ -920,14 +1064,33 @@ static void scene_video_render(void *data, gs_effect_t *effect)
 						    NULL);
 	}
 
+	cx = (float)obs_source_get_width(scene->source);
+	cy = (float)obs_source_get_height(scene->source);
+
+	/* items beneath the topmost item that covers the whole canvas with
+	 * opaque pixels can never be seen */
+	occluder = NULL;
+	for (item = scene->first_item; item; item = item->next) {
+		if (item_occludes_canvas(item, cx, cy))
+			occluder = item;
+	}
+
 	gs_blend_state_push();
 	gs_reset_blend_state();
 
+	occluded = occluder != NULL;
 	item = scene->first_item;
 	while (item) {
-		if (item->user_visible ||
-		    transition_active(item->hide_transition))
-			render_item(item);
+		if (item == occluder)
+			occluded = false;
+
+		if (item_rendering(item)) {
+			if ((occluded && item_cullable(item)) ||
+			    item_outside_canvas(item, cx, cy))
+				obs_source_video_render_culled(item->source);
+			else
+				render_item(item);
+		}
 
 		item = item->next;
 	}
@@ -1279,6 +1442,7 @@ static void apply_scene_item_audio_actions(struct obs_scene_item *item,
 					   size_t sample_rate)
 {
 	bool cur_visible = item->visible;
+	uint64_t frames = obs->audio.frames_per_tick;
 	uint64_t frame_num = 0;
 	size_t deref_count = 0;
 
@@ -1295,7 +1459,7 @@ static void apply_scene_item_audio_actions(struct obs_scene_item *item,
 		new_frame_num = util_mul_div64(timestamp - ts, sample_rate,
 					       1000000000ULL);
 
-		if (ts && new_frame_num >= AUDIO_OUTPUT_FRAMES)
+		if (ts && new_frame_num >= frames)
 			break;
 
 		da_erase(item->audio_actions, i--);
@@ -1313,7 +1477,7 @@ static void apply_scene_item_audio_actions(struct obs_scene_item *item,
 	}
 
 	if (buf) {
-		for (; frame_num < AUDIO_OUTPUT_FRAMES; frame_num++)
+		for (; frame_num < frames; frame_num++)
 			buf[frame_num] = cur_visible ? 1.0f : 0.0f;
 	}
 
@@ -1342,7 +1506,7 @@ static bool apply_scene_item_volume(struct obs_scene_item *item, float *buf,
 	pthread_mutex_unlock(&item->actions_mutex);
 
 	if (actions_pending) {
-		uint64_t duration = util_mul_div64(AUDIO_OUTPUT_FRAMES,
+		uint64_t duration = util_mul_div64(obs->audio.frames_per_tick,
 						   1000000000ULL, sample_rate);
 
 		if (!ts || action.timestamp < (ts + duration)) {
@@ -1362,27 +1526,16 @@ static void process_all_audio_actions(struct obs_scene_item *item,
 		;
 }
 
-static void mix_audio_with_buf(float *p_out, float *p_in, float *buf_in,
-			       size_t pos, size_t count)
+static inline void mix_audio_with_buf(float *p_out, float *p_in,
+				      float *buf_in, size_t pos, size_t count)
 {
-	register float *out = p_out;
-	register float *buf = buf_in + pos;
-	register float *in = p_in + pos;
-	register float *end = in + count;
-
-	while (in < end)
-		*(out++) += *(in++) * *(buf++);
+	audio_simd_mix_buf(p_out, p_in + pos, buf_in + pos, count);
 }
 
 static inline void mix_audio(float *p_out, float *p_in, size_t pos,
 			     size_t count)
 {
-	register float *out = p_out;
-	register float *in = p_in + pos;
-	register float *end = in + count;
-
-	while (in < end)
-		*(out++) += *(in++);
+	audio_simd_mix(p_out, p_in + pos, 1.0f, count);
 }
 
 static bool scene_audio_render(void *data, uint64_t *ts_out,
@@ -1392,6 +1545,7 @@ static bool scene_audio_render(void *data, uint64_t *ts_out,
 {
 	uint64_t timestamp = 0;
 	float buf[AUDIO_OUTPUT_FRAMES];
+	size_t frames = obs->audio.frames_per_tick;
 	struct obs_source_audio_mix child_audio;
 	struct obs_scene *scene = data;
 	struct obs_scene_item *item;
@@ -1464,7 +1618,11 @@ static bool scene_audio_render(void *data, uint64_t *ts_out,
 
 		pos = (size_t)ns_to_audio_frames(sample_rate,
 						 source_ts - timestamp);
-		count = AUDIO_OUTPUT_FRAMES - pos;
+		if (pos >= frames) {
+			item = item->next;
+			continue;
+		}
+		count = frames - pos;
 
 		if (!apply_buf && !item->visible &&
 		    !transition_active(item->hide_transition)) {
@@ -1475,6 +1633,9 @@ static bool scene_audio_render(void *data, uint64_t *ts_out,
 		obs_source_get_audio_mix(source, &child_audio);
 
 		for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+			if ((mixers & (1 << mix)) == 0)
+				continue;
+
 			for (size_t ch = 0; ch < channels; ch++) {
 				float *out = audio_output->output[mix].data[ch];
 				float *in = child_audio.output[mix].data[ch];
@@ -48,6 +48,7 @@ struct obs_scene_item {
 	bool locked;
 
 	gs_texrender_t *item_render;
+	long item_render_generation;
 	struct obs_sceneitem_crop crop;
 
 	struct vec2 pos;
@@ -958,6 +958,7 @@ static void process_audio(obs_source_t *transition, obs_source_t *child,
 {
 	bool valid = child && !child->audio_pending && child->audio_ts;
 	struct obs_source_audio_mix child_audio;
+	size_t frames = obs->audio.frames_per_tick;
 	uint64_t ts;
 	size_t pos;
 
@@ -968,19 +969,22 @@ static void process_audio(obs_source_t *transition, obs_source_t *child,
 	obs_source_get_audio_mix(child, &child_audio);
 	pos = (size_t)ns_to_audio_frames(sample_rate, ts - min_ts);
 
-	if (pos > AUDIO_OUTPUT_FRAMES)
+	if (pos > frames)
 		return;
 
 	for (size_t mix_idx = 0; mix_idx < MAX_AUDIO_MIXES; mix_idx++) {
 		struct audio_output_data *output = &audio->output[mix_idx];
 		struct audio_output_data *input = &child_audio.output[mix_idx];
+
+		if ((mixers & (1 << mix_idx)) == 0)
+			continue;
+
 		for (size_t ch = 0; ch < channels; ch++) {
 			float *out = output->data[ch];
 			float *in = input->data[ch];
 
-			mix_child(transition, out + pos, in,
-				  AUDIO_OUTPUT_FRAMES - pos, sample_rate, ts,
-				  mix);
+			mix_child(transition, out + pos, in, frames - pos,
+				  sample_rate, ts, mix);
 		}
 	}
 }
@@ -21,6 +21,7 @@
 #include "media-io/format-conversion.h"
 #include "media-io/video-frame.h"
 #include "media-io/audio-io.h"
+#include "media-io/audio-simd.h"
 #include "util/threading.h"
 #include "util/platform.h"
 #include "util/util_uint64.h"
@@ -180,9 +181,16 @@ static inline bool is_composite_source(const struct obs_source *source)
 
 extern char *find_libobs_data_file(const char *file);
 
+static inline void bump_content_generation(obs_source_t *source)
+{
+	long gen = os_atomic_inc_long(&obs->data.content_generation);
+	os_atomic_set_long(&source->content_generation, gen);
+}
+
 /* internal initialization */
 static bool obs_source_init(struct obs_source *source)
 {
+	bump_content_generation(source);
 	source->user_volume = 1.0f;
 	source->volume = 1.0f;
 	source->sync_offset = 0;
@@ -212,6 +220,8 @@ static bool obs_source_init(struct obs_source *source)
 
 	if (is_audio_source(source) || is_composite_source(source))
 		allocate_audio_output_buffer(source);
+	if (is_audio_source(source))
+		source->audio_input_ring = bzalloc(sizeof(struct audio_ring));
 	if (source->info.audio_mix)
 		allocate_audio_mix_buffer(source);
 
@@ -243,6 +253,7 @@ static void obs_source_init_finalize(struct obs_source *source)
 		obs->data.first_audio_source = source;
 
 		pthread_mutex_unlock(&obs->data.audio_sources_mutex);
+		obs_audio_graph_changed();
 	}
 
 	obs_context_data_insert(&source->context, &obs->data.sources_mutex,
@@ -663,10 +674,24 @@ void obs_source_frame_init(struct obs_source_frame *frame,
 	}
 }
 
+/* frames of the async cache, which can reference planes of the source */
+static void async_frame_destroy(struct obs_source_frame *frame)
+{
+	if (frame && (frame->flags & OBS_SOURCE_FRAME_EXTERNAL) != 0) {
+		struct async_external_frame *ext =
+			(struct async_external_frame *)frame;
+
+		ext->release(ext->param);
+		bfree(ext);
+	} else {
+		obs_source_frame_destroy(frame);
+	}
+}
+
 static inline void obs_source_frame_decref(struct obs_source_frame *frame)
 {
 	if (os_atomic_dec_long(&frame->refs) == 0)
-		obs_source_frame_destroy(frame);
+		async_frame_destroy(frame);
 }
 
 static bool obs_source_filter_remove_refless(obs_source_t *source,
@@ -707,6 +732,7 @@ void obs_source_destroy(struct obs_source *source)
 				source->prev_next_audio_source;
 	}
 	pthread_mutex_unlock(&obs->data.audio_sources_mutex);
+	obs_audio_graph_changed();
 
 	if (source->filter_parent)
 		obs_source_filter_remove_refless(source->filter_parent, source);
@@ -768,6 +794,10 @@ static void obs_source_destroy_defer(struct obs_source *source)
 		bfree(source->audio_data.data[i]);
 	for (i = 0; i < MAX_AUDIO_CHANNELS; i++)
 		circlebuf_free(&source->audio_input_buf[i]);
+	if (source->audio_input_ring) {
+		audio_ring_free(source->audio_input_ring);
+		bfree(source->audio_input_ring);
+	}
 	audio_resampler_destroy(source->resampler);
 	bfree(source->audio_output_buf[0][0]);
 	bfree(source->audio_mix_buf[0]);
@@ -1023,6 +1053,7 @@ static void obs_source_deferred_update(obs_source_t *source)
 				    source->context.settings);
 		os_atomic_compare_swap_long(&source->defer_update_count, count,
 					    0);
+		bump_content_generation(source);
 	}
 }
 
@@ -1040,6 +1071,7 @@ void obs_source_update(obs_source_t *source, obs_data_t *settings)
 	} else if (source->context.data && source->info.update) {
 		source->info.update(source->context.data,
 				    source->context.settings);
+		bump_content_generation(source);
 	}
 }
 
@@ -1216,6 +1248,8 @@ void obs_source_activate(obs_source_t *source, enum view_type type)
 		os_atomic_inc_long(&source->activate_refs);
 		obs_source_enum_active_tree(source, activate_tree, NULL);
 	}
+
+	obs_audio_graph_changed();
 }
 
 void obs_source_deactivate(obs_source_t *source, enum view_type type)
@@ -1235,6 +1269,8 @@ void obs_source_deactivate(obs_source_t *source, enum view_type type)
 						    NULL);
 		}
 	}
+
+	obs_audio_graph_changed();
 }
 
 static inline struct obs_source_frame *get_closest_frame(obs_source_t *source,
@@ -1283,8 +1319,9 @@ void obs_source_video_tick(obs_source_t *source, float seconds)
 	if (os_atomic_load_long(&source->defer_update_count) > 0)
 		obs_source_deferred_update(source);
 
-	/* reset the filter render texture information once every frame */
-	if (source->filter_texrender)
+	/* reset the filter render texture information once every frame, unless
+	 * it holds a cached render that is checked when the filter renders */
+	if (source->filter_texrender && !source->filter_render_generation)
 		gs_texrender_reset(source->filter_texrender);
 
 	/* call show/hide if the reference changed */
@@ -1372,7 +1409,17 @@ static inline void reset_audio_timing(obs_source_t *source, uint64_t timestamp,
 	source->timing_adjust = os_time - timestamp;
 }
 
+/* called with audio_buf_mutex held, the buffered audio itself is cleared by
+ * the audio thread once it reaches the reset message */
 static void reset_audio_data(obs_source_t *source, uint64_t os_time)
+{
+	if (source->audio_input_ring)
+		audio_ring_push_reset(source->audio_input_ring, os_time);
+
+	source->next_audio_sys_ts_min = os_time;
+}
+
+static void clear_audio_input(obs_source_t *source, uint64_t ts)
 {
 	for (size_t i = 0; i < MAX_AUDIO_CHANNELS; i++) {
 		if (source->audio_input_buf[i].size)
@@ -1381,8 +1428,7 @@ static void reset_audio_data(obs_source_t *source, uint64_t os_time)
 	}
 
 	source->last_audio_input_buf_size = 0;
-	source->audio_ts = os_time;
-	source->next_audio_sys_ts_min = os_time;
+	source->audio_ts = ts;
 }
 
 static void handle_ts_jump(obs_source_t *source, uint64_t expected, uint64_t ts,
@@ -1432,7 +1478,7 @@ static void source_output_audio_place(obs_source_t *source,
 	size_t size = in->frames * sizeof(float);
 
 	if (!source->audio_ts || in->timestamp < source->audio_ts)
-		reset_audio_data(source, in->timestamp);
+		clear_audio_input(source, in->timestamp);
 
 	buf_placement =
 		get_buf_placement(audio, in->timestamp - source->audio_ts) *
@@ -1481,6 +1527,78 @@ static inline void source_output_audio_push_back(obs_source_t *source,
 	source->last_audio_input_buf_size = 0;
 }
 
+/* largest message queued at once, bigger blocks are split */
+#define MAX_QUEUED_FRAMES (AUDIO_RING_FRAMES / 4)
+
+static void source_queue_audio_data(obs_source_t *source,
+				    const struct audio_data *in, bool push_back)
+{
+	size_t sample_rate = audio_output_get_sample_rate(obs->audio.audio);
+	uint32_t channels =
+		(uint32_t)audio_output_get_channels(obs->audio.audio);
+	const uint8_t *data[MAX_AUDIO_CHANNELS];
+	uint64_t timestamp = in->timestamp;
+	uint32_t offset = 0;
+
+	if (!source->audio_input_ring)
+		return;
+
+	while (offset < in->frames) {
+		uint32_t frames = in->frames - offset;
+		if (frames > MAX_QUEUED_FRAMES)
+			frames = MAX_QUEUED_FRAMES;
+
+		for (size_t ch = 0; ch < channels; ch++)
+			data[ch] = in->data[ch] + offset * sizeof(float);
+
+		if (!audio_ring_push_data(source->audio_input_ring, data,
+					  channels, frames, timestamp,
+					  push_back))
+			blog(LOG_DEBUG,
+			     "Audio input queue of '%s' is full, "
+			     "dropped %" PRIu32 " frames",
+			     source->context.name, frames);
+
+		/* the rest of a split block always follows directly */
+		push_back = true;
+		timestamp += conv_frames_to_time(sample_rate, frames);
+		offset += frames;
+	}
+}
+
+void obs_source_drain_audio_input(obs_source_t *source, size_t channels)
+{
+	struct audio_ring *ring = source->audio_input_ring;
+	const struct audio_ring_msg *msg;
+
+	if (!ring)
+		return;
+
+	while ((msg = audio_ring_peek(ring)) != NULL) {
+		if (msg->type == AUDIO_RING_RESET) {
+			clear_audio_input(source, msg->timestamp);
+
+			/* queued before an audio reset changed the channel
+			 * count, drop it */
+		} else if (msg->channels >= channels) {
+			struct audio_data in = {0};
+
+			for (size_t ch = 0; ch < channels; ch++)
+				in.data[ch] = (uint8_t *)audio_ring_plane(
+					ring, msg, ch);
+			in.frames = msg->frames;
+			in.timestamp = msg->timestamp;
+
+			if (msg->push_back && source->audio_ts)
+				source_output_audio_push_back(source, &in);
+			else
+				source_output_audio_place(source, &in);
+		}
+
+		audio_ring_pop(ring);
+	}
+}
+
 static inline bool source_muted(obs_source_t *source, uint64_t os_time)
 {
 	if (source->push_to_mute_enabled && source->user_push_to_mute_pressed)
@@ -1596,12 +1714,8 @@ static void source_output_audio_data(obs_source_t *source,
 		source->last_sync_offset = sync_offset;
 	}
 
-	if (obs_source_get_sends(source)) {
-		if (push_back && source->audio_ts)
-			source_output_audio_push_back(source, &in);
-		else
-			source_output_audio_place(source, &in);
-	}
+	if (obs_source_get_sends(source))
+		source_queue_audio_data(source, &in, push_back);
 
 	pthread_mutex_unlock(&source->audio_buf_mutex);
 
@@ -2768,6 +2882,17 @@ static const char *get_type_format(enum obs_source_type type)
 }
 #endif
 
+static inline void update_async_video_textures(obs_source_t *source)
+{
+	if (source->info.type == OBS_SOURCE_TYPE_INPUT &&
+	    (source->info.output_flags & OBS_SOURCE_ASYNC) != 0 &&
+	    !source->rendering_filter) {
+		if (deinterlacing_enabled(source))
+			deinterlace_update_async_video(source);
+		obs_source_update_async_video(source);
+	}
+}
+
 static inline void render_video(obs_source_t *source)
 {
 	if (source->info.type != OBS_SOURCE_TYPE_FILTER &&
@@ -2777,13 +2902,7 @@ static inline void render_video(obs_source_t *source)
 		return;
 	}
 
-	if (source->info.type == OBS_SOURCE_TYPE_INPUT &&
-	    (source->info.output_flags & OBS_SOURCE_ASYNC) != 0 &&
-	    !source->rendering_filter) {
-		if (deinterlacing_enabled(source))
-			deinterlace_update_async_video(source);
-		obs_source_update_async_video(source);
-	}
+	update_async_video_textures(source);
 
 	if (!source->context.data || !source->enabled) {
 		if (source->filter_parent)
@@ -2825,6 +2944,22 @@ void obs_source_video_render(obs_source_t *source)
 	}
 }
 
+/* called instead of obs_source_video_render when a scene culls the source.
+ * nothing is drawn, but async frames are still uploaded, otherwise the frame
+ * output while the source was hidden would be lost and a stale texture shown
+ * once it becomes visible again */
+void obs_source_video_render_culled(obs_source_t *source)
+{
+	if (!obs_source_valid(source, "obs_source_video_render_culled"))
+		return;
+
+	source = obs_source_get_ref(source);
+	if (source) {
+		update_async_video_textures(source);
+		obs_source_release(source);
+	}
+}
+
 static uint32_t get_recurse_width(obs_source_t *source)
 {
 	uint32_t width;
@@ -2992,8 +3127,10 @@ void obs_source_filter_add(obs_source_t *source, obs_source_t *filter)
 						     : source->filters.array[0];
 
 	da_insert(source->filters, 0, &filter);
+	bump_content_generation(source);
 
 	pthread_mutex_unlock(&source->filter_mutex);
+	obs_audio_graph_changed();
 
 	calldata_init_fixed(&cd, stack, sizeof(stack));
 	calldata_set_ptr(&cd, "source", source);
@@ -3026,8 +3163,10 @@ static bool obs_source_filter_remove_refless(obs_source_t *source,
 	}
 
 	da_erase(source->filters, idx);
+	bump_content_generation(source);
 
 	pthread_mutex_unlock(&source->filter_mutex);
+	obs_audio_graph_changed();
 
 	calldata_init_fixed(&cd, stack, sizeof(stack));
 	calldata_set_ptr(&cd, "source", source);
@@ -3154,6 +3293,8 @@ void obs_source_filter_set_order(obs_source_t *source, obs_source_t *filter,
 
 	pthread_mutex_lock(&source->filter_mutex);
 	success = move_filter_dir(source, filter, movement);
+	if (success)
+		bump_content_generation(source);
 	pthread_mutex_unlock(&source->filter_mutex);
 
 	if (success)
@@ -3225,7 +3366,7 @@ static void copy_frame_data(struct obs_source_frame *dst,
 			    const struct obs_source_frame *src)
 {
 	dst->flip = src->flip;
-	dst->flags = src->flags;
+	dst->flags = src->flags & ~OBS_SOURCE_FRAME_EXTERNAL;
 	dst->trc = src->trc;
 	dst->full_range = src->full_range;
 	dst->timestamp = src->timestamp;
@@ -3336,7 +3477,7 @@ static void clean_cache(obs_source_t *source)
 		struct async_frame *af = &source->async_cache.array[i - 1];
 		if (!af->used) {
 			if (++af->unused_count == MAX_UNUSED_FRAME_DURATION) {
-				obs_source_frame_destroy(af->frame);
+				async_frame_destroy(af->frame);
 				da_erase(source->async_cache, i - 1);
 			}
 		}
@@ -3344,19 +3485,16 @@ static void clean_cache(obs_source_t *source)
 }
 
 #define MAX_ASYNC_FRAMES 30
-//if return value is not null then do (os_atomic_dec_long(&output->refs) == 0) && obs_source_frame_destroy(output)
-static inline struct obs_source_frame *
-cache_video(struct obs_source *source, const struct obs_source_frame *frame)
-{
-	struct obs_source_frame *new_frame = NULL;
-
-	pthread_mutex_lock(&source->async_mutex);
 
+/* must be called with async_mutex locked, returns false if the queue
+ * overflowed and was flushed */
+static bool prepare_async_cache(struct obs_source *source,
+				const struct obs_source_frame *frame)
+{
 	if (source->async_frames.num >= MAX_ASYNC_FRAMES) {
 		free_async_cache(source);
 		source->last_frame_ts = 0;
-		pthread_mutex_unlock(&source->async_mutex);
-		return NULL;
+		return false;
 	}
 
 	if (async_texture_changed(source, frame)) {
@@ -3365,10 +3503,26 @@ cache_video(struct obs_source *source, const struct obs_source_frame *frame)
 		source->async_cache_height = frame->height;
 	}
 
-	const enum video_format format = frame->format;
-	source->async_cache_format = format;
+	source->async_cache_format = frame->format;
 	source->async_cache_full_range = frame->full_range;
 	source->async_cache_trc = frame->trc;
+	return true;
+}
+
+//if return value is not null then do (os_atomic_dec_long(&output->refs) == 0) && obs_source_frame_destroy(output)
+static inline struct obs_source_frame *
+cache_video(struct obs_source *source, const struct obs_source_frame *frame)
+{
+	struct obs_source_frame *new_frame = NULL;
+
+	pthread_mutex_lock(&source->async_mutex);
+
+	if (!prepare_async_cache(source, frame)) {
+		pthread_mutex_unlock(&source->async_mutex);
+		return NULL;
+	}
+
+	const enum video_format format = frame->format;
 
 	for (size_t i = 0; i < source->async_cache.num; i++) {
 		struct async_frame *af = &source->async_cache.array[i];
@@ -3405,12 +3559,75 @@ cache_video(struct obs_source *source, const struct obs_source_frame *frame)
 	return new_frame;
 }
 
+/* same as cache_video, but the new frame references the planes of the
+ * source instead of a copy.  the frame is not reused like the other cache
+ * entries, remove_async_frame drops it as soon as it is done */
+static struct obs_source_frame *
+cache_external_video(struct obs_source *source,
+		     const struct obs_source_frame *frame,
+		     obs_source_frame_release_t release, void *param)
+{
+	struct async_external_frame *ext;
+	struct async_frame new_af;
+
+	pthread_mutex_lock(&source->async_mutex);
+
+	if (!prepare_async_cache(source, frame)) {
+		pthread_mutex_unlock(&source->async_mutex);
+		release(param);
+		return NULL;
+	}
+
+	clean_cache(source);
+
+	ext = bzalloc(sizeof(*ext));
+	ext->frame = *frame;
+	ext->frame.flags |= OBS_SOURCE_FRAME_EXTERNAL;
+	ext->frame.prev_frame = false;
+	ext->frame.refs = 2;
+	ext->release = release;
+	ext->param = param;
+
+	new_af.frame = &ext->frame;
+	new_af.used = true;
+	new_af.unused_count = 0;
+	da_push_back(source->async_cache, &new_af);
+
+	pthread_mutex_unlock(&source->async_mutex);
+	return &ext->frame;
+}
+
+static bool has_async_video_filters(obs_source_t *source)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&source->filter_mutex);
+
+	for (size_t i = 0; i < source->filters.num; i++) {
+		struct obs_source *filter = source->filters.array[i];
+
+		if (filter->enabled && filter->context.data &&
+		    filter->info.filter_video) {
+			found = true;
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&source->filter_mutex);
+	return found;
+}
+
 static void
 obs_source_output_video_internal(obs_source_t *source,
-				 const struct obs_source_frame *frame)
+				 const struct obs_source_frame *frame,
+				 obs_source_frame_release_t release,
+				 void *param)
 {
-	if (!obs_source_valid(source, "obs_source_output_video"))
+	if (!obs_source_valid(source, "obs_source_output_video")) {
+		if (release)
+			release(param);
 		return;
+	}
 
 	if (!frame) {
 		pthread_mutex_lock(&source->async_mutex);
@@ -3421,13 +3638,22 @@ obs_source_output_video_internal(obs_source_t *source,
 		return;
 	}
 
-	struct obs_source_frame *output = cache_video(source, frame);
+	struct obs_source_frame *output;
+
+	if (!release) {
+		output = cache_video(source, frame);
+	} else if (has_async_video_filters(source)) {
+		output = cache_video(source, frame);
+		release(param);
+	} else {
+		output = cache_external_video(source, frame, release, param);
+	}
 
 	/* ------------------------------------------- */
 	pthread_mutex_lock(&source->async_mutex);
 	if (output) {
 		if (os_atomic_dec_long(&output->refs) == 0) {
-			obs_source_frame_destroy(output);
+			async_frame_destroy(output);
 			output = NULL;
 		} else {
 			da_push_back(source->async_frames, &output);
@@ -3443,7 +3669,7 @@ void obs_source_output_video(obs_source_t *source,
 	if (destroying(source))
 		return;
 	if (!frame) {
-		obs_source_output_video_internal(source, NULL);
+		obs_source_output_video_internal(source, NULL, NULL, NULL);
 		return;
 	}
 
@@ -3451,7 +3677,7 @@ void obs_source_output_video(obs_source_t *source,
 	new_frame.full_range =
 		format_is_yuv(frame->format) ? new_frame.full_range : true;
 
-	obs_source_output_video_internal(source, &new_frame);
+	obs_source_output_video_internal(source, &new_frame, NULL, NULL);
 }
 
 void obs_source_output_video2(obs_source_t *source,
@@ -3460,7 +3686,7 @@ void obs_source_output_video2(obs_source_t *source,
 	if (destroying(source))
 		return;
 	if (!frame) {
-		obs_source_output_video_internal(source, NULL);
+		obs_source_output_video_internal(source, NULL, NULL, NULL);
 		return;
 	}
 
@@ -3489,7 +3715,31 @@ void obs_source_output_video2(obs_source_t *source,
 	memcpy(&new_frame.color_range_max, &frame->color_range_max,
 	       sizeof(frame->color_range_max));
 
-	obs_source_output_video_internal(source, &new_frame);
+	obs_source_output_video_internal(source, &new_frame, NULL, NULL);
+}
+
+void obs_source_output_video_nocopy(obs_source_t *source,
+				    const struct obs_source_frame *frame,
+				    obs_source_frame_release_t release,
+				    void *param)
+{
+	if (!release) {
+		obs_source_output_video(source, frame);
+		return;
+	}
+	if (destroying(source) || !frame) {
+		release(param);
+		if (!frame)
+			obs_source_output_video(source, NULL);
+		return;
+	}
+
+	struct obs_source_frame new_frame = *frame;
+	new_frame.full_range =
+		format_is_yuv(frame->format) ? new_frame.full_range : true;
+	new_frame.flags &= ~OBS_SOURCE_FRAME_EXTERNAL;
+
+	obs_source_output_video_internal(source, &new_frame, release, param);
 }
 
 void obs_source_set_async_rotation(obs_source_t *source, long rotation)
@@ -4009,7 +4259,14 @@ void remove_async_frame(obs_source_t *source, struct obs_source_frame *frame)
 		struct async_frame *f = &source->async_cache.array[i];
 
 		if (f->frame == frame) {
-			f->used = false;
+			/* external planes go back to the source right away
+			 * instead of being reused */
+			if (frame->flags & OBS_SOURCE_FRAME_EXTERNAL) {
+				da_erase(source->async_cache, i);
+				obs_source_frame_decref(frame);
+			} else {
+				f->used = false;
+			}
 			break;
 		}
 	}
@@ -4160,12 +4417,12 @@ void obs_source_release_frame(obs_source_t *source,
 		return;
 
 	if (!source) {
-		obs_source_frame_destroy(frame);
+		async_frame_destroy(frame);
 	} else {
 		pthread_mutex_lock(&source->async_mutex);
 
 		if (os_atomic_dec_long(&frame->refs) == 0)
-			obs_source_frame_destroy(frame);
+			async_frame_destroy(frame);
 		else
 			remove_async_frame(source, frame);
 
@@ -4269,6 +4526,87 @@ static inline void render_filter_tex(gs_texture_t *tex, gs_effect_t *effect,
 	gs_enable_framebuffer_srgb(previous);
 }
 
+/* content generations are unique, increasing stamps, so the newest stamp of
+ * everything that goes into a render changes whenever any part of it does.
+ * a generation of 0 means the render may change at any time. */
+
+static inline long get_source_generation(obs_source_t *source)
+{
+	const uint32_t flags = source->info.output_flags;
+
+	if ((flags & OBS_SOURCE_CACHEABLE) == 0 ||
+	    (flags & OBS_SOURCE_ASYNC) != 0)
+		return 0;
+
+	return os_atomic_load_long(&source->content_generation);
+}
+
+/* generation of what target renders as part of the filter chain of parent */
+static long get_chain_generation(obs_source_t *target, obs_source_t *parent)
+{
+	long chain_gen = 0;
+	long gen;
+
+	for (; target && target != parent; target = target->filter_target) {
+		/* disabled filters just pass their target through, but their
+		 * stamp still counts so that toggling them is noticed */
+		if (target->enabled)
+			gen = get_source_generation(target);
+		else
+			gen = os_atomic_load_long(&target->content_generation);
+
+		if (!gen)
+			return 0;
+		if (gen > chain_gen)
+			chain_gen = gen;
+	}
+
+	gen = target ? get_source_generation(parent) : 0;
+	if (!gen)
+		return 0;
+
+	return (gen > chain_gen) ? gen : chain_gen;
+}
+
+long obs_source_get_render_generation(obs_source_t *source)
+{
+	long gen;
+
+	pthread_mutex_lock(&source->filter_mutex);
+	gen = source->filters.num
+		      ? get_chain_generation(source->filters.array[0], source)
+		      : get_source_generation(source);
+	pthread_mutex_unlock(&source->filter_mutex);
+
+	return gen;
+}
+
+/* checks whether texrender, holding a cx by cy render of content with the
+ * given generation, can be reused and resets it if not.  renders without a
+ * generation are reset on every tick instead, so that they are still only
+ * drawn once per frame. */
+bool obs_source_check_render_cache(obs_source_t *source,
+				   gs_texrender_t *texrender, long generation,
+				   long *cached_generation, uint32_t cx,
+				   uint32_t cy)
+{
+	gs_texture_t *tex = gs_texrender_get_texture(texrender);
+
+	if (generation && generation == *cached_generation && tex &&
+	    gs_texture_get_width(tex) == cx &&
+	    gs_texture_get_height(tex) == cy) {
+		os_atomic_inc_long(&source->render_cache_hits);
+		return true;
+	}
+
+	if (generation || *cached_generation)
+		gs_texrender_reset(texrender);
+
+	*cached_generation = generation;
+	os_atomic_inc_long(&source->render_cache_misses);
+	return false;
+}
+
 static inline bool can_bypass(obs_source_t *target, obs_source_t *parent,
 			      uint32_t filter_flags, uint32_t parent_flags,
 			      enum obs_allow_direct_render allow_direct,
@@ -4352,6 +4690,11 @@ bool obs_source_process_filter_begin_with_color_space(
 			gs_texrender_create(format, GS_ZS_NONE);
 	}
 
+	obs_source_check_render_cache(filter, filter->filter_texrender,
+				      get_chain_generation(target, parent),
+				      &filter->filter_render_generation, cx,
+				      cy);
+
 	if (gs_texrender_begin_with_color_space(filter->filter_texrender, cx,
 						cy, space)) {
 		gs_blend_state_push();
@@ -4932,6 +5275,24 @@ void obs_source_draw(gs_texture_t *texture, int x, int y, uint32_t cx,
 	gs_enable_framebuffer_srgb(previous);
 }
 
+void obs_source_content_changed(obs_source_t *source)
+{
+	if (obs_source_valid(source, "obs_source_content_changed"))
+		bump_content_generation(source);
+}
+
+float obs_source_get_render_cache_hit_rate(const obs_source_t *source)
+{
+	long hits, misses;
+
+	if (!obs_source_valid(source, "obs_source_get_render_cache_hit_rate"))
+		return 0.0f;
+
+	hits = os_atomic_load_long(&source->render_cache_hits);
+	misses = os_atomic_load_long(&source->render_cache_misses);
+	return (hits + misses) ? (float)hits / (float)(hits + misses) : 0.0f;
+}
+
 void obs_source_inc_showing(obs_source_t *source)
 {
 	if (obs_source_valid(source, "obs_source_inc_showing"))
@@ -5031,6 +5392,7 @@ void obs_source_set_enabled(obs_source_t *source, bool enabled)
 		return;
 
 	source->enabled = enabled;
+	bump_content_generation(source);
 
 	calldata_init_fixed(&data, stack, sizeof(stack));
 	calldata_set_ptr(&data, "source", source);
@@ -5269,27 +5631,43 @@ static float get_source_volume(obs_source_t *source, uint64_t os_time)
 	return source->volume;
 }
 
+/* the output planes are AUDIO_OUTPUT_FRAMES apart, of which only the
+ * frames of the current tick are used */
+static inline void clear_output_audio(obs_source_t *source, size_t mix,
+				      size_t channels, size_t frames)
+{
+	if (frames == AUDIO_OUTPUT_FRAMES) {
+		memset(source->audio_output_buf[mix][0], 0,
+		       AUDIO_OUTPUT_FRAMES * sizeof(float) * channels);
+		return;
+	}
+
+	for (size_t ch = 0; ch < channels; ch++)
+		memset(source->audio_output_buf[mix][ch], 0,
+		       frames * sizeof(float));
+}
+
 static inline void multiply_output_audio(obs_source_t *source, size_t mix,
-					 size_t channels, float vol)
+					 size_t channels, size_t frames,
+					 float vol)
 {
-	register float *out = source->audio_output_buf[mix][0];
-	register float *end = out + AUDIO_OUTPUT_FRAMES * channels;
+	if (frames == AUDIO_OUTPUT_FRAMES) {
+		audio_simd_gain(source->audio_output_buf[mix][0], vol,
+				AUDIO_OUTPUT_FRAMES * channels);
+		return;
+	}
 
-	while (out < end)
-		*(out++) *= vol;
+	for (size_t ch = 0; ch < channels; ch++)
+		audio_simd_gain(source->audio_output_buf[mix][ch], vol, frames);
 }
 
 static inline void multiply_vol_data(obs_source_t *source, size_t mix,
-				     size_t channels, float *vol_data)
+				     size_t channels, size_t frames,
+				     float *vol_data)
 {
-	for (size_t ch = 0; ch < channels; ch++) {
-		register float *out = source->audio_output_buf[mix][ch];
-		register float *end = out + AUDIO_OUTPUT_FRAMES;
-		register float *vol = vol_data;
-
-		while (out < end)
-			*(out++) *= *(vol++);
-	}
+	for (size_t ch = 0; ch < channels; ch++)
+		audio_simd_gain_buf(source->audio_output_buf[mix][ch],
+				    vol_data, frames);
 }
 
 static inline void apply_audio_action(obs_source_t *source,
@@ -5314,11 +5692,12 @@ static inline void apply_audio_action(obs_source_t *source,
 	}
 }
 
-static void apply_audio_actions(obs_source_t *source, size_t channels,
-				size_t sample_rate)
+static void apply_audio_actions(obs_source_t *source, uint32_t mixers,
+				size_t channels, size_t sample_rate)
 {
 	float vol_data[AUDIO_OUTPUT_FRAMES];
 	float cur_vol = get_source_volume(source, source->audio_ts);
+	size_t frames = obs->audio.frames_per_tick;
 	size_t frame_num = 0;
 
 	pthread_mutex_lock(&source->audio_actions_mutex);
@@ -5334,7 +5713,7 @@ static void apply_audio_actions(obs_source_t *source, size_t channels,
 		new_frame_num = conv_time_to_frames(
 			sample_rate, timestamp - source->audio_ts);
 
-		if (new_frame_num >= AUDIO_OUTPUT_FRAMES)
+		if (new_frame_num >= frames)
 			break;
 
 		da_erase(source->audio_actions, i--);
@@ -5349,20 +5728,24 @@ static void apply_audio_actions(obs_source_t *source, size_t channels,
 		cur_vol = get_source_volume(source, timestamp);
 	}
 
-	for (; frame_num < AUDIO_OUTPUT_FRAMES; frame_num++)
+	for (; frame_num < frames; frame_num++)
 		vol_data[frame_num] = cur_vol;
 
 	pthread_mutex_unlock(&source->audio_actions_mutex);
 
 	for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
-		if ((source->audio_mixers & (1 << mix)) != 0)
-			multiply_vol_data(source, mix, channels, vol_data);
+		uint32_t mix_and_val = (1 << mix);
+		if ((source->audio_mixers & mix_and_val) != 0 &&
+		    (mixers & mix_and_val) != 0)
+			multiply_vol_data(source, mix, channels, frames,
+					  vol_data);
 	}
 }
 
 static void apply_audio_volume(obs_source_t *source, uint32_t mixers,
 			       size_t channels, size_t sample_rate)
 {
+	size_t frames = obs->audio.frames_per_tick;
 	struct audio_action action;
 	bool actions_pending;
 	float vol;
@@ -5377,10 +5760,11 @@ static void apply_audio_volume(obs_source_t *source, uint32_t mixers,
 
 	if (actions_pending) {
 		uint64_t duration =
-			conv_frames_to_time(sample_rate, AUDIO_OUTPUT_FRAMES);
+			conv_frames_to_time(sample_rate, frames);
 
 		if (action.timestamp < (source->audio_ts + duration)) {
-			apply_audio_actions(source, channels, sample_rate);
+			apply_audio_actions(source, mixers, channels,
+					    sample_rate);
 			return;
 		}
 	}
@@ -5390,9 +5774,11 @@ static void apply_audio_volume(obs_source_t *source, uint32_t mixers,
 		return;
 
 	if (vol == 0.0f || mixers == 0) {
-		memset(source->audio_output_buf[0][0], 0,
-		       AUDIO_OUTPUT_FRAMES * sizeof(float) *
-			       MAX_AUDIO_CHANNELS * MAX_AUDIO_MIXES);
+		for (size_t mix = 0; mix < MAX_AUDIO_MIXES; mix++) {
+			if ((mixers & (1 << mix)) != 0)
+				clear_output_audio(source, mix, channels,
+						   frames);
+		}
 		return;
 	}
 
@@ -5400,7 +5786,8 @@ static void apply_audio_volume(obs_source_t *source, uint32_t mixers,
 		uint32_t mix_and_val = (1 << mix);
 		if ((source->audio_mixers & mix_and_val) != 0 &&
 		    (mixers & mix_and_val) != 0)
-			multiply_output_audio(source, mix, channels, vol);
+			multiply_output_audio(source, mix, channels, frames,
+					      vol);
 	}
 }
 
@@ -5416,8 +5803,10 @@ static void custom_audio_render(obs_source_t *source, uint32_t mixers,
 			audio_data.output[mix].data[ch] =
 				source->audio_output_buf[mix][ch];
 		}
-		memset(source->audio_output_buf[mix][0], 0,
-		       sizeof(float) * AUDIO_OUTPUT_FRAMES * channels);
+
+		if ((mixers & (1 << mix)) != 0)
+			clear_output_audio(source, mix, channels,
+					   obs->audio.frames_per_tick);
 	}
 
 	success = source->info.audio_render(source->context.data, &ts,
@@ -5457,7 +5846,7 @@ static void audio_submix(obs_source_t *source, size_t channels,
 		audio.data[i] = (const uint8_t *)audio_data.data[i];
 
 	audio.samples_per_sec = (uint32_t)sample_rate;
-	audio.frames = AUDIO_OUTPUT_FRAMES;
+	audio.frames = obs->audio.frames_per_tick;
 	audio.format = AUDIO_FORMAT_FLOAT_PLANAR;
 	audio.speakers = (enum speaker_layout)channels;
 	audio.timestamp = ts;
@@ -5471,11 +5860,8 @@ static inline void process_audio_source_tick(obs_source_t *source,
 {
 	bool audio_submix = !!(source->info.output_flags & OBS_SOURCE_SUBMIX);
 
-	pthread_mutex_lock(&source->audio_buf_mutex);
-
 	if (source->audio_input_buf[0].size < size) {
 		source->audio_pending = true;
-		pthread_mutex_unlock(&source->audio_buf_mutex);
 		return;
 	}
 
@@ -5483,8 +5869,6 @@ static inline void process_audio_source_tick(obs_source_t *source,
 		circlebuf_peek_front(&source->audio_input_buf[ch],
 				     source->audio_output_buf[0][ch], size);
 
-	pthread_mutex_unlock(&source->audio_buf_mutex);
-
 	for (size_t mix = 1; mix < MAX_AUDIO_MIXES; mix++) {
 		uint32_t mix_and_val = (1 << mix);
 
@@ -5494,11 +5878,13 @@ static inline void process_audio_source_tick(obs_source_t *source,
 
 			mixers = 1;
 			mix_and_val = 1;
+		} else if ((mixers & mix_and_val) == 0) {
+			continue;
 		}
 
 		if ((source->audio_mixers & mix_and_val) == 0) {
-			memset(source->audio_output_buf[mix][0], 0,
-			       size * channels);
+			clear_output_audio(source, mix, channels,
+					   size / sizeof(float));
 			continue;
 		}
 
@@ -5513,7 +5899,7 @@ static inline void process_audio_source_tick(obs_source_t *source,
 	}
 
 	if ((source->audio_mixers & 1) == 0)
-		memset(source->audio_output_buf[0][0], 0, size * channels);
+		clear_output_audio(source, 0, channels, size / sizeof(float));
 
 	apply_audio_volume(source, mixers, channels, sample_rate);
 	source->audio_pending = false;
@@ -6033,6 +6419,7 @@ void obs_source_restore_filters(obs_source_t *source, obs_data_array_t *array)
 
 	pthread_mutex_lock(&source->filter_mutex);
 	da_move(source->filters, new_filters);
+	bump_content_generation(source);
 	pthread_mutex_unlock(&source->filter_mutex);
 
 	/* release filters */
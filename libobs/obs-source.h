@@ -207,6 +207,18 @@ enum obs_media_state {
  */
 #define OBS_SOURCE_TRACK (1 << 17)
 
+/**
+ * Source always renders fully opaque pixels over its whole area, so scenes
+ * may skip rendering anything it completely covers
+ */
+#define OBS_SOURCE_OPAQUE (1 << 18)
+
+/**
+ * Source output only changes on updates or when the source calls
+ * obs_source_content_changed, so renders of it may be cached
+ */
+#define OBS_SOURCE_CACHEABLE (1 << 19)
+
 /** @} */
 
 typedef void (*obs_source_enum_proc_t)(obs_source_t *parent,
@@ -556,6 +568,17 @@ struct obs_source_info {
 	enum gs_color_space (*video_get_color_space)(
 		void *data, size_t count,
 		const enum gs_color_space *preferred_spaces);
+
+	/**
+	 * Returns whether the source currently renders fully opaque pixels
+	 * over its whole area, for sources whose opacity depends on their
+	 * content or settings.  Sources that are always opaque can set
+	 * OBS_SOURCE_OPAQUE instead.  Called from the graphics thread.
+	 *
+	 * @param  data  Source data
+	 * @return       true if nothing beneath the source can be seen
+	 */
+	bool (*is_opaque)(void *data);
 };
 
 EXPORT void obs_register_source_s(const struct obs_source_info *info,
@@ -113,16 +113,50 @@ static inline void set_render_size(uint32_t width, uint32_t height)
 	gs_set_viewport(0, 0, width, height);
 }
 
-static inline void unmap_last_surface(struct obs_core_video *video)
+static inline void unmap_copy_surfaces(struct obs_core_video *video, int set)
 {
 	for (int c = 0; c < NUM_CHANNELS; ++c) {
-		if (video->mapped_surfaces[c]) {
-			gs_stagesurface_unmap(video->mapped_surfaces[c]);
-			video->mapped_surfaces[c] = NULL;
+		if (video->mapped_surfaces[set][c]) {
+			gs_stagesurface_unmap(video->mapped_surfaces[set][c]);
+			video->mapped_surfaces[set][c] = NULL;
 		}
 	}
 }
 
+/* the video thread only flags the sets it is done with, unmapping them has to
+ * happen on the graphics thread */
+static inline void reclaim_copy_surfaces(struct obs_core_video *video)
+{
+	for (int i = 0; i < NUM_COPY_SURFACES; i++) {
+		if (!os_atomic_load_bool(&video->copy_surfaces_released[i]))
+			continue;
+
+		unmap_copy_surfaces(video, i);
+		os_atomic_set_bool(&video->copy_surfaces_released[i], false);
+		video->copy_surfaces_busy[i] = false;
+	}
+}
+
+static int get_free_copy_surfaces(struct obs_core_video *video)
+{
+	for (size_t i = 0; i < video->num_copy_surfaces; i++) {
+		if (!video->copy_surfaces_busy[i])
+			return (int)i;
+	}
+
+	if (video->num_copy_surfaces < NUM_COPY_SURFACES) {
+		size_t set = video->num_copy_surfaces;
+		if (obs_init_copy_surfaces(set)) {
+			blog(LOG_DEBUG, "Added raw video staging surface "
+					"set %d",
+			     (int)set + 1);
+			return (int)set;
+		}
+	}
+
+	return -1;
+}
+
 static const char *render_main_texture_name = "render_main_texture";
 static inline void render_main_texture(struct obs_core_video *video)
 {
@@ -383,12 +417,39 @@ static const char *stage_output_texture_name = "stage_output_texture";
 static inline void
 stage_output_texture(struct obs_core_video *video, int cur_texture,
 		     gs_texture_t *const *const convert_textures,
-		     gs_stagesurf_t *const *const copy_surfaces,
-		     size_t channel_count)
+		     bool encode_surfaces, size_t channel_count)
 {
+	gs_stagesurf_t *const *copy_surfaces;
+	int set;
+
 	profile_start(stage_output_texture_name);
 
-	unmap_last_surface(video);
+	reclaim_copy_surfaces(video);
+
+	video->textures_copied[cur_texture] = false;
+	video->textures_dropped[cur_texture] = false;
+	for (size_t i = 0; i < NUM_CHANNELS; i++)
+		video->active_copy_surfaces[cur_texture][i] = NULL;
+
+	if (video->gpu_conversion && !video->texture_converted)
+		goto end;
+
+	/* every set is still mapped by raw outputs, so this frame is dropped
+	 * and the previous one repeated in its place */
+	set = get_free_copy_surfaces(video);
+	if (set == -1) {
+		video_output_inc_texture_skipped_frames(video->video);
+		video->textures_dropped[cur_texture] = true;
+		goto end;
+	}
+
+	copy_surfaces = video->copy_surfaces[set];
+#ifdef _WIN32
+	if (encode_surfaces)
+		copy_surfaces = &video->copy_surfaces_encode[set];
+#else
+	UNUSED_PARAMETER(encode_surfaces);
+#endif
 
 	if (!video->gpu_conversion) {
 		gs_stagesurf_t *copy = copy_surfaces[0];
@@ -396,9 +457,7 @@ stage_output_texture(struct obs_core_video *video, int cur_texture,
 			gs_stage_texture(copy, video->output_texture);
 			video->active_copy_surfaces[cur_texture][0] = copy;
 		}
-
-		video->textures_copied[cur_texture] = true;
-	} else if (video->texture_converted) {
+	} else {
 		for (size_t i = 0; i < channel_count; i++) {
 			gs_stagesurf_t *copy = copy_surfaces[i];
 			if (copy) {
@@ -407,10 +466,13 @@ stage_output_texture(struct obs_core_video *video, int cur_texture,
 					copy;
 			}
 		}
-
-		video->textures_copied[cur_texture] = true;
 	}
 
+	video->active_copy_set[cur_texture] = set;
+	video->copy_surfaces_busy[set] = true;
+	video->textures_copied[cur_texture] = true;
+
+end:
 	profile_end(stage_output_texture_name);
 }
 
@@ -519,15 +581,14 @@ static inline void render_video(struct obs_core_video *video, bool raw_active,
 
 	if (raw_active || gpu_active) {
 		gs_texture_t *const *convert_textures = video->convert_textures;
-		gs_stagesurf_t *const *copy_surfaces =
-			video->copy_surfaces[cur_texture];
+		bool encode_surfaces = false;
 		size_t channel_count = NUM_CHANNELS;
 		gs_texture_t *texture = render_output_texture(video);
 
 #ifdef _WIN32
 		if (gpu_active) {
 			convert_textures = video->convert_textures_encode;
-			copy_surfaces = video->copy_surfaces_encode;
+			encode_surfaces = true;
 			channel_count = 1;
 			gs_flush();
 		}
@@ -546,7 +607,7 @@ static inline void render_video(struct obs_core_video *video, bool raw_active,
 
 		if (raw_active)
 			stage_output_texture(video, cur_texture,
-					     convert_textures, copy_surfaces,
+					     convert_textures, encode_surfaces,
 					     channel_count);
 	}
 
@@ -557,228 +618,74 @@ static inline void render_video(struct obs_core_video *video, bool raw_active,
 }
 
 static inline bool download_frame(struct obs_core_video *video,
-				  int prev_texture, struct video_data *frame)
+				  int prev_texture, struct video_data *frame,
+				  int *p_set)
 {
+	int set = video->active_copy_set[prev_texture];
+
 	if (!video->textures_copied[prev_texture])
 		return false;
 
+	video->textures_copied[prev_texture] = false;
+
 	for (int channel = 0; channel < NUM_CHANNELS; ++channel) {
 		gs_stagesurf_t *surface =
 			video->active_copy_surfaces[prev_texture][channel];
 		if (surface) {
 			if (!gs_stagesurface_map(surface, &frame->data[channel],
-						 &frame->linesize[channel]))
+						 &frame->linesize[channel])) {
+				unmap_copy_surfaces(video, set);
+				video->copy_surfaces_busy[set] = false;
 				return false;
+			}
 
-			video->mapped_surfaces[channel] = surface;
+			video->mapped_surfaces[set][channel] = surface;
 		}
 	}
+
+	*p_set = set;
 	return true;
 }
 
-static const uint8_t *set_gpu_converted_plane(uint32_t width, uint32_t height,
-					      uint32_t linesize_input,
-					      uint32_t linesize_output,
-					      const uint8_t *in, uint8_t *out)
+/* semi-planar formats staged to a single surface have their chroma plane
+ * right below the luma plane */
+static inline void set_packed_uv_plane(struct video_data *frame,
+				       const struct video_output_info *info)
 {
-	if ((width == linesize_input) && (width == linesize_output)) {
-		size_t total = (size_t)width * (size_t)height;
-		memcpy(out, in, total);
-		in += total;
-	} else {
-		for (size_t y = 0; y < height; y++) {
-			memcpy(out, in, width);
-			out += linesize_output;
-			in += linesize_input;
-		}
-	}
-
-	return in;
-}
+	if (frame->linesize[1])
+		return;
 
-static void set_gpu_converted_data(struct obs_core_video *video,
-				   struct video_frame *output,
-				   const struct video_data *input,
-				   const struct video_output_info *info)
-{
 	switch (info->format) {
-	case VIDEO_FORMAT_I420: {
-		const uint32_t width = info->width;
-		const uint32_t height = info->height;
-
-		set_gpu_converted_plane(width, height, input->linesize[0],
-					output->linesize[0], input->data[0],
-					output->data[0]);
-
-		const uint32_t width_d2 = width / 2;
-		const uint32_t height_d2 = height / 2;
-
-		set_gpu_converted_plane(width_d2, height_d2, input->linesize[1],
-					output->linesize[1], input->data[1],
-					output->data[1]);
-
-		set_gpu_converted_plane(width_d2, height_d2, input->linesize[2],
-					output->linesize[2], input->data[2],
-					output->data[2]);
-
-		break;
-	}
-	case VIDEO_FORMAT_NV12: {
-		const uint32_t width = info->width;
-		const uint32_t height = info->height;
-		const uint32_t height_d2 = height / 2;
-		if (input->linesize[1]) {
-			set_gpu_converted_plane(width, height,
-						input->linesize[0],
-						output->linesize[0],
-						input->data[0],
-						output->data[0]);
-			set_gpu_converted_plane(width, height_d2,
-						input->linesize[1],
-						output->linesize[1],
-						input->data[1],
-						output->data[1]);
-		} else {
-			const uint8_t *const in_uv = set_gpu_converted_plane(
-				width, height, input->linesize[0],
-				output->linesize[0], input->data[0],
-				output->data[0]);
-			set_gpu_converted_plane(width, height_d2,
-						input->linesize[0],
-						output->linesize[1], in_uv,
-						output->data[1]);
-		}
-
-		break;
-	}
-	case VIDEO_FORMAT_I444: {
-		const uint32_t width = info->width;
-		const uint32_t height = info->height;
-
-		set_gpu_converted_plane(width, height, input->linesize[0],
-					output->linesize[0], input->data[0],
-					output->data[0]);
-
-		set_gpu_converted_plane(width, height, input->linesize[1],
-					output->linesize[1], input->data[1],
-					output->data[1]);
-
-		set_gpu_converted_plane(width, height, input->linesize[2],
-					output->linesize[2], input->data[2],
-					output->data[2]);
-
+	case VIDEO_FORMAT_NV12:
+	case VIDEO_FORMAT_P010:
+		frame->data[1] = frame->data[0] +
+				 (size_t)frame->linesize[0] * info->height;
+		frame->linesize[1] = frame->linesize[0];
 		break;
-	}
-	case VIDEO_FORMAT_I010: {
-		const uint32_t width = info->width;
-		const uint32_t height = info->height;
-
-		set_gpu_converted_plane(width * 2, height, input->linesize[0],
-					output->linesize[0], input->data[0],
-					output->data[0]);
-
-		const uint32_t height_d2 = height / 2;
-
-		set_gpu_converted_plane(width, height_d2, input->linesize[1],
-					output->linesize[1], input->data[1],
-					output->data[1]);
-
-		set_gpu_converted_plane(width, height_d2, input->linesize[2],
-					output->linesize[2], input->data[2],
-					output->data[2]);
-
-		break;
-	}
-	case VIDEO_FORMAT_P010: {
-		const uint32_t width_x2 = info->width * 2;
-		const uint32_t height = info->height;
-		const uint32_t height_d2 = height / 2;
-		if (input->linesize[1]) {
-			set_gpu_converted_plane(width_x2, height,
-						input->linesize[0],
-						output->linesize[0],
-						input->data[0],
-						output->data[0]);
-			set_gpu_converted_plane(width_x2, height_d2,
-						input->linesize[1],
-						output->linesize[1],
-						input->data[1],
-						output->data[1]);
-		} else {
-			const uint8_t *const in_uv = set_gpu_converted_plane(
-				width_x2, height, input->linesize[0],
-				output->linesize[0], input->data[0],
-				output->data[0]);
-			set_gpu_converted_plane(width_x2, height_d2,
-						input->linesize[0],
-						output->linesize[1], in_uv,
-						output->data[1]);
-		}
-
+	default:
 		break;
 	}
-
-	case VIDEO_FORMAT_NONE:
-	case VIDEO_FORMAT_YVYU:
-	case VIDEO_FORMAT_YUY2:
-	case VIDEO_FORMAT_UYVY:
-	case VIDEO_FORMAT_RGBA:
-	case VIDEO_FORMAT_BGRA:
-	case VIDEO_FORMAT_BGRX:
-	case VIDEO_FORMAT_Y800:
-	case VIDEO_FORMAT_BGR3:
-	case VIDEO_FORMAT_I422:
-	case VIDEO_FORMAT_I40A:
-	case VIDEO_FORMAT_I42A:
-	case VIDEO_FORMAT_YUVA:
-	case VIDEO_FORMAT_AYUV:
-		/* unimplemented */
-		;
-	}
 }
 
-static inline void copy_rgbx_frame(struct video_frame *output,
-				   const struct video_data *input,
-				   const struct video_output_info *info)
+static void release_copy_surfaces(void *param)
 {
-	uint8_t *in_ptr = input->data[0];
-	uint8_t *out_ptr = output->data[0];
-
-	/* if the line sizes match, do a single copy */
-	if (input->linesize[0] == output->linesize[0]) {
-		memcpy(out_ptr, in_ptr,
-		       (size_t)input->linesize[0] * (size_t)info->height);
-	} else {
-		const size_t copy_size = (size_t)info->width * 4;
-		for (size_t y = 0; y < info->height; y++) {
-			memcpy(out_ptr, in_ptr, copy_size);
-			in_ptr += input->linesize[0];
-			out_ptr += output->linesize[0];
-		}
-	}
+	volatile bool *released = param;
+	os_atomic_set_bool(released, true);
 }
 
+/* the mapped staging memory is handed to the raw outputs as is, and the set
+ * stays busy until the video thread is done with it */
 static inline void output_video_data(struct obs_core_video *video,
-				     struct video_data *input_frame, int count)
+				     struct video_data *frame, int count,
+				     int set)
 {
-	const struct video_output_info *info;
-	struct video_frame output_frame;
-	bool locked;
-
-	info = video_output_get_info(video->video);
-
-	locked = video_output_lock_frame(video->video, &output_frame, count,
-					 input_frame->timestamp);
-	if (locked) {
-		if (video->gpu_conversion) {
-			set_gpu_converted_data(video, &output_frame,
-					       input_frame, info);
-		} else {
-			copy_rgbx_frame(&output_frame, input_frame, info);
-		}
+	volatile bool *released = &video->copy_surfaces_released[set];
 
-		video_output_unlock_frame(video->video);
-	}
+	set_packed_uv_plane(frame, video_output_get_info(video->video));
+
+	if (!video_output_submit_frame(video->video, frame, count,
+				       release_copy_surfaces, (void *)released))
+		os_atomic_set_bool(released, true);
 }
 
 static inline void video_sleep(struct obs_core_video *video, bool raw_active,
@@ -830,6 +737,7 @@ static inline void output_frame(bool raw_active, const bool gpu_active)
 					    : cur_texture - 1;
 	struct video_data frame;
 	bool frame_ready = 0;
+	int set = 0;
 
 	memset(&frame, 0, sizeof(struct video_data));
 
@@ -845,7 +753,8 @@ static inline void output_frame(bool raw_active, const bool gpu_active)
 
 	if (raw_active) {
 		profile_start(output_frame_download_frame_name);
-		frame_ready = download_frame(video, prev_texture, &frame);
+		frame_ready = download_frame(video, prev_texture, &frame,
+					     &set);
 		profile_end(output_frame_download_frame_name);
 	}
 
@@ -861,10 +770,34 @@ static inline void output_frame(bool raw_active, const bool gpu_active)
 		circlebuf_pop_front(&video->vframe_info_buffer, &vframe_info,
 				    sizeof(vframe_info));
 
+		/* frames that were dropped before it are covered by this one */
+		if (video->skipped_vframe_info.count) {
+			vframe_info.timestamp =
+				video->skipped_vframe_info.timestamp;
+			vframe_info.count += video->skipped_vframe_info.count;
+			video->skipped_vframe_info.count = 0;
+		}
+
 		frame.timestamp = vframe_info.timestamp;
 		profile_start(output_frame_output_video_data_name);
-		output_video_data(video, &frame, vframe_info.count);
+		output_video_data(video, &frame, vframe_info.count, set);
 		profile_end(output_frame_output_video_data_name);
+
+	} else if (raw_active && video->textures_dropped[prev_texture] &&
+		   video->vframe_info_buffer.size) {
+		/* the tick staged into prev_texture had no copy surface, its
+		 * time goes to the next frame that is output.  ticks that
+		 * simply have nothing staged yet keep their info queued */
+		struct obs_vframe_info vframe_info;
+
+		video->textures_dropped[prev_texture] = false;
+		circlebuf_pop_front(&video->vframe_info_buffer, &vframe_info,
+				    sizeof(vframe_info));
+
+		if (!video->skipped_vframe_info.count)
+			video->skipped_vframe_info.timestamp =
+				vframe_info.timestamp;
+		video->skipped_vframe_info.count += vframe_info.count;
 	}
 
 	if (++video->cur_texture == NUM_TEXTURES)
@@ -885,7 +818,18 @@ static void clear_base_frame_data(void)
 static void clear_raw_frame_data(void)
 {
 	struct obs_core_video *video = &obs->video;
+
+	/* sets that were staged but never mapped are not owned by anyone */
+	for (size_t i = 0; i < NUM_TEXTURES; i++) {
+		if (video->textures_copied[i])
+			video->copy_surfaces_busy[video->active_copy_set[i]] =
+				false;
+	}
+
 	memset(video->textures_copied, 0, sizeof(video->textures_copied));
+	memset(video->textures_dropped, 0, sizeof(video->textures_dropped));
+	memset(&video->skipped_vframe_info, 0,
+	       sizeof(video->skipped_vframe_info));
 	circlebuf_free(&video->vframe_info_buffer);
 }
 
@@ -257,72 +257,71 @@ static bool obs_init_gpu_conversion(struct obs_video_info *ovi)
 	return success;
 }
 
-static bool obs_init_gpu_copy_surfaces(struct obs_video_info *ovi, size_t i)
+static bool obs_init_gpu_copy_surfaces(const struct video_output_info *info,
+				       size_t i)
 {
 	struct obs_core_video *video = &obs->video;
 
-	const struct video_output_info *info =
-		video_output_get_info(video->video);
 	switch (info->format) {
 	case VIDEO_FORMAT_I420:
 		video->copy_surfaces[i][0] = gs_stagesurface_create(
-			ovi->output_width, ovi->output_height, GS_R8);
+			info->width, info->height, GS_R8);
 		if (!video->copy_surfaces[i][0])
 			return false;
 		video->copy_surfaces[i][1] = gs_stagesurface_create(
-			ovi->output_width / 2, ovi->output_height / 2, GS_R8);
+			info->width / 2, info->height / 2, GS_R8);
 		if (!video->copy_surfaces[i][1])
 			return false;
 		video->copy_surfaces[i][2] = gs_stagesurface_create(
-			ovi->output_width / 2, ovi->output_height / 2, GS_R8);
+			info->width / 2, info->height / 2, GS_R8);
 		if (!video->copy_surfaces[i][2])
 			return false;
 		break;
 	case VIDEO_FORMAT_NV12:
 		video->copy_surfaces[i][0] = gs_stagesurface_create(
-			ovi->output_width, ovi->output_height, GS_R8);
+			info->width, info->height, GS_R8);
 		if (!video->copy_surfaces[i][0])
 			return false;
 		video->copy_surfaces[i][1] = gs_stagesurface_create(
-			ovi->output_width / 2, ovi->output_height / 2, GS_R8G8);
+			info->width / 2, info->height / 2, GS_R8G8);
 		if (!video->copy_surfaces[i][1])
 			return false;
 		break;
 	case VIDEO_FORMAT_I444:
 		video->copy_surfaces[i][0] = gs_stagesurface_create(
-			ovi->output_width, ovi->output_height, GS_R8);
+			info->width, info->height, GS_R8);
 		if (!video->copy_surfaces[i][0])
 			return false;
 		video->copy_surfaces[i][1] = gs_stagesurface_create(
-			ovi->output_width, ovi->output_height, GS_R8);
+			info->width, info->height, GS_R8);
 		if (!video->copy_surfaces[i][1])
 			return false;
 		video->copy_surfaces[i][2] = gs_stagesurface_create(
-			ovi->output_width, ovi->output_height, GS_R8);
+			info->width, info->height, GS_R8);
 		if (!video->copy_surfaces[i][2])
 			return false;
 		break;
 	case VIDEO_FORMAT_I010:
 		video->copy_surfaces[i][0] = gs_stagesurface_create(
-			ovi->output_width, ovi->output_height, GS_R16);
+			info->width, info->height, GS_R16);
 		if (!video->copy_surfaces[i][0])
 			return false;
 		video->copy_surfaces[i][1] = gs_stagesurface_create(
-			ovi->output_width / 2, ovi->output_height / 2, GS_R16);
+			info->width / 2, info->height / 2, GS_R16);
 		if (!video->copy_surfaces[i][1])
 			return false;
 		video->copy_surfaces[i][2] = gs_stagesurface_create(
-			ovi->output_width / 2, ovi->output_height / 2, GS_R16);
+			info->width / 2, info->height / 2, GS_R16);
 		if (!video->copy_surfaces[i][2])
 			return false;
 		break;
 	case VIDEO_FORMAT_P010:
 		video->copy_surfaces[i][0] = gs_stagesurface_create(
-			ovi->output_width, ovi->output_height, GS_R16);
+			info->width, info->height, GS_R16);
 		if (!video->copy_surfaces[i][0])
 			return false;
 		video->copy_surfaces[i][1] = gs_stagesurface_create(
-			ovi->output_width / 2, ovi->output_height / 2, GS_RG16);
+			info->width / 2, info->height / 2, GS_RG16);
 		if (!video->copy_surfaces[i][1])
 			return false;
 		break;
@@ -333,45 +332,82 @@ static bool obs_init_gpu_copy_surfaces(struct obs_video_info *ovi, size_t i)
 	return true;
 }
 
-static bool obs_init_textures(struct obs_video_info *ovi)
+static void obs_free_copy_surfaces(size_t i)
 {
 	struct obs_core_video *video = &obs->video;
 
-	bool success = true;
+	for (size_t c = 0; c < NUM_CHANNELS; c++) {
+		if (video->mapped_surfaces[i][c]) {
+			gs_stagesurface_unmap(video->mapped_surfaces[i][c]);
+			video->mapped_surfaces[i][c] = NULL;
+		}
+		if (video->copy_surfaces[i][c]) {
+			gs_stagesurface_destroy(video->copy_surfaces[i][c]);
+			video->copy_surfaces[i][c] = NULL;
+		}
+	}
+#ifdef _WIN32
+	if (video->copy_surfaces_encode[i]) {
+		gs_stagesurface_destroy(video->copy_surfaces_encode[i]);
+		video->copy_surfaces_encode[i] = NULL;
+	}
+#endif
+
+	video->copy_surfaces_busy[i] = false;
+	video->copy_surfaces_released[i] = false;
+}
+
+/* creates one set of staging surfaces for raw output frames.  the first
+ * NUM_TEXTURES sets are created up front, the rest on demand by the graphics
+ * thread while raw outputs still hold on to the mapped memory of the others */
+bool obs_init_copy_surfaces(size_t i)
+{
+	struct obs_core_video *video = &obs->video;
+	const struct video_output_info *info =
+		video_output_get_info(video->video);
 
-	for (size_t i = 0; i < NUM_TEXTURES; i++) {
 #ifdef _WIN32
-		if (video->using_nv12_tex) {
-			video->copy_surfaces_encode[i] =
-				gs_stagesurface_create_nv12(ovi->output_width,
-							    ovi->output_height);
-			if (!video->copy_surfaces_encode[i]) {
-				success = false;
-				break;
-			}
-		} else if (video->using_p010_tex) {
-			video->copy_surfaces_encode[i] =
-				gs_stagesurface_create_p010(ovi->output_width,
-							    ovi->output_height);
-			if (!video->copy_surfaces_encode[i]) {
-				success = false;
-				break;
-			}
-		}
+	if (video->using_nv12_tex) {
+		video->copy_surfaces_encode[i] =
+			gs_stagesurface_create_nv12(info->width, info->height);
+		if (!video->copy_surfaces_encode[i])
+			goto fail;
+	} else if (video->using_p010_tex) {
+		video->copy_surfaces_encode[i] =
+			gs_stagesurface_create_p010(info->width, info->height);
+		if (!video->copy_surfaces_encode[i])
+			goto fail;
+	}
 #endif
 
-		if (video->gpu_conversion) {
-			if (!obs_init_gpu_copy_surfaces(ovi, i)) {
-				success = false;
-				break;
-			}
-		} else {
-			video->copy_surfaces[i][0] = gs_stagesurface_create(
-				ovi->output_width, ovi->output_height, GS_RGBA);
-			if (!video->copy_surfaces[i][0]) {
-				success = false;
-				break;
-			}
+	if (video->gpu_conversion) {
+		if (!obs_init_gpu_copy_surfaces(info, i))
+			goto fail;
+	} else {
+		video->copy_surfaces[i][0] = gs_stagesurface_create(
+			info->width, info->height, GS_RGBA);
+		if (!video->copy_surfaces[i][0])
+			goto fail;
+	}
+
+	video->num_copy_surfaces = i + 1;
+	return true;
+
+fail:
+	obs_free_copy_surfaces(i);
+	return false;
+}
+
+static bool obs_init_textures(struct obs_video_info *ovi)
+{
+	struct obs_core_video *video = &obs->video;
+
+	bool success = true;
+
+	for (size_t i = 0; i < NUM_TEXTURES; i++) {
+		if (!obs_init_copy_surfaces(i)) {
+			success = false;
+			break;
 		}
 	}
 
@@ -411,22 +447,9 @@ static bool obs_init_textures(struct obs_video_info *ovi)
 	if (success) {
 		video->render_space = space;
 	} else {
-		for (size_t i = 0; i < NUM_TEXTURES; i++) {
-			for (size_t c = 0; c < NUM_CHANNELS; c++) {
-				if (video->copy_surfaces[i][c]) {
-					gs_stagesurface_destroy(
-						video->copy_surfaces[i][c]);
-					video->copy_surfaces[i][c] = NULL;
-				}
-			}
-#ifdef _WIN32
-			if (video->copy_surfaces_encode[i]) {
-				gs_stagesurface_destroy(
-					video->copy_surfaces_encode[i]);
-				video->copy_surfaces_encode[i] = NULL;
-			}
-#endif
-		}
+		for (size_t i = 0; i < NUM_COPY_SURFACES; i++)
+			obs_free_copy_surfaces(i);
+		video->num_copy_surfaces = 0;
 
 		if (video->render_texture) {
 			gs_texture_destroy(video->render_texture);
@@ -662,31 +685,13 @@ static void obs_free_video(void)
 
 		gs_enter_context(video->graphics);
 
-		for (size_t c = 0; c < NUM_CHANNELS; c++) {
-			if (video->mapped_surfaces[c]) {
-				gs_stagesurface_unmap(
-					video->mapped_surfaces[c]);
-				video->mapped_surfaces[c] = NULL;
-			}
-		}
+		for (size_t i = 0; i < NUM_COPY_SURFACES; i++)
+			obs_free_copy_surfaces(i);
+		video->num_copy_surfaces = 0;
 
 		for (size_t i = 0; i < NUM_TEXTURES; i++) {
-			for (size_t c = 0; c < NUM_CHANNELS; c++) {
-				if (video->copy_surfaces[i][c]) {
-					gs_stagesurface_destroy(
-						video->copy_surfaces[i][c]);
-					video->copy_surfaces[i][c] = NULL;
-				}
-
+			for (size_t c = 0; c < NUM_CHANNELS; c++)
 				video->active_copy_surfaces[i][c] = NULL;
-			}
-#ifdef _WIN32
-			if (video->copy_surfaces_encode[i]) {
-				gs_stagesurface_destroy(
-					video->copy_surfaces_encode[i]);
-				video->copy_surfaces_encode[i] = NULL;
-			}
-#endif
 		}
 
 		gs_texture_destroy(video->render_texture);
@@ -717,6 +722,8 @@ static void obs_free_video(void)
 		video->texture_rendered = false;
 		memset(video->textures_copied, 0,
 		       sizeof(video->textures_copied));
+		memset(&video->skipped_vframe_info, 0,
+		       sizeof(video->skipped_vframe_info));
 		video->texture_converted = false;
 
 		pthread_mutex_destroy(&video->gpu_encoder_mutex);
@@ -775,6 +782,8 @@ static bool obs_init_audio(struct audio_output_info *ai)
 		return false;
 	if (pthread_mutex_init(&audio->task_mutex, NULL) != 0)
 		return false;
+	if (pthread_mutex_init(&audio->stats_mutex, NULL) != 0)
+		return false;
 
 	struct obs_task_info audio_init = {.task = set_audio_thread};
 	circlebuf_push_back(&audio->tasks, &audio_init, sizeof(audio_init));
@@ -784,6 +793,12 @@ static bool obs_init_audio(struct audio_output_info *ai)
 	audio->monitoring_device_name = bstrdup("Default");
 	audio->monitoring_device_id = bstrdup("default");
 
+	uint64_t tick_ns = audio_frames_to_ns(ai->samples_per_sec,
+					      ai->frames_per_tick);
+	if (!audio_track_pool_init(&audio->track_pool,
+				   get_audio_channels(ai->speakers), tick_ns))
+		return false;
+
 	errorcode = audio_output_open(&audio->audio, ai);
 	if (errorcode == AUDIO_OUTPUT_SUCCESS)
 		return true;
@@ -819,9 +834,15 @@ static void obs_free_audio(void)
 		audio_output_close(audio->audio);
 	}
 
+	audio_track_pool_free(&audio->track_pool);
+
 	circlebuf_free(&audio->buffered_timestamps);
 	da_free(audio->render_order);
 	da_free(audio->root_nodes);
+	for (size_t i = 0; i < audio->render_order_cache.num; i++)
+		obs_weak_source_release(audio->render_order_cache.array[i]);
+	da_free(audio->render_order_cache);
+	da_free(audio->root_nodes_cache);
 
 	da_free(audio->monitors);
 	bfree(audio->monitoring_device_name);
@@ -829,6 +850,7 @@ static void obs_free_audio(void)
 	circlebuf_free(&audio->tasks);
 	pthread_mutex_destroy(&audio->task_mutex);
 	pthread_mutex_destroy(&audio->monitoring_mutex);
+	pthread_mutex_destroy(&audio->stats_mutex);
 
 	memset(audio, 0, sizeof(struct obs_core_audio));
 }
@@ -870,6 +892,7 @@ static bool obs_init_data(void)
 	}
 
 	data->private_data = obs_data_create();
+	data->packet_pool = obs_packet_pool_create();
 	data->valid = true;
 
 fail:
@@ -928,6 +951,8 @@ static void obs_free_data(void)
 	da_free(data->draw_callbacks);
 	da_free(data->tick_callbacks);
 	obs_data_release(data->private_data);
+	obs_packet_pool_release(data->packet_pool);
+	data->packet_pool = NULL;
 }
 
 static const char *obs_signals[] = {
@@ -1420,33 +1445,45 @@ int obs_reset_video(struct obs_video_info *ovi)
 #define SEC_TO_MSEC 1000
 #endif
 
-bool obs_reset_audio2(const struct obs_audio_info2 *oai)
+bool obs_reset_audio3(const struct obs_audio_info3 *oai)
 {
 	struct obs_core_audio *audio = &obs->audio;
 	struct audio_output_info ai;
 	size_t channels = get_audio_channels(oai->speakers);
+	uint32_t frames = oai->frames_per_tick;
 
 	/* don't allow changing of audio settings if active. */
 	if (!obs || (audio->audio && audio_output_active(audio->audio)))
 		return false;
 
+	if (!frames)
+		frames = AUDIO_OUTPUT_FRAMES;
+	if (frames < AUDIO_OUTPUT_MIN_FRAMES || frames > AUDIO_OUTPUT_FRAMES ||
+	    (frames & (frames - 1)) != 0) {
+		blog(LOG_ERROR, "obs_reset_audio3: invalid frames per tick %u",
+		     frames);
+		return false;
+	}
+
 	obs_free_audio();
 	if (!oai)
 		return true;
 
+	audio->frames_per_tick = frames;
+
 	if (oai->max_buffering_ms) {
 		uint32_t max_frames = oai->max_buffering_ms *
 				      oai->samples_per_sec / SEC_TO_MSEC;
-		max_frames += (AUDIO_OUTPUT_FRAMES - 1);
-		audio->max_buffering_ticks = max_frames / AUDIO_OUTPUT_FRAMES;
+		max_frames += (frames - 1);
+		audio->max_buffering_ticks = max_frames / frames;
 	} else {
-		audio->max_buffering_ticks = 45;
+		/* the same ~960 ms at 48 kHz for any tick size */
+		audio->max_buffering_ticks = 45 * AUDIO_OUTPUT_FRAMES / frames;
 	}
 	audio->fixed_buffer = oai->fixed_buffering;
 
-	int max_buffering_ms = audio->max_buffering_ticks *
-			       AUDIO_OUTPUT_FRAMES * SEC_TO_MSEC /
-			       (int)oai->samples_per_sec;
+	int max_buffering_ms = audio->max_buffering_ticks * (int)frames *
+			       SEC_TO_MSEC / (int)oai->samples_per_sec;
 
 	ai.name = "Audio";
 	ai.samples_per_sec = oai->samples_per_sec;
@@ -1454,11 +1491,13 @@ bool obs_reset_audio2(const struct obs_audio_info2 *oai)
 	ai.speakers = oai->speakers;
 	ai.input_callback = audio_callback;
 	ai.audio_out = (struct audio_data){0};
-	ai.audio_out.frames = AUDIO_OUTPUT_FRAMES;
+	ai.audio_out.frames = frames;
 	for (size_t j = 0; j < channels; j++) {
 		ai.audio_out.data[j] =
 			malloc(AUDIO_OUTPUT_FRAMES * sizeof(float));
 	}
+	ai.frames_per_tick = frames;
+	ai.realtime_priority = oai->realtime_priority;
 
 	blog(LOG_INFO, "---------------------------------");
 	blog(LOG_INFO,
@@ -1466,21 +1505,36 @@ bool obs_reset_audio2(const struct obs_audio_info2 *oai)
 	     "\tsamples per sec: %d\n"
 	     "\tspeakers:        %d\n"
 	     "\tmax buffering:   %d milliseconds\n"
-	     "\tbuffering type:  %s",
+	     "\tbuffering type:  %s\n"
+	     "\tframes per tick: %d\n"
+	     "\treal-time:       %s",
 	     (int)ai.samples_per_sec, (int)ai.speakers, max_buffering_ms,
-	     oai->fixed_buffering ? "fixed" : "dynamically increasing");
+	     oai->fixed_buffering ? "fixed" : "dynamically increasing",
+	     (int)frames, oai->realtime_priority ? "requested" : "no");
 
 	return obs_init_audio(&ai);
 }
 
+bool obs_reset_audio2(const struct obs_audio_info2 *oai)
+{
+	struct obs_audio_info3 oai3 = {
+		.samples_per_sec = oai->samples_per_sec,
+		.speakers = oai->speakers,
+		.max_buffering_ms = oai->max_buffering_ms,
+		.fixed_buffering = oai->fixed_buffering,
+	};
+
+	return obs_reset_audio3(&oai3);
+}
+
 bool obs_reset_audio(const struct obs_audio_info *oai)
 {
-	struct obs_audio_info2 oai2 = {
+	struct obs_audio_info3 oai3 = {
 		.samples_per_sec = oai->samples_per_sec,
 		.speakers = oai->speakers,
 	};
 
-	return obs_reset_audio2(&oai2);
+	return obs_reset_audio3(&oai3);
 }
 
 bool obs_get_video_info(struct obs_video_info *ovi)
@@ -1530,6 +1584,52 @@ bool obs_get_audio_info(struct obs_audio_info *oai)
 	return true;
 }
 
+bool obs_get_audio_info3(struct obs_audio_info3 *oai3)
+{
+	struct obs_core_audio *audio = &obs->audio;
+	const struct audio_output_info *info;
+
+	if (!oai3 || !audio->audio)
+		return false;
+
+	info = audio_output_get_info(audio->audio);
+
+	oai3->samples_per_sec = info->samples_per_sec;
+	oai3->speakers = info->speakers;
+	oai3->max_buffering_ms = audio->max_buffering_ticks *
+				 audio->frames_per_tick * SEC_TO_MSEC /
+				 info->samples_per_sec;
+	oai3->fixed_buffering = audio->fixed_buffer;
+	oai3->frames_per_tick = audio->frames_per_tick;
+	oai3->realtime_priority = info->realtime_priority;
+	return true;
+}
+
+bool obs_get_audio_stats(struct obs_audio_stats *stats)
+{
+	struct obs_core_audio *audio = &obs->audio;
+	struct audio_output_stats out;
+
+	if (!stats || !audio->audio)
+		return false;
+
+	audio_output_get_stats(audio->audio, &out);
+
+	memset(stats, 0, sizeof(*stats));
+	stats->realtime = out.realtime;
+	stats->ticks = out.ticks;
+	stats->missed_deadlines = out.missed_deadlines;
+	stats->max_lateness_ns = out.max_lateness_ns;
+	memcpy(stats->lateness, out.lateness, sizeof(stats->lateness));
+
+	pthread_mutex_lock(&audio->stats_mutex);
+	memcpy(stats->stages, audio->stage_stats, sizeof(audio->stage_stats));
+	pthread_mutex_unlock(&audio->stats_mutex);
+
+	stats->stages[OBS_AUDIO_STAGE_OUTPUT] = out.output;
+	return true;
+}
+
 bool obs_enum_source_types(size_t idx, const char **id)
 {
 	if (idx >= obs->source_types.num)
@@ -1736,6 +1836,7 @@ void obs_set_output_source(uint32_t channel, obs_source_t *source)
 	view->channels[channel] = source;
 
 	pthread_mutex_unlock(&view->channels_mutex);
+	obs_audio_graph_changed();
 
 	if (source)
 		obs_source_activate(source, MAIN_VIEW);
@@ -171,7 +171,8 @@ struct obs_transform_info {
 struct obs_video_info {
 #ifndef SWIG
 	/**
-	 * Graphics module to use (usually "libobs-opengl" or "libobs-d3d11")
+	 * Graphics module to use (usually "libobs-opengl" or "libobs-d3d11",
+	 * or "libobs-null" to run the pipeline without a GPU)
 	 */
 	const char *graphics_module;
 #endif
@@ -214,6 +215,56 @@ struct obs_audio_info2 {
 	bool fixed_buffering;
 };
 
+struct obs_audio_info3 {
+	uint32_t samples_per_sec;
+	enum speaker_layout speakers;
+
+	uint32_t max_buffering_ms;
+	bool fixed_buffering;
+
+	/**
+	 * Audio frames mixed per tick: 128, 256, 512 or 1024 (the default
+	 * when 0).  Smaller values lower monitoring latency at the cost of
+	 * more frequent mixing; encoders still receive their own frame size.
+	 */
+	uint32_t frames_per_tick;
+
+	/**
+	 * Try to run the audio thread with real-time scheduling (SCHED_FIFO,
+	 * or through rtkit on Linux).  On Windows the audio thread always
+	 * uses MMCSS, and this also raises it to time critical priority.
+	 */
+	bool realtime_priority;
+};
+
+enum obs_audio_stage {
+	OBS_AUDIO_STAGE_RENDER,
+	OBS_AUDIO_STAGE_MIX,
+	OBS_AUDIO_STAGE_TRACK_FILTERS,
+	OBS_AUDIO_STAGE_OUTPUT,
+	OBS_AUDIO_STAGE_COUNT,
+};
+
+/**
+ * Audio thread timing since the audio was last reset
+ */
+struct obs_audio_stats {
+	bool realtime;
+	uint64_t ticks;
+
+	/** Ticks that finished after the next one was due */
+	uint64_t missed_deadlines;
+
+	/**
+	 * Ticks by how late they started, see audio_lateness_bucket_limit()
+	 * for the bucket bounds
+	 */
+	uint64_t lateness[AUDIO_LATENESS_BUCKETS];
+	uint64_t max_lateness_ns;
+
+	struct audio_stage_stats stages[OBS_AUDIO_STAGE_COUNT];
+};
+
 /**
  * Sent to source filters via the filter_audio callback to allow filtering of
  * audio data
@@ -422,6 +473,7 @@ EXPORT int obs_reset_video(struct obs_video_info *ovi);
  */
 EXPORT bool obs_reset_audio(const struct obs_audio_info *oai);
 EXPORT bool obs_reset_audio2(const struct obs_audio_info2 *oai);
+EXPORT bool obs_reset_audio3(const struct obs_audio_info3 *oai);
 
 /** Gets the current video settings, returns false if no video */
 EXPORT bool obs_get_video_info(struct obs_video_info *ovi);
@@ -438,6 +490,10 @@ EXPORT void obs_set_video_levels(float sdr_white_level,
 
 /** Gets the current audio settings, returns false if no audio */
 EXPORT bool obs_get_audio_info(struct obs_audio_info *oai);
+EXPORT bool obs_get_audio_info3(struct obs_audio_info3 *oai3);
+
+/** Gets the audio thread timing statistics, returns false if no audio */
+EXPORT bool obs_get_audio_stats(struct obs_audio_stats *stats);
 
 /**
  * Opens a plugin module directly from a specific path.
@@ -1368,6 +1424,20 @@ obs_source_draw_set_color_matrix(const struct matrix4 *color_matrix,
 EXPORT void obs_source_draw(gs_texture_t *image, int x, int y, uint32_t cx,
 			    uint32_t cy, bool flip);
 
+/**
+ * Notifies libobs that the rendered output of a source changed, so that any
+ * cached renders of it are discarded.  Sources with the OBS_SOURCE_CACHEABLE
+ * flag must call this whenever their output changes outside of an update.
+ */
+EXPORT void obs_source_content_changed(obs_source_t *source);
+
+/**
+ * Returns the fraction of render cache lookups for this source (its filter
+ * input texture and scene item textures) that reused the cached render,
+ * from 0.0 to 1.0.
+ */
+EXPORT float obs_source_get_render_cache_hit_rate(const obs_source_t *source);
+
 /**
  * Outputs asynchronous video data.  Set to NULL to deactivate the texture
  *
@@ -1380,6 +1450,25 @@ EXPORT void obs_source_output_video(obs_source_t *source,
 EXPORT void obs_source_output_video2(obs_source_t *source,
 				     const struct obs_source_frame2 *frame);
 
+typedef void (*obs_source_frame_release_t)(void *param);
+
+/**
+ * Outputs asynchronous video data without copying it.  The planes of the
+ * frame stay owned by the caller and must not be modified or freed until
+ * release is called, which happens once the frame has been uploaded,
+ * skipped, or dropped.
+ *
+ * release can be called from any thread, including from within this call,
+ * and possibly with internal locks held:  it must not call back into libobs
+ * or block.  While async video filters are active, frames are copied as with
+ * obs_source_output_video and released right away, because filters can keep
+ * frames around for an arbitrary amount of time.
+ */
+EXPORT void obs_source_output_video_nocopy(obs_source_t *source,
+					   const struct obs_source_frame *frame,
+					   obs_source_frame_release_t release,
+					   void *param);
+
 EXPORT void obs_source_set_async_rotation(obs_source_t *source, long rotation);
 
 EXPORT void obs_source_output_cea708(obs_source_t *source,
@@ -15,8 +15,10 @@
  */
 
 #include <assert.h>
+#include <sys/resource.h>
 #include <gio/gio.h>
 #include "bmem.h"
+#include "platform-nix-dbus.h"
 
 /* NOTE: This is basically just the VLC implementation from its d-bus power
  * management inhibition code.  Credit is theirs for this. */
@@ -174,3 +176,82 @@ void dbus_inhibit_sleep(struct dbus_sleep_info *info, const char *reason,
 	else
 		info->cookie = 0;
 }
+
+/* ------------------------------------------------------------------------- */
+/* rtkit, hands out real-time scheduling to unprivileged threads              */
+
+#define RTKIT_NAME "org.freedesktop.RealtimeKit1"
+#define RTKIT_PATH "/org/freedesktop/RealtimeKit1"
+
+static bool rtkit_get_property(GDBusConnection *c, const char *property,
+			       int64_t *value)
+{
+	g_autoptr(GVariant) reply = NULL;
+	g_autoptr(GVariant) v = NULL;
+
+	reply = g_dbus_connection_call_sync(
+		c, RTKIT_NAME, RTKIT_PATH, "org.freedesktop.DBus.Properties",
+		"Get", g_variant_new("(ss)", RTKIT_NAME, property),
+		G_VARIANT_TYPE("(v)"), G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
+	if (!reply)
+		return false;
+
+	g_variant_get(reply, "(v)", &v);
+
+	if (g_variant_is_of_type(v, G_VARIANT_TYPE_INT32))
+		*value = g_variant_get_int32(v);
+	else if (g_variant_is_of_type(v, G_VARIANT_TYPE_INT64))
+		*value = g_variant_get_int64(v);
+	else
+		return false;
+
+	return true;
+}
+
+bool dbus_make_thread_realtime(uint64_t thread_id, int priority)
+{
+	g_autoptr(GDBusConnection) c = NULL;
+	g_autoptr(GVariant) reply = NULL;
+	g_autoptr(GError) error = NULL;
+	int64_t value;
+
+	c = g_bus_get_sync(G_BUS_TYPE_SYSTEM, NULL, &error);
+	if (!c) {
+		blog(LOG_DEBUG, "Could not connect to the system bus: %s",
+		     error->message);
+		return false;
+	}
+
+	if (rtkit_get_property(c, "MaxRealtimePriority", &value) &&
+	    priority > value)
+		priority = (int)value;
+
+#ifdef RLIMIT_RTTIME
+	/* rtkit refuses processes that could hog the CPU forever.  the limit
+	 * is per process, so it also applies to any other real-time thread,
+	 * which then gets SIGXCPU (and SIGKILL at the hard limit) when it
+	 * runs that long without blocking */
+	if (rtkit_get_property(c, "RTTimeUSecMax", &value)) {
+		struct rlimit limit;
+
+		if (getrlimit(RLIMIT_RTTIME, &limit) == 0 &&
+		    (limit.rlim_max == RLIM_INFINITY ||
+		     limit.rlim_max > (rlim_t)value)) {
+			limit.rlim_cur = limit.rlim_max = (rlim_t)value;
+			setrlimit(RLIMIT_RTTIME, &limit);
+		}
+	}
+#endif
+
+	reply = g_dbus_connection_call_sync(
+		c, RTKIT_NAME, RTKIT_PATH, RTKIT_NAME, "MakeThreadRealtime",
+		g_variant_new("(tu)", thread_id, (uint32_t)priority), NULL,
+		G_DBUS_CALL_FLAGS_NONE, -1, NULL, &error);
+	if (!reply) {
+		blog(LOG_DEBUG, "rtkit MakeThreadRealtime failed: %s",
+		     error->message);
+		return false;
+	}
+
+	return true;
+}
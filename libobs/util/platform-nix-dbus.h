@@ -0,0 +1,32 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include "c99defs.h"
+
+/* only available on Linux builds with GIO */
+
+struct dbus_sleep_info;
+
+extern struct dbus_sleep_info *dbus_sleep_info_create(void);
+extern void dbus_inhibit_sleep(struct dbus_sleep_info *dbus, const char *sleep,
+			       bool active);
+extern void dbus_sleep_info_destroy(struct dbus_sleep_info *dbus);
+
+/* asks rtkit for SCHED_FIFO at the given priority, clamped to what rtkit
+ * allows.  rtkit requires RLIMIT_RTTIME to be set, so this lowers the limit
+ * of the whole process to the maximum of rtkit if it is higher */
+extern bool dbus_make_thread_realtime(uint64_t thread_id, int priority);
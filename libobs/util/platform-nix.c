@@ -164,6 +164,17 @@ bool os_sleepto_ns(uint64_t time_target)
 	if (time_target < current)
 		return false;
 
+#if !defined(__APPLE__)
+	/* absolute deadline on the clock of os_gettime_ns, so preemption or
+	 * interruptions between here and the sleep do not delay the wake up */
+	struct timespec deadline;
+	deadline.tv_sec = (time_t)(time_target / 1000000000);
+	deadline.tv_nsec = (long)(time_target % 1000000000);
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+			       NULL) == EINTR)
+		;
+#else
 	time_target -= current;
 
 	struct timespec req, remain;
@@ -176,6 +187,7 @@ bool os_sleepto_ns(uint64_t time_target)
 		req = remain;
 		memset(&remain, 0, sizeof(remain));
 	}
+#endif
 
 	return true;
 }
@@ -632,13 +644,9 @@ int os_chdir(const char *path)
 #if !defined(__APPLE__)
 
 #if defined(GIO_FOUND)
-struct dbus_sleep_info;
-struct portal_inhibit_info;
+#include "platform-nix-dbus.h"
 
-extern struct dbus_sleep_info *dbus_sleep_info_create(void);
-extern void dbus_inhibit_sleep(struct dbus_sleep_info *dbus, const char *sleep,
-			       bool active);
-extern void dbus_sleep_info_destroy(struct dbus_sleep_info *dbus);
+struct portal_inhibit_info;
 
 extern struct portal_inhibit_info *portal_inhibit_info_create(void);
 extern void portal_inhibit(struct portal_inhibit_info *portal,
@@ -30,9 +30,20 @@
 #include <pthread_np.h>
 #endif
 
+#include <sched.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "obsconfig.h"
 #include "bmem.h"
 #include "threading.h"
 
+#if defined(__linux__) && defined(GIO_FOUND)
+#include "platform-nix-dbus.h"
+#endif
+
 struct os_event_data {
 	pthread_mutex_t mutex;
 	pthread_cond_t cond;
@@ -271,3 +282,50 @@ void os_set_thread_name(const char *name)
 	}
 #endif
 }
+
+bool os_set_thread_realtime(int priority)
+{
+	struct sched_param param = {0};
+	int min = sched_get_priority_min(SCHED_FIFO);
+	int max = sched_get_priority_max(SCHED_FIFO);
+
+	if (priority < min)
+		priority = min;
+	if (priority > max)
+		priority = max;
+
+	param.sched_priority = priority;
+	if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0)
+		return true;
+
+#if defined(__linux__) && defined(GIO_FOUND)
+	return dbus_make_thread_realtime((uint64_t)syscall(SYS_gettid),
+					 priority);
+#else
+	return false;
+#endif
+}
+
+bool os_copy_thread_scheduling(pthread_t thread)
+{
+	struct sched_param param;
+	int policy;
+
+#if defined(__linux__)
+	cpu_set_t cpus;
+	if (pthread_getaffinity_np(thread, sizeof(cpus), &cpus) == 0)
+		pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+#endif
+
+	if (pthread_getschedparam(thread, &policy, &param) != 0)
+		return true;
+
+	/* rtkit hands out real-time scheduling that children don't get */
+#ifdef SCHED_RESET_ON_FORK
+	policy &= ~SCHED_RESET_ON_FORK;
+#endif
+	if (policy != SCHED_FIFO && policy != SCHED_RR)
+		return true;
+
+	return os_set_thread_realtime(param.sched_priority);
+}
@@ -214,3 +214,27 @@ void os_set_thread_name(const char *name)
 		FreeLibrary(hModule);
 	}
 }
+
+bool os_set_thread_realtime(int priority)
+{
+	UNUSED_PARAMETER(priority);
+	return !!SetThreadPriority(GetCurrentThread(),
+				   THREAD_PRIORITY_TIME_CRITICAL);
+}
+
+bool os_copy_thread_scheduling(pthread_t thread)
+{
+	HANDLE handle = pthread_getw32threadhandle_np(thread);
+	GROUP_AFFINITY affinity;
+	int priority;
+
+	if (GetThreadGroupAffinity(handle, &affinity))
+		SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL);
+
+	priority = GetThreadPriority(handle);
+	if (priority == THREAD_PRIORITY_ERROR_RETURN ||
+	    priority <= GetThreadPriority(GetCurrentThread()))
+		return true;
+
+	return !!SetThreadPriority(GetCurrentThread(), priority);
+}
@@ -94,6 +94,30 @@ EXPORT int os_sem_wait(os_sem_t *sem);
 
 EXPORT void os_set_thread_name(const char *name);
 
+/**
+ * Tries to give the calling thread real-time scheduling.  On POSIX systems
+ * this is SCHED_FIFO at the given priority, requested through rtkit on Linux
+ * when the process is not allowed to set it itself.  On Windows the thread
+ * gets time critical priority and the priority value is ignored.
+ *
+ * rtkit requires an RLIMIT_RTTIME, so going through it lowers the limit of
+ * the whole process, which then also applies to other real-time threads.
+ *
+ * Returns false if the thread keeps its normal scheduling.
+ */
+EXPORT bool os_set_thread_realtime(int priority);
+
+/**
+ * Gives the calling thread the scheduling of another thread of the process:
+ * real-time scheduling through os_set_thread_realtime() if that thread has
+ * it, and the same CPU affinity where the system can query it (Linux and
+ * Windows).
+ *
+ * Returns false if the other thread has real-time scheduling and the
+ * calling thread could not get it.
+ */
+EXPORT bool os_copy_thread_scheduling(pthread_t thread);
+
 #ifdef _MSC_VER
 #define THREAD_LOCAL __declspec(thread)
 #else
@@ -117,6 +117,12 @@ static uint32_t color_source_getheight(void *data)
 	return context->height;
 }
 
+static bool color_source_is_opaque(void *data)
+{
+	struct color_source *context = data;
+	return context->color.w >= 1.0f;
+}
+
 static void color_source_defaults_v1(obs_data_t *settings)
 {
 	obs_data_set_default_int(settings, "color", 0xFFFFFFFF);
@@ -142,7 +148,7 @@ struct obs_source_info color_source_info_v1 = {
 	.id = "color_source",
 	.type = OBS_SOURCE_TYPE_INPUT,
 	.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW |
-			OBS_SOURCE_CAP_OBSOLETE,
+			OBS_SOURCE_CAP_OBSOLETE | OBS_SOURCE_CACHEABLE,
 	.create = color_source_create,
 	.destroy = color_source_destroy,
 	.update = color_source_update,
@@ -151,6 +157,7 @@ struct obs_source_info color_source_info_v1 = {
 	.get_width = color_source_getwidth,
 	.get_height = color_source_getheight,
 	.video_render = color_source_render,
+	.is_opaque = color_source_is_opaque,
 	.get_properties = color_source_properties,
 	.icon_type = OBS_ICON_TYPE_COLOR,
 };
@@ -160,7 +167,7 @@ struct obs_source_info color_source_info_v2 = {
 	.version = 2,
 	.type = OBS_SOURCE_TYPE_INPUT,
 	.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW |
-			OBS_SOURCE_CAP_OBSOLETE,
+			OBS_SOURCE_CAP_OBSOLETE | OBS_SOURCE_CACHEABLE,
 	.create = color_source_create,
 	.destroy = color_source_destroy,
 	.update = color_source_update,
@@ -169,6 +176,7 @@ struct obs_source_info color_source_info_v2 = {
 	.get_width = color_source_getwidth,
 	.get_height = color_source_getheight,
 	.video_render = color_source_render,
+	.is_opaque = color_source_is_opaque,
 	.get_properties = color_source_properties,
 	.icon_type = OBS_ICON_TYPE_COLOR,
 };
@@ -178,7 +186,7 @@ struct obs_source_info color_source_info_v3 = {
 	.version = 3,
 	.type = OBS_SOURCE_TYPE_INPUT,
 	.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_CUSTOM_DRAW |
-			OBS_SOURCE_SRGB,
+			OBS_SOURCE_SRGB | OBS_SOURCE_CACHEABLE,
 	.create = color_source_create,
 	.destroy = color_source_destroy,
 	.update = color_source_update,
@@ -187,6 +195,7 @@ struct obs_source_info color_source_info_v3 = {
 	.get_width = color_source_getwidth,
 	.get_height = color_source_getheight,
 	.video_render = color_source_render,
+	.is_opaque = color_source_is_opaque,
 	.get_properties = color_source_properties,
 	.icon_type = OBS_ICON_TYPE_COLOR,
 };
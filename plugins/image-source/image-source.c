@@ -23,6 +23,7 @@ struct image_source {
 	uint64_t last_time;
 	bool active;
 	bool restart_gif;
+	bool opaque;
 
 	gs_image_file3_t if3;
 };
@@ -41,10 +42,33 @@ static const char *image_source_get_name(void *unused)
 	return obs_module_text("ImageInput");
 }
 
+/* checked once on load, while the decoded pixels are still in memory */
+static bool image_file_opaque(const gs_image_file_t *image)
+{
+	const uint8_t *data = image->texture_data;
+	const size_t size = (size_t)image->cx * image->cy * 4;
+
+	if (!data || image->is_animated_gif)
+		return false;
+	if (image->format == GS_BGRX)
+		return true;
+	if (image->format != GS_BGRA && image->format != GS_RGBA)
+		return false;
+
+	for (size_t i = 3; i < size; i += 4) {
+		if (data[i] != 0xFF)
+			return false;
+	}
+
+	return true;
+}
+
 static void image_source_load(struct image_source *context)
 {
 	char *file = context->file;
 
+	context->opaque = false;
+
 	obs_enter_graphics();
 	gs_image_file3_free(&context->if3);
 	obs_leave_graphics();
@@ -57,6 +81,7 @@ static void image_source_load(struct image_source *context)
 					    ? GS_IMAGE_ALPHA_PREMULTIPLY_SRGB
 					    : GS_IMAGE_ALPHA_PREMULTIPLY);
 		context->update_time_elapsed = 0;
+		context->opaque = image_file_opaque(&context->if3.image2.image);
 
 		obs_enter_graphics();
 		gs_image_file3_init_texture(&context->if3);
@@ -65,13 +90,19 @@ static void image_source_load(struct image_source *context)
 		if (!context->if3.image2.image.loaded)
 			warn("failed to load texture '%s'", file);
 	}
+
+	obs_source_content_changed(context->source);
 }
 
 static void image_source_unload(struct image_source *context)
 {
+	context->opaque = false;
+
 	obs_enter_graphics();
 	gs_image_file3_free(&context->if3);
 	obs_leave_graphics();
+
+	obs_source_content_changed(context->source);
 }
 
 static void image_source_update(void *data, obs_data_t *settings)
@@ -129,6 +160,7 @@ static void restart_gif(void *data)
 		gs_image_file3_update_texture(&context->if3);
 		obs_leave_graphics();
 
+		obs_source_content_changed(context->source);
 		context->restart_gif = false;
 	}
 }
@@ -196,6 +228,13 @@ static void image_source_render(void *data, gs_effect_t *effect)
 	gs_enable_framebuffer_srgb(previous);
 }
 
+static bool image_source_is_opaque(void *data)
+{
+	struct image_source *context = data;
+
+	return context->opaque && context->if3.image2.image.texture;
+}
+
 static void image_source_tick(void *data, float seconds)
 {
 	struct image_source *context = data;
@@ -241,6 +280,8 @@ static void image_source_tick(void *data, float seconds)
 			obs_enter_graphics();
 			gs_image_file3_update_texture(&context->if3);
 			obs_leave_graphics();
+
+			obs_source_content_changed(context->source);
 		}
 	}
 
@@ -326,7 +367,8 @@ static obs_missing_files_t *image_source_missingfiles(void *data)
 static struct obs_source_info image_source_info = {
 	.id = "image_source",
 	.type = OBS_SOURCE_TYPE_INPUT,
-	.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_SRGB,
+	.output_flags = OBS_SOURCE_VIDEO | OBS_SOURCE_SRGB |
+			OBS_SOURCE_CACHEABLE,
 	.get_name = image_source_get_name,
 	.create = image_source_create,
 	.destroy = image_source_destroy,
@@ -338,6 +380,7 @@ static struct obs_source_info image_source_info = {
 	.get_height = image_source_getheight,
 	.video_render = image_source_render,
 	.video_tick = image_source_tick,
+	.is_opaque = image_source_is_opaque,
 	.missing_files = image_source_missingfiles,
 	.get_properties = image_source_properties,
 	.icon_type = OBS_ICON_TYPE_IMAGE,
@@ -737,6 +737,16 @@ void XCompcapMain::render(gs_effect_t *effect)
 	}
 }
 
+bool XCompcapMain::opaque()
+{
+	if (!p->win)
+		return false;
+
+	PLock lock(&p->lock, true);
+
+	return lock.isLocked() && p->draw_opaque && p->tex;
+}
+
 uint32_t XCompcapMain::width()
 {
 	if (!p->win)
@@ -17,6 +17,7 @@ public:
 
 	void tick(float seconds);
 	void render(gs_effect_t *effect);
+	bool opaque();
 
 	uint32_t width();
 	uint32_t height();
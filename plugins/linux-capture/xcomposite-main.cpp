@@ -25,6 +25,12 @@ static void xcompcap_video_render(void *data, gs_effect_t *effect)
 	cc->render(effect);
 }
 
+static bool xcompcap_is_opaque(void *data)
+{
+	XCompcapMain *cc = (XCompcapMain *)data;
+	return cc->opaque();
+}
+
 static uint32_t xcompcap_getwidth(void *data)
 {
 	XCompcapMain *cc = (XCompcapMain *)data;
@@ -80,6 +86,7 @@ extern "C" void xcomposite_load(void)
 	sinfo.update = xcompcap_update;
 	sinfo.video_tick = xcompcap_video_tick;
 	sinfo.video_render = xcompcap_video_render;
+	sinfo.is_opaque = xcompcap_is_opaque;
 	sinfo.get_width = xcompcap_getwidth;
 	sinfo.get_height = xcompcap_getheight;
 	sinfo.icon_type = OBS_ICON_TYPE_WINDOW_CAPTURE,
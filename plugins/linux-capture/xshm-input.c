@@ -548,6 +548,15 @@ static void xshm_video_render(void *vptr, gs_effect_t *effect)
 	}
 }
 
+/**
+ * The screen is drawn with the opaque effect once there is a texture
+ */
+static bool xshm_is_opaque(void *vptr)
+{
+	XSHM_DATA(vptr);
+	return data->texture != NULL;
+}
+
 /**
  * Width of the captured data
  */
@@ -579,6 +588,7 @@ struct obs_source_info xshm_input = {
 	.get_properties = xshm_properties,
 	.video_tick = xshm_video_tick,
 	.video_render = xshm_video_render,
+	.is_opaque = xshm_is_opaque,
 	.get_width = xshm_getwidth,
 	.get_height = xshm_getheight,
 	.icon_type = OBS_ICON_TYPE_DESKTOP_CAPTURE,
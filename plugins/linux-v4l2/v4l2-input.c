@@ -63,6 +63,38 @@ along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #define blog(level, msg, ...) blog(level, "v4l2-input: " msg, ##__VA_ARGS__)
 
+/* buffers that have to stay queued for the driver, frames arriving while
+ * libobs holds on to more buffers are copied instead of referenced */
+#define MIN_QUEUED_BUFFERS 2
+#define RELEASE_TIMEOUT_MS 2000
+
+struct v4l2_mapping;
+
+struct v4l2_buffer_ref {
+	struct v4l2_mapping *mapping;
+	uint32_t index;
+	/* referenced by a frame in libobs, protected by the mapping mutex */
+	bool held;
+};
+
+/*
+ * The mapped buffers.  Frames passed to libobs without copying keep a
+ * reference, so the buffers stay mapped until the last of them is released
+ * even after the source stopped capturing.
+ */
+struct v4l2_mapping {
+	struct v4l2_buffer_data buffers;
+	struct v4l2_buffer_ref *refs;
+	volatile long refcount;
+	volatile long held_buffers;
+
+	/* released buffers are only queued again while streaming */
+	pthread_mutex_t mutex;
+	bool streaming;
+	int_fast32_t dev;
+	char *device_id;
+};
+
 /**
  * Data structure for the v4l2 source
  */
@@ -89,7 +121,7 @@ struct v4l2_data {
 	int width;
 	int height;
 	int linesize;
-	struct v4l2_buffer_data buffers;
+	struct v4l2_mapping *mapping;
 
 	bool auto_reset;
 	int timeout_frames;
@@ -158,6 +190,180 @@ static void v4l2_prep_obs_frame(struct v4l2_data *data,
 	}
 }
 
+static struct v4l2_mapping *v4l2_mapping_create(int_fast32_t dev,
+						const char *device_id)
+{
+	struct v4l2_mapping *mapping = bzalloc(sizeof(*mapping));
+
+	if (pthread_mutex_init(&mapping->mutex, NULL) != 0) {
+		bfree(mapping);
+		return NULL;
+	}
+
+	if (v4l2_create_mmap(dev, &mapping->buffers) < 0) {
+		v4l2_destroy_mmap(&mapping->buffers);
+		pthread_mutex_destroy(&mapping->mutex);
+		bfree(mapping);
+		return NULL;
+	}
+
+	mapping->refs =
+		bzalloc(mapping->buffers.count * sizeof(*mapping->refs));
+	for (uint_fast32_t i = 0; i < mapping->buffers.count; i++) {
+		mapping->refs[i].mapping = mapping;
+		mapping->refs[i].index = (uint32_t)i;
+	}
+
+	mapping->refcount = 1;
+	mapping->dev = dev;
+	mapping->device_id = bstrdup(device_id);
+	return mapping;
+}
+
+static void v4l2_mapping_release(struct v4l2_mapping *mapping)
+{
+	if (!mapping || os_atomic_dec_long(&mapping->refcount) != 0)
+		return;
+
+	v4l2_destroy_mmap(&mapping->buffers);
+	pthread_mutex_destroy(&mapping->mutex);
+	bfree(mapping->refs);
+	bfree(mapping->device_id);
+	bfree(mapping);
+}
+
+/* queues all buffers that are not held by libobs and starts the stream */
+static int_fast32_t v4l2_mapping_start(struct v4l2_mapping *mapping)
+{
+	enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	struct v4l2_buffer buf;
+	int_fast32_t ret = 0;
+
+	memset(&buf, 0, sizeof(buf));
+	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory = V4L2_MEMORY_MMAP;
+
+	pthread_mutex_lock(&mapping->mutex);
+
+	for (buf.index = 0; buf.index < mapping->buffers.count; ++buf.index) {
+		if (mapping->refs[buf.index].held)
+			continue;
+		if (v4l2_ioctl(mapping->dev, VIDIOC_QBUF, &buf) < 0) {
+			blog(LOG_ERROR, "%s: unable to queue buffer",
+			     mapping->device_id);
+			ret = -1;
+			goto unlock;
+		}
+	}
+
+	if (v4l2_ioctl(mapping->dev, VIDIOC_STREAMON, &type) < 0) {
+		blog(LOG_ERROR, "%s: unable to start stream",
+		     mapping->device_id);
+		ret = -1;
+		goto unlock;
+	}
+
+	mapping->streaming = true;
+
+unlock:
+	pthread_mutex_unlock(&mapping->mutex);
+	return ret;
+}
+
+static int_fast32_t v4l2_mapping_stop(struct v4l2_mapping *mapping)
+{
+	int_fast32_t ret;
+
+	pthread_mutex_lock(&mapping->mutex);
+	mapping->streaming = false;
+	ret = v4l2_stop_capture(mapping->dev);
+	pthread_mutex_unlock(&mapping->mutex);
+
+	return ret;
+}
+
+/* held buffers are left alone, they are queued again once released */
+static int_fast32_t v4l2_mapping_reset(struct v4l2_mapping *mapping)
+{
+	blog(LOG_DEBUG, "%s: attempting to reset capture", mapping->device_id);
+	if (v4l2_mapping_stop(mapping) < 0)
+		return -1;
+	return v4l2_mapping_start(mapping);
+}
+
+static void v4l2_release_buffer(void *param)
+{
+	struct v4l2_buffer_ref *ref = param;
+	struct v4l2_mapping *mapping = ref->mapping;
+	struct v4l2_buffer buf;
+
+	memset(&buf, 0, sizeof(buf));
+	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.memory = V4L2_MEMORY_MMAP;
+	buf.index = ref->index;
+
+	pthread_mutex_lock(&mapping->mutex);
+	ref->held = false;
+	if (mapping->streaming &&
+	    v4l2_ioctl(mapping->dev, VIDIOC_QBUF, &buf) < 0)
+		blog(LOG_ERROR, "%s: failed to enqueue released buffer",
+		     mapping->device_id);
+	pthread_mutex_unlock(&mapping->mutex);
+
+	os_atomic_dec_long(&mapping->held_buffers);
+	v4l2_mapping_release(mapping);
+}
+
+/*
+ * Passes the mapped buffer to obs without copying it, as long as enough
+ * buffers stay queued for the driver.  Returns false if the frame has to be
+ * copied and the buffer queued again right away.
+ */
+static bool v4l2_output_nocopy(struct v4l2_data *data,
+			       struct obs_source_frame *out, uint32_t index)
+{
+	struct v4l2_mapping *mapping = data->mapping;
+	long held = os_atomic_load_long(&mapping->held_buffers);
+
+	if ((uint_fast32_t)held + 1 + MIN_QUEUED_BUFFERS >
+	    mapping->buffers.count)
+		return false;
+
+	pthread_mutex_lock(&mapping->mutex);
+	mapping->refs[index].held = true;
+	pthread_mutex_unlock(&mapping->mutex);
+
+	os_atomic_inc_long(&mapping->held_buffers);
+	os_atomic_inc_long(&mapping->refcount);
+	obs_source_output_video_nocopy(data->source, out, v4l2_release_buffer,
+				       &mapping->refs[index]);
+	return true;
+}
+
+/*
+ * Flushes the frames queued in libobs and waits for their buffers to be
+ * released, so that the device can be set up again.  Buffers that are still
+ * held after that stay mapped until they are released.
+ */
+static void v4l2_release_frames(struct v4l2_data *data)
+{
+	struct v4l2_mapping *mapping = data->mapping;
+
+	if (!mapping || !os_atomic_load_long(&mapping->held_buffers))
+		return;
+
+	obs_source_output_video(data->source, NULL);
+
+	for (int i = 0; i < RELEASE_TIMEOUT_MS / 10; i++) {
+		if (!os_atomic_load_long(&mapping->held_buffers))
+			return;
+		os_sleep_ms(10);
+	}
+
+	blog(LOG_WARNING, "%s: %ld buffers are still in use",
+	     data->device_id, os_atomic_load_long(&mapping->held_buffers));
+}
+
 /*
  * Worker thread to get video data
  */
@@ -190,7 +396,7 @@ static void *v4l2_thread(void *vptr)
 	     "%s: select timeout set to %" PRIu64 " (%dx frame periods)",
 	     data->device_id, timeout_usec, data->timeout_frames);
 
-	if (v4l2_start_capture(data->dev, &data->buffers) < 0)
+	if (v4l2_mapping_start(data->mapping) < 0)
 		goto exit;
 
 	blog(LOG_DEBUG, "%s: new capture started", data->device_id);
@@ -220,7 +426,8 @@ static void *v4l2_thread(void *vptr)
 			     data->device_id);
 
 #ifdef _DEBUG
-			v4l2_query_all_buffers(data->dev, &data->buffers);
+			v4l2_query_all_buffers(data->dev,
+					       &data->mapping->buffers);
 #endif
 
 			if (v4l2_ioctl(data->dev, VIDIOC_LOG_STATUS) < 0) {
@@ -229,8 +436,7 @@ static void *v4l2_thread(void *vptr)
 			}
 
 			if (data->auto_reset) {
-				if (v4l2_reset_capture(data->dev,
-						       &data->buffers) == 0)
+				if (v4l2_mapping_reset(data->mapping) == 0)
 					blog(LOG_INFO,
 					     "%s: stream reset successful",
 					     data->device_id);
@@ -266,7 +472,7 @@ static void *v4l2_thread(void *vptr)
 			first_ts = out.timestamp;
 		out.timestamp -= first_ts;
 
-		start = (uint8_t *)data->buffers.info[buf.index].start;
+		start = (uint8_t *)data->mapping->buffers.info[buf.index].start;
 
 		if (data->pixfmt == V4L2_PIX_FMT_MJPEG) {
 			if (v4l2_decode_mjpeg(&out, start, buf.bytesused,
@@ -277,6 +483,11 @@ static void *v4l2_thread(void *vptr)
 		} else {
 			for (uint_fast32_t i = 0; i < MAX_AV_PLANES; ++i)
 				out.data[i] = start + plane_offsets[i];
+
+			if (v4l2_output_nocopy(data, &out, buf.index)) {
+				frames++;
+				continue;
+			}
 		}
 		obs_source_output_video(data->source, &out);
 
@@ -293,7 +504,7 @@ static void *v4l2_thread(void *vptr)
 	     data->device_id, frames);
 
 exit:
-	v4l2_stop_capture(data->dev);
+	v4l2_mapping_stop(data->mapping);
 	return NULL;
 }
 
@@ -911,7 +1122,8 @@ static void v4l2_terminate(struct v4l2_data *data)
 	}
 
 	v4l2_destroy_mjpeg(&data->mjpeg_decoder);
-	v4l2_destroy_mmap(&data->buffers);
+	v4l2_mapping_release(data->mapping);
+	data->mapping = NULL;
 
 	if (data->dev != -1) {
 		v4l2_close(data->dev);
@@ -1020,7 +1232,8 @@ static void v4l2_init(struct v4l2_data *data)
 	blog(LOG_INFO, "Framerate: %.2f fps", (float)fps_denom / fps_num);
 
 	/* map buffers */
-	if (v4l2_create_mmap(data->dev, &data->buffers) < 0) {
+	data->mapping = v4l2_mapping_create(data->dev, data->device_id);
+	if (!data->mapping) {
 		blog(LOG_ERROR, "Failed to map buffers");
 		goto fail;
 	}
@@ -1119,8 +1332,12 @@ static void v4l2_update(void *vptr, obs_data_t *settings)
 
 	bool needs_restart = v4l2_settings_changed(data, settings);
 
-	if (needs_restart)
+	if (needs_restart) {
+		/* the device can't allocate new buffers while the old ones
+		 * are still mapped */
+		v4l2_release_frames(data);
 		v4l2_terminate(data);
+	}
 
 	if (data->device_id)
 		bfree(data->device_id);
@@ -23,6 +23,10 @@
 
 #include <libavformat/avformat.h>
 
+/* the ring keeps going while a save reads from the spill file, so it gets
+ * room past the size limit for the packets that come in meanwhile */
+#define SPILL_HEADROOM_MIN (64LL * 1024 * 1024)
+
 #define do_log(level, format, ...)                  \
 	blog(level, "[ffmpeg muxer: '%s'] " format, \
 	     obs_output_get_name(stream->output), ##__VA_ARGS__)
@@ -59,6 +63,11 @@ static inline void replay_buffer_clear(struct ffmpeg_muxer *stream)
 	stream->max_time = 0;
 	stream->save_ts = 0;
 	stream->keyframes = 0;
+
+	/* a replay that is still being saved keeps its own reference */
+	replay_spill_release(stream->spill);
+	stream->spill = NULL;
+	stream->spill_wait_keyframe = false;
 }
 
 static void ffmpeg_mux_destroy(void *data)
@@ -71,6 +80,7 @@ static void ffmpeg_mux_destroy(void *data)
 	for (size_t i = 0; i < stream->mux_packets.num; i++)
 		obs_encoder_packet_release(&stream->mux_packets.array[i]);
 	da_free(stream->mux_packets);
+	da_free(stream->mux_positions);
 	circlebuf_free(&stream->packets);
 
 	os_process_pipe_destroy(stream->pipe);
@@ -589,7 +599,8 @@ static void generate_filename(struct ffmpeg_muxer *stream, struct dstr *dst,
 	obs_data_release(settings);
 }
 
-bool write_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet)
+static bool write_packet_info(struct ffmpeg_muxer *stream,
+			      struct encoder_packet *packet)
 {
 	bool is_video = packet->type == OBS_ENCODER_VIDEO;
 	size_t ret;
@@ -620,6 +631,16 @@ bool write_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet)
 		return false;
 	}
 
+	return true;
+}
+
+bool write_packet(struct ffmpeg_muxer *stream, struct encoder_packet *packet)
+{
+	size_t ret;
+
+	if (!write_packet_info(stream, packet))
+		return false;
+
 	ret = os_process_pipe_write(stream->pipe, packet->data, packet->size);
 	if (ret != packet->size) {
 		warn("os_process_pipe_write for packet data failed");
@@ -993,6 +1014,29 @@ static bool replay_buffer_start(void *data)
 	obs_data_t *s = obs_output_get_settings(stream->output);
 	stream->max_time = obs_data_get_int(s, "max_time_sec") * 1000000LL;
 	stream->max_size = obs_data_get_int(s, "max_size_mb") * (1024 * 1024);
+
+	/* the file is preallocated, so it needs a size limit */
+	if (obs_data_get_bool(s, "spill_to_disk") && !stream->max_size) {
+		warn("The replay buffer needs a maximum size to be kept on "
+		     "disk, keeping it in memory");
+	} else if (obs_data_get_bool(s, "spill_to_disk")) {
+		const char *dir = obs_data_get_string(s, "directory");
+		int64_t headroom = stream->max_size / 4;
+
+		if (headroom < SPILL_HEADROOM_MIN)
+			headroom = SPILL_HEADROOM_MIN;
+
+		stream->spill = replay_spill_create(
+			dir, (uint64_t)(stream->max_size + headroom));
+		if (!stream->spill) {
+			obs_output_set_last_error(
+				stream->output,
+				obs_module_text("ReplayBuffer.SpillFailed"));
+			obs_data_release(s);
+			return false;
+		}
+	}
+
 	obs_data_release(s);
 
 	os_atomic_set_bool(&stream->active, true);
@@ -1013,6 +1057,9 @@ static bool purge_front(struct ffmpeg_muxer *stream)
 
 	circlebuf_pop_front(&stream->packets, &pkt, sizeof(pkt));
 
+	if (stream->spill)
+		replay_spill_pop(stream->spill, pkt.size);
+
 	keyframe = pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe;
 
 	if (keyframe)
@@ -1054,11 +1101,15 @@ static inline void replay_buffer_purge(struct ffmpeg_muxer *stream,
 				       struct encoder_packet *pkt)
 {
 	if (stream->max_size) {
-		if (!stream->packets.size || stream->keyframes <= 2)
+		/* the spill file can't grow, so it can't keep the last
+		 * keyframes past the size limit like memory can */
+		if (!stream->packets.size ||
+		    (stream->keyframes <= 2 && !stream->spill))
 			return;
 
-		while ((stream->cur_size + (int64_t)pkt->size) >
-		       stream->max_size)
+		while (stream->packets.size &&
+		       (stream->cur_size + (int64_t)pkt->size) >
+			       stream->max_size)
 			purge(stream);
 	}
 
@@ -1069,35 +1120,38 @@ static inline void replay_buffer_purge(struct ffmpeg_muxer *stream,
 		purge(stream);
 }
 
-static void insert_packet(struct darray *array, struct encoder_packet *packet,
-			  int64_t video_offset, int64_t *audio_offsets,
-			  int64_t video_pts_offset, int64_t *audio_dts_offsets)
+static bool write_spilled_data(void *param, const uint8_t *data, size_t size)
 {
-	struct encoder_packet pkt;
-	DARRAY(struct encoder_packet) packets;
-	packets.da = *array;
-	size_t idx;
+	struct ffmpeg_muxer *stream = param;
 
-	obs_encoder_packet_ref(&pkt, packet);
-
-	if (pkt.type == OBS_ENCODER_VIDEO) {
-		pkt.dts_usec -= video_offset;
-		pkt.dts -= video_pts_offset;
-		pkt.pts -= video_pts_offset;
-	} else {
-		pkt.dts_usec -= audio_offsets[pkt.track_idx];
-		pkt.dts -= audio_dts_offsets[pkt.track_idx];
-		pkt.pts -= audio_dts_offsets[pkt.track_idx];
+	if (os_process_pipe_write(stream->pipe, data, size) != size) {
+		warn("os_process_pipe_write for packet data failed");
+		signal_failure(stream);
+		return false;
 	}
 
-	for (idx = packets.num; idx > 0; idx--) {
-		struct encoder_packet *p = packets.array + (idx - 1);
-		if (p->dts_usec < pkt.dts_usec)
-			break;
-	}
+	return true;
+}
 
-	da_insert(packets, idx, &pkt);
-	*array = packets.da;
+static bool write_spilled_packet(void *param, struct encoder_packet *pkt)
+{
+	struct ffmpeg_muxer *stream = param;
+
+	if (!write_packet_info(stream, pkt))
+		return false;
+
+	stream->total_bytes += pkt->size;
+	return true;
+}
+
+/* streams the packet data straight from the spill file to the muxer, and
+ * hands the space back to the replay buffer as it goes */
+static bool write_spilled_packets(struct ffmpeg_muxer *stream)
+{
+	return replay_save_write_spilled(
+		stream->mux_spill, stream->mux_packets.array,
+		stream->mux_positions.array, stream->mux_packets.num,
+		write_spilled_packet, write_spilled_data, stream);
 }
 
 static void *replay_buffer_mux_thread(void *data)
@@ -1120,10 +1174,18 @@ static void *replay_buffer_mux_thread(void *data)
 		goto error;
 	}
 
-	for (size_t i = 0; i < stream->mux_packets.num; i++) {
-		struct encoder_packet *pkt = &stream->mux_packets.array[i];
-		write_packet(stream, pkt);
-		obs_encoder_packet_release(pkt);
+	if (stream->mux_spill) {
+		if (!write_spilled_packets(stream)) {
+			error = true;
+			goto error;
+		}
+	} else {
+		for (size_t i = 0; i < stream->mux_packets.num; i++) {
+			struct encoder_packet *pkt =
+				&stream->mux_packets.array[i];
+			write_packet(stream, pkt);
+			obs_encoder_packet_release(pkt);
+		}
 	}
 
 	info("Wrote replay buffer to '%s'", stream->path.array);
@@ -1131,12 +1193,20 @@ static void *replay_buffer_mux_thread(void *data)
 error:
 	os_process_pipe_destroy(stream->pipe);
 	stream->pipe = NULL;
-	if (error) {
+	if (error || stream->mux_spill) {
 		for (size_t i = 0; i < stream->mux_packets.num; i++)
 			obs_encoder_packet_release(
 				&stream->mux_packets.array[i]);
 	}
 	da_free(stream->mux_packets);
+	da_free(stream->mux_positions);
+
+	if (stream->mux_spill) {
+		replay_spill_unpin(stream->mux_spill);
+		replay_spill_release(stream->mux_spill);
+		stream->mux_spill = NULL;
+	}
+
 	os_atomic_set_bool(&stream->muxing, false);
 
 	if (!error) {
@@ -1151,43 +1221,12 @@ error:
 
 static void replay_buffer_save(struct ffmpeg_muxer *stream)
 {
-	const size_t size = sizeof(struct encoder_packet);
-	size_t num_packets = stream->packets.size / size;
-
-	da_reserve(stream->mux_packets, num_packets);
-
-	/* ---------------------------- */
-	/* reorder packets */
-
-	bool found_video = false;
-	bool found_audio[MAX_AUDIO_MIXES] = {0};
-	int64_t video_offset = 0;
-	int64_t video_pts_offset = 0;
-	int64_t audio_offsets[MAX_AUDIO_MIXES] = {0};
-	int64_t audio_dts_offsets[MAX_AUDIO_MIXES] = {0};
-
-	for (size_t i = 0; i < num_packets; i++) {
-		struct encoder_packet *pkt;
-		pkt = circlebuf_data(&stream->packets, i * size);
-
-		if (pkt->type == OBS_ENCODER_VIDEO) {
-			if (!found_video) {
-				video_pts_offset = pkt->pts;
-				video_offset = video_pts_offset * 1000000 /
-					       pkt->timebase_den;
-				found_video = true;
-			}
-		} else {
-			if (!found_audio[pkt->track_idx]) {
-				found_audio[pkt->track_idx] = true;
-				audio_offsets[pkt->track_idx] = pkt->dts_usec;
-				audio_dts_offsets[pkt->track_idx] = pkt->dts;
-			}
-		}
+	replay_save_order(&stream->packets, &stream->mux_packets.da,
+			  stream->spill, &stream->mux_positions.da);
 
-		insert_packet(&stream->mux_packets.da, pkt, video_offset,
-			      audio_offsets, video_pts_offset,
-			      audio_dts_offsets);
+	if (stream->spill) {
+		replay_spill_addref(stream->spill);
+		stream->mux_spill = stream->spill;
 	}
 
 	generate_filename(stream, &stream->path, true);
@@ -1198,6 +1237,19 @@ static void replay_buffer_save(struct ffmpeg_muxer *stream)
 						     stream) == 0;
 	if (!stream->mux_thread_joinable) {
 		warn("Failed to create muxer thread");
+
+		for (size_t i = 0; i < stream->mux_packets.num; i++)
+			obs_encoder_packet_release(
+				&stream->mux_packets.array[i]);
+		da_free(stream->mux_packets);
+		da_free(stream->mux_positions);
+
+		if (stream->mux_spill) {
+			replay_spill_unpin(stream->mux_spill);
+			replay_spill_release(stream->mux_spill);
+			stream->mux_spill = NULL;
+		}
+
 		os_atomic_set_bool(&stream->muxing, false);
 	}
 }
@@ -1216,6 +1268,45 @@ static void deactivate_replay_buffer(struct ffmpeg_muxer *stream, int code)
 	replay_buffer_clear(stream);
 }
 
+/* moves the packet data to the spill file, leaving only the metadata in the
+ * packet.  returns false if the packet was dropped. */
+static bool spill_packet(struct ffmpeg_muxer *stream,
+			 struct encoder_packet *pkt)
+{
+	bool keyframe = pkt->type == OBS_ENCODER_VIDEO && pkt->keyframe;
+
+	/* a replay that is still being saved can hold on to more of the file
+	 * than the size limit leaves, the buffer then continues from the
+	 * next keyframe that fits */
+	if (stream->spill_wait_keyframe && !keyframe)
+		goto drop;
+
+	if (!replay_spill_fits(stream->spill, pkt->size)) {
+		if (!stream->spill_wait_keyframe)
+			warn("Replay buffer file is full, dropping packets "
+			     "until the next keyframe");
+		stream->spill_wait_keyframe = true;
+		goto drop;
+	}
+
+	if (!replay_spill_write(stream->spill, pkt->data, pkt->size)) {
+		obs_encoder_packet_release(pkt);
+		deactivate_replay_buffer(stream, OBS_OUTPUT_ERROR);
+		return false;
+	}
+
+	struct encoder_packet ref = *pkt;
+	obs_encoder_packet_release(&ref);
+
+	pkt->data = NULL;
+	stream->spill_wait_keyframe = false;
+	return true;
+
+drop:
+	obs_encoder_packet_release(pkt);
+	return false;
+}
+
 static void replay_buffer_data(void *data, struct encoder_packet *packet)
 {
 	struct ffmpeg_muxer *stream = data;
@@ -1240,13 +1331,16 @@ static void replay_buffer_data(void *data, struct encoder_packet *packet)
 	obs_encoder_packet_ref(&pkt, packet);
 	replay_buffer_purge(stream, &pkt);
 
+	if (stream->spill && !spill_packet(stream, &pkt))
+		return;
+
 	if (!stream->packets.size)
 		stream->cur_time = pkt.dts_usec;
 	stream->cur_size += pkt.size;
 
-	circlebuf_push_back(&stream->packets, packet, sizeof(*packet));
+	circlebuf_push_back(&stream->packets, &pkt, sizeof(pkt));
 
-	if (packet->type == OBS_ENCODER_VIDEO && packet->keyframe)
+	if (pkt.type == OBS_ENCODER_VIDEO && pkt.keyframe)
 		stream->keyframes++;
 
 	if (stream->save_ts && packet->sys_dts_usec >= stream->save_ts) {
@@ -1267,6 +1361,7 @@ static void replay_buffer_defaults(obs_data_t *s)
 {
 	obs_data_set_default_int(s, "max_time_sec", 15);
 	obs_data_set_default_int(s, "max_size_mb", 500);
+	obs_data_set_default_bool(s, "spill_to_disk", false);
 	obs_data_set_default_string(s, "format", "%CCYY-%MM-%DD %hh-%mm-%ss");
 	obs_data_set_default_string(s, "extension", "mp4");
 	obs_data_set_default_bool(s, "allow_spaces", true);
@@ -9,6 +9,7 @@
 #include <util/pipe.h>
 #include <util/platform.h>
 #include <util/threading.h>
+#include "replay-save.h"
 
 struct ffmpeg_muxer {
 	obs_output_t *output;
@@ -37,6 +38,13 @@ struct ffmpeg_muxer {
 	volatile bool muxing;
 	DARRAY(struct encoder_packet) mux_packets;
 
+	/* replay buffer with the packet data in a file, the packets then only
+	 * hold the metadata */
+	struct replay_spill *spill;
+	struct replay_spill *mux_spill;
+	DARRAY(uint64_t) mux_positions;
+	bool spill_wait_keyframe;
+
 	/* split file */
 	bool found_video;
 	bool found_audio[MAX_AUDIO_MIXES];
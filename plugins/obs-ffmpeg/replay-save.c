@@ -0,0 +1,143 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <util/bmem.h>
+#include "replay-save.h"
+
+static size_t insert_packet(struct darray *array,
+			    struct encoder_packet *packet, int64_t video_offset,
+			    int64_t *audio_offsets, int64_t video_pts_offset,
+			    int64_t *audio_dts_offsets)
+{
+	struct encoder_packet pkt;
+	DARRAY(struct encoder_packet) packets;
+	packets.da = *array;
+	size_t idx;
+
+	obs_encoder_packet_ref(&pkt, packet);
+
+	if (pkt.type == OBS_ENCODER_VIDEO) {
+		pkt.dts_usec -= video_offset;
+		pkt.dts -= video_pts_offset;
+		pkt.pts -= video_pts_offset;
+	} else {
+		pkt.dts_usec -= audio_offsets[pkt.track_idx];
+		pkt.dts -= audio_dts_offsets[pkt.track_idx];
+		pkt.pts -= audio_dts_offsets[pkt.track_idx];
+	}
+
+	for (idx = packets.num; idx > 0; idx--) {
+		struct encoder_packet *p = packets.array + (idx - 1);
+		if (p->dts_usec < pkt.dts_usec)
+			break;
+	}
+
+	da_insert(packets, idx, &pkt);
+	*array = packets.da;
+	return idx;
+}
+
+void replay_save_order(struct circlebuf *packets, struct darray *mux_packets,
+		       struct replay_spill *spill, struct darray *positions)
+{
+	const size_t size = sizeof(struct encoder_packet);
+	size_t num_packets = packets->size / size;
+	uint64_t pos = spill ? replay_spill_tail(spill) : 0;
+
+	darray_reserve(size, mux_packets, num_packets);
+	if (spill)
+		darray_reserve(sizeof(uint64_t), positions, num_packets);
+
+	bool found_video = false;
+	bool found_audio[MAX_AUDIO_MIXES] = {0};
+	int64_t video_offset = 0;
+	int64_t video_pts_offset = 0;
+	int64_t audio_offsets[MAX_AUDIO_MIXES] = {0};
+	int64_t audio_dts_offsets[MAX_AUDIO_MIXES] = {0};
+
+	for (size_t i = 0; i < num_packets; i++) {
+		struct encoder_packet *pkt;
+		pkt = circlebuf_data(packets, i * size);
+
+		if (pkt->type == OBS_ENCODER_VIDEO) {
+			if (!found_video) {
+				video_pts_offset = pkt->pts;
+				video_offset = video_pts_offset * 1000000 /
+					       pkt->timebase_den;
+				found_video = true;
+			}
+		} else {
+			if (!found_audio[pkt->track_idx]) {
+				found_audio[pkt->track_idx] = true;
+				audio_offsets[pkt->track_idx] = pkt->dts_usec;
+				audio_dts_offsets[pkt->track_idx] = pkt->dts;
+			}
+		}
+
+		size_t idx = insert_packet(mux_packets, pkt, video_offset,
+					   audio_offsets, video_pts_offset,
+					   audio_dts_offsets);
+
+		/* the data of the packets is stored back to back from the
+		 * tail of the spill ring */
+		if (spill) {
+			darray_insert(sizeof(uint64_t), positions, idx, &pos);
+			pos += pkt->size;
+		}
+	}
+
+	/* keeps the data from being overwritten until it has been written
+	 * out, as the replay buffer goes on in the meantime */
+	if (spill)
+		replay_spill_pin(spill, replay_spill_tail(spill));
+}
+
+bool replay_save_write_spilled(struct replay_spill *spill,
+			       struct encoder_packet *packets,
+			       const uint64_t *positions, size_t num,
+			       replay_save_packet_cb packet_cb,
+			       replay_spill_read_cb data_cb, void *param)
+{
+	struct replay_spill_view view;
+	uint64_t *needed = bmalloc((num + 1) * sizeof(uint64_t));
+	bool success = true;
+
+	/* the packets were reordered by timestamp, so what's still needed
+	 * after each packet starts at the lowest position that is left */
+	needed[num] = UINT64_MAX;
+	for (size_t i = num; i > 0; i--)
+		needed[i - 1] = positions[i - 1] < needed[i] ? positions[i - 1]
+							     : needed[i];
+
+	replay_spill_view_init(&view, spill);
+
+	for (size_t i = 0; i < num; i++) {
+		struct encoder_packet *pkt = &packets[i];
+
+		if (!packet_cb(param, pkt) ||
+		    !replay_spill_read(&view, positions[i], pkt->size, data_cb,
+				       param)) {
+			success = false;
+			break;
+		}
+
+		if (i + 1 < num)
+			replay_spill_pin(spill, needed[i + 1]);
+	}
+
+	replay_spill_view_free(&view);
+	bfree(needed);
+	return success;
+}
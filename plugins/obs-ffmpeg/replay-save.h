@@ -0,0 +1,49 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <obs.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include "replay-spill.h"
+
+/*
+ * Packet order of replay buffer saves.  The packets of a save are rebased to
+ * the start of the replay and ordered by dts, so when their data is in a
+ * spill ring it is no longer read in the order it was written.
+ */
+
+/** Fills mux_packets (a darray of encoder packets) with references to the
+ * packets in the replay buffer, in the order they are muxed.  With a spill
+ * ring, positions (a darray of uint64_t) receives the position of the data
+ * of each of those packets, and the ring is pinned from its tail. */
+extern void replay_save_order(struct circlebuf *packets,
+			      struct darray *mux_packets,
+			      struct replay_spill *spill,
+			      struct darray *positions);
+
+typedef bool (*replay_save_packet_cb)(void *param,
+				      struct encoder_packet *packet);
+
+/** Writes out num packets whose data is in the spill ring: the packet
+ * callback gets each packet, then the data callback its data.  After each
+ * packet, the pin moves up to the lowest position that is still needed. */
+extern bool replay_save_write_spilled(struct replay_spill *spill,
+				      struct encoder_packet *packets,
+				      const uint64_t *positions, size_t num,
+				      replay_save_packet_cb packet_cb,
+				      replay_spill_read_cb data_cb,
+				      void *param);
@@ -0,0 +1,429 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <util/base.h>
+#include <util/bmem.h>
+#include <util/dstr.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <inttypes.h>
+#include "replay-spill.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/* segments are the unit of mapping, a multiple of the page size and of the
+ * windows allocation granularity */
+#define SEGMENT_SIZE (16ULL * 1024 * 1024)
+#define ZERO_CHUNK_SIZE (1024 * 1024)
+
+struct replay_spill {
+	volatile long refs;
+
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int fd;
+#endif
+
+	uint64_t capacity;
+	uint64_t head;
+	uint64_t tail;
+
+	/* writer mapping, only touched by the writer thread */
+	uint8_t *write_map;
+	uint64_t write_segment;
+
+	pthread_mutex_t pin_mutex;
+	bool pinned;
+	uint64_t pin;
+};
+
+/* ------------------------------------------------------------------------- */
+/* platform                                                                  */
+
+#ifdef _WIN32
+static bool open_file(struct replay_spill *spill, const char *path)
+{
+	LARGE_INTEGER size = {.QuadPart = (LONGLONG)spill->capacity};
+	wchar_t *wpath = NULL;
+
+	os_utf8_to_wcs_ptr(path, 0, &wpath);
+	spill->file = CreateFileW(wpath, GENERIC_READ | GENERIC_WRITE, 0,
+				  NULL, CREATE_NEW,
+				  FILE_ATTRIBUTE_TEMPORARY |
+					  FILE_ATTRIBUTE_HIDDEN |
+					  FILE_FLAG_DELETE_ON_CLOSE,
+				  NULL);
+	bfree(wpath);
+
+	if (spill->file == INVALID_HANDLE_VALUE) {
+		spill->file = NULL;
+		return false;
+	}
+
+	/* setting the end of file allocates the space */
+	if (!SetFilePointerEx(spill->file, size, NULL, FILE_BEGIN) ||
+	    !SetEndOfFile(spill->file))
+		return false;
+
+	spill->mapping = CreateFileMappingW(spill->file, NULL, PAGE_READWRITE,
+					    size.HighPart, size.LowPart, NULL);
+	return spill->mapping != NULL;
+}
+
+static void close_file(struct replay_spill *spill)
+{
+	if (spill->mapping)
+		CloseHandle(spill->mapping);
+	if (spill->file)
+		CloseHandle(spill->file);
+}
+
+static uint8_t *map_segment(struct replay_spill *spill, uint64_t segment,
+			    bool write)
+{
+	uint64_t offset = segment * SEGMENT_SIZE;
+	return MapViewOfFile(spill->mapping,
+			     write ? FILE_MAP_WRITE : FILE_MAP_READ,
+			     (DWORD)(offset >> 32), (DWORD)offset,
+			     (SIZE_T)SEGMENT_SIZE);
+}
+
+static void unmap_segment(uint8_t *data, bool write)
+{
+	/* starts writing the segment back, so that dirty pages don't pile up
+	 * while the ring goes around */
+	if (write)
+		FlushViewOfFile(data, 0);
+	UnmapViewOfFile(data);
+}
+
+#else
+#if !defined(__APPLE__)
+/* a sparse file would only get its blocks when the mapping is written to,
+ * and running out of space then raises SIGBUS instead of an error */
+static bool write_zeros(int fd, uint64_t size)
+{
+	uint8_t *zeros = bzalloc(ZERO_CHUNK_SIZE);
+	uint64_t pos = 0;
+
+	while (pos < size) {
+		uint64_t left = size - pos;
+		size_t len = left < ZERO_CHUNK_SIZE ? (size_t)left
+						    : ZERO_CHUNK_SIZE;
+		ssize_t ret = pwrite(fd, zeros, len, (off_t)pos);
+
+		if (ret < 0 && errno == EINTR)
+			continue;
+		if (ret <= 0)
+			break;
+		pos += (uint64_t)ret;
+	}
+
+	bfree(zeros);
+	return pos == size;
+}
+#endif
+
+static bool preallocate(int fd, uint64_t size)
+{
+#if defined(__APPLE__)
+	fstore_t store = {F_ALLOCATEALL, F_PEOFPOSMODE, 0, (off_t)size, 0};
+	if (fcntl(fd, F_PREALLOCATE, &store) == -1)
+		return false;
+	return ftruncate(fd, (off_t)size) == 0;
+#else
+	int ret = posix_fallocate(fd, 0, (off_t)size);
+	if (ret == 0)
+		return true;
+
+	/* only the lack of space is fatal, some file systems just don't
+	 * support allocating in advance, and get the blocks written out */
+	if (ret != EINVAL && ret != EOPNOTSUPP)
+		return false;
+
+	return write_zeros(fd, size);
+#endif
+}
+
+static bool open_file(struct replay_spill *spill, const char *path)
+{
+	spill->fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (spill->fd == -1)
+		return false;
+
+	/* the open descriptor keeps the file around, unlinking it right away
+	 * means that it can't be left behind */
+	unlink(path);
+
+	return preallocate(spill->fd, spill->capacity);
+}
+
+static void close_file(struct replay_spill *spill)
+{
+	if (spill->fd != -1)
+		close(spill->fd);
+}
+
+static uint8_t *map_segment(struct replay_spill *spill, uint64_t segment,
+			    bool write)
+{
+	int prot = write ? PROT_READ | PROT_WRITE : PROT_READ;
+	void *data = mmap(NULL, SEGMENT_SIZE, prot, MAP_SHARED, spill->fd,
+			  (off_t)(segment * SEGMENT_SIZE));
+	if (data == MAP_FAILED)
+		return NULL;
+
+	madvise(data, SEGMENT_SIZE, MADV_SEQUENTIAL);
+	return data;
+}
+
+static void unmap_segment(uint8_t *data, bool write)
+{
+	/* starts writing the segment back, so that dirty pages don't pile up
+	 * while the ring goes around */
+	if (write)
+		msync(data, SEGMENT_SIZE, MS_ASYNC);
+	munmap(data, SEGMENT_SIZE);
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+struct replay_spill *replay_spill_create(const char *dir, uint64_t size)
+{
+	struct replay_spill *spill = bzalloc(sizeof(struct replay_spill));
+	struct dstr path = {0};
+	uint64_t segments = (size + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+
+	spill->refs = 1;
+	spill->capacity = (segments ? segments : 1) * SEGMENT_SIZE;
+#ifndef _WIN32
+	spill->fd = -1;
+#endif
+	pthread_mutex_init_value(&spill->pin_mutex);
+
+	dstr_copy(&path, dir);
+	dstr_replace(&path, "\\", "/");
+	if (dstr_end(&path) != '/')
+		dstr_cat_ch(&path, '/');
+	dstr_catf(&path, ".obs-replay-%" PRIx64 ".spill", os_gettime_ns());
+
+	os_mkdirs(dir);
+
+	if (pthread_mutex_init(&spill->pin_mutex, NULL) != 0)
+		goto fail;
+
+	if (!open_file(spill, path.array)) {
+		blog(LOG_WARNING,
+		     "replay spill: Failed to create a %" PRIu64
+		     " MB file at '%s'",
+		     spill->capacity / (1024 * 1024), path.array);
+		goto fail;
+	}
+
+	blog(LOG_INFO, "replay spill: Using a %" PRIu64 " MB file at '%s'",
+	     spill->capacity / (1024 * 1024), path.array);
+	dstr_free(&path);
+	return spill;
+
+fail:
+	dstr_free(&path);
+	replay_spill_release(spill);
+	return NULL;
+}
+
+void replay_spill_addref(struct replay_spill *spill)
+{
+	os_atomic_inc_long(&spill->refs);
+}
+
+void replay_spill_release(struct replay_spill *spill)
+{
+	if (!spill || os_atomic_dec_long(&spill->refs) != 0)
+		return;
+
+	if (spill->write_map)
+		unmap_segment(spill->write_map, true);
+
+	close_file(spill);
+	pthread_mutex_destroy(&spill->pin_mutex);
+	bfree(spill);
+}
+
+uint64_t replay_spill_capacity(const struct replay_spill *spill)
+{
+	return spill->capacity;
+}
+
+uint64_t replay_spill_head(const struct replay_spill *spill)
+{
+	return spill->head;
+}
+
+uint64_t replay_spill_tail(const struct replay_spill *spill)
+{
+	return spill->tail;
+}
+
+bool replay_spill_fits(struct replay_spill *spill, size_t size)
+{
+	uint64_t oldest = spill->tail;
+
+	pthread_mutex_lock(&spill->pin_mutex);
+	if (spill->pinned && spill->pin < oldest)
+		oldest = spill->pin;
+	pthread_mutex_unlock(&spill->pin_mutex);
+
+	return spill->head + size <= oldest + spill->capacity;
+}
+
+static bool map_write_segment(struct replay_spill *spill, uint64_t segment)
+{
+	if (spill->write_map && spill->write_segment == segment)
+		return true;
+
+	if (spill->write_map)
+		unmap_segment(spill->write_map, true);
+
+	spill->write_map = map_segment(spill, segment, true);
+	spill->write_segment = segment;
+	return spill->write_map != NULL;
+}
+
+bool replay_spill_write(struct replay_spill *spill, const void *data,
+			size_t size)
+{
+	const uint8_t *src = data;
+
+	while (size) {
+		uint64_t offset = spill->head % spill->capacity;
+		uint64_t segment = offset / SEGMENT_SIZE;
+		size_t seg_offset = (size_t)(offset % SEGMENT_SIZE);
+		size_t len = (size_t)SEGMENT_SIZE - seg_offset;
+
+		if (len > size)
+			len = size;
+
+		if (!map_write_segment(spill, segment)) {
+			blog(LOG_WARNING, "replay spill: Failed to map "
+					  "segment %" PRIu64,
+			     segment);
+			return false;
+		}
+
+		memcpy(spill->write_map + seg_offset, src, len);
+		spill->head += len;
+		src += len;
+		size -= len;
+	}
+
+	return true;
+}
+
+void replay_spill_pop(struct replay_spill *spill, size_t size)
+{
+	spill->tail += size;
+	if (spill->tail > spill->head)
+		spill->tail = spill->head;
+}
+
+void replay_spill_pin(struct replay_spill *spill, uint64_t pos)
+{
+	pthread_mutex_lock(&spill->pin_mutex);
+	if (!spill->pinned || pos > spill->pin)
+		spill->pin = pos;
+	spill->pinned = true;
+	pthread_mutex_unlock(&spill->pin_mutex);
+}
+
+void replay_spill_unpin(struct replay_spill *spill)
+{
+	pthread_mutex_lock(&spill->pin_mutex);
+	spill->pinned = false;
+	pthread_mutex_unlock(&spill->pin_mutex);
+}
+
+/* ------------------------------------------------------------------------- */
+/* views                                                                     */
+
+void replay_spill_view_init(struct replay_spill_view *view,
+			    struct replay_spill *spill)
+{
+	view->spill = spill;
+	view->data = NULL;
+	view->segment = 0;
+}
+
+void replay_spill_view_free(struct replay_spill_view *view)
+{
+	if (view->data)
+		unmap_segment(view->data, false);
+	view->data = NULL;
+}
+
+static bool map_view_segment(struct replay_spill_view *view,
+			     uint64_t segment)
+{
+	if (view->data && view->segment == segment)
+		return true;
+
+	if (view->data)
+		unmap_segment(view->data, false);
+
+	view->data = map_segment(view->spill, segment, false);
+	view->segment = segment;
+	return view->data != NULL;
+}
+
+bool replay_spill_read(struct replay_spill_view *view, uint64_t pos,
+		       size_t size, replay_spill_read_cb callback, void *param)
+{
+	struct replay_spill *spill = view->spill;
+
+	while (size) {
+		uint64_t offset = pos % spill->capacity;
+		uint64_t segment = offset / SEGMENT_SIZE;
+		size_t seg_offset = (size_t)(offset % SEGMENT_SIZE);
+		size_t len = (size_t)SEGMENT_SIZE - seg_offset;
+
+		if (len > size)
+			len = size;
+
+		if (!map_view_segment(view, segment)) {
+			blog(LOG_WARNING, "replay spill: Failed to map "
+					  "segment %" PRIu64 " for reading",
+			     segment);
+			return false;
+		}
+
+		if (!callback(param, view->data + seg_offset, len))
+			return false;
+
+		pos += len;
+		size -= len;
+	}
+
+	return true;
+}
@@ -0,0 +1,87 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <util/c99defs.h>
+
+/*
+ * Disk-backed byte ring used by the replay buffer to keep packet payloads
+ * out of memory.  Data is appended sequentially at the head of a
+ * preallocated file and removed from the tail, and the file is mapped one
+ * segment at a time, so neither the file size nor the replay length grows
+ * the memory used by the process.
+ *
+ * Positions are absolute byte counts since the ring was created, the data
+ * of position pos is stored at pos % capacity.  The writer functions must
+ * all be called from the same thread, views and the pin can be used from
+ * another one.
+ */
+
+struct replay_spill;
+
+/** Creates a ring of at least size bytes in a temporary file in dir.  The
+ * file is deleted when the last reference is released (or by the system if
+ * the process dies, where supported). */
+extern struct replay_spill *replay_spill_create(const char *dir,
+						uint64_t size);
+extern void replay_spill_addref(struct replay_spill *spill);
+extern void replay_spill_release(struct replay_spill *spill);
+
+extern uint64_t replay_spill_capacity(const struct replay_spill *spill);
+extern uint64_t replay_spill_head(const struct replay_spill *spill);
+extern uint64_t replay_spill_tail(const struct replay_spill *spill);
+
+/** Returns false if appending size bytes would overwrite data before the
+ * tail, or data that is pinned */
+extern bool replay_spill_fits(struct replay_spill *spill, size_t size);
+
+/** Appends data at the head, replay_spill_fits must have returned true.
+ * Only fails if the file can't be mapped. */
+extern bool replay_spill_write(struct replay_spill *spill, const void *data,
+			       size_t size);
+
+/** Removes size bytes from the tail */
+extern void replay_spill_pop(struct replay_spill *spill, size_t size);
+
+/** Keeps the data from pos onward from being overwritten, even once it has
+ * been popped, so that another thread can read it.  The pin can only move
+ * forward until it is cleared. */
+extern void replay_spill_pin(struct replay_spill *spill, uint64_t pos);
+extern void replay_spill_unpin(struct replay_spill *spill);
+
+/* ------------------------------------------------------------------------- */
+/* views                                                                     */
+
+/* a read-only window on one segment of the ring, remapped as needed */
+struct replay_spill_view {
+	struct replay_spill *spill;
+	uint8_t *data;
+	uint64_t segment;
+};
+
+typedef bool (*replay_spill_read_cb)(void *param, const uint8_t *data,
+				     size_t size);
+
+extern void replay_spill_view_init(struct replay_spill_view *view,
+				   struct replay_spill *spill);
+extern void replay_spill_view_free(struct replay_spill_view *view);
+
+/** Passes size bytes starting at pos to the callback, straight out of the
+ * mapping and in as many pieces as the data is split into in the file.
+ * Returns false if mapping fails or the callback returns false. */
+extern bool replay_spill_read(struct replay_spill_view *view, uint64_t pos,
+			      size_t size, replay_spill_read_cb callback,
+			      void *param);
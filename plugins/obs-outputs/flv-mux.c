@@ -185,11 +185,32 @@ void flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 static int32_t last_time = 0;
 #endif
 
+size_t flv_packet_prefix(struct encoder_packet *packet, bool is_header,
+			 uint8_t *prefix)
+{
+	if (packet->type == OBS_ENCODER_VIDEO) {
+		int64_t offset = packet->pts - packet->dts;
+		int32_t offset_ms = get_ms_time(packet, offset);
+
+		prefix[0] = packet->keyframe ? 0x17 : 0x27;
+		prefix[1] = is_header ? 0 : 1;
+		prefix[2] = (uint8_t)(offset_ms >> 16);
+		prefix[3] = (uint8_t)(offset_ms >> 8);
+		prefix[4] = (uint8_t)offset_ms;
+		return 5;
+	}
+
+	prefix[0] = 0xaf;
+	prefix[1] = is_header ? 0 : 1;
+	return 2;
+}
+
 static void flv_video(struct serializer *s, int32_t dts_offset,
 		      struct encoder_packet *packet, bool is_header)
 {
-	int64_t offset = packet->pts - packet->dts;
 	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
+	uint8_t prefix[FLV_MAX_PACKET_PREFIX];
+	size_t prefix_size = flv_packet_prefix(packet, is_header, prefix);
 
 	if (!packet->data || !packet->size)
 		return;
@@ -205,15 +226,12 @@ static void flv_video(struct serializer *s, int32_t dts_offset,
 	last_time = time_ms;
 #endif
 
-	s_wb24(s, (uint32_t)packet->size + 5);
+	s_wb24(s, (uint32_t)(packet->size + prefix_size));
 	s_wb24(s, time_ms);
 	s_w8(s, (time_ms >> 24) & 0x7F);
 	s_wb24(s, 0);
 
-	/* these are the 5 extra bytes mentioned above */
-	s_w8(s, packet->keyframe ? 0x17 : 0x27);
-	s_w8(s, is_header ? 0 : 1);
-	s_wb24(s, get_ms_time(packet, offset));
+	s_write(s, prefix, prefix_size);
 	s_write(s, packet->data, packet->size);
 
 	/* write tag size (starting byte doesn't count) */
@@ -224,6 +242,8 @@ static void flv_audio(struct serializer *s, int32_t dts_offset,
 		      struct encoder_packet *packet, bool is_header)
 {
 	int32_t time_ms = get_ms_time(packet, packet->dts) - dts_offset;
+	uint8_t prefix[FLV_MAX_PACKET_PREFIX];
+	size_t prefix_size = flv_packet_prefix(packet, is_header, prefix);
 
 	if (!packet->data || !packet->size)
 		return;
@@ -239,14 +259,12 @@ static void flv_audio(struct serializer *s, int32_t dts_offset,
 	last_time = time_ms;
 #endif
 
-	s_wb24(s, (uint32_t)packet->size + 2);
+	s_wb24(s, (uint32_t)(packet->size + prefix_size));
 	s_wb24(s, time_ms);
 	s_w8(s, (time_ms >> 24) & 0x7F);
 	s_wb24(s, 0);
 
-	/* these are the two extra bytes mentioned above */
-	s_w8(s, 0xaf);
-	s_w8(s, is_header ? 0 : 1);
+	s_write(s, prefix, prefix_size);
 	s_write(s, packet->data, packet->size);
 
 	/* write tag size (starting byte doesn't count) */
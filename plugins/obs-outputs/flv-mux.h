@@ -32,6 +32,16 @@ extern void flv_meta_data(obs_output_t *context, uint8_t **output, size_t *size,
 			  bool write_header);
 extern void flv_additional_meta_data(obs_output_t *context, uint8_t **output,
 				     size_t *size);
+/* the codec bytes that go in front of the payload in a video or audio tag:
+ * 5 for AVC video, 2 for AAC audio */
+#define FLV_MAX_PACKET_PREFIX 5
+
+/* size of the FLV tag header and the trailing tag size, which RTMP does not
+ * send but which are still counted in the bytes sent */
+#define FLV_TAG_OVERHEAD (11 + 4)
+
+extern size_t flv_packet_prefix(struct encoder_packet *packet, bool is_header,
+				uint8_t *prefix);
 extern void flv_packet_mux(struct encoder_packet *packet, int32_t dts_offset,
 			   uint8_t **output, size_t *size, bool is_header);
 extern void flv_additional_packet_mux(struct encoder_packet *packet,
@@ -4045,18 +4045,19 @@ RTMP_SendChunk(RTMP *r, RTMPChunk *chunk)
     return wrote;
 }
 
-int
-RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+/* Encodes the basic and message header of the first chunk of a packet into
+ * header, compressing it against the last packet sent on the same channel.
+ * Returns the header size, or 0 on failure. */
+static int
+EncodeChunkHeader(RTMP *r, RTMPPacket *packet, char *header, char *pc,
+                  int *pcSize)
 {
     const RTMPPacket *prevPacket;
     uint32_t last = 0;
     int nSize;
     int hSize, cSize;
-    char *header, *hptr, *hend, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    char *hptr, *hend = header + RTMP_MAX_HEADER_SIZE, c;
     uint32_t t;
-    char *buffer, *tbuf = NULL, *toff = NULL;
-    int nChunkSize;
-    int tlen;
 
     if (packet->m_nChannel >= r->m_channelsAllocatedOut)
     {
@@ -4067,7 +4068,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
             free(r->m_vecChannelsOut);
             r->m_vecChannelsOut = NULL;
             r->m_channelsAllocatedOut = 0;
-            return FALSE;
+            return 0;
         }
         r->m_vecChannelsOut = packets;
         memset(r->m_vecChannelsOut + r->m_channelsAllocatedOut, 0, sizeof(RTMPPacket*) * (n - r->m_channelsAllocatedOut));
@@ -4093,7 +4094,7 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     {
         RTMP_Log(RTMP_LOGERROR, "sanity failed!! trying to send header of type: 0x%02x.",
                  (unsigned char)packet->m_headerType);
-        return FALSE;
+        return 0;
     }
 
     nSize = packetSize[packet->m_headerType];
@@ -4101,32 +4102,15 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     cSize = 0;
     t = packet->m_nTimeStamp - last;
 
-    if (packet->m_body)
-    {
-        header = packet->m_body - nSize;
-        hend = packet->m_body;
-    }
-    else
-    {
-        header = hbuf + 6;
-        hend = hbuf + sizeof(hbuf);
-    }
-
     if (packet->m_nChannel > 319)
         cSize = 2;
     else if (packet->m_nChannel > 63)
         cSize = 1;
     if (cSize)
-    {
-        header -= cSize;
         hSize += cSize;
-    }
 
     if (nSize > 1 && t >= 0xffffff)
-    {
-        header -= 4;
         hSize += 4;
-    }
 
     hptr = header;
     c = packet->m_headerType << 6;
@@ -4167,6 +4151,35 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     if (nSize > 1 && t >= 0xffffff)
         hptr = AMF_EncodeInt32(hptr, hend, t);
 
+    *pc = c;
+    *pcSize = cSize;
+    return hSize;
+}
+
+int
+RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
+{
+    int nSize;
+    int hSize, cSize;
+    char *header, hbuf[RTMP_MAX_HEADER_SIZE], c;
+    char *buffer, *tbuf = NULL, *toff = NULL;
+    int nChunkSize;
+    int tlen;
+
+    hSize = EncodeChunkHeader(r, packet, hbuf, &c, &cSize);
+    if (!hSize)
+        return FALSE;
+
+    if (packet->m_body)
+    {
+        header = packet->m_body - hSize;
+        memcpy(header, hbuf, hSize);
+    }
+    else
+    {
+        header = hbuf;
+    }
+
     nSize = packet->m_nBodySize;
     buffer = packet->m_body;
     nChunkSize = r->m_outChunkSize;
@@ -4262,6 +4275,235 @@ RTMP_SendPacket(RTMP *r, RTMPPacket *packet, int queue)
     return TRUE;
 }
 
+#define RTMP_MAX_IOV 64
+
+#ifdef _WIN32
+typedef WSABUF RTMPIOVec;
+#define IOV_BASE(v) ((v)->buf)
+#define IOV_LEN(v) ((int)(v)->len)
+#define IOV_SET(v, p, n) ((v)->buf = (CHAR *)(p), (v)->len = (ULONG)(n))
+#else
+typedef struct iovec RTMPIOVec;
+#define IOV_BASE(v) ((char *)(v)->iov_base)
+#define IOV_LEN(v) ((int)(v)->iov_len)
+#define IOV_SET(v, p, n) ((v)->iov_base = (void *)(p), (v)->iov_len = (size_t)(n))
+#endif
+
+/* one TLS record at most */
+#define RTMP_COALESCE_SIZE (16*1024)
+
+/* Gathered version of WriteN.  Plain sockets get the whole list in one
+ * sendmsg/WSASend call.  The other transports have no gathered write, so the
+ * slices are coalesced: into one request for HTTP, and into stack buffers
+ * for TLS and custom send functions, so that a chunk header never goes out
+ * in a write (and a TLS record) of its own. */
+static int
+WriteNV(RTMP *r, RTMPIOVec *iov, int iovcnt)
+{
+    int i;
+
+    if (r->Link.protocol & RTMP_FEATURE_HTTP)
+    {
+        char *tbuf, *toff;
+        int tlen = 0, wrote;
+
+        for (i = 0; i < iovcnt; i++)
+            tlen += IOV_LEN(&iov[i]);
+
+        tbuf = malloc(tlen);
+        if (!tbuf)
+            return FALSE;
+
+        toff = tbuf;
+        for (i = 0; i < iovcnt; i++)
+        {
+            memcpy(toff, IOV_BASE(&iov[i]), IOV_LEN(&iov[i]));
+            toff += IOV_LEN(&iov[i]);
+        }
+
+        wrote = WriteN(r, tbuf, tlen);
+        free(tbuf);
+        return wrote;
+    }
+
+    if ((r->m_bCustomSend && r->m_customSendFunc)
+#if defined(CRYPTO) && !defined(NO_SSL)
+            || r->m_sb.sb_ssl
+#endif
+       )
+    {
+        char cbuf[RTMP_COALESCE_SIZE];
+        int clen = 0;
+
+        for (i = 0; i < iovcnt; i++)
+        {
+            const char *ptr = IOV_BASE(&iov[i]);
+            int left = IOV_LEN(&iov[i]);
+
+            while (left > 0)
+            {
+                int len;
+
+                /* a slice that fills the buffer on its own needs no copy */
+                if (!clen && left >= RTMP_COALESCE_SIZE)
+                {
+                    if (!WriteN(r, ptr, left))
+                        return FALSE;
+                    break;
+                }
+
+                len = RTMP_COALESCE_SIZE - clen;
+                if (len > left)
+                    len = left;
+
+                memcpy(cbuf + clen, ptr, len);
+                clen += len;
+                ptr += len;
+                left -= len;
+
+                if (clen == RTMP_COALESCE_SIZE)
+                {
+                    if (!WriteN(r, cbuf, clen))
+                        return FALSE;
+                    clen = 0;
+                }
+            }
+        }
+
+        return !clen || WriteN(r, cbuf, clen);
+    }
+
+#if defined(RTMP_NETSTACK_DUMP)
+    for (i = 0; i < iovcnt; i++)
+        fwrite(IOV_BASE(&iov[i]), 1, IOV_LEN(&iov[i]), netstackdump);
+#endif
+
+    while (iovcnt > 0)
+    {
+        int nBytes;
+#ifdef _WIN32
+        DWORD sent = 0;
+
+        if (WSASend(r->m_sb.sb_socket, iov, iovcnt, &sent, 0, NULL, NULL) == 0)
+            nBytes = (int)sent;
+        else
+            nBytes = -1;
+#else
+        struct msghdr msg;
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+        nBytes = (int)sendmsg(r->m_sb.sb_socket, &msg, MSG_NOSIGNAL);
+#endif
+
+        if (nBytes < 0)
+        {
+            int sockerr = GetSockError();
+            RTMP_Log(RTMP_LOGERROR, "%s, RTMP send error %d", __FUNCTION__,
+                     sockerr);
+
+            if (sockerr == EINTR && !RTMP_ctrlC)
+                continue;
+
+            r->last_error_code = sockerr;
+
+            RTMP_Close(r);
+            return FALSE;
+        }
+
+        if (nBytes == 0)
+            return FALSE;
+
+        /* drop the slices that went out, and trim a partially sent one */
+        while (iovcnt > 0 && nBytes >= IOV_LEN(iov))
+        {
+            nBytes -= IOV_LEN(iov);
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0 && nBytes)
+            IOV_SET(iov, IOV_BASE(iov) + nBytes, IOV_LEN(iov) - nBytes);
+    }
+
+    return TRUE;
+}
+
+/* Sends a packet whose body is split across the given slices, without
+ * copying it into one buffer first.  The chunk headers are built on the
+ * stack and sent between the body slices.  Only for packets that are not
+ * remote method invocations; m_body is ignored. */
+int
+RTMP_SendPacketV(RTMP *r, RTMPPacket *packet, const AVal *body, int nbody)
+{
+    RTMPIOVec iov[RTMP_MAX_IOV];
+    char hbuf[RTMP_MAX_HEADER_SIZE], cbuf[3], c;
+    int hSize, cSize, iovcnt = 0;
+    int nChunkSize = r->m_outChunkSize;
+    int chunkLeft = nChunkSize;
+    int i;
+
+    hSize = EncodeChunkHeader(r, packet, hbuf, &c, &cSize);
+    if (!hSize)
+        return FALSE;
+
+    /* every following chunk of the packet starts with the same type 3
+     * header, so one copy of it serves them all */
+    cbuf[0] = (0xc0 | c);
+    if (cSize)
+    {
+        int tmp = packet->m_nChannel - 64;
+        cbuf[1] = tmp & 0xff;
+        if (cSize == 2)
+            cbuf[2] = tmp >> 8;
+    }
+
+    IOV_SET(&iov[iovcnt], hbuf, hSize);
+    iovcnt++;
+
+    for (i = 0; i < nbody; i++)
+    {
+        const char *ptr = body[i].av_val;
+        int left = body[i].av_len;
+
+        while (left > 0)
+        {
+            int len;
+
+            /* leave room for a chunk header and a body slice */
+            if (iovcnt > RTMP_MAX_IOV - 2)
+            {
+                if (!WriteNV(r, iov, iovcnt))
+                    return FALSE;
+                iovcnt = 0;
+            }
+
+            if (!chunkLeft)
+            {
+                IOV_SET(&iov[iovcnt], cbuf, 1 + cSize);
+                iovcnt++;
+                chunkLeft = nChunkSize;
+            }
+
+            len = left < chunkLeft ? left : chunkLeft;
+            IOV_SET(&iov[iovcnt], ptr, len);
+            iovcnt++;
+
+            ptr += len;
+            left -= len;
+            chunkLeft -= len;
+        }
+    }
+
+    if (iovcnt && !WriteNV(r, iov, iovcnt))
+        return FALSE;
+
+    if (!r->m_vecChannelsOut[packet->m_nChannel])
+        r->m_vecChannelsOut[packet->m_nChannel] = malloc(sizeof(RTMPPacket));
+    memcpy(r->m_vecChannelsOut[packet->m_nChannel], packet, sizeof(RTMPPacket));
+    return TRUE;
+}
+
 void
 RTMP_Close(RTMP *r)
 {
@@ -0,0 +1,975 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs-avc.h>
+#include <util/platform.h>
+#include <util/circlebuf.h>
+#include <util/darray.h>
+#include <util/dstr.h>
+#include <util/threading.h>
+#include <inttypes.h>
+#include "rtmp-fanout.h"
+#include "flv-mux.h"
+
+#ifdef _WIN32
+#define SHUT_RDWR SD_BOTH
+#else
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#define do_log(level, format, ...)                                  \
+	blog(level, "[rtmp fanout: '%s' #%d] " format,              \
+	     dest->fanout->name.array, (int)dest->idx, ##__VA_ARGS__)
+
+#define warn(format, ...) do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...) do_log(LOG_INFO, format, ##__VA_ARGS__)
+#define debug(format, ...) do_log(LOG_DEBUG, format, ##__VA_ARGS__)
+
+#define FLASH_VER "FMLE/3.0 (compatible; FMSc/1.0)"
+
+/* a packet turned into the body of an RTMP media message.  built once and
+ * shared read-only by the queues of all destinations, only the chunk headers
+ * differ per connection */
+struct fanout_message {
+	volatile long refs;
+	struct encoder_packet packet;
+	bool is_header;
+	uint32_t time_ms;
+	size_t prefix_size;
+	uint8_t prefix[FLV_MAX_PACKET_PREFIX];
+};
+
+struct fanout_dest {
+	struct rtmp_fanout *fanout;
+	size_t idx;
+	bool valid;
+
+	struct dstr url, key;
+	struct dstr username, password;
+
+	RTMP rtmp;
+	pthread_mutex_t socket_mutex;
+	SOCKET abort_socket;
+	bool abortable;
+
+	pthread_t thread;
+	bool thread_active;
+	os_sem_t *send_sem;
+
+	/* everything below up to connected is protected by packets_mutex */
+	pthread_mutex_t packets_mutex;
+	struct circlebuf packets;
+	bool ready;
+	bool wait_keyframe;
+	int min_priority;
+	int64_t last_dts_usec;
+	float congestion;
+	int dropped_frames;
+	uint64_t total_bytes;
+	int connect_time_ms;
+
+	volatile bool connected;
+	bool sent_headers;
+};
+
+struct rtmp_fanout {
+	struct rtmp_fanout_config config;
+	struct rtmp_fanout_callbacks callbacks;
+	struct dstr name;
+
+	DARRAY(struct fanout_dest *) dests;
+
+	uint8_t *meta_data;
+	size_t meta_data_size;
+	DARRAY(struct fanout_message *) headers;
+
+	bool got_first_video;
+	int32_t start_dts_offset;
+
+	bool started;
+	volatile long active_dests;
+	volatile long last_error;
+
+	os_event_t *stop_event;
+	uint64_t stop_ts;
+	uint64_t shutdown_timeout_ts;
+	volatile bool stop_reached;
+	volatile bool aborted;
+};
+
+/* ------------------------------------------------------------------------- */
+/* messages                                                                  */
+
+static struct fanout_message *message_create(struct rtmp_fanout *fanout,
+					     struct encoder_packet *packet,
+					     bool is_header)
+{
+	struct fanout_message *msg = bzalloc(sizeof(struct fanout_message));
+	int32_t dts_offset = is_header ? 0 : fanout->start_dts_offset;
+
+	msg->refs = 1;
+	msg->packet = *packet;
+	msg->is_header = is_header;
+	msg->prefix_size = flv_packet_prefix(packet, is_header, msg->prefix);
+
+	/* same 31 bits of timestamp that the FLV tag would have carried */
+	msg->time_ms = (uint32_t)(get_ms_time(packet, packet->dts) -
+				  dts_offset) &
+		       0x7FFFFFFF;
+	return msg;
+}
+
+static inline void message_addref(struct fanout_message *msg)
+{
+	os_atomic_inc_long(&msg->refs);
+}
+
+static void message_release(struct fanout_message *msg)
+{
+	if (!msg || os_atomic_dec_long(&msg->refs) != 0)
+		return;
+
+	if (msg->is_header)
+		bfree(msg->packet.data);
+	else
+		obs_encoder_packet_release(&msg->packet);
+	bfree(msg);
+}
+
+/* ------------------------------------------------------------------------- */
+/* destination packet queue, the push side runs on the encoder thread        */
+
+static inline bool stopping(struct rtmp_fanout *fanout)
+{
+	return os_event_try(fanout->stop_event) != EAGAIN;
+}
+
+static inline size_t num_buffered_messages(struct fanout_dest *dest)
+{
+	return dest->packets.size / sizeof(struct fanout_message *);
+}
+
+static inline struct fanout_message *peek_message(struct fanout_dest *dest,
+						  size_t idx)
+{
+	struct fanout_message **msg = circlebuf_data(
+		&dest->packets, idx * sizeof(struct fanout_message *));
+	return *msg;
+}
+
+/* releases all queued messages, returns the number of video frames lost */
+static int free_messages(struct fanout_dest *dest)
+{
+	int num_frames = 0;
+
+	while (dest->packets.size) {
+		struct fanout_message *msg;
+		circlebuf_pop_front(&dest->packets, &msg, sizeof(msg));
+
+		if (msg->packet.type == OBS_ENCODER_VIDEO)
+			num_frames++;
+		message_release(msg);
+	}
+
+	return num_frames;
+}
+
+static void drop_frames(struct fanout_dest *dest, const char *name,
+			int highest_priority)
+{
+	struct circlebuf new_buf = {0};
+	int num_frames_dropped = 0;
+
+	circlebuf_reserve(&new_buf, sizeof(struct fanout_message *) * 8);
+
+	while (dest->packets.size) {
+		struct fanout_message *msg;
+		circlebuf_pop_front(&dest->packets, &msg, sizeof(msg));
+
+		/* do not drop audio data or video keyframes */
+		if (msg->packet.type == OBS_ENCODER_AUDIO ||
+		    msg->packet.drop_priority >= highest_priority) {
+			circlebuf_push_back(&new_buf, &msg, sizeof(msg));
+
+		} else {
+			num_frames_dropped++;
+			message_release(msg);
+		}
+	}
+
+	circlebuf_free(&dest->packets);
+	dest->packets = new_buf;
+
+	if (dest->min_priority < highest_priority)
+		dest->min_priority = highest_priority;
+	if (!num_frames_dropped)
+		return;
+
+	dest->dropped_frames += num_frames_dropped;
+	debug("Dropped %d %s, new packet count: %d", num_frames_dropped, name,
+	      (int)num_buffered_messages(dest));
+}
+
+static struct fanout_message *find_first_video_message(struct fanout_dest *dest)
+{
+	size_t count = num_buffered_messages(dest);
+
+	for (size_t i = 0; i < count; i++) {
+		struct fanout_message *msg = peek_message(dest, i);
+		if (msg->packet.type == OBS_ENCODER_VIDEO &&
+		    !msg->packet.keyframe)
+			return msg;
+	}
+
+	return NULL;
+}
+
+static void check_to_drop_frames(struct fanout_dest *dest, bool pframes)
+{
+	const struct rtmp_fanout_config *config = &dest->fanout->config;
+	struct fanout_message *first;
+	int64_t buffer_duration_usec;
+	size_t num_packets = num_buffered_messages(dest);
+	const char *name = pframes ? "p-frames" : "b-frames";
+	int priority = pframes ? OBS_NAL_PRIORITY_HIGHEST
+			       : OBS_NAL_PRIORITY_HIGH;
+	int64_t drop_threshold = pframes ? config->pframe_drop_threshold_usec
+					 : config->drop_threshold_usec;
+
+	if (num_packets < 5) {
+		if (!pframes)
+			dest->congestion = 0.0f;
+		return;
+	}
+
+	first = find_first_video_message(dest);
+	if (!first)
+		return;
+
+	/* if the amount of time stored in the buffered packets waiting to be
+	 * sent is higher than threshold, drop frames */
+	buffer_duration_usec = dest->last_dts_usec - first->packet.dts_usec;
+
+	if (!pframes) {
+		dest->congestion =
+			(float)buffer_duration_usec / (float)drop_threshold;
+	}
+
+	if (buffer_duration_usec > drop_threshold) {
+		debug("buffer_duration_usec: %" PRId64, buffer_duration_usec);
+		drop_frames(dest, name, priority);
+	}
+}
+
+/* dropping b-frames and p-frames isn't enough for a destination that can't
+ * keep up at all, and audio and keyframes would pile up forever.  past the
+ * limit the whole queue goes, and the destination resumes at the next
+ * keyframe */
+static void check_buffer_limit(struct fanout_dest *dest, int64_t dts_usec)
+{
+	int64_t max_buffer_usec = dest->fanout->config.max_buffer_usec;
+	struct fanout_message *first;
+	int num_frames;
+
+	if (!max_buffer_usec || !dest->packets.size)
+		return;
+
+	first = peek_message(dest, 0);
+	if (dts_usec - first->packet.dts_usec <= max_buffer_usec)
+		return;
+
+	num_frames = free_messages(dest);
+	dest->dropped_frames += num_frames;
+	dest->wait_keyframe = true;
+	dest->min_priority = 0;
+
+	warn("Destination can't keep up, dropped %d buffered frames and "
+	     "waiting for the next keyframe",
+	     num_frames);
+}
+
+static bool add_message(struct fanout_dest *dest, struct fanout_message *msg)
+{
+	struct encoder_packet *packet = &msg->packet;
+	bool video = packet->type == OBS_ENCODER_VIDEO;
+	bool added = false;
+
+	pthread_mutex_lock(&dest->packets_mutex);
+
+	/* not connected yet, or reconnecting */
+	if (!dest->ready)
+		goto unlock;
+
+	check_buffer_limit(dest, packet->dts_usec);
+
+	/* a destination starts or resumes only on a keyframe, anything in
+	 * front of it can't be decoded anyway */
+	if (dest->wait_keyframe) {
+		if (!video || !packet->keyframe)
+			goto unlock;
+		dest->wait_keyframe = false;
+	}
+
+	if (video) {
+		check_to_drop_frames(dest, false);
+		check_to_drop_frames(dest, true);
+
+		/* if currently dropping frames, drop packets until it reaches
+		 * the desired priority */
+		if (packet->drop_priority < dest->min_priority) {
+			dest->dropped_frames++;
+			goto unlock;
+		}
+
+		dest->min_priority = 0;
+		dest->last_dts_usec = packet->dts_usec;
+	}
+
+	message_addref(msg);
+	circlebuf_push_back(&dest->packets, &msg, sizeof(msg));
+	added = true;
+
+unlock:
+	pthread_mutex_unlock(&dest->packets_mutex);
+
+	if (added)
+		os_sem_post(dest->send_sem);
+	return added;
+}
+
+static struct fanout_message *get_next_message(struct fanout_dest *dest)
+{
+	struct fanout_message *msg = NULL;
+
+	pthread_mutex_lock(&dest->packets_mutex);
+	if (dest->packets.size)
+		circlebuf_pop_front(&dest->packets, &msg, sizeof(msg));
+	pthread_mutex_unlock(&dest->packets_mutex);
+
+	return msg;
+}
+
+static void set_ready(struct fanout_dest *dest, bool ready)
+{
+	pthread_mutex_lock(&dest->packets_mutex);
+	if (ready)
+		dest->connect_time_ms = dest->rtmp.connect_time_ms;
+	dest->ready = ready;
+	dest->wait_keyframe = true;
+	dest->min_priority = 0;
+	dest->congestion = 0.0f;
+	free_messages(dest);
+	pthread_mutex_unlock(&dest->packets_mutex);
+
+	os_atomic_set_bool(&dest->connected, ready);
+}
+
+/* ------------------------------------------------------------------------- */
+/* destination connection, runs on the destination thread                    */
+
+static inline void set_rtmp_dstr(AVal *val, struct dstr *str)
+{
+	bool valid = !dstr_is_empty(str);
+	val->av_val = valid ? str->array : NULL;
+	val->av_len = valid ? (int)str->len : 0;
+}
+
+/* librtmp closes its socket by itself when a send fails, so another thread
+ * can't safely use rtmp.m_sb.sb_socket, its descriptor could already have
+ * been reused.  stops go through a duplicate that only this file closes. */
+static bool duplicate_socket(SOCKET sock, SOCKET *dup_sock)
+{
+#ifdef _WIN32
+	WSAPROTOCOL_INFO protocol_info;
+
+	if (WSADuplicateSocket(sock, GetCurrentProcessId(), &protocol_info))
+		return false;
+
+	*dup_sock = WSASocket(FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO,
+			      FROM_PROTOCOL_INFO, &protocol_info, 0, 0);
+	return *dup_sock != INVALID_SOCKET;
+#else
+	*dup_sock = dup(sock);
+	return *dup_sock != -1;
+#endif
+}
+
+/* unblocks a destination thread stuck in a send or receive */
+static void abort_dest(struct fanout_dest *dest)
+{
+	pthread_mutex_lock(&dest->socket_mutex);
+	if (dest->abortable)
+		shutdown(dest->abort_socket, SHUT_RDWR);
+	pthread_mutex_unlock(&dest->socket_mutex);
+}
+
+/* returns false if a stop came in before the socket could be aborted */
+static bool make_abortable(struct fanout_dest *dest)
+{
+	struct rtmp_fanout *fanout = dest->fanout;
+	bool aborted;
+
+	pthread_mutex_lock(&dest->socket_mutex);
+	aborted = stopping(fanout) && fanout->stop_ts == 0;
+	if (!aborted)
+		dest->abortable = duplicate_socket(RTMP_Socket(&dest->rtmp),
+						   &dest->abort_socket);
+	pthread_mutex_unlock(&dest->socket_mutex);
+
+	if (!aborted && !dest->abortable)
+		warn("Failed to duplicate the socket, stopping may have to "
+		     "wait for the connection to time out");
+	return !aborted;
+}
+
+static void close_dest(struct fanout_dest *dest)
+{
+	pthread_mutex_lock(&dest->socket_mutex);
+	if (dest->abortable) {
+#ifdef _WIN32
+		closesocket(dest->abort_socket);
+#else
+		close(dest->abort_socket);
+#endif
+		dest->abortable = false;
+	}
+	pthread_mutex_unlock(&dest->socket_mutex);
+
+	RTMP_Close(&dest->rtmp);
+}
+
+static int connect_dest(struct fanout_dest *dest)
+{
+	RTMP *rtmp = &dest->rtmp;
+
+	if (dstr_is_empty(&dest->url)) {
+		warn("URL is empty");
+		return OBS_OUTPUT_BAD_PATH;
+	}
+
+	info("Connecting to RTMP URL %s...", dest->url.array);
+
+	/* librtmp keeps state from the previous connection, which would break
+	 * the stream on a reconnect */
+	RTMP_Reset(rtmp);
+	memset(&rtmp->Link, 0, sizeof(rtmp->Link));
+	rtmp->last_error_code = 0;
+
+	if (!RTMP_SetupURL(rtmp, dest->url.array))
+		return OBS_OUTPUT_BAD_PATH;
+
+	RTMP_EnableWrite(rtmp);
+
+	set_rtmp_dstr(&rtmp->Link.pubUser, &dest->username);
+	set_rtmp_dstr(&rtmp->Link.pubPasswd, &dest->password);
+	rtmp->Link.flashVer.av_val = FLASH_VER;
+	rtmp->Link.flashVer.av_len = sizeof(FLASH_VER) - 1;
+	rtmp->Link.swfUrl = rtmp->Link.tcUrl;
+	rtmp->m_bindIP = dest->fanout->config.bind_ip;
+
+	RTMP_AddStream(rtmp, dest->key.array);
+
+	rtmp->m_outChunkSize = 4096;
+	rtmp->m_bSendChunkSizeInfo = true;
+	rtmp->m_bUseNagle = true;
+
+	if (!RTMP_Connect(rtmp, NULL))
+		return OBS_OUTPUT_CONNECT_FAILED;
+
+	if (!make_abortable(dest))
+		return OBS_OUTPUT_DISCONNECTED;
+
+	if (!RTMP_ConnectStream(rtmp, 0))
+		return OBS_OUTPUT_INVALID_STREAM;
+
+	info("Connection to %s successful", dest->url.array);
+	return OBS_OUTPUT_SUCCESS;
+}
+
+static bool receive_data(struct fanout_dest *dest)
+{
+	RTMPPacket packet = {0};
+	int recv_size = 0;
+	int ret;
+
+#ifdef _WIN32
+	ret = ioctlsocket(dest->rtmp.m_sb.sb_socket, FIONREAD,
+			  (u_long *)&recv_size);
+#else
+	ret = ioctl(dest->rtmp.m_sb.sb_socket, FIONREAD, &recv_size);
+#endif
+
+	if (ret < 0 || recv_size <= 0)
+		return true;
+
+	if (!RTMP_ReadPacket(&dest->rtmp, &packet)) {
+#ifdef _WIN32
+		int error = WSAGetLastError();
+#else
+		int error = errno;
+#endif
+		warn("RTMP_ReadPacket error: %d", error);
+		return false;
+	}
+
+	if (packet.m_body)
+		RTMPPacket_Free(&packet);
+	return true;
+}
+
+/* sends a message without muxing it into an FLV tag first, the body goes
+ * out straight from the shared message */
+static bool send_message(struct fanout_dest *dest, struct fanout_message *msg)
+{
+	struct encoder_packet *packet = &msg->packet;
+	RTMPPacket rtmp_packet = {0};
+	AVal body[2];
+
+	if (!packet->data || !packet->size)
+		return true;
+
+	body[0].av_val = (char *)msg->prefix;
+	body[0].av_len = (int)msg->prefix_size;
+	body[1].av_val = (char *)packet->data;
+	body[1].av_len = (int)packet->size;
+
+	rtmp_packet.m_packetType = packet->type == OBS_ENCODER_VIDEO
+					   ? RTMP_PACKET_TYPE_VIDEO
+					   : RTMP_PACKET_TYPE_AUDIO;
+	rtmp_packet.m_headerType = msg->time_ms ? RTMP_PACKET_SIZE_MEDIUM
+						: RTMP_PACKET_SIZE_LARGE;
+	rtmp_packet.m_nChannel = 0x04;
+	rtmp_packet.m_nTimeStamp = msg->time_ms;
+	rtmp_packet.m_nInfoField2 = dest->rtmp.Link.streams[0].id;
+	rtmp_packet.m_nBodySize = (uint32_t)(body[0].av_len + body[1].av_len);
+
+	if (!RTMP_SendPacketV(&dest->rtmp, &rtmp_packet, body, 2))
+		return false;
+
+	pthread_mutex_lock(&dest->packets_mutex);
+	dest->total_bytes += rtmp_packet.m_nBodySize + FLV_TAG_OVERHEAD;
+	pthread_mutex_unlock(&dest->packets_mutex);
+	return true;
+}
+
+static bool send_meta_data(struct fanout_dest *dest)
+{
+	struct rtmp_fanout *fanout = dest->fanout;
+
+	if (fanout->meta_data &&
+	    RTMP_Write(&dest->rtmp, (char *)fanout->meta_data,
+		       (int)fanout->meta_data_size, 0) < 0) {
+		warn("Disconnected while attempting to send metadata");
+		return false;
+	}
+
+	return true;
+}
+
+/* the headers go out right before the first packet, encoders don't always
+ * have them ready by the time a destination connects */
+static bool send_headers(struct fanout_dest *dest)
+{
+	struct rtmp_fanout *fanout = dest->fanout;
+
+	dest->sent_headers = true;
+
+	for (size_t i = 0; i < fanout->headers.num; i++) {
+		if (!send_message(dest, fanout->headers.array[i]))
+			return false;
+	}
+
+	return true;
+}
+
+static inline bool can_shutdown(struct rtmp_fanout *fanout,
+				struct fanout_message *msg)
+{
+	return os_gettime_ns() >= fanout->shutdown_timeout_ts ||
+	       msg->packet.sys_dts_usec >= (int64_t)fanout->stop_ts;
+}
+
+static int send_loop(struct fanout_dest *dest)
+{
+	struct rtmp_fanout *fanout = dest->fanout;
+
+	while (os_sem_wait(dest->send_sem) == 0) {
+		struct fanout_message *msg;
+
+		if (stopping(fanout) && fanout->stop_ts == 0)
+			return OBS_OUTPUT_SUCCESS;
+
+		msg = get_next_message(dest);
+		if (!msg) {
+			if (stopping(fanout) &&
+			    os_atomic_load_bool(&fanout->stop_reached))
+				return OBS_OUTPUT_SUCCESS;
+			continue;
+		}
+
+		if (stopping(fanout) && can_shutdown(fanout, msg)) {
+			message_release(msg);
+			return OBS_OUTPUT_SUCCESS;
+		}
+
+		if (!dest->sent_headers && !send_headers(dest)) {
+			message_release(msg);
+			return OBS_OUTPUT_DISCONNECTED;
+		}
+
+		if (!receive_data(dest) || !send_message(dest, msg)) {
+			message_release(msg);
+			return OBS_OUTPUT_DISCONNECTED;
+		}
+
+		message_release(msg);
+	}
+
+	return OBS_OUTPUT_ERROR;
+}
+
+static void dest_stopped(struct fanout_dest *dest, int code)
+{
+	struct rtmp_fanout *fanout = dest->fanout;
+
+	if (code != OBS_OUTPUT_SUCCESS)
+		os_atomic_set_long(&fanout->last_error, code);
+
+	if (os_atomic_dec_long(&fanout->active_dests) != 0)
+		return;
+
+	if (stopping(fanout))
+		code = OBS_OUTPUT_SUCCESS;
+	else
+		code = (int)os_atomic_load_long(&fanout->last_error);
+
+	if (fanout->callbacks.stopped)
+		fanout->callbacks.stopped(fanout->callbacks.param, code);
+}
+
+static void *dest_thread(void *data)
+{
+	struct fanout_dest *dest = data;
+	struct rtmp_fanout *fanout = dest->fanout;
+	const struct rtmp_fanout_config *config = &fanout->config;
+	bool was_connected = false;
+	int code = OBS_OUTPUT_SUCCESS;
+	int retries = 0;
+
+	os_set_thread_name("rtmp-fanout: dest_thread");
+
+	while (!stopping(fanout)) {
+		code = connect_dest(dest);
+		if (code == OBS_OUTPUT_SUCCESS && !send_meta_data(dest))
+			code = OBS_OUTPUT_DISCONNECTED;
+
+		if (code == OBS_OUTPUT_SUCCESS) {
+			dest->sent_headers = false;
+			set_ready(dest, true);
+
+			if (fanout->callbacks.connected)
+				fanout->callbacks.connected(
+					fanout->callbacks.param, dest->idx);
+
+			was_connected = true;
+			retries = 0;
+
+			code = send_loop(dest);
+			set_ready(dest, false);
+		}
+
+		close_dest(dest);
+
+		if (code == OBS_OUTPUT_SUCCESS || stopping(fanout)) {
+			code = OBS_OUTPUT_SUCCESS;
+			break;
+		}
+
+		/* only a connection that worked once gets retried, a bad URL
+		 * or key won't fix itself */
+		if (!was_connected) {
+			warn("Connection to %s failed: %d", dest->url.array,
+			     code);
+			break;
+		}
+		if (retries++ >= config->max_retries) {
+			warn("Disconnected from %s, giving up after %d "
+			     "attempts",
+			     dest->url.array, config->max_retries);
+			break;
+		}
+
+		info("Disconnected from %s, reconnecting in %d second(s)",
+		     dest->url.array, config->retry_delay_sec);
+
+		if (os_event_timedwait(fanout->stop_event,
+				       (unsigned long)config->retry_delay_sec *
+					       1000) == 0) {
+			code = OBS_OUTPUT_SUCCESS;
+			break;
+		}
+	}
+
+	dest_stopped(dest, code);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+rtmp_fanout_t *rtmp_fanout_create(const struct rtmp_fanout_config *config,
+				  const struct rtmp_fanout_callbacks *callbacks)
+{
+	struct rtmp_fanout *fanout = bzalloc(sizeof(struct rtmp_fanout));
+
+	fanout->config = *config;
+	if (callbacks)
+		fanout->callbacks = *callbacks;
+
+	dstr_copy(&fanout->name, config->name ? config->name : "");
+	fanout->config.name = fanout->name.array;
+
+	if (os_event_init(&fanout->stop_event, OS_EVENT_TYPE_MANUAL) != 0) {
+		dstr_free(&fanout->name);
+		bfree(fanout);
+		return NULL;
+	}
+
+	return fanout;
+}
+
+static void dest_destroy(struct fanout_dest *dest)
+{
+	if (dest->thread_active)
+		pthread_join(dest->thread, NULL);
+
+	if (dest->valid) {
+		RTMP_TLS_Free(&dest->rtmp);
+		free_messages(dest);
+	}
+
+	circlebuf_free(&dest->packets);
+	os_sem_destroy(dest->send_sem);
+	pthread_mutex_destroy(&dest->packets_mutex);
+	pthread_mutex_destroy(&dest->socket_mutex);
+	dstr_free(&dest->url);
+	dstr_free(&dest->key);
+	dstr_free(&dest->username);
+	dstr_free(&dest->password);
+	bfree(dest);
+}
+
+void rtmp_fanout_destroy(rtmp_fanout_t *fanout)
+{
+	if (!fanout)
+		return;
+
+	if (fanout->started)
+		rtmp_fanout_stop(fanout, 0);
+
+	for (size_t i = 0; i < fanout->dests.num; i++)
+		dest_destroy(fanout->dests.array[i]);
+	for (size_t i = 0; i < fanout->headers.num; i++)
+		message_release(fanout->headers.array[i]);
+
+	da_free(fanout->dests);
+	da_free(fanout->headers);
+	bfree(fanout->meta_data);
+	os_event_destroy(fanout->stop_event);
+	dstr_free(&fanout->name);
+	bfree(fanout);
+}
+
+size_t rtmp_fanout_add_destination(rtmp_fanout_t *fanout, const char *url,
+				   const char *key, const char *username,
+				   const char *password)
+{
+	struct fanout_dest *dest = bzalloc(sizeof(struct fanout_dest));
+
+	dest->fanout = fanout;
+	dest->idx = fanout->dests.num;
+	pthread_mutex_init_value(&dest->packets_mutex);
+	pthread_mutex_init_value(&dest->socket_mutex);
+
+	dstr_copy(&dest->url, url);
+	dstr_copy(&dest->key, key);
+	dstr_copy(&dest->username, username);
+	dstr_copy(&dest->password, password);
+	dstr_depad(&dest->url);
+	dstr_depad(&dest->key);
+
+	RTMP_Init(&dest->rtmp);
+
+	dest->valid = pthread_mutex_init(&dest->packets_mutex, NULL) == 0 &&
+		      pthread_mutex_init(&dest->socket_mutex, NULL) == 0 &&
+		      os_sem_init(&dest->send_sem, 0) == 0;
+	if (!dest->valid)
+		warn("Failed to initialize destination");
+
+	da_push_back(fanout->dests, &dest);
+	return dest->idx;
+}
+
+size_t rtmp_fanout_num_destinations(const rtmp_fanout_t *fanout)
+{
+	return fanout->dests.num;
+}
+
+void rtmp_fanout_set_meta_data(rtmp_fanout_t *fanout, const uint8_t *data,
+			       size_t size)
+{
+	bfree(fanout->meta_data);
+	fanout->meta_data = bmemdup(data, size);
+	fanout->meta_data_size = size;
+}
+
+void rtmp_fanout_add_header(rtmp_fanout_t *fanout,
+			    const struct encoder_packet *header)
+{
+	struct encoder_packet packet = *header;
+	struct fanout_message *msg;
+
+	packet.data = bmemdup(header->data, header->size);
+	msg = message_create(fanout, &packet, true);
+	da_push_back(fanout->headers, &msg);
+}
+
+bool rtmp_fanout_start(rtmp_fanout_t *fanout)
+{
+	size_t started = 0;
+
+	if (fanout->started)
+		return false;
+
+	fanout->active_dests = (long)fanout->dests.num;
+	fanout->last_error = OBS_OUTPUT_ERROR;
+
+	for (size_t i = 0; i < fanout->dests.num; i++) {
+		struct fanout_dest *dest = fanout->dests.array[i];
+
+		if (dest->valid && pthread_create(&dest->thread, NULL,
+						  dest_thread, dest) == 0) {
+			dest->thread_active = true;
+			started++;
+		} else {
+			warn("Failed to create destination thread");
+		}
+	}
+
+	if (!started)
+		return false;
+
+	fanout->started = true;
+
+	/* destinations that never got a thread count as already stopped */
+	for (size_t i = 0; i < fanout->dests.num; i++) {
+		struct fanout_dest *dest = fanout->dests.array[i];
+		if (!dest->thread_active)
+			dest_stopped(dest, OBS_OUTPUT_ERROR);
+	}
+
+	return true;
+}
+
+void rtmp_fanout_stop(rtmp_fanout_t *fanout, uint64_t ts)
+{
+	fanout->stop_ts = ts / 1000ULL;
+
+	if (ts)
+		fanout->shutdown_timeout_ts =
+			ts + (uint64_t)fanout->config.max_shutdown_time_sec *
+				     1000000000ULL;
+
+	os_event_signal(fanout->stop_event);
+
+	if (ts == 0) {
+		for (size_t i = 0; i < fanout->dests.num; i++) {
+			struct fanout_dest *dest = fanout->dests.array[i];
+			if (!dest->valid)
+				continue;
+
+			abort_dest(dest);
+			os_sem_post(dest->send_sem);
+		}
+	}
+}
+
+/* once the packet at the stop time has been reached, destinations that have
+ * drained their queue can stop.  a destination that is still stuck sending
+ * after the shutdown timeout gets its connection aborted */
+static void check_stop(struct rtmp_fanout *fanout,
+		       const struct encoder_packet *packet)
+{
+	bool timeout = os_gettime_ns() >= fanout->shutdown_timeout_ts;
+	bool abort = timeout && !os_atomic_set_bool(&fanout->aborted, true);
+
+	if (!timeout && packet->sys_dts_usec < (int64_t)fanout->stop_ts)
+		return;
+	if (os_atomic_set_bool(&fanout->stop_reached, true) && !abort)
+		return;
+
+	for (size_t i = 0; i < fanout->dests.num; i++) {
+		struct fanout_dest *dest = fanout->dests.array[i];
+		if (!dest->valid)
+			continue;
+
+		if (abort)
+			abort_dest(dest);
+		os_sem_post(dest->send_sem);
+	}
+}
+
+void rtmp_fanout_push(rtmp_fanout_t *fanout, struct encoder_packet *packet)
+{
+	struct fanout_message *msg;
+
+	if (packet->type == OBS_ENCODER_VIDEO && !fanout->got_first_video) {
+		fanout->start_dts_offset = get_ms_time(packet, packet->dts);
+		fanout->got_first_video = true;
+	}
+
+	msg = message_create(fanout, packet, false);
+
+	for (size_t i = 0; i < fanout->dests.num; i++) {
+		struct fanout_dest *dest = fanout->dests.array[i];
+		if (dest->valid)
+			add_message(dest, msg);
+	}
+
+	if (stopping(fanout) && fanout->stop_ts)
+		check_stop(fanout, packet);
+
+	message_release(msg);
+}
+
+void rtmp_fanout_get_dest_stats(rtmp_fanout_t *fanout, size_t idx,
+				struct rtmp_fanout_dest_stats *stats)
+{
+	struct fanout_dest *dest = fanout->dests.array[idx];
+
+	memset(stats, 0, sizeof(*stats));
+	if (!dest->valid)
+		return;
+
+	pthread_mutex_lock(&dest->packets_mutex);
+	stats->dropped_frames = dest->dropped_frames;
+	stats->congestion = dest->min_priority > 0 ? 1.0f : dest->congestion;
+	stats->total_bytes = dest->total_bytes;
+	stats->connect_time_ms = dest->connect_time_ms;
+	pthread_mutex_unlock(&dest->packets_mutex);
+
+	stats->connected = os_atomic_load_bool(&dest->connected);
+}
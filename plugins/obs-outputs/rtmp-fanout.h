@@ -0,0 +1,127 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#pragma once
+
+#include <obs.h>
+#include "librtmp/rtmp.h"
+
+/*
+ * RTMP fan-out.  Sends one stream of interleaved encoder packets to several
+ * RTMP destinations.  Each packet is turned into an FLV message once, and
+ * the same immutable message is queued to every destination, so memory and
+ * muxing cost don't grow with the number of destinations.
+ *
+ * Every destination has its own connection, send thread, packet queue and
+ * frame drop state, so a slow or disconnected destination only drops its
+ * own frames and never holds up the others.  A destination that loses its
+ * connection reconnects on its own and resumes at the next keyframe.
+ *
+ * The fan-out does not depend on an obs_output, it is driven entirely
+ * through the functions below.
+ */
+
+struct rtmp_fanout;
+typedef struct rtmp_fanout rtmp_fanout_t;
+
+struct rtmp_fanout_config {
+	/** Name used to prefix log messages */
+	const char *name;
+
+	/** Buffered duration after which b-frames and p-frames get dropped,
+	 * same meaning as the rtmp_output thresholds */
+	int64_t drop_threshold_usec;
+	int64_t pframe_drop_threshold_usec;
+
+	/** Buffered duration after which a destination throws away its whole
+	 * queue and waits for the next keyframe, 0 to never do so */
+	int64_t max_buffer_usec;
+
+	/** Reconnect delay and maximum number of reconnect attempts after a
+	 * destination loses an established connection */
+	int retry_delay_sec;
+	int max_retries;
+
+	/** Time to wait for the destinations to drain on a stop */
+	int max_shutdown_time_sec;
+
+	/** Local address to bind to, an addrLen of 0 uses the default */
+	RTMP_BINDINFO bind_ip;
+};
+
+struct rtmp_fanout_callbacks {
+	void *param;
+
+	/** Called from the destination thread each time a destination is
+	 * connected and ready for packets */
+	void (*connected)(void *param, size_t idx);
+
+	/** Called once the last destination has stopped for good.  The code
+	 * is OBS_OUTPUT_SUCCESS if the fan-out was stopped with
+	 * rtmp_fanout_stop, otherwise the OBS_OUTPUT_* error of the last
+	 * destination that failed. */
+	void (*stopped)(void *param, int code);
+};
+
+struct rtmp_fanout_dest_stats {
+	bool connected;
+	uint64_t total_bytes;
+	int dropped_frames;
+	float congestion;
+	int connect_time_ms;
+};
+
+extern rtmp_fanout_t *
+rtmp_fanout_create(const struct rtmp_fanout_config *config,
+		   const struct rtmp_fanout_callbacks *callbacks);
+extern void rtmp_fanout_destroy(rtmp_fanout_t *fanout);
+
+/** Adds a destination, must be called before rtmp_fanout_start.  Returns
+ * the index of the destination. */
+extern size_t rtmp_fanout_add_destination(rtmp_fanout_t *fanout,
+					  const char *url, const char *key,
+					  const char *username,
+					  const char *password);
+extern size_t rtmp_fanout_num_destinations(const rtmp_fanout_t *fanout);
+
+/** Sets the FLV script tag sent to each destination after it connects.  The
+ * data is copied. */
+extern void rtmp_fanout_set_meta_data(rtmp_fanout_t *fanout,
+				      const uint8_t *data, size_t size);
+
+/** Adds a codec header sent to each destination before its first packet, in
+ * the order they were added.  Headers must be added before the first packet
+ * is pushed.  The packet data is copied. */
+extern void rtmp_fanout_add_header(rtmp_fanout_t *fanout,
+				   const struct encoder_packet *header);
+
+/** Starts connecting all destinations.  A fan-out can only be started once.
+ * Fails only if no destination could be started at all, in which case the
+ * stopped callback is not called. */
+extern bool rtmp_fanout_start(rtmp_fanout_t *fanout);
+
+/** Stops all destinations.  With a non-zero timestamp the destinations keep
+ * sending until they reach the packet at that system time (or time out),
+ * otherwise they stop immediately. */
+extern void rtmp_fanout_stop(rtmp_fanout_t *fanout, uint64_t ts);
+
+/** Queues an encoder packet to every destination, in interleaved order.
+ * Takes ownership of the packet's reference.  Video packets must already be
+ * in AVCC form, as returned by obs_parse_avc_packet. */
+extern void rtmp_fanout_push(rtmp_fanout_t *fanout,
+			     struct encoder_packet *packet);
+
+extern void rtmp_fanout_get_dest_stats(rtmp_fanout_t *fanout, size_t idx,
+				       struct rtmp_fanout_dest_stats *stats);
@@ -0,0 +1,483 @@
+/******************************************************************************
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+******************************************************************************/
+
+#include <obs-module.h>
+#include <obs-avc.h>
+#include <util/threading.h>
+#include "librtmp/log.h"
+#include "rtmp-fanout.h"
+#include "flv-mux.h"
+#include "net-if.h"
+
+/* streams the same encoders to the service's server plus any number of
+ * additional RTMP servers, through a single rtmp_fanout */
+
+#define do_log(level, format, ...)                       \
+	blog(level, "[rtmp multi stream: '%s'] " format, \
+	     obs_output_get_name(stream->output), ##__VA_ARGS__)
+
+#define warn(format, ...) do_log(LOG_WARNING, format, ##__VA_ARGS__)
+#define info(format, ...) do_log(LOG_INFO, format, ##__VA_ARGS__)
+
+#define OPT_DESTINATIONS "destinations"
+#define OPT_DEST_SERVER "server"
+#define OPT_DEST_KEY "key"
+#define OPT_DEST_USERNAME "username"
+#define OPT_DEST_PASSWORD "password"
+#define OPT_DROP_THRESHOLD "drop_threshold_ms"
+#define OPT_PFRAME_DROP_THRESHOLD "pframe_drop_threshold_ms"
+#define OPT_MAX_BUFFER "max_buffer_ms"
+#define OPT_MAX_SHUTDOWN_TIME_SEC "max_shutdown_time_sec"
+#define OPT_RETRY_DELAY_SEC "retry_delay_sec"
+#define OPT_MAX_RETRIES "max_retries"
+#define OPT_BIND_IP "bind_ip"
+
+struct rtmp_multi_stream {
+	obs_output_t *output;
+
+	/* the stats callbacks may run while start replaces the fanout */
+	pthread_mutex_t fanout_mutex;
+	rtmp_fanout_t *fanout;
+
+	volatile bool active;
+	volatile bool capturing;
+	volatile bool encode_error;
+	bool sent_headers;
+};
+
+static const char *rtmp_multi_stream_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return obs_module_text("RTMPMultiStream");
+}
+
+static void log_rtmp(int level, const char *format, va_list args)
+{
+	if (level > RTMP_LOGWARNING)
+		return;
+
+	blogva(LOG_INFO, format, args);
+}
+
+static inline bool active(struct rtmp_multi_stream *stream)
+{
+	return os_atomic_load_bool(&stream->active);
+}
+
+static void rtmp_multi_stream_destroy(void *data)
+{
+	struct rtmp_multi_stream *stream = data;
+
+	/* keeps the stopped callback from reporting anything once the
+	 * destination threads are torn down */
+	if (os_atomic_set_bool(&stream->active, false))
+		obs_output_end_data_capture(stream->output);
+
+	rtmp_fanout_destroy(stream->fanout);
+	pthread_mutex_destroy(&stream->fanout_mutex);
+	bfree(stream);
+}
+
+static void *rtmp_multi_stream_create(obs_data_t *settings,
+				      obs_output_t *output)
+{
+	struct rtmp_multi_stream *stream =
+		bzalloc(sizeof(struct rtmp_multi_stream));
+	stream->output = output;
+	pthread_mutex_init_value(&stream->fanout_mutex);
+
+	if (pthread_mutex_init(&stream->fanout_mutex, NULL) != 0) {
+		bfree(stream);
+		return NULL;
+	}
+
+	RTMP_LogSetCallback(log_rtmp);
+	RTMP_LogSetLevel(RTMP_LOGWARNING);
+
+	UNUSED_PARAMETER(settings);
+	return stream;
+}
+
+static void fanout_connected(void *param, size_t idx)
+{
+	struct rtmp_multi_stream *stream = param;
+
+	info("Destination %d connected", (int)idx);
+
+	/* capture starts with the first destination, the others join in on
+	 * the next keyframe */
+	if (!os_atomic_set_bool(&stream->capturing, true))
+		obs_output_begin_data_capture(stream->output, 0);
+}
+
+static void fanout_stopped(void *param, int code)
+{
+	struct rtmp_multi_stream *stream = param;
+	bool capturing = os_atomic_load_bool(&stream->capturing);
+
+	if (!os_atomic_set_bool(&stream->active, false))
+		return;
+
+	if (os_atomic_load_bool(&stream->encode_error))
+		obs_output_signal_stop(stream->output, OBS_OUTPUT_ENCODE_ERROR);
+	else if (code == OBS_OUTPUT_SUCCESS && capturing)
+		obs_output_end_data_capture(stream->output);
+	else
+		obs_output_signal_stop(stream->output, code);
+}
+
+static void rtmp_multi_stream_stop(void *data, uint64_t ts)
+{
+	struct rtmp_multi_stream *stream = data;
+
+	if (active(stream))
+		rtmp_fanout_stop(stream->fanout, ts);
+	else
+		obs_output_signal_stop(stream->output, OBS_OUTPUT_SUCCESS);
+}
+
+static void add_destination(struct rtmp_multi_stream *stream,
+			    rtmp_fanout_t *fanout, const char *server,
+			    const char *key, const char *username,
+			    const char *password)
+{
+	if (!server || !*server)
+		return;
+
+	info("Adding destination %d: %s",
+	     (int)rtmp_fanout_num_destinations(fanout), server);
+	rtmp_fanout_add_destination(fanout, server, key, username, password);
+}
+
+static void add_destinations(struct rtmp_multi_stream *stream,
+			     rtmp_fanout_t *fanout, obs_data_t *settings)
+{
+	obs_service_t *service = obs_output_get_service(stream->output);
+	obs_data_array_t *dests;
+	size_t count;
+
+	if (service)
+		add_destination(stream, fanout, obs_service_get_url(service),
+				obs_service_get_key(service),
+				obs_service_get_username(service),
+				obs_service_get_password(service));
+
+	dests = obs_data_get_array(settings, OPT_DESTINATIONS);
+	count = obs_data_array_count(dests);
+
+	for (size_t i = 0; i < count; i++) {
+		obs_data_t *dest = obs_data_array_item(dests, i);
+
+		add_destination(stream, fanout,
+				obs_data_get_string(dest, OPT_DEST_SERVER),
+				obs_data_get_string(dest, OPT_DEST_KEY),
+				obs_data_get_string(dest, OPT_DEST_USERNAME),
+				obs_data_get_string(dest, OPT_DEST_PASSWORD));
+		obs_data_release(dest);
+	}
+
+	obs_data_array_release(dests);
+}
+
+static void get_config(struct rtmp_multi_stream *stream, obs_data_t *settings,
+		       struct rtmp_fanout_config *config)
+{
+	const char *bind_ip = obs_data_get_string(settings, OPT_BIND_IP);
+	int64_t drop_b = obs_data_get_int(settings, OPT_DROP_THRESHOLD);
+	int64_t drop_p = obs_data_get_int(settings, OPT_PFRAME_DROP_THRESHOLD);
+
+	if (drop_p < (drop_b + 200))
+		drop_p = drop_b + 200;
+
+	memset(config, 0, sizeof(*config));
+	config->name = obs_output_get_name(stream->output);
+	config->drop_threshold_usec = 1000 * drop_b;
+	config->pframe_drop_threshold_usec = 1000 * drop_p;
+	config->max_buffer_usec =
+		1000 * obs_data_get_int(settings, OPT_MAX_BUFFER);
+	config->retry_delay_sec =
+		(int)obs_data_get_int(settings, OPT_RETRY_DELAY_SEC);
+	config->max_retries = (int)obs_data_get_int(settings, OPT_MAX_RETRIES);
+	config->max_shutdown_time_sec =
+		(int)obs_data_get_int(settings, OPT_MAX_SHUTDOWN_TIME_SEC);
+
+	if (bind_ip && *bind_ip && strcmp(bind_ip, "default") != 0) {
+		bool success = netif_str_to_addr(&config->bind_ip.addr,
+						 &config->bind_ip.addrLen,
+						 bind_ip);
+		if (success) {
+			int len = config->bind_ip.addrLen;
+			bool ipv6 = len == sizeof(struct sockaddr_in6);
+			info("Binding to IPv%d", ipv6 ? 6 : 4);
+		}
+	}
+}
+
+static bool rtmp_multi_stream_start(void *data)
+{
+	struct rtmp_multi_stream *stream = data;
+	struct rtmp_fanout_config config;
+	struct rtmp_fanout_callbacks callbacks = {
+		.param = stream,
+		.connected = fanout_connected,
+		.stopped = fanout_stopped,
+	};
+	rtmp_fanout_t *fanout, *old_fanout;
+	obs_data_t *settings;
+	uint8_t *meta_data;
+	size_t meta_data_size;
+
+	if (!obs_output_can_begin_data_capture(stream->output, 0))
+		return false;
+	if (!obs_output_initialize_encoders(stream->output, 0))
+		return false;
+
+	settings = obs_output_get_settings(stream->output);
+	get_config(stream, settings, &config);
+	fanout = rtmp_fanout_create(&config, &callbacks);
+	if (fanout)
+		add_destinations(stream, fanout, settings);
+	obs_data_release(settings);
+
+	if (!fanout)
+		return false;
+
+	/* the destination threads of the previous session have all ended by
+	 * the time the output can be started again, only the stats callbacks
+	 * may still be looking at it */
+	pthread_mutex_lock(&stream->fanout_mutex);
+	old_fanout = stream->fanout;
+	stream->fanout = fanout;
+	pthread_mutex_unlock(&stream->fanout_mutex);
+	rtmp_fanout_destroy(old_fanout);
+
+	if (!rtmp_fanout_num_destinations(stream->fanout)) {
+		warn("No destinations");
+		return false;
+	}
+
+	flv_meta_data(stream->output, &meta_data, &meta_data_size, false);
+	rtmp_fanout_set_meta_data(stream->fanout, meta_data, meta_data_size);
+	bfree(meta_data);
+
+	os_atomic_set_bool(&stream->capturing, false);
+	os_atomic_set_bool(&stream->encode_error, false);
+	stream->sent_headers = false;
+
+	os_atomic_set_bool(&stream->active, true);
+	if (!rtmp_fanout_start(stream->fanout)) {
+		os_atomic_set_bool(&stream->active, false);
+		return false;
+	}
+
+	return true;
+}
+
+static void add_headers(struct rtmp_multi_stream *stream)
+{
+	obs_output_t *context = stream->output;
+	obs_encoder_t *vencoder = obs_output_get_video_encoder(context);
+	obs_encoder_t *aencoder = obs_output_get_audio_encoder(context, 0);
+	uint8_t *header;
+	size_t size;
+
+	stream->sent_headers = true;
+
+	if (aencoder) {
+		struct encoder_packet packet = {.type = OBS_ENCODER_AUDIO,
+						.timebase_den = 1};
+
+		obs_encoder_get_extra_data(aencoder, &packet.data,
+					   &packet.size);
+		rtmp_fanout_add_header(stream->fanout, &packet);
+	}
+
+	if (vencoder) {
+		struct encoder_packet packet = {.type = OBS_ENCODER_VIDEO,
+						.timebase_den = 1,
+						.keyframe = true};
+
+		obs_encoder_get_extra_data(vencoder, &header, &size);
+		packet.size = obs_parse_avc_header(&packet.data, header, size);
+		rtmp_fanout_add_header(stream->fanout, &packet);
+		bfree(packet.data);
+	}
+}
+
+static void rtmp_multi_stream_data(void *data, struct encoder_packet *packet)
+{
+	struct rtmp_multi_stream *stream = data;
+	struct encoder_packet new_packet;
+
+	if (!active(stream))
+		return;
+
+	/* encoder fail */
+	if (!packet) {
+		os_atomic_set_bool(&stream->encode_error, true);
+		rtmp_fanout_stop(stream->fanout, 0);
+		return;
+	}
+
+	if (!stream->sent_headers)
+		add_headers(stream);
+
+	if (packet->type == OBS_ENCODER_VIDEO)
+		obs_parse_avc_packet(&new_packet, packet);
+	else
+		obs_encoder_packet_ref(&new_packet, packet);
+
+	rtmp_fanout_push(stream->fanout, &new_packet);
+}
+
+static void rtmp_multi_stream_defaults(obs_data_t *defaults)
+{
+	obs_data_set_default_int(defaults, OPT_DROP_THRESHOLD, 700);
+	obs_data_set_default_int(defaults, OPT_PFRAME_DROP_THRESHOLD, 900);
+	obs_data_set_default_int(defaults, OPT_MAX_BUFFER, 5000);
+	obs_data_set_default_int(defaults, OPT_MAX_SHUTDOWN_TIME_SEC, 30);
+	obs_data_set_default_int(defaults, OPT_RETRY_DELAY_SEC, 2);
+	obs_data_set_default_int(defaults, OPT_MAX_RETRIES, 20);
+	obs_data_set_default_string(defaults, OPT_BIND_IP, "default");
+}
+
+static obs_properties_t *rtmp_multi_stream_properties(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+
+	obs_properties_t *props = obs_properties_create();
+	struct netif_saddr_data addrs = {0};
+	obs_property_t *p;
+
+	obs_properties_add_int(props, OPT_DROP_THRESHOLD,
+			       obs_module_text("RTMPStream.DropThreshold"), 200,
+			       10000, 100);
+	obs_properties_add_int(props, OPT_MAX_BUFFER,
+			       obs_module_text("RTMPMultiStream.MaxBuffer"),
+			       1000, 60000, 500);
+
+	p = obs_properties_add_list(props, OPT_BIND_IP,
+				    obs_module_text("RTMPStream.BindIP"),
+				    OBS_COMBO_TYPE_LIST,
+				    OBS_COMBO_FORMAT_STRING);
+
+	obs_property_list_add_string(p, obs_module_text("Default"), "default");
+
+	netif_get_addrs(&addrs);
+	for (size_t i = 0; i < addrs.addrs.num; i++) {
+		struct netif_saddr_item item = addrs.addrs.array[i];
+		obs_property_list_add_string(p, item.name, item.addr);
+	}
+	netif_saddr_data_free(&addrs);
+
+	return props;
+}
+
+/* call with fanout_mutex held */
+static inline size_t num_destinations(struct rtmp_multi_stream *stream)
+{
+	return stream->fanout ? rtmp_fanout_num_destinations(stream->fanout)
+			      : 0;
+}
+
+static uint64_t rtmp_multi_stream_total_bytes_sent(void *data)
+{
+	struct rtmp_multi_stream *stream = data;
+	struct rtmp_fanout_dest_stats stats;
+	uint64_t total_bytes = 0;
+	size_t count;
+
+	pthread_mutex_lock(&stream->fanout_mutex);
+	count = num_destinations(stream);
+	for (size_t i = 0; i < count; i++) {
+		rtmp_fanout_get_dest_stats(stream->fanout, i, &stats);
+		total_bytes += stats.total_bytes;
+	}
+	pthread_mutex_unlock(&stream->fanout_mutex);
+
+	return total_bytes;
+}
+
+/* dropped frames and congestion are reported for the worst destination, a
+ * sum over all of them would not mean much next to the frame count */
+static int rtmp_multi_stream_dropped_frames(void *data)
+{
+	struct rtmp_multi_stream *stream = data;
+	struct rtmp_fanout_dest_stats stats;
+	int dropped_frames = 0;
+	size_t count;
+
+	pthread_mutex_lock(&stream->fanout_mutex);
+	count = num_destinations(stream);
+	for (size_t i = 0; i < count; i++) {
+		rtmp_fanout_get_dest_stats(stream->fanout, i, &stats);
+		if (stats.dropped_frames > dropped_frames)
+			dropped_frames = stats.dropped_frames;
+	}
+	pthread_mutex_unlock(&stream->fanout_mutex);
+
+	return dropped_frames;
+}
+
+static float rtmp_multi_stream_congestion(void *data)
+{
+	struct rtmp_multi_stream *stream = data;
+	struct rtmp_fanout_dest_stats stats;
+	float congestion = 0.0f;
+	size_t count;
+
+	pthread_mutex_lock(&stream->fanout_mutex);
+	count = num_destinations(stream);
+	for (size_t i = 0; i < count; i++) {
+		rtmp_fanout_get_dest_stats(stream->fanout, i, &stats);
+		if (stats.connected && stats.congestion > congestion)
+			congestion = stats.congestion;
+	}
+	pthread_mutex_unlock(&stream->fanout_mutex);
+
+	return congestion;
+}
+
+static int rtmp_multi_stream_connect_time(void *data)
+{
+	struct rtmp_multi_stream *stream = data;
+	struct rtmp_fanout_dest_stats stats = {0};
+
+	pthread_mutex_lock(&stream->fanout_mutex);
+	if (num_destinations(stream))
+		rtmp_fanout_get_dest_stats(stream->fanout, 0, &stats);
+	pthread_mutex_unlock(&stream->fanout_mutex);
+
+	return stats.connect_time_ms;
+}
+
+struct obs_output_info rtmp_multi_output_info = {
+	.id = "rtmp_multi_output",
+	.flags = OBS_OUTPUT_AV | OBS_OUTPUT_ENCODED | OBS_OUTPUT_SERVICE,
+	.encoded_video_codecs = "h264",
+	.encoded_audio_codecs = "aac",
+	.get_name = rtmp_multi_stream_getname,
+	.create = rtmp_multi_stream_create,
+	.destroy = rtmp_multi_stream_destroy,
+	.start = rtmp_multi_stream_start,
+	.stop = rtmp_multi_stream_stop,
+	.encoded_packet = rtmp_multi_stream_data,
+	.get_defaults = rtmp_multi_stream_defaults,
+	.get_properties = rtmp_multi_stream_properties,
+	.get_total_bytes = rtmp_multi_stream_total_bytes_sent,
+	.get_congestion = rtmp_multi_stream_congestion,
+	.get_connect_time_ms = rtmp_multi_stream_connect_time,
+	.get_dropped_frames = rtmp_multi_stream_dropped_frames,
+};
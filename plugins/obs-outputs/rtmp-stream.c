@@ -415,6 +415,53 @@ retry_send:
 	return len;
 }
 
+/* sends a packet of the main track without muxing it into an FLV tag first.
+ * the tag prefix and the chunk headers are built on the stack, and the
+ * payload is sent straight from the encoder packet */
+static int send_media_packet(struct rtmp_stream *stream,
+			     struct encoder_packet *packet, bool is_header,
+			     size_t *size)
+{
+	int32_t dts_offset = is_header ? 0 : stream->start_dts_offset;
+	uint8_t prefix[FLV_MAX_PACKET_PREFIX];
+	RTMPPacket rtmp_packet = {0};
+	AVal body[2];
+	uint32_t time_ms;
+
+	*size = 0;
+	if (!packet->data || !packet->size)
+		return 0;
+
+	body[0].av_val = (char *)prefix;
+	body[0].av_len = (int)flv_packet_prefix(packet, is_header, prefix);
+	body[1].av_val = (char *)packet->data;
+	body[1].av_len = (int)packet->size;
+
+	/* same 31 bits of timestamp that the FLV tag would have carried */
+	time_ms = (uint32_t)(get_ms_time(packet, packet->dts) - dts_offset) &
+		  0x7FFFFFFF;
+
+	rtmp_packet.m_packetType = packet->type == OBS_ENCODER_VIDEO
+					   ? RTMP_PACKET_TYPE_VIDEO
+					   : RTMP_PACKET_TYPE_AUDIO;
+	rtmp_packet.m_headerType = time_ms ? RTMP_PACKET_SIZE_MEDIUM
+					   : RTMP_PACKET_SIZE_LARGE;
+	rtmp_packet.m_nChannel = 0x04;
+	rtmp_packet.m_nTimeStamp = time_ms;
+	rtmp_packet.m_nInfoField2 = stream->rtmp.Link.streams[0].id;
+	rtmp_packet.m_nBodySize = (uint32_t)(body[0].av_len + body[1].av_len);
+
+	*size = rtmp_packet.m_nBodySize + FLV_TAG_OVERHEAD;
+
+#ifdef TEST_FRAMEDROPS
+	droptest_cap_data_rate(stream, *size);
+#endif
+
+	if (!RTMP_SendPacketV(&stream->rtmp, &rtmp_packet, body, 2))
+		return -1;
+	return (int)*size;
+}
+
 static int send_packet(struct rtmp_stream *stream,
 		       struct encoder_packet *packet, bool is_header,
 		       size_t idx)
@@ -444,17 +491,16 @@ static int send_packet(struct rtmp_stream *stream,
 		flv_additional_packet_mux(
 			packet, is_header ? 0 : stream->start_dts_offset, &data,
 			&size, is_header, idx);
-	} else {
-		flv_packet_mux(packet, is_header ? 0 : stream->start_dts_offset,
-			       &data, &size, is_header);
-	}
 
 #ifdef TEST_FRAMEDROPS
-	droptest_cap_data_rate(stream, size);
+		droptest_cap_data_rate(stream, size);
 #endif
 
-	ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, 0);
-	bfree(data);
+		ret = RTMP_Write(&stream->rtmp, (char *)data, (int)size, 0);
+		bfree(data);
+	} else {
+		ret = send_media_packet(stream, packet, is_header, &size);
+	}
 
 	if (is_header)
 		bfree(packet->data);
@@ -4,9 +4,13 @@
 #include <util/dstr.h>
 #include <util/platform.h>
 #include <util/threading.h>
+#include <util/profiler.hpp>
+#include <util/util_uint64.h>
 #include <obs-module.h>
 #include <obs-frontend-api.h>
 #include <vector>
+#include <atomic>
+#include <algorithm>
 #include <stdio.h>
 #include <QMainWindow>
 #include <QApplication>
@@ -96,6 +100,63 @@ public:
 	}
 };
 
+/* single producer, single consumer ring of planar float audio */
+class AudioBridge {
+private:
+	juce::AbstractFifo       fifo;
+	juce::AudioBuffer<float> data;
+
+public:
+	AudioBridge(int channels, int capacity) : fifo(capacity), data(channels, capacity)
+	{
+		data.clear();
+	}
+
+	int available()
+	{
+		return fifo.getNumReady();
+	}
+
+	bool write(const float *const *src, int chs, int frames)
+	{
+		if (fifo.getFreeSpace() < frames)
+			return false;
+
+		int start1, size1, start2, size2;
+		fifo.prepareToWrite(frames, start1, size1, start2, size2);
+		for (int ch = 0; ch < chs; ch++) {
+			if (size1 > 0)
+				data.copyFrom(ch, start1, src[ch], size1);
+			if (size2 > 0)
+				data.copyFrom(ch, start2, src[ch] + size1, size2);
+		}
+		fifo.finishedWrite(size1 + size2);
+		return true;
+	}
+
+	int read(float *const *dst, int chs, int offset, int frames)
+	{
+		int start1, size1, start2, size2;
+		fifo.prepareToRead(frames, start1, size1, start2, size2);
+		for (int ch = 0; ch < chs; ch++) {
+			if (size1 > 0)
+				memcpy(dst[ch] + offset, data.getReadPointer(ch, start1), size1 * sizeof(float));
+			if (size2 > 0)
+				memcpy(dst[ch] + offset + size1, data.getReadPointer(ch, start2),
+						size2 * sizeof(float));
+		}
+		fifo.finishedRead(size1 + size2);
+		return size1 + size2;
+	}
+
+	void skip(int frames)
+	{
+		int start1, size1, start2, size2;
+		fifo.prepareToRead(frames, start1, size1, start2, size2);
+		fifo.finishedRead(size1 + size2);
+	}
+};
+
 template<class PluginFormat> class PluginHost : private AudioProcessorListener, public ReferenceCountedObject {
 private:
 	juce::AudioBuffer<float> buffer;
@@ -126,6 +187,52 @@ private:
 	bool enabled  = true;
 	bool swap     = false;
 
+	/* what the running instance was last prepared with, prepareToPlay is
+	 * only called again when one of these changes */
+	AudioPluginInstance *prepared_instance    = nullptr;
+	double               prepared_sample_rate = 0.0;
+	int                  prepared_block_size  = 0;
+
+	/* what change_vst prepared new_vst_instance with, taken over on swap */
+	double new_prepared_sample_rate = 0.0;
+	int    new_prepared_block_size  = 0;
+
+	/* follows the filter name, read on the audio or worker thread */
+	std::atomic<const char *> profile_name{nullptr};
+
+	/* optional worker thread mode: blocks are handed to the worker through
+	 * bridge_in and come back through bridge_out one block later, so a slow
+	 * plugin can no longer stall the audio thread.  process_lock is held
+	 * while blocks go through the plugin, and protects bridge_data */
+	std::unique_ptr<AudioBridge> bridge_in;
+	std::unique_ptr<AudioBridge> bridge_out;
+	std::unique_ptr<float[]>     bridge_data;
+	CriticalSection              bridge_lock;
+	CriticalSection              process_lock;
+	pthread_t                    worker_thread;
+	os_sem_t *                   worker_sem = nullptr;
+	std::atomic<bool>            worker_active{false};
+	std::atomic<bool>            worker_stop{false};
+	std::atomic<int>             bridge_channels{0};
+	int                          bridge_offset = 0;
+	std::atomic<uint64_t>        bridge_dropouts{0};
+
+	/* whether the filter is on an output track, only used on the audio
+	 * thread.  0 until the parent is known */
+	int  parent_kind         = 0;
+	bool track_warning_shown = false;
+
+	/* fixed latency added by the worker, it gets one block period to
+	 * process each block */
+	static constexpr int bridge_latency   = obs_output_frames;
+	static constexpr int bridge_capacity  = 8 * obs_output_frames;
+	static constexpr int bridge_max_block = 2 * obs_output_frames;
+
+	std::atomic<int>      latency_samples{0};
+	std::atomic<uint64_t> process_time_total{0};
+	std::atomic<uint64_t> process_time_peak{0};
+	std::atomic<uint64_t> process_blocks{0};
+
 	void save_state(AudioProcessor *processor)
 	{
 		if (!vst_settings)
@@ -149,9 +256,49 @@ private:
 
 	void audioProcessorChanged(AudioProcessor *processor, const ChangeDetails &details)
 	{
+		if (details.latencyChanged && processor == vst_instance.get())
+			latency_samples = processor->getLatencySamples();
 		save_state(processor);
 	}
 
+	void prepare(double sps, int block_size)
+	{
+		vst_instance->prepareToPlay(sps, block_size);
+
+		prepared_instance    = vst_instance.get();
+		prepared_sample_rate = sps;
+		prepared_block_size  = block_size;
+		latency_samples      = vst_instance->getLatencySamples();
+	}
+
+	void reset_stats()
+	{
+		process_time_total = 0;
+		process_time_peak  = 0;
+		process_blocks     = 0;
+	}
+
+	void set_profile_name(const char *name)
+	{
+		profile_name = profile_store_name(obs_get_profiler_name_store(), "vst_filter(%s)", name);
+	}
+
+	static void source_renamed(void *vptr, calldata_t *cd)
+	{
+		PluginHost *plugin = static_cast<PluginHost *>(vptr);
+		plugin->set_profile_name(calldata_string(cd, "new_name"));
+	}
+
+	void record_process_time(uint64_t ns)
+	{
+		process_time_total += ns;
+		process_blocks++;
+
+		uint64_t peak = process_time_peak;
+		while (ns > peak && !process_time_peak.compare_exchange_weak(peak, ns))
+			;
+	}
+
 	void close_vst(std::unique_ptr<AudioPluginInstance> &inst)
 	{
 		if (inst) {
@@ -177,6 +324,8 @@ private:
 			host_close();
 			new_vst_instance->setNonRealtime(false);
 			new_vst_instance->prepareToPlay((double)aoi.samples_per_sec, 2 * obs_output_frames);
+			new_prepared_sample_rate = (double)aoi.samples_per_sec;
+			new_prepared_block_size  = 2 * obs_output_frames;
 
 			if (!vst_settings) {
 				juce::MemoryBlock m;
@@ -202,6 +351,195 @@ private:
 		menu_update.exit();
 	}
 
+	static void *worker_main(void *param)
+	{
+		PluginHost *host = static_cast<PluginHost *>(param);
+		os_set_thread_name("obs-vst3: plugin worker");
+		host->worker_loop();
+		return nullptr;
+	}
+
+	/* moves everything queued in bridge_in through the plugin, the caller
+	 * holds process_lock */
+	void drain_bridge(int chs)
+	{
+		float *planes[MAX_AV_PLANES] = {};
+		for (int ch = 0; ch < chs; ch++)
+			planes[ch] = bridge_data.get() + ch * bridge_max_block;
+
+		int frames;
+		while ((frames = std::min(bridge_in->available(), bridge_max_block)) > 0) {
+			bridge_in->read(planes, chs, 0, frames);
+			process_block(planes, chs, frames);
+
+			/* cannot fail, the output holds the latency on top of
+			 * everything the input can hold */
+			bridge_out->write(planes, chs, frames);
+		}
+	}
+
+	void worker_loop()
+	{
+		while (os_sem_wait(worker_sem) == 0) {
+			if (worker_stop)
+				break;
+
+			process_lock.enter();
+			drain_bridge(bridge_channels);
+			process_lock.exit();
+		}
+	}
+
+	void start_worker()
+	{
+		int max_chs = std::min((int)obs_max_channels, MAX_AV_PLANES);
+
+		bridge_in.reset(new AudioBridge(max_chs, bridge_capacity));
+		bridge_out.reset(new AudioBridge(max_chs, bridge_capacity + bridge_latency));
+		bridge_data.reset(new float[max_chs * bridge_max_block]);
+		bridge_offset = -bridge_latency;
+		worker_stop   = false;
+
+		if (os_sem_init(&worker_sem, 0) != 0)
+			return;
+		if (pthread_create(&worker_thread, nullptr, worker_main, this) != 0) {
+			os_sem_destroy(worker_sem);
+			worker_sem = nullptr;
+			return;
+		}
+
+		worker_active = true;
+	}
+
+	void stop_worker()
+	{
+		if (!worker_active)
+			return;
+
+		worker_stop = true;
+		os_sem_post(worker_sem);
+		pthread_join(worker_thread, nullptr);
+		os_sem_destroy(worker_sem);
+		worker_sem    = nullptr;
+		worker_active = false;
+
+		bridge_in.reset();
+		bridge_out.reset();
+		bridge_data.reset();
+	}
+
+	void set_threaded(bool threaded)
+	{
+		if (threaded == worker_active)
+			return;
+
+		bridge_lock.enter();
+		if (threaded)
+			start_worker();
+		else
+			stop_worker();
+		bridge_lock.exit();
+
+		if (worker_active)
+			blog(LOG_INFO, "obs-vst3: '%s' runs on a worker thread, adding %d samples of latency",
+					obs_source_get_name(context), bridge_latency);
+	}
+
+	/* hands a block to the worker and returns the block it processed
+	 * bridge_latency frames earlier.  bridge_offset keeps that latency
+	 * fixed: negative values are frames of silence still owed to the
+	 * output (dropped input), positive values are late frames the worker
+	 * still has to deliver and that must be discarded (missed deadline).
+	 * with direct set, the block is processed on the calling thread
+	 * instead, after anything still queued for the worker */
+	void bridge_block(float *const *data, int chs, int frames, bool direct)
+	{
+		bridge_channels = chs;
+		if (direct) {
+			process_lock.enter();
+			drain_bridge(chs);
+			process_block(data, chs, frames);
+			bridge_out->write(data, chs, frames);
+			process_lock.exit();
+		} else {
+			if (!bridge_in->write(data, chs, frames)) {
+				bridge_offset -= frames;
+				bridge_dropouts++;
+			}
+			os_sem_post(worker_sem);
+		}
+
+		int pos = 0;
+		if (bridge_offset < 0) {
+			pos = std::min(-bridge_offset, frames);
+			for (int ch = 0; ch < chs; ch++)
+				memset(data[ch], 0, pos * sizeof(float));
+			bridge_offset += pos;
+		}
+		if (bridge_offset > 0) {
+			int late = std::min(bridge_offset, bridge_out->available());
+			bridge_out->skip(late);
+			bridge_offset -= late;
+		}
+
+		int got = bridge_out->read(data, chs, pos, frames - pos);
+		if (pos + got < frames) {
+			for (int ch = 0; ch < chs; ch++)
+				memset(data[ch] + pos + got, 0, (frames - pos - got) * sizeof(float));
+			bridge_offset += frames - pos - got;
+			bridge_dropouts++;
+		}
+	}
+
+	void bridge_audio(struct obs_audio_data *audio, int chs)
+	{
+		float *const *data   = (float *const *)audio->data;
+		int           frames = (int)audio->frames;
+
+		/* the worker can't return a block larger than the latency in
+		 * time, those are split up and processed on this thread */
+		bool direct = frames > bridge_latency;
+		int  step   = direct ? bridge_latency : frames;
+
+		for (int pos = 0; pos < frames; pos += step) {
+			float *chunk[MAX_AV_PLANES] = {};
+			for (int ch = 0; ch < chs; ch++)
+				chunk[ch] = data[ch] + pos;
+
+			bridge_block(chunk, chs, std::min(step, frames - pos), direct);
+		}
+
+		/* compensate for the added latency the same way a negative sync
+		 * offset would */
+		audio->timestamp -= util_mul_div64(bridge_latency, 1000000000ULL,
+				audio_output_get_sample_rate(obs_get_audio()));
+	}
+
+	/* track filters run on the mixed output, where the timestamp isn't
+	 * used anymore, so the latency of the worker can't be compensated */
+	static bool is_track_source(obs_source_t *source)
+	{
+		bool found = false;
+
+		obs_audio_mix_lock();
+		obs_source_t **tracks = (obs_source_t **)obs_audio_mix_tracks();
+		for (size_t i = 0; i < MAX_AUDIO_MIXES && !found; i++)
+			found = tracks[i] == source;
+		obs_audio_mix_unlock();
+		return found;
+	}
+
+	bool on_track()
+	{
+		if (!parent_kind) {
+			obs_source_t *parent = obs_filter_get_parent(context);
+			if (parent)
+				parent_kind = is_track_source(parent) ? 2 : 1;
+		}
+
+		return parent_kind == 2;
+	}
+
 	void update(obs_data_t *settings)
 	{
 		static PluginFormat plugin_format;
@@ -222,6 +560,8 @@ private:
 		}
 		dpi_aware = dpi_awareness;
 
+		set_threaded(obs_data_get_bool(settings, "threaded"));
+
 		auto midi_stop = [this]() {
 			if (midi_input) {
 				midi_input->stop();
@@ -329,7 +669,8 @@ private:
 			obs_data_set_string(settings, "state", "");
 	}
 
-	void filter_audio(struct obs_audio_data *audio)
+	/* runs on the audio thread, or on the worker in threaded mode */
+	void process_block(float *const *data, int chs, int frames)
 	{
 		if (menu_update.tryEnter()) {
 			if (swap) {
@@ -337,29 +678,41 @@ private:
 				if (new_vst_instance)
 					new_vst_instance->removeListener(this);
 				swap = false;
+
+				if (vst_instance) {
+					prepared_instance    = vst_instance.get();
+					prepared_sample_rate = new_prepared_sample_rate;
+					prepared_block_size  = new_prepared_block_size;
+					latency_samples      = vst_instance->getLatencySamples();
+				} else {
+					prepared_instance = nullptr;
+					latency_samples   = 0;
+				}
+				reset_stats();
 			}
 			menu_update.exit();
 		}
 
 		/*Process w/ VST*/
 		if (vst_instance) {
-			int chs = 0;
-			for (; chs < obs_max_channels && audio->data[chs]; chs++)
-				;
-
-			struct obs_audio_info aoi;
-			bool                  audio_info = obs_get_audio_info(&aoi);
-			double                sps        = (double)aoi.samples_per_sec;
-
-			if (audio_info) {
-				vst_instance->prepareToPlay(sps, audio->frames);
-				if (current_sample_rate != sps)
-					midi_collector.reset(sps);
+			double sps = (double)audio_output_get_sample_rate(obs_get_audio());
+
+			/* re-preparing resets the state of most plugins and may
+			 * reallocate, so only do it when the format changes */
+			if (prepared_instance != vst_instance.get() || prepared_sample_rate != sps ||
+					prepared_block_size < frames)
+				prepare(sps, std::max(frames, 2 * obs_output_frames));
+
+			if (current_sample_rate != sps) {
+				midi_collector.reset(sps);
 				current_sample_rate = sps;
 			}
 
-			midi_collector.removeNextBlockOfMessages(midi, audio->frames);
-			buffer.setDataToReferTo((float **)audio->data, chs, audio->frames);
+			ProfileScope(profile_name.load());
+			uint64_t start = os_gettime_ns();
+
+			midi_collector.removeNextBlockOfMessages(midi, frames);
+			buffer.setDataToReferTo((float **)data, chs, frames);
 			param = vst_instance->getBypassParameter();
 
 			if (param && param->getValue() != 0.0f)
@@ -368,7 +721,35 @@ private:
 				vst_instance->processBlock(buffer, midi);
 
 			midi.clear();
+
+			record_process_time(os_gettime_ns() - start);
+		}
+	}
+
+	void filter_audio(struct obs_audio_data *audio)
+	{
+		int chs = 0;
+		for (; chs < obs_max_channels && chs < MAX_AV_PLANES && audio->data[chs]; chs++)
+			;
+
+		/* only fails while threaded mode is being toggled, the block
+		 * then passes through unprocessed */
+		if (!bridge_lock.tryEnter())
+			return;
+
+		bool threaded = worker_active && !on_track();
+		if (worker_active && !threaded && !track_warning_shown) {
+			blog(LOG_WARNING, "obs-vst3: '%s' is a track filter, it can't run on a worker thread",
+					obs_source_get_name(context));
+			track_warning_shown = true;
 		}
+
+		if (threaded)
+			bridge_audio(audio, chs);
+		else
+			process_block((float *const *)audio->data, chs, (int)audio->frames);
+
+		bridge_lock.exit();
 	}
 
 public:
@@ -380,10 +761,18 @@ public:
 
 	PluginHost(obs_data_t *settings, obs_source_t *source) : context(source)
 	{
+		/* the audio buffer only ever refers to the filter's planes, but
+		 * the midi buffer is filled on the audio thread */
+		midi.ensureSize(2048);
+
+		set_profile_name(obs_source_get_name(source));
+		signal_handler_connect(obs_source_get_signal_handler(source), "rename", source_renamed, this);
 	}
 
 	~PluginHost() override
 	{
+		signal_handler_disconnect(obs_source_get_signal_handler(context), "rename", source_renamed, this);
+		stop_worker();
 		if (vst_settings)
 			obs_data_release(vst_settings);
 		host_close();
@@ -486,6 +875,14 @@ public:
 		return true;
 	}
 
+	static bool reset_stats_clicked(obs_properties_t *props, obs_property_t *property, void *vptr)
+	{
+		PluginHost *plugin = static_cast<PluginHost *>(vptr);
+		plugin->reset_stats();
+		plugin->bridge_dropouts = 0;
+		return true;
+	}
+
 	static bool vst_selected_modified(
 			void *vptr, obs_properties_t *props, obs_property_t *property, obs_data_t *settings)
 	{
@@ -539,6 +936,40 @@ public:
 
 		dpi_aware = obs_properties_add_bool(props, "dpi_aware", obs_module_text("DPI Aware"));
 
+		bool            on_track = is_track_source(obs_filter_get_parent(plugin->context));
+		obs_property_t *threaded = obs_properties_add_bool(props, "threaded", obs_module_text("Threaded"));
+		obs_property_set_enabled(threaded, !on_track);
+
+		/* processing statistics since the plugin was loaded or the stats
+		 * were last reset */
+		uint64_t blocks = plugin->process_blocks.load();
+		uint64_t total  = plugin->process_time_total.load();
+		uint64_t peak   = plugin->process_time_peak.load();
+		uint64_t drops  = plugin->bridge_dropouts.load();
+		int      delay  = plugin->latency_samples;
+		double   sps    = (double)audio_output_get_sample_rate(obs_get_audio());
+
+		if (plugin->worker_active && !on_track)
+			delay += bridge_latency;
+
+		std::string stats = std::string(obs_module_text("Latency")) + ": " + std::to_string(delay) +
+				" samples";
+		if (sps > 0.0)
+			stats += " (" + std::to_string((int)(delay * 1000.0 / sps)) + " ms)";
+		if (blocks) {
+			stats += ", " + std::string(obs_module_text("Processing")) + ": " +
+					std::to_string(total / blocks / 1000) + " us avg, " +
+					std::to_string(peak / 1000) + " us peak";
+		}
+		if (drops)
+			stats += ", " + std::to_string(drops) + " " + obs_module_text("Dropouts");
+
+		obs_property_t *stats_info = obs_properties_add_text(props, "stats", stats.c_str(), OBS_TEXT_DEFAULT);
+		obs_property_set_enabled(stats_info, false);
+
+		obs_properties_add_button2(
+				props, "reset_stats", obs_module_text("ResetStats"), reset_stats_clicked, plugin);
+
 		/*Add VSTs to list*/
 		bool scannable = plugin_format.canScanForPlugins();
 		if (scannable) {
@@ -573,6 +1004,7 @@ public:
 		obs_data_set_default_string(settings, "effect", "None");
 		obs_data_set_default_double(settings, "enable", true);
 		obs_data_set_default_bool(settings, "dpi_aware", true);
+		obs_data_set_default_bool(settings, "threaded", false);
 	}
 
 	static const char *Name(void *unused)
@@ -3,8 +3,11 @@
 #include <stdio.h>
 
 #include <media-io/audio-math.h>
+#include <util/threading.h>
 #include <math.h>
 
+#include "rematrix-routing.h"
+
 OBS_DECLARE_MODULE()
 OBS_MODULE_USE_DEFAULT_LOCALE("rematrix-filter", "en-US")
 
@@ -19,6 +22,9 @@ OBS_MODULE_USE_DEFAULT_LOCALE("rematrix-filter", "en-US")
 
 #define SCALE 100.0f
 
+//set on the shared table index when update published a new table
+#define TABLE_FRESH 4
+
 /*****************************************************************************/
 long long get_obs_output_channels()
 {
@@ -42,12 +48,14 @@ struct rematrix_data {
 	//ensure we can treat it as a dynamic array
 	size_t size;
 
-	//initialize once, optimize for fast use
-	volatile long long _ch_count[MAX_AV_PLANES];
-	volatile double _gain[MAX_AV_PLANES];
-	volatile float _mix[MAX_AV_PLANES][MAX_AV_PLANES];
-	volatile double _true_gain[MAX_AV_PLANES];
-	//static volatile uint32_t options[MAX_AV_PLANES];
+	//routing tables, triple buffered so update never has to wait for
+	//the audio thread: update fills table_back and swaps it with
+	//table_shared, the audio thread swaps table_front with table_shared
+	//whenever it was freshly published
+	struct rematrix_table tables[3];
+	long table_front;
+	long table_back;
+	volatile long table_shared;
 };
 
 /*****************************************************************************/
@@ -128,6 +136,15 @@ static void rematrix_update(void *data, obs_data_t *settings)
 		}
 	}
 
+	//publish the new routing
+	struct rematrix_table *table = &rematrix->tables[rematrix->table_back];
+	rematrix_table_build(table, rematrix->channels, rematrix->mix,
+			     rematrix->gain);
+	rematrix->table_back =
+		os_atomic_exchange_long(&rematrix->table_shared,
+					rematrix->table_back | TABLE_FRESH) &
+		~TABLE_FRESH;
+
 	//don't memory leak
 	free(route_name);
 	free(gain_name);
@@ -139,6 +156,9 @@ static void *rematrix_create(obs_data_t *settings, obs_source_t *filter)
 {
 	struct rematrix_data *rematrix = bzalloc(sizeof(*rematrix));
 	rematrix->context = filter;
+	rematrix->table_front = 0;
+	rematrix->table_back = 1;
+	rematrix->table_shared = 2;
 	rematrix_update(rematrix, settings);
 
 	size_t target_size = MAX_AUDIO_SIZE;
@@ -168,88 +188,18 @@ rematrix_filter_audio(void *data, struct obs_audio_data *audio)
 {
 
 	struct rematrix_data *rematrix = data;
-	const size_t channels = rematrix->channels;
-	float **fmatrixed_data = (float **)rematrix->tmpbuffer;
-	float **fdata = (float **)audio->data;
-	size_t ch_buffer = (audio->frames * sizeof(float));
-
-	//prevent race condition
-	for (size_t c = 0; c < channels; c++) {
-		rematrix->_ch_count[c] = 0;
-		rematrix->_gain[c] = rematrix->gain[c];
-		for (size_t c2 = 0; c2 < channels; c2++) {
-			rematrix->_mix[c][c2] = rematrix->mix[c][c2];
-			//use ch_count to "count" how many chs are in use
-			//for normalization
-			if (rematrix->_mix[c][c2] > 0)
-				rematrix->_ch_count[c]++;
-		}
-		//when ch_count == 0.0 float returns +inf, making this division by 0.0 actually safe
-		if (rematrix->_ch_count[c] == 0.0) {
-			rematrix->_true_gain[c] = 0.0;
-		} else {
-			rematrix->_true_gain[c] =
-				rematrix->_gain[c] / rematrix->_ch_count[c];
-		}
-	}
 
-	uint32_t frames = audio->frames;
-	size_t copy_size = 0;
-	size_t unprocessed_samples = 0;
-	//consume AUDIO_OUTPUT_FRAMES or less # of frames
-	size_t size = rematrix->size / sizeof(float);
-	for (size_t chunk = 0; chunk < frames; chunk += size) {
-		//calculate the size of the data we're about to try to copy
-		if (frames - chunk < size)
-			unprocessed_samples = frames - chunk;
-		else
-			unprocessed_samples = size;
-		copy_size = unprocessed_samples * sizeof(float);
-
-		//copy data to temporary buffer
-		for (size_t c = 0; c < channels; c++) {
-			//reset to 0
-			size_t c2 = 0;
-			for (; c2 < 1; c2++) {
-				if (fdata[c2] && rematrix->_mix[c][c2]) {
-					for (size_t s = 0;
-					     s < unprocessed_samples; s++) {
-						fmatrixed_data[c][s] =
-							fdata[c2][chunk + s] *
-							rematrix->_mix[c][c2];
-					}
-				} else {
-					//memset(fmatrixed_data[c], 0, copy_size);
-					for (size_t s = 0;
-					     s < unprocessed_samples; s++) {
-						fmatrixed_data[c][s] = 0.0;
-					}
-				}
-			}
-			//memset(fmatrixed_data[c], 0, copy_size);
-			//add contributions
-			for (; c2 < channels; c2++) {
-				if (fdata[c2] && rematrix->_mix[c][c2]) {
-					for (size_t s = 0;
-					     s < unprocessed_samples; s++) {
-						fmatrixed_data[c][s] +=
-							fdata[c2][chunk + s] *
-							rematrix->_mix[c][c2];
-					}
-				}
-			}
-		}
-		//move data into place and process gain
-		for (size_t c = 0; c < channels; c++) {
-			if (!fdata[c])
-				continue;
-			for (size_t s = 0; s < unprocessed_samples; s++) {
-				fdata[c][chunk + s] = fmatrixed_data[c][s] *
-						      rematrix->_true_gain[c];
-			}
-		}
-		//move to next chunk of unprocessed data
-	}
+	//pick up the routing published by the last update
+	if (os_atomic_load_long(&rematrix->table_shared) & TABLE_FRESH)
+		rematrix->table_front = os_atomic_exchange_long(
+						&rematrix->table_shared,
+						rematrix->table_front) &
+					~TABLE_FRESH;
+
+	rematrix_table_process(&rematrix->tables[rematrix->table_front],
+			       (float **)audio->data,
+			       (float **)rematrix->tmpbuffer,
+			       rematrix->size / sizeof(float), audio->frames);
 	return audio;
 }
 
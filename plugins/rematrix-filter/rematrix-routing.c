@@ -0,0 +1,118 @@
+#include "rematrix-routing.h"
+
+#include <media-io/audio-simd.h>
+#include <string.h>
+
+/*****************************************************************************/
+void rematrix_table_build(struct rematrix_table *table, size_t channels,
+			  const float mix[MAX_AV_PLANES][MAX_AV_PLANES],
+			  const double gain[MAX_AV_PLANES])
+{
+	table->channels = channels;
+
+	for (size_t c = 0; c < channels; c++) {
+		size_t ch_count = 0;
+		size_t num = 0;
+
+		//use ch_count to "count" how many chs are in use for
+		//normalization
+		for (size_t c2 = 0; c2 < channels; c2++) {
+			if (mix[c][c2] > 0)
+				ch_count++;
+		}
+
+		float true_gain = ch_count ? (float)(gain[c] / ch_count) : 0.0f;
+
+		for (size_t c2 = 0; c2 < channels && true_gain != 0.0f; c2++) {
+			if (mix[c][c2] == 0.0f)
+				continue;
+
+			table->routes[c][num].src = (uint32_t)c2;
+			table->routes[c][num].gain = mix[c][c2] * true_gain;
+			num++;
+		}
+
+		table->num_routes[c] = num;
+
+		if (num == 0)
+			table->type[c] = REMATRIX_OUTPUT_ZERO;
+		else if (num > 1 || table->routes[c][0].src != c)
+			table->type[c] = REMATRIX_OUTPUT_MIX;
+		else if (table->routes[c][0].gain == 1.0f)
+			table->type[c] = REMATRIX_OUTPUT_PASSTHROUGH;
+		else
+			table->type[c] = REMATRIX_OUTPUT_SCALE;
+	}
+}
+
+/*****************************************************************************/
+static void mix_output(const struct rematrix_table *table, size_t c,
+		       float **data, float *out, size_t offset, size_t frames)
+{
+	const struct rematrix_route *route = table->routes[c];
+	const struct rematrix_route *end = route + table->num_routes[c];
+
+	//the first contribution initializes the output
+	for (; route < end; route++) {
+		if (data[route->src]) {
+			audio_simd_copy_scaled(out, data[route->src] + offset,
+					       route->gain, frames);
+			break;
+		}
+	}
+
+	if (route == end) {
+		memset(out, 0, frames * sizeof(float));
+		return;
+	}
+
+	//add contributions
+	for (route++; route < end; route++) {
+		if (data[route->src])
+			audio_simd_mix(out, data[route->src] + offset,
+				       route->gain, frames);
+	}
+}
+
+void rematrix_table_process(const struct rematrix_table *table, float **data,
+			    float **tmp, size_t tmp_frames, size_t frames)
+{
+	const size_t channels = table->channels;
+
+	for (size_t chunk = 0; chunk < frames; chunk += tmp_frames) {
+		size_t count = frames - chunk < tmp_frames ? frames - chunk
+							   : tmp_frames;
+
+		//mixed outputs read the unmodified inputs, so they go through
+		//the temporary buffers first
+		for (size_t c = 0; c < channels; c++) {
+			if (data[c] && table->type[c] == REMATRIX_OUTPUT_MIX)
+				mix_output(table, c, data, tmp[c], chunk,
+					   count);
+		}
+
+		//then everything can be written in place
+		for (size_t c = 0; c < channels; c++) {
+			if (!data[c])
+				continue;
+
+			switch (table->type[c]) {
+			case REMATRIX_OUTPUT_ZERO:
+				memset(data[c] + chunk, 0,
+				       count * sizeof(float));
+				break;
+			case REMATRIX_OUTPUT_PASSTHROUGH:
+				break;
+			case REMATRIX_OUTPUT_SCALE:
+				audio_simd_gain(data[c] + chunk,
+						table->routes[c][0].gain,
+						count);
+				break;
+			case REMATRIX_OUTPUT_MIX:
+				memcpy(data[c] + chunk, tmp[c],
+				       count * sizeof(float));
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <media-io/audio-io.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum rematrix_output_type {
+	/* output is silent */
+	REMATRIX_OUTPUT_ZERO,
+	/* output is its own input unchanged, nothing to do */
+	REMATRIX_OUTPUT_PASSTHROUGH,
+	/* output is its own input scaled, processed in place */
+	REMATRIX_OUTPUT_SCALE,
+	/* anything else, mixed through a temporary buffer */
+	REMATRIX_OUTPUT_MIX,
+};
+
+struct rematrix_route {
+	uint32_t src;
+	float gain;
+};
+
+/* the non-zero entries of the routing matrix per output channel, with the
+ * output gain and normalization already folded into each route's gain */
+struct rematrix_table {
+	size_t channels;
+	enum rematrix_output_type type[MAX_AV_PLANES];
+	size_t num_routes[MAX_AV_PLANES];
+	struct rematrix_route routes[MAX_AV_PLANES][MAX_AV_PLANES];
+};
+
+extern void rematrix_table_build(struct rematrix_table *table,
+				 size_t channels,
+				 const float mix[MAX_AV_PLANES][MAX_AV_PLANES],
+				 const double gain[MAX_AV_PLANES]);
+
+/* processes frames in chunks of up to tmp_frames, tmp needs a buffer for
+ * every channel */
+extern void rematrix_table_process(const struct rematrix_table *table,
+				   float **data, float **tmp, size_t tmp_frames,
+				   size_t frames);
+
+#ifdef __cplusplus
+}
+#endif
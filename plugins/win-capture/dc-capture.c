@@ -188,6 +188,12 @@ void dc_capture_capture(struct dc_capture *capture, HWND window)
 	capture->texture_written = true;
 }
 
+/* the captured bitmap is drawn without blending over its whole area */
+bool dc_capture_opaque(const struct dc_capture *capture)
+{
+	return capture->valid && capture->texture_written;
+}
+
 void dc_capture_render(struct dc_capture *capture, bool texcoords_centered)
 {
 	if (capture->valid && capture->texture_written) {
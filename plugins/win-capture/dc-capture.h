@@ -34,3 +34,4 @@ extern void dc_capture_free(struct dc_capture *capture);
 extern void dc_capture_capture(struct dc_capture *capture, HWND window);
 extern void dc_capture_render(struct dc_capture *capture,
 			      bool texcoords_centered);
+extern bool dc_capture_opaque(const struct dc_capture *capture);
@@ -464,6 +464,16 @@ static void duplicator_capture_tick(void *data, float seconds)
 	UNUSED_PARAMETER(seconds);
 }
 
+/* the desktop duplicator texture is drawn without blending, while the
+ * opacity of WGC captures isn't known */
+static bool duplicator_capture_is_opaque(void *data)
+{
+	struct duplicator_capture *capture = data;
+
+	return capture->method != METHOD_WGC && capture->duplicator &&
+	       gs_duplicator_get_texture(capture->duplicator);
+}
+
 static uint32_t duplicator_capture_width(void *data)
 {
 	struct duplicator_capture *capture = data;
@@ -747,6 +757,7 @@ struct obs_source_info duplicator_capture_info = {
 	.create = duplicator_capture_create,
 	.destroy = duplicator_capture_destroy,
 	.video_render = duplicator_capture_render,
+	.is_opaque = duplicator_capture_is_opaque,
 	.video_tick = duplicator_capture_tick,
 	.update = duplicator_capture_update,
 	.get_width = duplicator_capture_width,
@@ -2190,6 +2190,13 @@ static void game_capture_render(void *data, gs_effect_t *unused)
 	}
 }
 
+/* transparency is only kept when the user allows it */
+static bool game_capture_is_opaque(void *data)
+{
+	struct game_capture *gc = data;
+	return gc->texture && gc->active && !gc->config.allow_transparency;
+}
+
 static uint32_t game_capture_width(void *data)
 {
 	struct game_capture *gc = data;
@@ -2478,6 +2485,7 @@ struct obs_source_info game_capture_info = {
 	.update = game_capture_update,
 	.video_tick = game_capture_tick,
 	.video_render = game_capture_render,
+	.is_opaque = game_capture_is_opaque,
 	.icon_type = OBS_ICON_TYPE_GAME_CAPTURE,
 	.video_get_color_space = game_capture_get_color_space,
 };
@@ -157,6 +157,12 @@ static void monitor_capture_render(void *data, gs_effect_t *effect)
 	UNUSED_PARAMETER(effect);
 }
 
+static bool monitor_capture_is_opaque(void *data)
+{
+	struct monitor_capture *capture = data;
+	return dc_capture_opaque(&capture->data);
+}
+
 static uint32_t monitor_capture_width(void *data)
 {
 	struct monitor_capture *capture = data;
@@ -237,6 +243,7 @@ struct obs_source_info monitor_capture_info = {
 	.create = monitor_capture_create,
 	.destroy = monitor_capture_destroy,
 	.video_render = monitor_capture_render,
+	.is_opaque = monitor_capture_is_opaque,
 	.video_tick = monitor_capture_tick,
 	.update = monitor_capture_update,
 	.get_width = monitor_capture_width,
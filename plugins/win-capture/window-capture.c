@@ -648,6 +648,13 @@ static void wc_render(void *data, gs_effect_t *effect)
 	UNUSED_PARAMETER(effect);
 }
 
+/* windows captured through WGC may have transparent areas */
+static bool wc_is_opaque(void *data)
+{
+	struct window_capture *wc = data;
+	return wc->method != METHOD_WGC && dc_capture_opaque(&wc->capture);
+}
+
 enum gs_color_space
 wc_get_color_space(void *data, size_t count,
 		   const enum gs_color_space *preferred_spaces)
@@ -682,6 +689,7 @@ struct obs_source_info window_capture_info = {
 	.destroy = wc_destroy,
 	.update = wc_update,
 	.video_render = wc_render,
+	.is_opaque = wc_is_opaque,
 	.hide = wc_hide,
 	.video_tick = wc_tick,
 	.get_width = wc_width,
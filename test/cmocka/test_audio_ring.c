@@ -0,0 +1,273 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <cmocka.h>
+
+#include <util/bmem.h>
+#include <media-io/audio-ring.h>
+
+#define CHANNELS 2
+#define BLOCK 1024
+
+/* sample values encode channel and position, so that the data of every
+ * message can be checked after the buffer has been replaced */
+static float sample(size_t ch, uint64_t pos)
+{
+	return (float)(ch * 10000000 + pos % 1000000);
+}
+
+static bool push(struct audio_ring *ring, uint64_t pos, uint32_t frames)
+{
+	float *planes[CHANNELS];
+	const uint8_t *data[CHANNELS];
+	bool success;
+
+	for (size_t ch = 0; ch < CHANNELS; ch++) {
+		planes[ch] = bmalloc(frames * sizeof(float));
+		for (uint32_t i = 0; i < frames; i++)
+			planes[ch][i] = sample(ch, pos + i);
+		data[ch] = (const uint8_t *)planes[ch];
+	}
+
+	success = audio_ring_push_data(ring, data, CHANNELS, frames, pos,
+				       false);
+
+	for (size_t ch = 0; ch < CHANNELS; ch++)
+		bfree(planes[ch]);
+	return success;
+}
+
+static void check_msg(struct audio_ring *ring,
+		      const struct audio_ring_msg *msg)
+{
+	assert_int_equal(msg->type, AUDIO_RING_DATA);
+	assert_int_equal(msg->channels, CHANNELS);
+
+	for (size_t ch = 0; ch < CHANNELS; ch++) {
+		const float *plane = audio_ring_plane(ring, msg, ch);
+		for (uint32_t i = 0; i < msg->frames; i++)
+			assert_true(plane[i] == sample(ch, msg->timestamp + i));
+	}
+}
+
+/* pops data messages up to the next reset, returns the position after the
+ * last one */
+static uint64_t drain(struct audio_ring *ring, uint64_t pos)
+{
+	const struct audio_ring_msg *msg;
+
+	while ((msg = audio_ring_peek(ring)) != NULL) {
+		if (msg->type == AUDIO_RING_RESET)
+			break;
+
+		check_msg(ring, msg);
+		assert_int_equal(msg->timestamp, pos);
+		pos += msg->frames;
+		audio_ring_pop(ring);
+	}
+
+	return pos;
+}
+
+/* a burst of several times the initial size is queued instead of dropped */
+static void grows_for_bursts(void **state)
+{
+	struct audio_ring *ring = bzalloc(sizeof(*ring));
+	uint64_t pos = 0;
+	uint64_t read;
+
+	UNUSED_PARAMETER(state);
+
+	assert_true(push(ring, pos, BLOCK));
+	pos += BLOCK;
+
+	while (pos < 4 * AUDIO_RING_FRAMES) {
+		assert_true(push(ring, pos, BLOCK + 7));
+		pos += BLOCK + 7;
+	}
+	assert_int_equal(ring->dropped, 0);
+
+	/* consume part of it, then keep writing across the buffer switch */
+	read = 0;
+	for (size_t i = 0; i < 8; i++) {
+		const struct audio_ring_msg *msg = audio_ring_peek(ring);
+		check_msg(ring, msg);
+		read += msg->frames;
+		audio_ring_pop(ring);
+	}
+
+	for (size_t i = 0; i < 100; i++) {
+		assert_true(push(ring, pos, 333));
+		pos += 333;
+		read = drain(ring, read);
+	}
+
+	assert_int_equal(read, pos);
+	assert_int_equal(ring->dropped, 0);
+
+	audio_ring_free(ring);
+	bfree(ring);
+}
+
+/* data beyond the limit is dropped and counted, nothing else */
+static void drops_at_limit(void **state)
+{
+	struct audio_ring *ring = bzalloc(sizeof(*ring));
+	uint64_t pos = 0;
+
+	UNUSED_PARAMETER(state);
+
+	while (push(ring, pos, 8 * BLOCK))
+		pos += 8 * BLOCK;
+
+	assert_true(pos >= AUDIO_RING_MAX_FRAMES / 2);
+	assert_int_equal(ring->dropped, 1);
+	assert_int_equal(drain(ring, 0), pos);
+
+	audio_ring_free(ring);
+	bfree(ring);
+}
+
+/* a reset gets through even when every message slot is taken */
+static void reset_when_full(void **state)
+{
+	struct audio_ring *ring = bzalloc(sizeof(*ring));
+	const struct audio_ring_msg *msg;
+	uint64_t pos = 0;
+
+	UNUSED_PARAMETER(state);
+
+	while (push(ring, pos, 16))
+		pos += 16;
+	assert_int_equal(pos, AUDIO_RING_MESSAGES * 16);
+
+	audio_ring_push_reset(ring, 0x123456789ULL);
+
+	/* the queued data comes first, then the reset */
+	assert_int_equal(drain(ring, 0), pos);
+
+	msg = audio_ring_peek(ring);
+	assert_non_null(msg);
+	assert_int_equal(msg->type, AUDIO_RING_RESET);
+	assert_int_equal(msg->timestamp, 0x123456789ULL);
+
+	/* peeking again returns the same reset until it is popped */
+	assert_ptr_equal(audio_ring_peek(ring), msg);
+	audio_ring_pop(ring);
+	assert_null(audio_ring_peek(ring));
+
+	audio_ring_free(ring);
+	bfree(ring);
+}
+
+/* only the latest reset is delivered, after the data queued before it */
+static void latest_reset_wins(void **state)
+{
+	struct audio_ring *ring = bzalloc(sizeof(*ring));
+	const struct audio_ring_msg *msg;
+
+	UNUSED_PARAMETER(state);
+
+	assert_true(push(ring, 0, BLOCK));
+	audio_ring_push_reset(ring, 1);
+	assert_true(push(ring, BLOCK, BLOCK));
+	audio_ring_push_reset(ring, 2);
+	assert_true(push(ring, 5000, BLOCK));
+
+	assert_int_equal(drain(ring, 0), 2 * BLOCK);
+
+	msg = audio_ring_peek(ring);
+	assert_int_equal(msg->type, AUDIO_RING_RESET);
+	assert_int_equal(msg->timestamp, 2);
+	audio_ring_pop(ring);
+
+	assert_int_equal(drain(ring, 5000), 5000 + BLOCK);
+
+	/* a reset on an empty queue is delivered right away, and only once */
+	audio_ring_push_reset(ring, 3);
+	msg = audio_ring_peek(ring);
+	assert_int_equal(msg->type, AUDIO_RING_RESET);
+	assert_int_equal(msg->timestamp, 3);
+	audio_ring_pop(ring);
+	assert_null(audio_ring_peek(ring));
+
+	audio_ring_free(ring);
+	bfree(ring);
+}
+
+/* a reset and a message pushed while the consumer is between peeks */
+static void reset_between_peeks(void **state)
+{
+	struct audio_ring *ring = bzalloc(sizeof(*ring));
+	const struct audio_ring_msg *msg;
+
+	UNUSED_PARAMETER(state);
+
+	assert_true(push(ring, 0, BLOCK));
+	msg = audio_ring_peek(ring);
+	assert_int_equal(msg->type, AUDIO_RING_DATA);
+
+	audio_ring_push_reset(ring, 1);
+	assert_true(push(ring, 5000, BLOCK));
+	audio_ring_pop(ring);
+
+	msg = audio_ring_peek(ring);
+	assert_int_equal(msg->type, AUDIO_RING_RESET);
+	assert_int_equal(msg->timestamp, 1);
+	audio_ring_pop(ring);
+	assert_int_equal(drain(ring, 5000), 5000 + BLOCK);
+
+	/* the producer can publish a reset for the position of the message
+	 * that the consumer is about to return, after the consumer has
+	 * checked for resets.  the reset is then still due after the message
+	 * has been popped */
+	assert_true(push(ring, 7000, BLOCK));
+	msg = audio_ring_peek(ring);
+	assert_int_equal(msg->type, AUDIO_RING_DATA);
+	audio_ring_push_reset(ring, 2);
+	ring->reset_pos = ring->msg_tail;
+	audio_ring_pop(ring);
+
+	msg = audio_ring_peek(ring);
+	assert_non_null(msg);
+	assert_int_equal(msg->type, AUDIO_RING_RESET);
+	assert_int_equal(msg->timestamp, 2);
+	audio_ring_pop(ring);
+	assert_null(audio_ring_peek(ring));
+
+	audio_ring_free(ring);
+	bfree(ring);
+}
+
+/* buffers replaced while their data is still queued are freed with the
+ * ring */
+static void free_with_queued_buffers(void **state)
+{
+	struct audio_ring *ring = bzalloc(sizeof(*ring));
+	uint64_t pos = 0;
+
+	UNUSED_PARAMETER(state);
+
+	for (uint32_t frames = BLOCK; frames <= 64 * BLOCK; frames *= 2) {
+		assert_true(push(ring, pos, frames));
+		pos += frames;
+	}
+
+	audio_ring_free(ring);
+	bfree(ring);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(grows_for_bursts),
+		cmocka_unit_test(drops_at_limit),
+		cmocka_unit_test(reset_when_full),
+		cmocka_unit_test(latest_reset_wins),
+		cmocka_unit_test(reset_between_peeks),
+		cmocka_unit_test(free_with_queued_buffers),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
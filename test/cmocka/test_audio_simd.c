@@ -0,0 +1,293 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <math.h>
+#include <cmocka.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <media-io/audio-simd.h>
+
+#define FRAMES 1024
+#define CHANNELS 24
+#define BENCH_ITERATIONS 2000
+
+/* odd counts and offsets exercise the unaligned heads and scalar tails */
+static const size_t counts[] = {0, 1, 3, 4, 5, 7, 8, 9, 15, 17, 1000, 1021};
+static const size_t offsets[] = {0, 1, 3};
+
+static float rand_sample(void)
+{
+	return ((float)rand() / (float)RAND_MAX) * 4.0f - 2.0f;
+}
+
+static void fill_random(float *data, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		data[i] = rand_sample();
+}
+
+struct buffers {
+	float src[FRAMES + 8];
+	float gain[FRAMES + 8];
+	float ref[FRAMES + 8];
+	float out[FRAMES + 8];
+};
+
+static void check_kernels(const struct audio_simd_funcs *funcs)
+{
+	const struct audio_simd_funcs *ref =
+		audio_simd_get_funcs(AUDIO_SIMD_SCALAR);
+	struct buffers *b = bzalloc(sizeof(*b));
+	size_t size = sizeof(b->ref);
+
+	for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+		for (size_t o = 0; o < sizeof(offsets) / sizeof(offsets[0]);
+		     o++) {
+			size_t count = counts[c];
+			size_t off = offsets[o];
+			float gain = rand_sample();
+
+			fill_random(b->src, FRAMES + 8);
+			fill_random(b->gain, FRAMES + 8);
+			fill_random(b->ref, FRAMES + 8);
+			b->ref[off] = NAN;
+			memcpy(b->out, b->ref, size);
+
+			ref->mix(b->ref + off, b->src + off, gain, count);
+			funcs->mix(b->out + off, b->src + off, gain, count);
+			assert_memory_equal(b->ref, b->out, size);
+
+			ref->mix_buf(b->ref + off, b->src, b->gain + off,
+				     count);
+			funcs->mix_buf(b->out + off, b->src, b->gain + off,
+				       count);
+			assert_memory_equal(b->ref, b->out, size);
+
+			ref->gain(b->ref + off, gain, count);
+			funcs->gain(b->out + off, gain, count);
+			assert_memory_equal(b->ref, b->out, size);
+
+			ref->gain_buf(b->ref + off, b->gain, count);
+			funcs->gain_buf(b->out + off, b->gain, count);
+			assert_memory_equal(b->ref, b->out, size);
+
+			ref->clamp(b->ref + off, count);
+			funcs->clamp(b->out + off, count);
+			assert_memory_equal(b->ref, b->out, size);
+
+			ref->copy_scaled(b->ref + off, b->src, gain, count);
+			funcs->copy_scaled(b->out + off, b->src, gain, count);
+			assert_memory_equal(b->ref, b->out, size);
+		}
+	}
+
+	bfree(b);
+}
+
+/* a few downmixed outputs, one silent output, one NULL input */
+static void fill_matrix(float *matrix)
+{
+	memset(matrix, 0, sizeof(float) * CHANNELS * CHANNELS);
+
+	for (size_t out = 0; out < CHANNELS - 1; out++) {
+		matrix[out * CHANNELS + out] = 0.5f;
+		matrix[out * CHANNELS + (out + 3) % CHANNELS] = 0.25f;
+		matrix[out * CHANNELS + (out + 7) % CHANNELS] = -0.125f;
+	}
+}
+
+struct planes {
+	float src_data[CHANNELS * (FRAMES + 8)];
+	float ref_data[CHANNELS * (FRAMES + 8)];
+	float out_data[CHANNELS * (FRAMES + 8)];
+	float matrix[CHANNELS * CHANNELS];
+	const float *src[CHANNELS];
+	float *ref[CHANNELS];
+	float *out[CHANNELS];
+};
+
+static void check_matrix_mix(const struct audio_simd_funcs *funcs)
+{
+	const struct audio_simd_funcs *ref =
+		audio_simd_get_funcs(AUDIO_SIMD_SCALAR);
+	struct planes *p = bzalloc(sizeof(*p));
+	size_t size = sizeof(p->ref_data);
+
+	fill_matrix(p->matrix);
+
+	for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+		for (size_t o = 0; o < sizeof(offsets) / sizeof(offsets[0]);
+		     o++) {
+			size_t count = counts[c];
+			size_t off = offsets[o];
+
+			fill_random(p->src_data, CHANNELS * (FRAMES + 8));
+			fill_random(p->ref_data, CHANNELS * (FRAMES + 8));
+			memcpy(p->out_data, p->ref_data, size);
+
+			for (size_t ch = 0; ch < CHANNELS; ch++) {
+				size_t plane = ch * (FRAMES + 8) + off;
+				p->src[ch] = p->src_data + plane;
+				p->ref[ch] = p->ref_data + plane;
+				p->out[ch] = p->out_data + plane;
+			}
+			p->src[5] = NULL;
+			p->ref[9] = p->out[9] = NULL;
+
+			ref->matrix_mix(p->ref, CHANNELS, p->src, CHANNELS,
+					p->matrix, count);
+			funcs->matrix_mix(p->out, CHANNELS, p->src, CHANNELS,
+					  p->matrix, count);
+			assert_memory_equal(p->ref_data, p->out_data, size);
+		}
+	}
+
+	bfree(p);
+}
+
+static void kernels_match_scalar_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	for (int level = AUDIO_SIMD_SSE2; level <= AUDIO_SIMD_AVX2; level++) {
+		const struct audio_simd_funcs *funcs =
+			audio_simd_get_funcs((enum audio_simd_level)level);
+		if (!funcs) {
+			print_message("%s not supported, skipped\n",
+				      audio_simd_level_name(level));
+			continue;
+		}
+
+		check_kernels(funcs);
+		check_matrix_mix(funcs);
+	}
+}
+
+static void matrix_mix_test(void **state)
+{
+	float *src_data = bzalloc(sizeof(float) * FRAMES * CHANNELS);
+	float *dst_data = bzalloc(sizeof(float) * FRAMES * CHANNELS);
+	float matrix[CHANNELS * CHANNELS];
+	const float *src[CHANNELS];
+	float *dst[CHANNELS];
+
+	UNUSED_PARAMETER(state);
+
+	for (size_t ch = 0; ch < CHANNELS; ch++) {
+		src[ch] = src_data + ch * FRAMES;
+		dst[ch] = dst_data + ch * FRAMES;
+	}
+
+	fill_random(src_data, FRAMES * CHANNELS);
+	fill_random(dst_data, FRAMES * CHANNELS);
+	fill_matrix(matrix);
+	src[5] = NULL;
+
+	audio_simd_matrix_mix(dst, CHANNELS, src, CHANNELS, matrix, FRAMES);
+
+	for (size_t out = 0; out < CHANNELS; out++) {
+		for (size_t i = 0; i < FRAMES; i++) {
+			float expected = 0.0f;
+
+			for (size_t in = 0; in < CHANNELS; in++) {
+				if (src[in])
+					expected += src[in][i] *
+						    matrix[out * CHANNELS + in];
+			}
+
+			assert_true(fabsf(dst[out][i] - expected) <= 1e-6f);
+		}
+	}
+
+	bfree(src_data);
+	bfree(dst_data);
+}
+
+/* not a pass/fail test, prints the cost of each kernel per level.  unity
+ * gains keep the repeatedly processed data away from denormals/infinity */
+static void kernels_benchmark(void **state)
+{
+	float *a = bzalloc(sizeof(float) * FRAMES);
+	float *b = bzalloc(sizeof(float) * FRAMES);
+	float *g = bzalloc(sizeof(float) * FRAMES);
+	float *planes = bzalloc(sizeof(float) * FRAMES * CHANNELS);
+	float matrix[CHANNELS * CHANNELS];
+	const float *src[CHANNELS];
+	float *dst[2] = {a, b};
+
+	UNUSED_PARAMETER(state);
+
+	/* a 24 channel downmix to stereo */
+	for (size_t ch = 0; ch < CHANNELS; ch++) {
+		src[ch] = planes + ch * FRAMES;
+		matrix[ch] = ch % 2 ? 0.0f : 1.0f / CHANNELS;
+		matrix[CHANNELS + ch] = ch % 2 ? 1.0f / CHANNELS : 0.0f;
+	}
+	fill_random(planes, FRAMES * CHANNELS);
+
+	fill_random(a, FRAMES);
+	fill_random(b, FRAMES);
+	for (size_t i = 0; i < FRAMES; i++)
+		g[i] = 1.0f;
+
+	print_message("audio SIMD level in use: %s\n",
+		      audio_simd_level_name(audio_simd_get_level()));
+
+	for (int level = AUDIO_SIMD_SCALAR; level <= AUDIO_SIMD_AVX2;
+	     level++) {
+		const struct audio_simd_funcs *funcs =
+			audio_simd_get_funcs((enum audio_simd_level)level);
+		uint64_t times[7];
+		uint64_t start;
+
+		if (!funcs)
+			continue;
+
+#define BENCH(idx, call)                                      \
+	start = os_gettime_ns();                              \
+	for (int i = 0; i < BENCH_ITERATIONS; i++)            \
+		call;                                         \
+	times[idx] = (os_gettime_ns() - start) / BENCH_ITERATIONS
+
+		BENCH(0, funcs->mix(a, b, 0.5f, FRAMES));
+		BENCH(1, funcs->mix_buf(a, b, g, FRAMES));
+		BENCH(2, funcs->gain(a, 1.0f, FRAMES));
+		BENCH(3, funcs->gain_buf(a, g, FRAMES));
+		BENCH(4, funcs->copy_scaled(a, b, 0.5f, FRAMES));
+		BENCH(5, funcs->clamp(a, FRAMES));
+		BENCH(6, funcs->matrix_mix(dst, 2, src, CHANNELS, matrix,
+					   FRAMES));
+#undef BENCH
+
+		print_message("%-12s mix %4llu  mix_buf %4llu  gain %4llu  "
+			      "gain_buf %4llu  copy_scaled %4llu  "
+			      "clamp %4llu  matrix_mix %4llu  "
+			      "(ns per %d frames)\n",
+			      audio_simd_level_name(level),
+			      (unsigned long long)times[0],
+			      (unsigned long long)times[1],
+			      (unsigned long long)times[2],
+			      (unsigned long long)times[3],
+			      (unsigned long long)times[4],
+			      (unsigned long long)times[5],
+			      (unsigned long long)times[6], FRAMES);
+	}
+
+	bfree(a);
+	bfree(b);
+	bfree(g);
+	bfree(planes);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(kernels_match_scalar_test),
+		cmocka_unit_test(matrix_mix_test),
+		cmocka_unit_test(kernels_benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,425 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <cmocka.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <media-io/format-conversion.h>
+#include <media-io/video-frame.h>
+#include <media-io/video-scaler.h>
+
+#define CHECK_WIDTH 640
+#define CHECK_HEIGHT 360
+#define BENCH_WIDTH 1920
+#define BENCH_HEIGHT 1080
+#define BENCH_FRAMES 30
+
+struct conversion {
+	const char *name;
+	enum video_format src;
+	enum video_format dst;
+	/* largest difference to swscale allowed on smooth content, in output
+	 * sample values */
+	uint32_t tolerance;
+};
+
+static const struct conversion conversions[] = {
+	{"BGRA->NV12", VIDEO_FORMAT_BGRA, VIDEO_FORMAT_NV12, 3},
+	{"RGBA->NV12", VIDEO_FORMAT_RGBA, VIDEO_FORMAT_NV12, 3},
+	{"YUY2->NV12", VIDEO_FORMAT_YUY2, VIDEO_FORMAT_NV12, 2},
+	{"NV12->YUY2", VIDEO_FORMAT_NV12, VIDEO_FORMAT_YUY2, 2},
+	{"I010->P010", VIDEO_FORMAT_I010, VIDEO_FORMAT_P010, 2},
+	{"P010->I010", VIDEO_FORMAT_P010, VIDEO_FORMAT_I010, 2},
+	{"I422->NV12", VIDEO_FORMAT_I422, VIDEO_FORMAT_NV12, 2},
+};
+
+/* even widths around every vector width exercise the scalar tails */
+static const uint32_t widths[] = {2,  4,  6,  14, 16,  18,  30,  32,
+				  34, 62, 64, 66, 126, 130, 642, 1282};
+
+#define NUM_CONVERSIONS (sizeof(conversions) / sizeof(conversions[0]))
+#define NUM_WIDTHS (sizeof(widths) / sizeof(widths[0]))
+
+static format_conversion_func
+get_kernel(const struct format_conversion_funcs *funcs,
+	   const struct conversion *conv)
+{
+	switch (conv->src) {
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_RGBA:
+		return funcs->rgbx_to_nv12;
+	case VIDEO_FORMAT_YUY2:
+		return funcs->yuy2_to_nv12;
+	case VIDEO_FORMAT_NV12:
+		return funcs->nv12_to_yuy2;
+	case VIDEO_FORMAT_I010:
+		return funcs->i010_to_p010;
+	case VIDEO_FORMAT_P010:
+		return funcs->p010_to_i010;
+	default:
+		return funcs->i422_to_nv12;
+	}
+}
+
+/* bytes actually used per row, and rows of each plane */
+static bool get_plane(enum video_format format, uint32_t width,
+		      uint32_t height, size_t plane, uint32_t *bytes,
+		      uint32_t *rows)
+{
+	*rows = height;
+
+	switch (format) {
+	case VIDEO_FORMAT_BGRA:
+	case VIDEO_FORMAT_RGBA:
+		*bytes = width * 4;
+		return plane == 0;
+	case VIDEO_FORMAT_YUY2:
+		*bytes = width * 2;
+		return plane == 0;
+	case VIDEO_FORMAT_NV12:
+		*bytes = width;
+		*rows = plane ? height / 2 : height;
+		return plane < 2;
+	case VIDEO_FORMAT_P010:
+		*bytes = width * 2;
+		*rows = plane ? height / 2 : height;
+		return plane < 2;
+	case VIDEO_FORMAT_I010:
+		*bytes = plane ? width : width * 2;
+		*rows = plane ? height / 2 : height;
+		return plane < 3;
+	case VIDEO_FORMAT_I422:
+		*bytes = plane ? width / 2 : width;
+		return plane < 3;
+	default:
+		return false;
+	}
+}
+
+static bool is_16bit(enum video_format format)
+{
+	return format == VIDEO_FORMAT_I010 || format == VIDEO_FORMAT_P010;
+}
+
+static void fill_random(struct video_frame *frame, enum video_format format,
+			uint32_t width, uint32_t height)
+{
+	uint32_t bytes, rows;
+
+	for (size_t plane = 0; get_plane(format, width, height, plane, &bytes,
+					 &rows);
+	     plane++) {
+		for (uint32_t i = 0; i < frame->linesize[plane] * rows; i++)
+			frame->data[plane][i] = (uint8_t)rand();
+	}
+}
+
+/* a diagonal ramp per plane, so every component changes by a sample value
+ * or less between neighbouring pixels */
+static void fill_smooth(struct video_frame *frame, enum video_format format,
+			uint32_t width, uint32_t height)
+{
+	uint32_t bytes, rows;
+
+	for (size_t plane = 0; get_plane(format, width, height, plane, &bytes,
+					 &rows);
+	     plane++) {
+		for (uint32_t y = 0; y < rows; y++) {
+			uint8_t *row = frame->data[plane] +
+				       (size_t)y * frame->linesize[plane];
+
+			if (!is_16bit(format)) {
+				for (uint32_t x = 0; x < bytes; x++)
+					row[x] = (uint8_t)((x + y) * 255 /
+							   (bytes + rows));
+				continue;
+			}
+
+			uint16_t *row16 = (uint16_t *)row;
+			uint32_t samples = bytes / 2;
+
+			for (uint32_t x = 0; x < samples; x++) {
+				uint32_t val = (x + y) * 1023 /
+					       (samples + rows);
+				if (format == VIDEO_FORMAT_P010)
+					val <<= 6;
+				row16[x] = (uint16_t)val;
+			}
+		}
+	}
+}
+
+static void clear_frame(struct video_frame *frame, enum video_format format,
+			uint32_t width, uint32_t height)
+{
+	uint32_t bytes, rows;
+
+	for (size_t plane = 0; get_plane(format, width, height, plane, &bytes,
+					 &rows);
+	     plane++)
+		memset(frame->data[plane], 0, frame->linesize[plane] * rows);
+}
+
+static uint32_t max_difference(const struct video_frame *a,
+			       const struct video_frame *b,
+			       enum video_format format, uint32_t width,
+			       uint32_t height)
+{
+	uint32_t bytes, rows;
+	uint32_t max_diff = 0;
+
+	for (size_t plane = 0; get_plane(format, width, height, plane, &bytes,
+					 &rows);
+	     plane++) {
+		for (uint32_t y = 0; y < rows; y++) {
+			const uint8_t *row_a =
+				a->data[plane] + (size_t)y * a->linesize[plane];
+			const uint8_t *row_b =
+				b->data[plane] + (size_t)y * b->linesize[plane];
+
+			for (uint32_t x = 0; x < bytes;) {
+				int32_t va, vb;
+
+				if (is_16bit(format)) {
+					va = *(const uint16_t *)(row_a + x);
+					vb = *(const uint16_t *)(row_b + x);
+					if (format == VIDEO_FORMAT_P010) {
+						va >>= 6;
+						vb >>= 6;
+					}
+					x += 2;
+				} else {
+					va = row_a[x];
+					vb = row_b[x];
+					x++;
+				}
+
+				uint32_t diff = (uint32_t)abs(va - vb);
+				if (diff > max_diff)
+					max_diff = diff;
+			}
+		}
+	}
+
+	return max_diff;
+}
+
+static void convert(format_conversion_func func,
+		    const struct format_conversion_matrix *matrix,
+		    const struct video_frame *in, struct video_frame *out,
+		    uint32_t width, uint32_t height)
+{
+	func((const uint8_t *const *)in->data, in->linesize, width, 0, height,
+	     out->data, out->linesize, matrix);
+}
+
+static void init_matrix(struct format_conversion_matrix *matrix,
+			const struct conversion *conv)
+{
+	memset(matrix, 0, sizeof(*matrix));
+	if (!format_is_yuv(conv->src))
+		assert_true(format_conversion_init_matrix(matrix, conv->src,
+							  VIDEO_CS_709,
+							  VIDEO_RANGE_PARTIAL));
+}
+
+static void check_kernels(const struct format_conversion_funcs *funcs)
+{
+	const struct format_conversion_funcs *ref =
+		format_conversion_get_funcs(FORMAT_CONVERSION_SCALAR);
+	const uint32_t height = 6;
+
+	for (size_t c = 0; c < NUM_CONVERSIONS; c++) {
+		const struct conversion *conv = &conversions[c];
+		struct format_conversion_matrix matrix;
+
+		init_matrix(&matrix, conv);
+
+		for (size_t w = 0; w < NUM_WIDTHS; w++) {
+			uint32_t width = widths[w];
+			struct video_frame *in =
+				video_frame_create(conv->src, width, height);
+			struct video_frame *expected =
+				video_frame_create(conv->dst, width, height);
+			struct video_frame *out =
+				video_frame_create(conv->dst, width, height);
+
+			fill_random(in, conv->src, width, height);
+			clear_frame(expected, conv->dst, width, height);
+			clear_frame(out, conv->dst, width, height);
+
+			convert(get_kernel(ref, conv), &matrix, in, expected,
+				width, height);
+			convert(get_kernel(funcs, conv), &matrix, in, out,
+				width, height);
+
+			if (max_difference(expected, out, conv->dst, width,
+					   height) != 0)
+				fail_msg("%s differs from scalar at width %u",
+					 conv->name, width);
+
+			video_frame_destroy(in);
+			video_frame_destroy(expected);
+			video_frame_destroy(out);
+		}
+	}
+}
+
+static void kernels_match_scalar_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	for (int level = FORMAT_CONVERSION_SSE2;
+	     level <= FORMAT_CONVERSION_AVX2; level++) {
+		const struct format_conversion_funcs *funcs =
+			format_conversion_get_funcs(
+				(enum format_conversion_level)level);
+		if (!funcs) {
+			print_message("%s not supported, skipped\n",
+				      format_conversion_level_name(level));
+			continue;
+		}
+
+		check_kernels(funcs);
+	}
+}
+
+static video_scaler_t *create_scaler(const struct conversion *conv,
+				     uint32_t width, uint32_t height)
+{
+	struct video_scale_info src = {.format = conv->src,
+				       .width = width,
+				       .height = height,
+				       .range = VIDEO_RANGE_PARTIAL,
+				       .colorspace = VIDEO_CS_709};
+	struct video_scale_info dst = {.format = conv->dst,
+				       .width = width,
+				       .height = height,
+				       .range = VIDEO_RANGE_PARTIAL,
+				       .colorspace = VIDEO_CS_709};
+	video_scaler_t *scaler = NULL;
+
+	int ret = video_scaler_create(&scaler, &dst, &src,
+				      VIDEO_SCALE_FAST_BILINEAR);
+	assert_int_equal(ret, VIDEO_SCALER_SUCCESS);
+	return scaler;
+}
+
+/* chroma siting and rounding differ slightly from swscale, so only small
+ * differences are allowed */
+static void matches_swscale_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	for (size_t c = 0; c < NUM_CONVERSIONS; c++) {
+		const struct conversion *conv = &conversions[c];
+		struct format_conversion_matrix matrix;
+		struct video_frame *in = video_frame_create(
+			conv->src, CHECK_WIDTH, CHECK_HEIGHT);
+		struct video_frame *expected = video_frame_create(
+			conv->dst, CHECK_WIDTH, CHECK_HEIGHT);
+		struct video_frame *out = video_frame_create(
+			conv->dst, CHECK_WIDTH, CHECK_HEIGHT);
+		video_scaler_t *scaler =
+			create_scaler(conv, CHECK_WIDTH, CHECK_HEIGHT);
+		format_conversion_func func =
+			format_conversion_find(conv->src, conv->dst);
+
+		assert_non_null(func);
+		init_matrix(&matrix, conv);
+		fill_smooth(in, conv->src, CHECK_WIDTH, CHECK_HEIGHT);
+
+		assert_true(video_scaler_scale(
+			scaler, expected->data, expected->linesize,
+			(const uint8_t *const *)in->data, in->linesize));
+		convert(func, &matrix, in, out, CHECK_WIDTH, CHECK_HEIGHT);
+
+		uint32_t diff = max_difference(expected, out, conv->dst,
+					       CHECK_WIDTH, CHECK_HEIGHT);
+		if (diff > conv->tolerance)
+			fail_msg("%s differs from swscale by %u", conv->name,
+				 diff);
+
+		video_scaler_destroy(scaler);
+		video_frame_destroy(in);
+		video_frame_destroy(expected);
+		video_frame_destroy(out);
+	}
+}
+
+/* not a pass/fail test, prints the cost of each conversion per level next to
+ * the cost of the same conversion through swscale */
+static void conversion_benchmark(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	print_message("format conversion level in use: %s\n",
+		      format_conversion_level_name(
+			      format_conversion_get_level()));
+
+	for (size_t c = 0; c < NUM_CONVERSIONS; c++) {
+		const struct conversion *conv = &conversions[c];
+		struct format_conversion_matrix matrix;
+		struct video_frame *in = video_frame_create(
+			conv->src, BENCH_WIDTH, BENCH_HEIGHT);
+		struct video_frame *out = video_frame_create(
+			conv->dst, BENCH_WIDTH, BENCH_HEIGHT);
+		video_scaler_t *scaler =
+			create_scaler(conv, BENCH_WIDTH, BENCH_HEIGHT);
+		double times[FORMAT_CONVERSION_AVX2 + 2] = {0};
+		uint64_t start;
+
+		init_matrix(&matrix, conv);
+		fill_smooth(in, conv->src, BENCH_WIDTH, BENCH_HEIGHT);
+
+		for (int level = FORMAT_CONVERSION_SCALAR;
+		     level <= FORMAT_CONVERSION_AVX2; level++) {
+			const struct format_conversion_funcs *funcs =
+				format_conversion_get_funcs(
+					(enum format_conversion_level)level);
+			if (!funcs)
+				continue;
+
+			format_conversion_func func = get_kernel(funcs, conv);
+
+			start = os_gettime_ns();
+			for (int i = 0; i < BENCH_FRAMES; i++)
+				convert(func, &matrix, in, out, BENCH_WIDTH,
+					BENCH_HEIGHT);
+			times[level] = (double)(os_gettime_ns() - start) /
+				       BENCH_FRAMES / 1000000.0;
+		}
+
+		start = os_gettime_ns();
+		for (int i = 0; i < BENCH_FRAMES; i++)
+			video_scaler_scale(scaler, out->data, out->linesize,
+					   (const uint8_t *const *)in->data,
+					   in->linesize);
+		times[FORMAT_CONVERSION_AVX2 + 1] =
+			(double)(os_gettime_ns() - start) / BENCH_FRAMES /
+			1000000.0;
+
+		print_message("%-12s scalar %6.2f  SSE2 %6.2f  AVX2 %6.2f  "
+			      "swscale %6.2f  (ms per %dx%d frame, 0 = "
+			      "unsupported)\n",
+			      conv->name, times[0], times[1], times[2],
+			      times[3], BENCH_WIDTH, BENCH_HEIGHT);
+
+		video_scaler_destroy(scaler);
+		video_frame_destroy(in);
+		video_frame_destroy(out);
+	}
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(kernels_match_scalar_test),
+		cmocka_unit_test(matches_swscale_test),
+		cmocka_unit_test(conversion_benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,196 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <util/bmem.h>
+#include "gl-subsystem.h"
+
+/* uploads to dynamic textures through the unpack buffer ring, read back
+ * after every frame.  runs on any EGL device that provides GL 3.3, such as
+ * Mesa's llvmpipe, and is skipped without one */
+
+#define WIDTH 640
+#define HEIGHT 360
+#define FRAMES 50
+
+/* the rest of the device isn't built into the test, and the textures
+ * uploaded here never use samplers or framebuffers */
+void gs_samplerstate_destroy(gs_samplerstate_t *samplerstate)
+{
+	UNUSED_PARAMETER(samplerstate);
+}
+
+struct fbo_info *get_fbo(gs_texture_t *tex, uint32_t width, uint32_t height)
+{
+	UNUSED_PARAMETER(tex);
+	UNUSED_PARAMETER(width);
+	UNUSED_PARAMETER(height);
+	return NULL;
+}
+
+struct gl_context {
+	EGLDisplay display;
+	EGLContext context;
+};
+
+/* no window is needed, so a surfaceless display works even without a
+ * display server */
+static EGLDisplay get_display(void)
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC eglGetPlatformDisplayEXT =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress(
+			"eglGetPlatformDisplayEXT");
+	EGLDisplay display = EGL_NO_DISPLAY;
+
+	if (eglGetPlatformDisplayEXT)
+		display = eglGetPlatformDisplayEXT(
+			EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY,
+			NULL);
+	if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		if (display != EGL_NO_DISPLAY &&
+		    !eglInitialize(display, NULL, NULL))
+			display = EGL_NO_DISPLAY;
+	}
+
+	return display;
+}
+
+static int setup(void **state)
+{
+	static const EGLint attribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION,
+		3,
+		EGL_CONTEXT_MINOR_VERSION,
+		3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK,
+		EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE,
+	};
+	struct gl_context *gl = bzalloc(sizeof(*gl));
+
+	*state = gl;
+
+	gl->display = get_display();
+	if (gl->display == EGL_NO_DISPLAY || !eglBindAPI(EGL_OPENGL_API))
+		return 0;
+
+	gl->context = eglCreateContext(gl->display, NULL, EGL_NO_CONTEXT,
+				       attribs);
+	if (gl->context == EGL_NO_CONTEXT)
+		return 0;
+
+	if (!eglMakeCurrent(gl->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+			    gl->context) ||
+	    !gladLoadGL()) {
+		eglDestroyContext(gl->display, gl->context);
+		gl->context = EGL_NO_CONTEXT;
+	}
+
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	struct gl_context *gl = *state;
+
+	if (gl->context != EGL_NO_CONTEXT) {
+		eglMakeCurrent(gl->display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+			       EGL_NO_CONTEXT);
+		eglDestroyContext(gl->display, gl->context);
+	}
+	if (gl->display != EGL_NO_DISPLAY)
+		eglTerminate(gl->display);
+
+	bfree(gl);
+	return 0;
+}
+
+static void upload_round_trip(void **state, bool persistent)
+{
+	struct gl_context *gl = *state;
+	struct gs_device device = {0};
+	struct gs_texture_2d *tex2d;
+	gs_texture_t *tex;
+	uint32_t *image;
+	uint32_t *readback;
+	bool used[NUM_UNPACK_BUFFERS] = {0};
+
+	if (gl->context == EGL_NO_CONTEXT)
+		skip();
+
+	if (persistent && !GLAD_GL_VERSION_4_4 && !GLAD_GL_ARB_buffer_storage)
+		skip();
+
+	device.persistent_mapping = persistent;
+
+	tex = device_texture_create(&device, WIDTH, HEIGHT, GS_BGRA, 1, NULL,
+				    GS_DYNAMIC);
+	assert_non_null(tex);
+	tex2d = (struct gs_texture_2d *)tex;
+
+	image = bmalloc(WIDTH * HEIGHT * 4);
+	readback = bmalloc(WIDTH * HEIGHT * 4);
+
+	for (uint32_t frame = 0; frame < FRAMES; frame++) {
+		uint8_t *ptr;
+		uint32_t linesize;
+
+		used[tex2d->cur_unpack] = true;
+
+		assert_true(gs_texture_map(tex, &ptr, &linesize));
+		assert_int_equal(linesize, WIDTH * 4);
+		assert_true(!persistent ||
+			    ptr == tex2d->unpack[tex2d->cur_unpack]
+					    .persistent_ptr);
+
+		for (size_t i = 0; i < WIDTH * HEIGHT; i++)
+			image[i] = frame * 1000003u + (uint32_t)i;
+		memcpy(ptr, image, WIDTH * HEIGHT * 4);
+
+		gs_texture_unmap(tex);
+
+		glBindTexture(GL_TEXTURE_2D, tex2d->base.texture);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_BGRA, GL_UNSIGNED_BYTE,
+			      readback);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		assert_memory_equal(image, readback, WIDTH * HEIGHT * 4);
+	}
+
+	/* every buffer of the ring has been written to */
+	for (size_t i = 0; i < NUM_UNPACK_BUFFERS; i++)
+		assert_true(used[i]);
+
+	gs_texture_destroy(tex);
+	assert_int_equal(glGetError(), GL_NO_ERROR);
+
+	bfree(image);
+	bfree(readback);
+}
+
+static void map_range_upload(void **state)
+{
+	upload_round_trip(state, false);
+}
+
+static void persistent_upload(void **state)
+{
+	upload_round_trip(state, true);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(map_range_upload),
+		cmocka_unit_test(persistent_upload),
+	};
+
+	return cmocka_run_group_tests(tests, setup, teardown);
+}
@@ -0,0 +1,300 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/darray.h>
+#include <util/platform.h>
+#include <obs-interleave.h>
+
+/* the output interleaver used to keep every packet in one sorted array, and
+ * the per-track queues are meant to be a drop-in replacement for it.  these
+ * tests feed both the same packets and check that they come back out in the
+ * same order, then time the two against each other. */
+
+#define PACKETS_PER_TRACK 2000
+#define BENCH_OPS 20000
+
+static uint32_t rand_state;
+
+static uint32_t next_rand(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+struct track_gen {
+	int64_t dts_usec;
+	int64_t step;
+	int64_t dts;
+};
+
+static void init_tracks(struct track_gen *gens, size_t tracks)
+{
+	for (size_t i = 0; i < tracks; i++) {
+		/* steps in multiples of 10ms give plenty of equal timestamps
+		 * across tracks */
+		gens[i].dts_usec = (int64_t)(next_rand() % 4) * 10000;
+		gens[i].step = (int64_t)(next_rand() % 3 + 1) * 10000;
+		gens[i].dts = 0;
+	}
+}
+
+static struct encoder_packet next_packet(struct track_gen *gens, size_t tracks)
+{
+	size_t track = next_rand() % tracks;
+	struct track_gen *gen = &gens[track];
+	struct encoder_packet packet = {0};
+
+	packet.type = track == 0 ? OBS_ENCODER_VIDEO : OBS_ENCODER_AUDIO;
+	packet.track_idx = track == 0 ? 0 : track - 1;
+	packet.dts = gen->dts++;
+	packet.pts = packet.dts;
+	packet.dts_usec = gen->dts_usec;
+	gen->dts_usec += gen->step;
+	return packet;
+}
+
+/* ------------------------------------------------------------------------- */
+/* the previous sorted array implementation */
+
+struct linear_queue {
+	DARRAY(struct encoder_packet) packets;
+};
+
+static void linear_insert(struct linear_queue *lq,
+			  const struct encoder_packet *out)
+{
+	size_t idx;
+	for (idx = 0; idx < lq->packets.num; idx++) {
+		struct encoder_packet *cur_packet;
+		cur_packet = lq->packets.array + idx;
+
+		if (out->dts_usec == cur_packet->dts_usec &&
+		    out->type == OBS_ENCODER_VIDEO) {
+			break;
+		} else if (out->dts_usec < cur_packet->dts_usec) {
+			break;
+		}
+	}
+
+	da_insert(lq->packets, idx, out);
+}
+
+static void linear_resort(struct linear_queue *lq)
+{
+	DARRAY(struct encoder_packet) old_array;
+
+	old_array.da = lq->packets.da;
+	memset(&lq->packets, 0, sizeof(lq->packets));
+
+	for (size_t i = 0; i < old_array.num; i++)
+		linear_insert(lq, &old_array.array[i]);
+
+	da_free(old_array);
+}
+
+static bool linear_pop(struct linear_queue *lq, struct encoder_packet *packet)
+{
+	if (!lq->packets.num)
+		return false;
+
+	*packet = lq->packets.array[0];
+	da_erase(lq->packets, 0);
+	return true;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void assert_same_packet(const struct encoder_packet *a,
+			       const struct encoder_packet *b)
+{
+	assert_int_equal(a->type, b->type);
+	assert_int_equal(a->track_idx, b->track_idx);
+	assert_int_equal(a->dts, b->dts);
+	assert_int_equal(a->dts_usec, b->dts_usec);
+}
+
+static void pop_and_compare(struct linear_queue *lq,
+			    struct interleave_queue *iq)
+{
+	struct encoder_packet expected;
+	struct encoder_packet packet;
+
+	assert_true(linear_pop(lq, &expected));
+	assert_true(interleave_queue_pop(iq, &packet));
+	assert_same_packet(&expected, &packet);
+}
+
+static void drain_and_compare(struct linear_queue *lq,
+			      struct interleave_queue *iq)
+{
+	while (lq->packets.num)
+		pop_and_compare(lq, iq);
+
+	assert_true(interleave_queue_empty(iq));
+}
+
+static void order_matches_linear(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	rand_state = 0x12345678;
+
+	for (size_t tracks = 1; tracks <= INTERLEAVE_MAX_TRACKS; tracks++) {
+		struct track_gen gens[INTERLEAVE_MAX_TRACKS];
+		struct linear_queue lq = {0};
+		struct interleave_queue iq = {0};
+
+		init_tracks(gens, tracks);
+
+		for (size_t i = 0; i < PACKETS_PER_TRACK * tracks; i++) {
+			struct encoder_packet packet =
+				next_packet(gens, tracks);
+
+			linear_insert(&lq, &packet);
+			interleave_queue_push(&iq, &packet);
+
+			/* keep a varying backlog, like an output that sends
+			 * one packet per received packet once started */
+			if (next_rand() % 4 != 0)
+				pop_and_compare(&lq, &iq);
+		}
+
+		drain_and_compare(&lq, &iq);
+
+		da_free(lq.packets);
+		interleave_queue_free(&iq);
+	}
+}
+
+/* once audio and video have both been received, the output subtracts a
+ * different offset from each track and resorts what it has buffered */
+static void resort_matches_linear(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	rand_state = 0x9abcdef0;
+
+	for (int run = 0; run < 50; run++) {
+		size_t tracks = next_rand() % INTERLEAVE_MAX_TRACKS + 1;
+		struct track_gen gens[INTERLEAVE_MAX_TRACKS];
+		int64_t offsets[INTERLEAVE_MAX_TRACKS];
+		struct linear_queue lq = {0};
+		struct interleave_queue iq = {0};
+		size_t prefill = next_rand() % 200 + 1;
+
+		init_tracks(gens, tracks);
+		for (size_t i = 0; i < tracks; i++)
+			offsets[i] = (int64_t)(next_rand() % 6) * 10000;
+
+		for (size_t i = 0; i < prefill; i++) {
+			struct encoder_packet packet =
+				next_packet(gens, tracks);
+			linear_insert(&lq, &packet);
+			interleave_queue_push(&iq, &packet);
+		}
+
+		for (size_t i = 0; i < lq.packets.num; i++) {
+			struct encoder_packet *packet = &lq.packets.array[i];
+			packet->dts_usec -= offsets[interleave_track(packet)];
+		}
+		linear_resort(&lq);
+
+		interleave_queue_renumber(&iq);
+		for (size_t track = 0; track < tracks; track++) {
+			size_t count = interleave_queue_count(&iq, track);
+
+			for (size_t i = 0; i < count; i++) {
+				struct interleaved_packet *packet =
+					interleave_queue_peek(&iq, track, i);
+				packet->packet.dts_usec -= offsets[track];
+			}
+		}
+		interleave_queue_rebuild(&iq);
+
+		for (size_t i = 0; i < PACKETS_PER_TRACK; i++) {
+			struct encoder_packet packet =
+				next_packet(gens, tracks);
+			packet.dts_usec -= offsets[interleave_track(&packet)];
+
+			linear_insert(&lq, &packet);
+			interleave_queue_push(&iq, &packet);
+			pop_and_compare(&lq, &iq);
+		}
+
+		drain_and_compare(&lq, &iq);
+
+		da_free(lq.packets);
+		interleave_queue_free(&iq);
+	}
+}
+
+/* not a pass/fail test, prints the cost per packet of both implementations
+ * with a steady backlog, as happens when an output stalls waiting for one of
+ * its encoders */
+static void interleave_benchmark(void **state)
+{
+	static const size_t track_counts[] = {2, INTERLEAVE_MAX_TRACKS};
+	static const size_t backlogs[] = {16, 256, 2048};
+
+	UNUSED_PARAMETER(state);
+
+	for (size_t t = 0; t < sizeof(track_counts) / sizeof(size_t); t++) {
+		for (size_t b = 0; b < sizeof(backlogs) / sizeof(size_t); b++) {
+			size_t tracks = track_counts[t];
+			struct track_gen gens[INTERLEAVE_MAX_TRACKS];
+			struct encoder_packet packet;
+			struct linear_queue lq = {0};
+			struct interleave_queue iq = {0};
+			uint64_t linear_ns;
+			uint64_t queue_ns;
+			uint64_t start;
+
+			rand_state = 0x2468ace0;
+			init_tracks(gens, tracks);
+			start = os_gettime_ns();
+			for (size_t i = 0; i < backlogs[b] + BENCH_OPS; i++) {
+				packet = next_packet(gens, tracks);
+				linear_insert(&lq, &packet);
+				if (i >= backlogs[b])
+					linear_pop(&lq, &packet);
+			}
+			linear_ns = os_gettime_ns() - start;
+
+			rand_state = 0x2468ace0;
+			init_tracks(gens, tracks);
+			start = os_gettime_ns();
+			for (size_t i = 0; i < backlogs[b] + BENCH_OPS; i++) {
+				packet = next_packet(gens, tracks);
+				interleave_queue_push(&iq, &packet);
+				if (i >= backlogs[b])
+					interleave_queue_pop(&iq, &packet);
+			}
+			queue_ns = os_gettime_ns() - start;
+
+			print_message("%zu tracks, backlog %4zu: linear "
+				      "%8.1f ns/packet, queue %6.1f "
+				      "ns/packet\n",
+				      tracks, backlogs[b],
+				      (double)linear_ns / BENCH_OPS,
+				      (double)queue_ns / BENCH_OPS);
+
+			da_free(lq.packets);
+			interleave_queue_free(&iq);
+		}
+	}
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(order_matches_linear),
+		cmocka_unit_test(resort_matches_linear),
+		cmocka_unit_test(interleave_benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,213 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <obs.h>
+#include <util/platform.h>
+#include <util/threading.h>
+
+/* end-to-end run of the video pipeline on the null graphics module:  an
+ * async source feeds frames through the texture upload, render, GPU format
+ * conversion and staging paths, and a raw video callback stands in for an
+ * encoder.  runs without a GPU, so it works on any CI runner. */
+
+#define WIDTH 1280
+#define HEIGHT 720
+#define FPS 60
+#define RUN_SECONDS 3
+
+struct pipeline_source {
+	obs_source_t *source;
+	os_event_t *stop_signal;
+	pthread_t thread;
+	bool initialized;
+};
+
+struct pipeline_stats {
+	volatile long frames;
+	volatile long bad_frames;
+};
+
+static const char *pipeline_source_name(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Null pipeline source";
+}
+
+static void pipeline_source_destroy(void *data)
+{
+	struct pipeline_source *ps = data;
+
+	if (ps->initialized) {
+		os_event_signal(ps->stop_signal);
+		pthread_join(ps->thread, NULL);
+	}
+
+	os_event_destroy(ps->stop_signal);
+	bfree(ps);
+}
+
+static void *pipeline_source_thread(void *data)
+{
+	struct pipeline_source *ps = data;
+	uint32_t *pixels = bmalloc(WIDTH * HEIGHT * sizeof(uint32_t));
+	uint64_t cur_time = os_gettime_ns();
+	uint32_t count = 0;
+
+	struct obs_source_frame frame = {
+		.data = {[0] = (uint8_t *)pixels},
+		.linesize = {[0] = WIDTH * 4},
+		.width = WIDTH,
+		.height = HEIGHT,
+		.format = VIDEO_FORMAT_BGRX,
+	};
+
+	while (os_event_try(ps->stop_signal) == EAGAIN) {
+		for (size_t i = 0; i < WIDTH * HEIGHT; i++)
+			pixels[i] = 0xFF000000 | (count + (uint32_t)i);
+
+		frame.timestamp = cur_time;
+		obs_source_output_video(ps->source, &frame);
+
+		os_sleepto_ns(cur_time += 1000000000 / FPS);
+		count++;
+	}
+
+	bfree(pixels);
+	return NULL;
+}
+
+static void *pipeline_source_create(obs_data_t *settings, obs_source_t *source)
+{
+	struct pipeline_source *ps = bzalloc(sizeof(struct pipeline_source));
+	ps->source = source;
+
+	UNUSED_PARAMETER(settings);
+
+	if (os_event_init(&ps->stop_signal, OS_EVENT_TYPE_MANUAL) != 0) {
+		pipeline_source_destroy(ps);
+		return NULL;
+	}
+
+	if (pthread_create(&ps->thread, NULL, pipeline_source_thread, ps)) {
+		pipeline_source_destroy(ps);
+		return NULL;
+	}
+
+	ps->initialized = true;
+	return ps;
+}
+
+static struct obs_source_info pipeline_source_info = {
+	.id = "null_pipeline_source",
+	.type = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_ASYNC_VIDEO,
+	.get_name = pipeline_source_name,
+	.create = pipeline_source_create,
+	.destroy = pipeline_source_destroy,
+};
+
+static void raw_video(void *param, struct video_data *frame)
+{
+	struct pipeline_stats *stats = param;
+
+	if (!frame->data[0] || !frame->data[1] || frame->linesize[0] < WIDTH)
+		os_atomic_inc_long(&stats->bad_frames);
+
+	os_atomic_inc_long(&stats->frames);
+}
+
+static int setup(void **state)
+{
+	struct obs_video_info ovi = {
+		.graphics_module = NULL_GRAPHICS_MODULE,
+		.fps_num = FPS,
+		.fps_den = 1,
+		.base_width = WIDTH,
+		.base_height = HEIGHT,
+		.output_width = WIDTH,
+		.output_height = HEIGHT,
+		.output_format = VIDEO_FORMAT_NV12,
+		.gpu_conversion = true,
+		.colorspace = VIDEO_CS_709,
+		.range = VIDEO_RANGE_PARTIAL,
+		.scale_type = OBS_SCALE_BICUBIC,
+	};
+
+	UNUSED_PARAMETER(state);
+
+	if (!obs_startup("en-US", NULL, NULL))
+		return -1;
+
+	obs_add_data_path(LIBOBS_DATA_PATH);
+
+	if (obs_reset_video(&ovi) != OBS_VIDEO_SUCCESS)
+		return -1;
+
+	obs_register_source(&pipeline_source_info);
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	UNUSED_PARAMETER(state);
+	obs_shutdown();
+	return 0;
+}
+
+static void null_pipeline_throughput(void **state)
+{
+	struct pipeline_stats stats = {0};
+	obs_source_t *source;
+	uint32_t total_start, lagged_start, skipped_start;
+	uint64_t start, elapsed;
+
+	UNUSED_PARAMETER(state);
+
+	obs_enter_graphics();
+	assert_int_equal(gs_get_device_type(), GS_DEVICE_NULL);
+	obs_leave_graphics();
+
+	source = obs_source_create_private("null_pipeline_source", "source",
+					   NULL);
+	assert_non_null(source);
+	obs_set_output_source(0, source);
+
+	total_start = obs_get_total_frames();
+	lagged_start = obs_get_lagged_frames();
+	skipped_start = video_output_get_skipped_frames(obs_get_video());
+	start = os_gettime_ns();
+
+	obs_add_raw_video_callback(NULL, raw_video, &stats);
+	os_sleep_ms(RUN_SECONDS * 1000);
+	obs_remove_raw_video_callback(raw_video, &stats);
+
+	elapsed = os_gettime_ns() - start;
+
+	obs_set_output_source(0, NULL);
+	obs_source_release(source);
+
+	print_message("null pipeline %dx%d NV12 @ %d fps: %ld frames output "
+		      "in %.2f s, %u rendered, %u lagged, %u skipped, "
+		      "average frame time %.3f ms\n",
+		      WIDTH, HEIGHT, FPS, os_atomic_load_long(&stats.frames),
+		      (double)elapsed / 1000000000.0,
+		      obs_get_total_frames() - total_start,
+		      obs_get_lagged_frames() - lagged_start,
+		      video_output_get_skipped_frames(obs_get_video()) -
+			      skipped_start,
+		      (double)obs_get_average_frame_time_ns() / 1000000.0);
+
+	assert_true(os_atomic_load_long(&stats.frames) > 0);
+	assert_int_equal(os_atomic_load_long(&stats.bad_frames), 0);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(null_pipeline_throughput),
+	};
+
+	return cmocka_run_group_tests(tests, setup, teardown);
+}
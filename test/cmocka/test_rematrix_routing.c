@@ -0,0 +1,199 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <math.h>
+#include <cmocka.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+
+#include "rematrix-routing.h"
+
+#define FRAMES 1024
+#define CHANNELS 24
+#define BENCH_ITERATIONS 2000
+
+struct routing_test {
+	float mix[MAX_AV_PLANES][MAX_AV_PLANES];
+	double gain[MAX_AV_PLANES];
+	struct rematrix_table table;
+
+	float *src_data;
+	float *data_data;
+	float *tmp_data;
+	float *src[CHANNELS];
+	float *data[MAX_AV_PLANES];
+	float *tmp[MAX_AV_PLANES];
+};
+
+enum route_type {
+	ROUTE_IDENTITY,
+	ROUTE_DOWNMIX,
+	ROUTE_SPARSE,
+};
+
+static const char *route_names[] = {"identity", "downmix", "sparse"};
+
+static struct routing_test *routing_test_create(enum route_type type)
+{
+	struct routing_test *t = bzalloc(sizeof(*t));
+
+	t->src_data = bmalloc(sizeof(float) * FRAMES * CHANNELS);
+	t->data_data = bmalloc(sizeof(float) * FRAMES * CHANNELS);
+	t->tmp_data = bmalloc(sizeof(float) * FRAMES * CHANNELS);
+
+	for (size_t c = 0; c < CHANNELS; c++) {
+		t->src[c] = t->src_data + c * FRAMES;
+		t->data[c] = t->data_data + c * FRAMES;
+		t->tmp[c] = t->tmp_data + c * FRAMES;
+		t->gain[c] = 1.0;
+	}
+
+	for (size_t i = 0; i < FRAMES * CHANNELS; i++)
+		t->src_data[i] =
+			((float)rand() / (float)RAND_MAX) * 2.0f - 1.0f;
+
+	for (size_t out = 0; out < CHANNELS; out++) {
+		switch (type) {
+		case ROUTE_IDENTITY:
+			t->mix[out][out] = 1.0f;
+			break;
+		case ROUTE_DOWNMIX:
+			/* every input into the first two outputs */
+			for (size_t in = 0; out < 2 && in < CHANNELS; in++)
+				t->mix[out][in] = (in % 2 == out) ? 1.0f : 0.5f;
+			break;
+		case ROUTE_SPARSE:
+			t->mix[out][(out + 1) % CHANNELS] = 1.0f;
+			t->mix[out][(out + 5) % CHANNELS] = 0.5f;
+			t->gain[out] = 0.5;
+			break;
+		}
+	}
+
+	rematrix_table_build(&t->table, CHANNELS, t->mix, t->gain);
+	return t;
+}
+
+static void routing_test_destroy(struct routing_test *t)
+{
+	bfree(t->src_data);
+	bfree(t->data_data);
+	bfree(t->tmp_data);
+	bfree(t);
+}
+
+/* same math as the old rematrix loop */
+static float reference_sample(struct routing_test *t, size_t out, size_t i)
+{
+	size_t ch_count = 0;
+	float sum = 0.0f;
+
+	for (size_t in = 0; in < CHANNELS; in++) {
+		if (t->mix[out][in] > 0) {
+			ch_count++;
+			sum += t->src[in][i] * t->mix[out][in];
+		}
+	}
+
+	return ch_count ? sum * (float)(t->gain[out] / ch_count) : 0.0f;
+}
+
+static void check_route(enum route_type type, size_t tmp_frames)
+{
+	struct routing_test *t = routing_test_create(type);
+
+	memcpy(t->data_data, t->src_data, sizeof(float) * FRAMES * CHANNELS);
+	rematrix_table_process(&t->table, t->data, t->tmp, tmp_frames, FRAMES);
+
+	for (size_t out = 0; out < CHANNELS; out++) {
+		for (size_t i = 0; i < FRAMES; i++) {
+			float expected = reference_sample(t, out, i);
+			assert_true(fabsf(t->data[out][i] - expected) <= 1e-6f);
+		}
+	}
+
+	routing_test_destroy(t);
+}
+
+static void routes_match_reference_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	for (int type = ROUTE_IDENTITY; type <= ROUTE_SPARSE; type++) {
+		/* whole blocks and odd chunk sizes */
+		check_route((enum route_type)type, FRAMES);
+		check_route((enum route_type)type, 100);
+	}
+}
+
+static void table_types_test(void **state)
+{
+	struct routing_test *t;
+
+	UNUSED_PARAMETER(state);
+
+	t = routing_test_create(ROUTE_IDENTITY);
+	for (size_t c = 0; c < CHANNELS; c++)
+		assert_int_equal(t->table.type[c], REMATRIX_OUTPUT_PASSTHROUGH);
+	routing_test_destroy(t);
+
+	t = routing_test_create(ROUTE_DOWNMIX);
+	assert_int_equal(t->table.type[0], REMATRIX_OUTPUT_MIX);
+	assert_int_equal(t->table.num_routes[0], CHANNELS);
+	for (size_t c = 2; c < CHANNELS; c++)
+		assert_int_equal(t->table.type[c], REMATRIX_OUTPUT_ZERO);
+	routing_test_destroy(t);
+
+	t = routing_test_create(ROUTE_SPARSE);
+	for (size_t c = 0; c < CHANNELS; c++)
+		assert_int_equal(t->table.num_routes[c], 2);
+	routing_test_destroy(t);
+}
+
+/* not a pass/fail test, prints the cost of each kind of routing next to a
+ * plain copy of the same amount of audio */
+static void routing_benchmark(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	struct routing_test *t = routing_test_create(ROUTE_IDENTITY);
+	uint64_t start = os_gettime_ns();
+	for (int i = 0; i < BENCH_ITERATIONS; i++)
+		memcpy(t->tmp_data, t->data_data,
+		       sizeof(float) * FRAMES * CHANNELS);
+	print_message("%-10s %6llu ns per %d frames x %d channels\n", "memcpy",
+		      (unsigned long long)(os_gettime_ns() - start) /
+			      BENCH_ITERATIONS,
+		      FRAMES, CHANNELS);
+	routing_test_destroy(t);
+
+	for (int type = ROUTE_IDENTITY; type <= ROUTE_SPARSE; type++) {
+		t = routing_test_create((enum route_type)type);
+		memcpy(t->data_data, t->src_data,
+		       sizeof(float) * FRAMES * CHANNELS);
+
+		start = os_gettime_ns();
+		for (int i = 0; i < BENCH_ITERATIONS; i++)
+			rematrix_table_process(&t->table, t->data, t->tmp,
+					       FRAMES, FRAMES);
+		print_message("%-10s %6llu ns per %d frames x %d channels\n",
+			      route_names[type],
+			      (unsigned long long)(os_gettime_ns() - start) /
+				      BENCH_ITERATIONS,
+			      FRAMES, CHANNELS);
+
+		routing_test_destroy(t);
+	}
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(routes_match_reference_test),
+		cmocka_unit_test(table_types_test),
+		cmocka_unit_test(routing_benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,358 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/bmem.h>
+#include "replay-save.h"
+
+/* the ring is at least one 16MB segment, so a few passes of odd sized
+ * chunks cover writes and reads that cross segments and the end of the
+ * file */
+
+#define RING_SIZE (32 * 1024 * 1024)
+#define MAX_CHUNK (3 * 1024 * 1024 + 17)
+
+static uint8_t pattern(uint64_t pos)
+{
+	return (uint8_t)((pos * 2654435761ULL) >> 24);
+}
+
+static void fill(uint8_t *data, uint64_t pos, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		data[i] = pattern(pos + i);
+}
+
+struct check {
+	uint64_t pos;
+	size_t pieces;
+	bool match;
+};
+
+static bool check_data(void *param, const uint8_t *data, size_t size)
+{
+	struct check *check = param;
+
+	for (size_t i = 0; i < size; i++) {
+		if (data[i] != pattern(check->pos + i)) {
+			check->match = false;
+			return false;
+		}
+	}
+
+	check->pos += size;
+	check->pieces++;
+	return true;
+}
+
+static void check_read(struct replay_spill_view *view, uint64_t pos,
+		       size_t size)
+{
+	struct check check = {pos, 0, true};
+
+	assert_true(replay_spill_read(view, pos, size, check_data, &check));
+	assert_true(check.match);
+	assert_int_equal(check.pos, pos + size);
+}
+
+static void round_trip(void **state)
+{
+	struct replay_spill *spill = replay_spill_create(".", RING_SIZE);
+	struct replay_spill_view view;
+	uint8_t *chunk = bmalloc(MAX_CHUNK);
+	uint64_t sizes[64];
+	size_t first = 0;
+	size_t count = 0;
+
+	UNUSED_PARAMETER(state);
+
+	assert_non_null(spill);
+	assert_true(replay_spill_capacity(spill) >= RING_SIZE);
+	replay_spill_view_init(&view, spill);
+
+	/* keep writing chunks, popping the oldest ones once the ring is full,
+	 * and read back everything that is still in it after each write */
+	for (size_t i = 0; i < 48; i++) {
+		size_t size = (size_t)(i * 1048573ULL % MAX_CHUNK) + 1;
+		uint64_t pos = replay_spill_head(spill);
+
+		while (!replay_spill_fits(spill, size)) {
+			replay_spill_pop(spill, (size_t)sizes[first % 64]);
+			first++;
+		}
+
+		fill(chunk, pos, size);
+		assert_true(replay_spill_write(spill, chunk, size));
+		sizes[count++ % 64] = size;
+
+		pos = replay_spill_tail(spill);
+		for (size_t j = first; j < count; j++) {
+			check_read(&view, pos, (size_t)sizes[j % 64]);
+			pos += sizes[j % 64];
+		}
+		assert_int_equal(pos, replay_spill_head(spill));
+	}
+
+	assert_true(replay_spill_head(spill) >
+		    2 * replay_spill_capacity(spill));
+
+	replay_spill_view_free(&view);
+	replay_spill_release(spill);
+	bfree(chunk);
+}
+
+static void pin_holds_data(void **state)
+{
+	struct replay_spill *spill = replay_spill_create(".", RING_SIZE);
+	uint64_t capacity = replay_spill_capacity(spill);
+	struct replay_spill_view view;
+	uint8_t *chunk = bmalloc(MAX_CHUNK);
+	size_t size = MAX_CHUNK;
+	uint64_t pinned;
+
+	UNUSED_PARAMETER(state);
+
+	replay_spill_view_init(&view, spill);
+
+	fill(chunk, 0, size);
+	assert_true(replay_spill_write(spill, chunk, size));
+	pinned = replay_spill_tail(spill);
+	replay_spill_pin(spill, pinned);
+
+	/* popped data stays readable as long as it is pinned */
+	replay_spill_pop(spill, size);
+	assert_int_equal(replay_spill_tail(spill), replay_spill_head(spill));
+
+	while (replay_spill_head(spill) + size <= pinned + capacity) {
+		uint64_t pos = replay_spill_head(spill);
+
+		assert_true(replay_spill_fits(spill, size));
+		fill(chunk, pos, size);
+		assert_true(replay_spill_write(spill, chunk, size));
+		replay_spill_pop(spill, size);
+	}
+
+	assert_false(replay_spill_fits(spill, size));
+	check_read(&view, pinned, MAX_CHUNK);
+
+	/* moving the pin forward frees the space behind it */
+	replay_spill_pin(spill, pinned + size);
+	assert_true(replay_spill_fits(spill, size));
+
+	/* and it can't move back */
+	replay_spill_pin(spill, pinned);
+	assert_true(replay_spill_fits(spill, size));
+
+	replay_spill_unpin(spill);
+	assert_true(replay_spill_fits(spill, (size_t)capacity));
+
+	replay_spill_view_free(&view);
+	replay_spill_release(spill);
+	bfree(chunk);
+}
+
+/* a reader keeps the ring alive after the writer is done with it */
+static void reference_outlives_writer(void **state)
+{
+	struct replay_spill *spill = replay_spill_create(".", 1);
+	struct replay_spill_view view;
+	uint8_t chunk[4096];
+
+	UNUSED_PARAMETER(state);
+
+	fill(chunk, 0, sizeof(chunk));
+	assert_true(replay_spill_write(spill, chunk, sizeof(chunk)));
+
+	replay_spill_addref(spill);
+	replay_spill_release(spill);
+
+	replay_spill_view_init(&view, spill);
+	check_read(&view, 0, sizeof(chunk));
+	replay_spill_view_free(&view);
+	replay_spill_release(spill);
+}
+
+/* a save reorders the packets by timestamp, and the data of the packets
+ * that come later in the file is written out first */
+
+#define NUM_PACKETS 60
+#define AUDIO_DELAY_USEC 50000
+#define VIDEO_CHUNK (MAX_CHUNK / 4)
+
+struct save_check {
+	struct replay_spill *spill;
+	const uint64_t *positions;
+	size_t num;
+	size_t idx;
+	int64_t last_dts_usec;
+	uint64_t pos;
+};
+
+static void push_packet(struct circlebuf *packets, struct replay_spill *spill,
+			struct encoder_packet *pkt, uint8_t *chunk)
+{
+	uint64_t pos = replay_spill_head(spill);
+
+	assert_true(replay_spill_fits(spill, pkt->size));
+	fill(chunk, pos, pkt->size);
+	assert_true(replay_spill_write(spill, chunk, pkt->size));
+
+	/* where the data went, to check the positions against */
+	pkt->sys_dts_usec = (int64_t)pos;
+	circlebuf_push_back(packets, pkt, sizeof(*pkt));
+}
+
+/* video at 30 fps and audio in blocks of 1024 samples, with the audio
+ * arriving a bit later than the video of the same time */
+static void push_packets(struct circlebuf *packets, struct replay_spill *spill)
+{
+	uint8_t *chunk = bmalloc(VIDEO_CHUNK);
+	size_t video = 0;
+	size_t audio = 0;
+
+	while (video + audio < NUM_PACKETS) {
+		struct encoder_packet pkt = {0};
+		int64_t video_usec = (int64_t)video * 1000000 / 30;
+		int64_t audio_usec = (int64_t)audio * 1024 * 1000000 / 48000;
+
+		if (video_usec <= audio_usec + AUDIO_DELAY_USEC) {
+			pkt.type = OBS_ENCODER_VIDEO;
+			pkt.timebase_num = 1;
+			pkt.timebase_den = 30;
+			pkt.pts = pkt.dts = (int64_t)video;
+			pkt.dts_usec = video_usec;
+			pkt.keyframe = video == 0;
+			pkt.size = (size_t)(video * 1048573ULL % VIDEO_CHUNK) + 1;
+			video++;
+		} else {
+			pkt.type = OBS_ENCODER_AUDIO;
+			pkt.timebase_num = 1;
+			pkt.timebase_den = 48000;
+			pkt.pts = pkt.dts = (int64_t)audio * 1024;
+			pkt.dts_usec = audio_usec;
+			pkt.size = 300 + audio % 7;
+			audio++;
+		}
+
+		push_packet(packets, spill, &pkt, chunk);
+	}
+
+	bfree(chunk);
+}
+
+static bool check_save_packet(void *param, struct encoder_packet *pkt)
+{
+	struct save_check *check = param;
+	uint64_t capacity = replay_spill_capacity(check->spill);
+	uint64_t head = replay_spill_head(check->spill);
+	uint64_t oldest = UINT64_MAX;
+
+	/* the packets come in the order they were sorted in */
+	assert_int_equal(check->positions[check->idx], pkt->sys_dts_usec);
+	assert_true(pkt->dts_usec >= check->last_dts_usec);
+	check->last_dts_usec = pkt->dts_usec;
+
+	/* everything that is still to be written stays pinned, and nothing
+	 * before it */
+	for (size_t i = check->idx; i < check->num; i++) {
+		if (check->positions[i] < oldest)
+			oldest = check->positions[i];
+	}
+	assert_true(replay_spill_fits(check->spill,
+				      (size_t)(oldest + capacity - head)));
+	assert_false(replay_spill_fits(check->spill,
+				       (size_t)(oldest + capacity - head + 1)));
+
+	check->pos = check->positions[check->idx++];
+	return true;
+}
+
+static bool check_save_data(void *param, const uint8_t *data, size_t size)
+{
+	struct save_check *check = param;
+
+	for (size_t i = 0; i < size; i++) {
+		if (data[i] != pattern(check->pos + i))
+			return false;
+	}
+
+	check->pos += size;
+	return true;
+}
+
+static void save_order(void **state)
+{
+	struct replay_spill *spill = replay_spill_create(".", RING_SIZE);
+	struct circlebuf packets = {0};
+	DARRAY(struct encoder_packet) mux_packets = {0};
+	DARRAY(uint64_t) positions = {0};
+	struct save_check check = {0};
+	uint8_t chunk[4096];
+	size_t reordered = 0;
+
+	UNUSED_PARAMETER(state);
+
+	assert_non_null(spill);
+
+	/* so that the packets don't start at the beginning of the file */
+	fill(chunk, 0, sizeof(chunk));
+	assert_true(replay_spill_write(spill, chunk, sizeof(chunk)));
+	replay_spill_pop(spill, sizeof(chunk));
+
+	push_packets(&packets, spill);
+
+	replay_save_order(&packets, &mux_packets.da, spill, &positions.da);
+	assert_int_equal(mux_packets.num, NUM_PACKETS);
+	assert_int_equal(positions.num, NUM_PACKETS);
+
+	for (size_t i = 0; i < NUM_PACKETS; i++) {
+		struct encoder_packet *pkt = &mux_packets.array[i];
+
+		assert_int_equal(positions.array[i], pkt->sys_dts_usec);
+		if (i > 0 && positions.array[i] < positions.array[i - 1])
+			reordered++;
+	}
+	assert_true(reordered > 0);
+
+	/* the replay buffer moves on, only the pin keeps the data */
+	while (packets.size) {
+		struct encoder_packet pkt;
+		circlebuf_pop_front(&packets, &pkt, sizeof(pkt));
+		replay_spill_pop(spill, pkt.size);
+	}
+
+	check.spill = spill;
+	check.positions = positions.array;
+	check.num = positions.num;
+	check.last_dts_usec = INT64_MIN;
+
+	assert_true(replay_save_write_spilled(spill, mux_packets.array,
+					      positions.array, mux_packets.num,
+					      check_save_packet,
+					      check_save_data, &check));
+	assert_int_equal(check.idx, NUM_PACKETS);
+
+	replay_spill_unpin(spill);
+	assert_true(replay_spill_fits(spill,
+				      (size_t)replay_spill_capacity(spill)));
+
+	for (size_t i = 0; i < mux_packets.num; i++)
+		obs_encoder_packet_release(&mux_packets.array[i]);
+	da_free(mux_packets);
+	da_free(positions);
+	circlebuf_free(&packets);
+	replay_spill_release(spill);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(round_trip),
+		cmocka_unit_test(pin_holds_data),
+		cmocka_unit_test(reference_outlives_writer),
+		cmocka_unit_test(save_order),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
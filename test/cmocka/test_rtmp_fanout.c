@@ -0,0 +1,555 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <obs-avc.h>
+
+#include "librtmp/rtmp_sys.h"
+#include "rtmp-fanout.h"
+
+/* streams to a few minimal RTMP servers on the loopback interface: two that
+ * keep up, one that stops reading after the publish (and so has to drop
+ * frames), and one that drops the connection part way through (and so has to
+ * reconnect).  the servers check the sequence numbers carried in each packet
+ * to make sure that the slow and the flaky destination never hold up or
+ * disturb the other two. */
+
+#define NUM_FRAMES 600
+#define KEYFRAME_INTERVAL 30
+#define FRAME_MS 33
+#define VIDEO_SIZE (32 * 1024)
+#define AUDIO_SIZE 512
+#define FLAKY_CLOSE_AFTER 100
+#define NUM_HEADERS 2
+#define HANDSHAKE_SIZE 1536
+
+enum server_mode {
+	SERVER_FAST,
+	SERVER_SLOW,
+	SERVER_FLAKY,
+};
+
+struct server {
+	enum server_mode mode;
+	SOCKET listen_fd;
+	int port;
+	pthread_t thread;
+	os_event_t *release;
+	volatile bool exit;
+
+	volatile long connections;
+	volatile long media_count;
+	volatile long last_seq;
+	volatile long errors;
+};
+
+#define NUM_SERVERS 4
+
+static struct server servers[NUM_SERVERS] = {
+	{SERVER_FAST},
+	{SERVER_FAST},
+	{SERVER_SLOW},
+	{SERVER_FLAKY},
+};
+
+static volatile long connected_calls;
+static volatile long stopped_calls;
+static volatile long stopped_code;
+
+/* ------------------------------------------------------------------------- */
+/* payloads */
+
+#define SEQ_SIZE 5
+
+static void write_seq(uint8_t *data, long seq)
+{
+	for (size_t i = 0; i < SEQ_SIZE; i++)
+		data[i] = 0x80 | ((seq >> (7 * i)) & 0x7F);
+}
+
+static long read_seq(const uint8_t *data)
+{
+	long seq = 0;
+	for (size_t i = 0; i < SEQ_SIZE; i++)
+		seq |= (long)(data[i] & 0x7F) << (7 * i);
+	return seq;
+}
+
+/* obs_parse_avc_packet is the exported way to get a referenced packet, so
+ * the audio packets are also built as a single annex-b NAL (of a type that is
+ * never a keyframe) */
+static void create_packet(struct encoder_packet *packet, long frame,
+			  bool audio)
+{
+	size_t size = audio ? AUDIO_SIZE : VIDEO_SIZE;
+	uint8_t *data = bmalloc(size);
+	long seq = frame * 2 + (audio ? 1 : 0);
+	struct encoder_packet src = {0};
+
+	data[0] = 0;
+	data[1] = 0;
+	data[2] = 0;
+	data[3] = 1;
+	if (audio)
+		data[4] = 0x06;
+	else
+		data[4] = frame % KEYFRAME_INTERVAL == 0 ? 0x65 : 0x41;
+	write_seq(data + 5, seq);
+
+	/* no zeros, so that the filler never looks like a start code */
+	for (size_t i = 5 + SEQ_SIZE; i < size; i++)
+		data[i] = (uint8_t)((seq + i) % 251 + 1);
+
+	src.type = audio ? OBS_ENCODER_AUDIO : OBS_ENCODER_VIDEO;
+	src.data = data;
+	src.size = size;
+	src.timebase_num = 1;
+	src.timebase_den = 1000;
+	src.dts = frame * FRAME_MS;
+	src.pts = src.dts;
+	src.dts_usec = src.dts * 1000;
+	src.sys_dts_usec = src.dts_usec;
+
+	obs_parse_avc_packet(packet, &src);
+	bfree(data);
+}
+
+/* ------------------------------------------------------------------------- */
+/* server */
+
+static bool recv_all(SOCKET fd, uint8_t *data, size_t size)
+{
+	while (size) {
+		int ret = recv(fd, (char *)data, (int)size, 0);
+		if (ret <= 0)
+			return false;
+
+		data += ret;
+		size -= ret;
+	}
+
+	return true;
+}
+
+static bool send_all(SOCKET fd, const uint8_t *data, size_t size)
+{
+	while (size) {
+		int ret = send(fd, (const char *)data, (int)size, 0);
+		if (ret <= 0)
+			return false;
+
+		data += ret;
+		size -= ret;
+	}
+
+	return true;
+}
+
+/* plain handshake, the client only warns if S2 doesn't match */
+static bool server_handshake(SOCKET fd)
+{
+	uint8_t c0c1[HANDSHAKE_SIZE + 1];
+	uint8_t s0s1s2[HANDSHAKE_SIZE * 2 + 1] = {0};
+	uint8_t c2[HANDSHAKE_SIZE];
+
+	if (!recv_all(fd, c0c1, sizeof(c0c1)))
+		return false;
+
+	s0s1s2[0] = 0x03;
+	memcpy(s0s1s2 + 1 + HANDSHAKE_SIZE, c0c1 + 1, HANDSHAKE_SIZE);
+	if (!send_all(fd, s0s1s2, sizeof(s0s1s2)))
+		return false;
+
+	return recv_all(fd, c2, sizeof(c2));
+}
+
+static const AVal av_result = AVC("_result");
+static const AVal av_create_stream = AVC("createStream");
+static const AVal av_publish = AVC("publish");
+
+/* replies to every transaction so that the client moves on to the next
+ * step, returns true once the publish has been answered */
+static bool server_invoke(RTMP *r, const RTMPPacket *packet)
+{
+	char buf[RTMP_MAX_HEADER_SIZE + 128];
+	char *body = buf + RTMP_MAX_HEADER_SIZE;
+	char *end = buf + sizeof(buf);
+	char *enc = body;
+	RTMPPacket reply = {0};
+	AMFObject obj;
+	AVal method;
+	double txn;
+
+	if (AMF_Decode(&obj, packet->m_body, (int)packet->m_nBodySize,
+		       FALSE) < 0)
+		return false;
+
+	AMFProp_GetString(AMF_GetProp(&obj, NULL, 0), &method);
+	txn = AMFProp_GetNumber(AMF_GetProp(&obj, NULL, 1));
+
+	if (txn > 0.0) {
+		enc = AMF_EncodeString(enc, end, &av_result);
+		enc = AMF_EncodeNumber(enc, end, txn);
+		*enc++ = AMF_NULL;
+		if (AVMATCH(&method, &av_create_stream))
+			enc = AMF_EncodeNumber(enc, end, 1.0);
+		else
+			*enc++ = AMF_NULL;
+
+		reply.m_nChannel = 0x03;
+		reply.m_headerType = RTMP_PACKET_SIZE_LARGE;
+		reply.m_packetType = RTMP_PACKET_TYPE_INVOKE;
+		reply.m_body = body;
+		reply.m_nBodySize = (uint32_t)(enc - body);
+		RTMP_SendPacket(r, &reply, FALSE);
+	}
+
+	bool published = AVMATCH(&method, &av_publish);
+	AMF_Reset(&obj);
+	return published;
+}
+
+struct session {
+	int headers;
+	long media;
+	long last_seq;
+};
+
+static void server_media(struct server *server, struct session *session,
+			 const RTMPPacket *packet)
+{
+	const uint8_t *body = (const uint8_t *)packet->m_body;
+	bool video = packet->m_packetType == RTMP_PACKET_TYPE_VIDEO;
+	size_t prefix_size = video ? 5 : 2;
+	long seq;
+
+	/* the codec headers come first in every session */
+	if (session->headers < NUM_HEADERS) {
+		if (body[1] != 0)
+			os_atomic_inc_long(&server->errors);
+		session->headers++;
+		return;
+	}
+
+	if (packet->m_nBodySize < prefix_size + 5 + SEQ_SIZE ||
+	    body[1] != 1) {
+		os_atomic_inc_long(&server->errors);
+		return;
+	}
+
+	seq = read_seq(body + prefix_size + 5);
+
+	/* every session starts at a keyframe, and nothing is lost after it */
+	if (!session->media) {
+		if (!video || body[0] != 0x17)
+			os_atomic_inc_long(&server->errors);
+	} else if (seq != session->last_seq + 1) {
+		os_atomic_inc_long(&server->errors);
+	}
+
+	if (packet->m_nTimeStamp != (uint32_t)(seq / 2 * FRAME_MS))
+		os_atomic_inc_long(&server->errors);
+
+	session->last_seq = seq;
+	session->media++;
+	os_atomic_set_long(&server->last_seq, seq);
+	os_atomic_inc_long(&server->media_count);
+}
+
+static void server_session(struct server *server, SOCKET fd)
+{
+	RTMP *r = bzalloc(sizeof(RTMP));
+	RTMPPacket packet = {0};
+	struct session session = {0};
+	long connection = os_atomic_inc_long(&server->connections);
+
+	RTMP_Init(r);
+	r->m_sb.sb_socket = fd;
+
+	if (!server_handshake(fd)) {
+		os_atomic_inc_long(&server->errors);
+		goto close;
+	}
+
+	while (RTMP_ReadPacket(r, &packet)) {
+		if (!RTMPPacket_IsReady(&packet))
+			continue;
+
+		switch (packet.m_packetType) {
+		case RTMP_PACKET_TYPE_CHUNK_SIZE:
+			r->m_inChunkSize = AMF_DecodeInt32(packet.m_body);
+			break;
+
+		case RTMP_PACKET_TYPE_INVOKE:
+			if (server_invoke(r, &packet) &&
+			    server->mode == SERVER_SLOW) {
+				RTMPPacket_Free(&packet);
+				os_event_wait(server->release);
+				goto close;
+			}
+			break;
+
+		case RTMP_PACKET_TYPE_AUDIO:
+		case RTMP_PACKET_TYPE_VIDEO:
+			server_media(server, &session, &packet);
+			break;
+		}
+
+		RTMPPacket_Free(&packet);
+
+		if (server->mode == SERVER_FLAKY && connection == 1 &&
+		    session.media == FLAKY_CLOSE_AFTER)
+			break;
+	}
+
+close:
+	RTMPPacket_Free(&packet);
+	RTMP_Close(r);
+	bfree(r);
+}
+
+static void *server_thread(void *data)
+{
+	struct server *server = data;
+
+	for (;;) {
+		SOCKET fd = accept(server->listen_fd, NULL, NULL);
+		if (fd == INVALID_SOCKET)
+			break;
+
+		if (os_atomic_load_bool(&server->exit)) {
+			closesocket(fd);
+			break;
+		}
+
+		server_session(server, fd);
+	}
+
+	return NULL;
+}
+
+static bool server_start(struct server *server)
+{
+	struct sockaddr_in addr = {0};
+	socklen_t addr_len = sizeof(addr);
+	int rcvbuf = 4096;
+
+	server->listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (server->listen_fd == INVALID_SOCKET)
+		return false;
+
+	/* accepted sockets inherit the small receive buffer, which makes
+	 * the slow server back up quickly */
+	if (server->mode == SERVER_SLOW)
+		setsockopt(server->listen_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf,
+			   sizeof(rcvbuf));
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(server->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    getsockname(server->listen_fd, (struct sockaddr *)&addr,
+			&addr_len) ||
+	    listen(server->listen_fd, 4))
+		return false;
+
+	server->port = ntohs(addr.sin_port);
+	if (os_event_init(&server->release, OS_EVENT_TYPE_MANUAL) != 0)
+		return false;
+
+	return pthread_create(&server->thread, NULL, server_thread, server) ==
+	       0;
+}
+
+/* the accept call is woken up with a connection of our own */
+static void server_stop(struct server *server)
+{
+	struct sockaddr_in addr = {0};
+	SOCKET fd;
+
+	os_atomic_set_bool(&server->exit, true);
+	os_event_signal(server->release);
+
+	fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons((unsigned short)server->port);
+	connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+
+	pthread_join(server->thread, NULL);
+	closesocket(fd);
+	closesocket(server->listen_fd);
+	os_event_destroy(server->release);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void fanout_connected(void *param, size_t idx)
+{
+	UNUSED_PARAMETER(param);
+	UNUSED_PARAMETER(idx);
+	os_atomic_inc_long(&connected_calls);
+}
+
+static void fanout_stopped(void *param, int code)
+{
+	UNUSED_PARAMETER(param);
+	os_atomic_set_long(&stopped_code, code);
+	os_atomic_inc_long(&stopped_calls);
+}
+
+static bool wait_until(bool (*done)(void), uint64_t timeout_ms)
+{
+	uint64_t end = os_gettime_ns() + timeout_ms * 1000000ULL;
+
+	while (!done()) {
+		if (os_gettime_ns() >= end)
+			return false;
+		os_sleep_ms(10);
+	}
+
+	return true;
+}
+
+static bool all_connected(void)
+{
+	return os_atomic_load_long(&connected_calls) >= NUM_SERVERS;
+}
+
+static bool all_received(void)
+{
+	for (size_t i = 0; i < NUM_SERVERS; i++) {
+		struct server *server = &servers[i];
+		long last = os_atomic_load_long(&server->last_seq);
+
+		if (server->mode == SERVER_FAST &&
+		    os_atomic_load_long(&server->media_count) < NUM_FRAMES * 2)
+			return false;
+		if (server->mode == SERVER_FLAKY && last != NUM_FRAMES * 2 - 1)
+			return false;
+	}
+
+	return true;
+}
+
+static void add_headers(rtmp_fanout_t *fanout)
+{
+	uint8_t audio_header[] = {0x12, 0x10};
+	uint8_t video_header[] = {0x01, 0x64, 0x00, 0x1f, 0xff, 0xe0};
+	struct encoder_packet packet = {.timebase_den = 1};
+
+	packet.type = OBS_ENCODER_AUDIO;
+	packet.data = audio_header;
+	packet.size = sizeof(audio_header);
+	rtmp_fanout_add_header(fanout, &packet);
+
+	packet.type = OBS_ENCODER_VIDEO;
+	packet.keyframe = true;
+	packet.data = video_header;
+	packet.size = sizeof(video_header);
+	rtmp_fanout_add_header(fanout, &packet);
+}
+
+static void fanout_isolates_destinations(void **state)
+{
+	struct rtmp_fanout_config config = {0};
+	struct rtmp_fanout_callbacks callbacks = {0};
+	rtmp_fanout_t *fanout;
+
+	UNUSED_PARAMETER(state);
+
+	config.name = "test";
+	config.drop_threshold_usec = 5000000;
+	config.pframe_drop_threshold_usec = 5200000;
+	config.max_buffer_usec = 8000000;
+	config.retry_delay_sec = 0;
+	config.max_retries = 5;
+	config.max_shutdown_time_sec = 5;
+
+	callbacks.connected = fanout_connected;
+	callbacks.stopped = fanout_stopped;
+
+	fanout = rtmp_fanout_create(&config, &callbacks);
+	assert_non_null(fanout);
+
+	for (size_t i = 0; i < NUM_SERVERS; i++) {
+		char url[64];
+
+		assert_true(server_start(&servers[i]));
+		snprintf(url, sizeof(url), "rtmp://127.0.0.1:%d/app",
+			 servers[i].port);
+		assert_int_equal(rtmp_fanout_add_destination(fanout, url,
+							     "stream", "",
+							     ""),
+				 i);
+	}
+
+	add_headers(fanout);
+	assert_true(rtmp_fanout_start(fanout));
+	assert_true(wait_until(all_connected, 10000));
+
+	for (long frame = 0; frame < NUM_FRAMES; frame++) {
+		struct encoder_packet packet;
+
+		create_packet(&packet, frame, false);
+		rtmp_fanout_push(fanout, &packet);
+		create_packet(&packet, frame, true);
+		rtmp_fanout_push(fanout, &packet);
+
+		os_sleep_ms(3);
+	}
+
+	assert_true(wait_until(all_received, 20000));
+
+	for (size_t i = 0; i < NUM_SERVERS; i++) {
+		struct rtmp_fanout_dest_stats stats;
+		struct server *server = &servers[i];
+
+		rtmp_fanout_get_dest_stats(fanout, i, &stats);
+		print_message("destination %zu: %d dropped, %ld received, "
+			      "%ld connections\n",
+			      i, stats.dropped_frames,
+			      os_atomic_load_long(&server->media_count),
+			      os_atomic_load_long(&server->connections));
+
+		assert_int_equal(os_atomic_load_long(&server->errors), 0);
+
+		if (server->mode == SERVER_FAST)
+			assert_int_equal(stats.dropped_frames, 0);
+		else if (server->mode == SERVER_SLOW)
+			assert_true(stats.dropped_frames > 0);
+		else if (server->mode == SERVER_FLAKY)
+			assert_int_equal(
+				os_atomic_load_long(&server->connections), 2);
+	}
+
+	/* the slow destination is still blocked in a send at this point */
+	rtmp_fanout_destroy(fanout);
+	assert_int_equal(stopped_calls, 1);
+	assert_int_equal(stopped_code, OBS_OUTPUT_SUCCESS);
+
+	for (size_t i = 0; i < NUM_SERVERS; i++)
+		server_stop(&servers[i]);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(fanout_isolates_destinations),
+	};
+
+#ifdef _WIN32
+	WSADATA wsa_data;
+	WSAStartup(MAKEWORD(2, 2), &wsa_data);
+#endif
+
+	int ret = cmocka_run_group_tests(tests, NULL, NULL);
+
+#ifdef _WIN32
+	WSACleanup();
+#endif
+	return ret;
+}
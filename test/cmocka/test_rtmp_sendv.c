@@ -0,0 +1,246 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/bmem.h>
+#include <util/darray.h>
+#include <util/threading.h>
+
+#include "librtmp/rtmp_sys.h"
+
+/* packets sent with RTMP_SendPacketV, over a plain socket and through a
+ * custom send function (which takes the same path as TLS), have to produce
+ * exactly the bytes that RTMP_SendPacket produces for the same packets */
+
+#define NUM_PACKETS 24
+#define COALESCE_SIZE (16 * 1024)
+
+struct capture {
+	int fds[2];
+	pthread_t thread;
+	DARRAY(uint8_t) data;
+};
+
+struct send_calls {
+	size_t count;
+	long total;
+};
+
+static void *read_thread(void *param)
+{
+	struct capture *cap = param;
+	uint8_t buf[4096];
+	ssize_t len;
+
+	while ((len = recv(cap->fds[1], buf, sizeof(buf), 0)) > 0)
+		da_push_back_array(cap->data, buf, (size_t)len);
+
+	return NULL;
+}
+
+static RTMP *open_capture(struct capture *cap, int chunk_size)
+{
+	RTMP *r = RTMP_Alloc();
+
+	memset(cap, 0, sizeof(*cap));
+	assert_int_equal(socketpair(AF_UNIX, SOCK_STREAM, 0, cap->fds), 0);
+	assert_int_equal(pthread_create(&cap->thread, NULL, read_thread, cap),
+			 0);
+
+	RTMP_Init(r);
+	r->m_sb.sb_socket = cap->fds[0];
+	r->m_outChunkSize = chunk_size;
+	return r;
+}
+
+static void close_capture(struct capture *cap, RTMP *r)
+{
+	/* closes the write end, so the reader sees the end of the stream */
+	RTMP_Close(r);
+	RTMP_Free(r);
+
+	pthread_join(cap->thread, NULL);
+	close(cap->fds[1]);
+}
+
+static int counting_send(RTMPSockBuf *sb, const char *buf, int len, void *param)
+{
+	struct send_calls *calls = param;
+	int sent = 0;
+
+	while (sent < len) {
+		ssize_t ret = send(sb->sb_socket, buf + sent, len - sent, 0);
+		if (ret < 0)
+			return -1;
+		sent += (int)ret;
+	}
+
+	calls->count++;
+	calls->total += len;
+	return len;
+}
+
+static const int channels[] = {0x04, 0x05, 100, 400};
+
+static void fill_packet(RTMPPacket *packet, size_t idx, char *body,
+			uint32_t size)
+{
+	memset(packet, 0, sizeof(*packet));
+	packet->m_headerType = idx < 4 ? RTMP_PACKET_SIZE_LARGE
+				       : RTMP_PACKET_SIZE_MEDIUM;
+	packet->m_packetType = idx % 2 ? RTMP_PACKET_TYPE_AUDIO
+				       : RTMP_PACKET_TYPE_VIDEO;
+	packet->m_nChannel = channels[idx % 4];
+	packet->m_nTimeStamp = (uint32_t)(idx * 33);
+	packet->m_nInfoField2 = 1;
+	packet->m_nBodySize = size;
+	packet->m_body = body;
+}
+
+static uint32_t packet_size(size_t idx)
+{
+	static const uint32_t sizes[] = {
+		1, 127, 128, 129, 4096, 4097, 40000, 150000,
+	};
+	return sizes[idx % 8] + (uint32_t)(idx / 8) * 7;
+}
+
+static void fill_body(char *body, uint32_t size, size_t idx)
+{
+	for (uint32_t i = 0; i < size; i++)
+		body[i] = (char)(i * 31 + idx);
+}
+
+static void send_reference(struct capture *cap, int chunk_size)
+{
+	RTMP *r = open_capture(cap, chunk_size);
+
+	for (size_t i = 0; i < NUM_PACKETS; i++) {
+		RTMPPacket packet;
+		uint32_t size = packet_size(i);
+		char *body;
+
+		RTMPPacket_Reset(&packet);
+		assert_true(RTMPPacket_Alloc(&packet, size));
+		body = packet.m_body;
+		fill_body(body, size, i);
+
+		fill_packet(&packet, i, body, size);
+		assert_true(RTMP_SendPacket(r, &packet, FALSE));
+
+		packet.m_body = body;
+		RTMPPacket_Free(&packet);
+	}
+
+	close_capture(cap, r);
+}
+
+/* the chunk headers have to go out along with the payload, in full buffers,
+ * instead of taking a write (and a TLS record) each.  only the end of the
+ * packet and of each gathered batch of about 60 slices may leave a buffer
+ * partly filled */
+static void check_writes(const struct send_calls *calls, size_t writes,
+			 long total, uint32_t size, int chunk_size, int slices)
+{
+	size_t chunks = (size + chunk_size - 1) / chunk_size;
+	size_t bytes = (size_t)(calls->total - total);
+	size_t max_writes = (bytes + COALESCE_SIZE - 1) / COALESCE_SIZE +
+			    (2 * chunks + slices) / 60 + 1;
+
+	assert_true(calls->count - writes <= max_writes);
+}
+
+static void send_vectored(struct capture *cap, int chunk_size,
+			  struct send_calls *calls)
+{
+	/* split like a video packet: tag header, then length prefixed NAL
+	 * units */
+	static const uint32_t split[] = {5, 4, 1000, 4};
+	RTMP *r = open_capture(cap, chunk_size);
+
+	if (calls) {
+		r->m_bCustomSend = 1;
+		r->m_customSendFunc = counting_send;
+		r->m_customSendParam = calls;
+	}
+
+	for (size_t i = 0; i < NUM_PACKETS; i++) {
+		RTMPPacket packet;
+		uint32_t size = packet_size(i);
+		char *body = bmalloc(size);
+		AVal slices[5];
+		uint32_t offset = 0;
+		int count = 0;
+		size_t writes = calls ? calls->count : 0;
+		long total = calls ? calls->total : 0;
+
+		fill_body(body, size, i);
+
+		for (size_t j = 0; j < 4 && offset + split[j] < size; j++) {
+			slices[count].av_val = body + offset;
+			slices[count].av_len = (int)split[j];
+			offset += split[j];
+			count++;
+		}
+		slices[count].av_val = body + offset;
+		slices[count].av_len = (int)(size - offset);
+		count++;
+
+		fill_packet(&packet, i, NULL, size);
+		assert_true(RTMP_SendPacketV(r, &packet, slices, count));
+		bfree(body);
+
+		if (calls)
+			check_writes(calls, writes, total, size, chunk_size,
+				     count);
+	}
+
+	close_capture(cap, r);
+}
+
+static void check_equal(struct capture *ref, struct capture *test)
+{
+	assert_int_equal(ref->data.num, test->data.num);
+	assert_memory_equal(ref->data.array, test->data.array, ref->data.num);
+}
+
+static void sendv_matches(int chunk_size)
+{
+	struct capture ref, plain, custom;
+	struct send_calls calls = {0};
+
+	send_reference(&ref, chunk_size);
+	send_vectored(&plain, chunk_size, NULL);
+	send_vectored(&custom, chunk_size, &calls);
+
+	check_equal(&ref, &plain);
+	check_equal(&ref, &custom);
+	assert_int_equal(calls.total, (long)ref.data.num);
+
+	da_free(ref.data);
+	da_free(plain.data);
+	da_free(custom.data);
+}
+
+static void sendv_default_chunks(void **state)
+{
+	UNUSED_PARAMETER(state);
+	sendv_matches(RTMP_DEFAULT_CHUNKSIZE);
+}
+
+static void sendv_large_chunks(void **state)
+{
+	UNUSED_PARAMETER(state);
+	sendv_matches(4096);
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(sendv_default_chunks),
+		cmocka_unit_test(sendv_large_chunks),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,158 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <util/threading.h>
+#include <media-io/video-io.h>
+#include <obs.h>
+
+#define WIDTH 64
+#define HEIGHT 64
+#define TIMEOUT_MS 2000
+
+struct self_disconnect {
+	video_t *video;
+	volatile long calls;
+};
+
+static void disconnect_callback(void *param, struct video_data *frame)
+{
+	struct self_disconnect *sd = param;
+
+	if (os_atomic_inc_long(&sd->calls) == 1)
+		video_output_disconnect(sd->video, disconnect_callback, sd);
+
+	UNUSED_PARAMETER(frame);
+}
+
+static void release_frame(void *param)
+{
+	os_atomic_inc_long(param);
+}
+
+static video_t *open_video(void)
+{
+	struct video_output_info info = {
+		.name = "test",
+		.format = VIDEO_FORMAT_I420,
+		.fps_num = 60,
+		.fps_den = 1,
+		.width = WIDTH,
+		.height = HEIGHT,
+		.cache_size = 4,
+		.colorspace = VIDEO_CS_709,
+		.range = VIDEO_RANGE_PARTIAL,
+	};
+	video_t *video = NULL;
+
+	assert_int_equal(video_output_open(&video, &info),
+			 VIDEO_OUTPUT_SUCCESS);
+	return video;
+}
+
+/* submits frames until cond becomes true or the timeout passes */
+static bool submit_until(video_t *video, volatile long *cond,
+			 volatile long *released, uint64_t timeout_ms)
+{
+	static uint8_t planes[WIDTH * HEIGHT * 3 / 2];
+	struct video_data frame = {0};
+	uint64_t end = os_gettime_ns() + timeout_ms * 1000000ULL;
+	long submitted = os_atomic_load_long(released);
+
+	frame.data[0] = planes;
+	frame.data[1] = planes + WIDTH * HEIGHT;
+	frame.data[2] = planes + WIDTH * HEIGHT * 5 / 4;
+	frame.linesize[0] = WIDTH;
+	frame.linesize[1] = WIDTH / 2;
+	frame.linesize[2] = WIDTH / 2;
+
+	while (!os_atomic_load_long(cond) && os_gettime_ns() < end) {
+		/* one frame at a time, the planes are shared */
+		if (os_atomic_load_long(released) == submitted) {
+			frame.timestamp = os_gettime_ns();
+			if (video_output_submit_frame(video, &frame, 1,
+						      release_frame,
+						      (void *)released))
+				submitted++;
+		}
+		os_sleep_ms(1);
+	}
+
+	return os_atomic_load_long(cond) != 0;
+}
+
+static void plain_callback(void *param, struct video_data *frame)
+{
+	UNUSED_PARAMETER(param);
+	UNUSED_PARAMETER(frame);
+}
+
+/* an input that disconnects from its own callback must still have its
+ * thread exit and the input freed, without any more frames after that */
+static void disconnect_from_callback(void **state)
+{
+	struct self_disconnect sd = {0};
+	volatile long released = 0;
+	volatile long never = 0;
+	long allocs, kept;
+	uint64_t end;
+
+	UNUSED_PARAMETER(state);
+
+	sd.video = open_video();
+
+	/* the profiler keeps the name of every input thread, so a regular
+	 * disconnect gives the allocations that are expected to remain.  the
+	 * first one also creates the profiler's own data */
+	for (int i = 0; i < 2; i++) {
+		allocs = bnum_allocs();
+		assert_true(video_output_connect(sd.video, NULL, plain_callback,
+						 NULL));
+		video_output_disconnect(sd.video, plain_callback, NULL);
+		kept = bnum_allocs() - allocs;
+	}
+
+	allocs = bnum_allocs();
+	assert_true(video_output_connect(sd.video, NULL, disconnect_callback,
+					 &sd));
+	assert_true(submit_until(sd.video, &sd.calls, &released, TIMEOUT_MS));
+	assert_false(video_output_active(sd.video));
+
+	/* the input thread frees the input once it has seen the stop */
+	end = os_gettime_ns() + TIMEOUT_MS * 1000000ULL;
+	while (bnum_allocs() != allocs + kept && os_gettime_ns() < end)
+		os_sleep_ms(1);
+	assert_int_equal(bnum_allocs(), allocs + kept);
+
+	/* frames keep coming, but the callback is gone */
+	submit_until(sd.video, &never, &released, 100);
+	assert_int_equal(os_atomic_load_long(&sd.calls), 1);
+
+	video_output_close(sd.video);
+}
+
+/* the video threads register their profiler names with the core */
+static int setup(void **state)
+{
+	UNUSED_PARAMETER(state);
+	return obs_startup("en-US", NULL, NULL) ? 0 : -1;
+}
+
+static int teardown(void **state)
+{
+	UNUSED_PARAMETER(state);
+	obs_shutdown();
+	return 0;
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(disconnect_from_callback),
+	};
+
+	return cmocka_run_group_tests(tests, setup, teardown);
+}
@@ -0,0 +1,189 @@
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <util/bmem.h>
+#include <util/platform.h>
+#include <media-io/video-frame.h>
+#include <media-io/video-scaler.h>
+
+#define BENCH_FRAMES 30
+
+struct conversion {
+	const char *name;
+	enum video_format src_format;
+	uint32_t src_width;
+	uint32_t src_height;
+	enum video_format dst_format;
+	uint32_t dst_width;
+	uint32_t dst_height;
+};
+
+static const struct conversion conversions[] = {
+	{"BGRA->NV12 1080p", VIDEO_FORMAT_BGRA, 1920, 1080, VIDEO_FORMAT_NV12,
+	 1920, 1080},
+	{"NV12->I420 1080p", VIDEO_FORMAT_NV12, 1920, 1080, VIDEO_FORMAT_I420,
+	 1920, 1080},
+	{"NV12 4K->1080p", VIDEO_FORMAT_NV12, 3840, 2160, VIDEO_FORMAT_NV12,
+	 1920, 1080},
+	{"NV12 4K->720p", VIDEO_FORMAT_NV12, 3840, 2160, VIDEO_FORMAT_NV12,
+	 1280, 720},
+};
+
+static const int thread_counts[] = {1, 2, 4, 8};
+
+#define NUM_CONVERSIONS (sizeof(conversions) / sizeof(conversions[0]))
+#define NUM_THREAD_COUNTS (sizeof(thread_counts) / sizeof(thread_counts[0]))
+
+static uint32_t plane_height(enum video_format format, size_t plane,
+			     uint32_t height)
+{
+	if (plane > 0 &&
+	    (format == VIDEO_FORMAT_NV12 || format == VIDEO_FORMAT_I420))
+		return height / 2;
+	return height;
+}
+
+static void fill_pattern(struct video_frame *frame, enum video_format format,
+			 uint32_t height)
+{
+	uint8_t value = 0;
+
+	for (size_t plane = 0; plane < MAX_AV_PLANES; plane++) {
+		if (!frame->data[plane])
+			continue;
+
+		uint32_t rows = plane_height(format, plane, height);
+		for (uint32_t y = 0; y < rows; y++) {
+			uint8_t *row = frame->data[plane] +
+				       (size_t)y * frame->linesize[plane];
+			for (uint32_t x = 0; x < frame->linesize[plane]; x++)
+				row[x] = value += 7 + (y & 3);
+		}
+	}
+}
+
+static void scale_frame(video_scaler_t *scaler, struct video_frame *out,
+			const struct video_frame *in)
+{
+	bool success = video_scaler_scale(scaler, out->data, out->linesize,
+					  (const uint8_t *const *)in->data,
+					  in->linesize);
+	assert_true(success);
+}
+
+static video_scaler_t *create_scaler(const struct conversion *conv,
+				     int threads)
+{
+	struct video_scale_info src = {.format = conv->src_format,
+				       .width = conv->src_width,
+				       .height = conv->src_height,
+				       .range = VIDEO_RANGE_PARTIAL,
+				       .colorspace = VIDEO_CS_709};
+	struct video_scale_info dst = {.format = conv->dst_format,
+				       .width = conv->dst_width,
+				       .height = conv->dst_height,
+				       .range = VIDEO_RANGE_PARTIAL,
+				       .colorspace = VIDEO_CS_709};
+	video_scaler_t *scaler = NULL;
+
+	int ret = video_scaler_create_threaded(&scaler, &dst, &src,
+					       VIDEO_SCALE_FAST_BILINEAR,
+					       threads);
+	assert_int_equal(ret, VIDEO_SCALER_SUCCESS);
+	return scaler;
+}
+
+/* every slice gets the full filter context, so the sliced output has to be
+ * identical to the single threaded one */
+static void threaded_matches_single_test(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	for (size_t c = 0; c < NUM_CONVERSIONS; c++) {
+		const struct conversion *conv = &conversions[c];
+		struct video_frame *in = video_frame_create(
+			conv->src_format, conv->src_width, conv->src_height);
+		struct video_frame *ref = video_frame_create(
+			conv->dst_format, conv->dst_width, conv->dst_height);
+		struct video_frame *out = video_frame_create(
+			conv->dst_format, conv->dst_width, conv->dst_height);
+		fill_pattern(in, conv->src_format, conv->src_height);
+
+		video_scaler_t *single = create_scaler(conv, 1);
+		scale_frame(single, ref, in);
+		video_scaler_destroy(single);
+
+		video_scaler_t *threaded = create_scaler(conv, 4);
+		scale_frame(threaded, out, in);
+		video_scaler_destroy(threaded);
+
+		for (size_t plane = 0; plane < MAX_AV_PLANES; plane++) {
+			if (!out->data[plane])
+				continue;
+
+			size_t size = (size_t)out->linesize[plane] *
+				      plane_height(conv->dst_format, plane,
+						   conv->dst_height);
+			assert_memory_equal(ref->data[plane], out->data[plane],
+					    size);
+		}
+
+		video_frame_destroy(in);
+		video_frame_destroy(ref);
+		video_frame_destroy(out);
+	}
+}
+
+/* not a pass/fail test, prints the cost of each conversion per thread count.
+ * counts above what the FFmpeg version supports fall back to one thread */
+static void scaler_benchmark(void **state)
+{
+	UNUSED_PARAMETER(state);
+
+	for (size_t c = 0; c < NUM_CONVERSIONS; c++) {
+		const struct conversion *conv = &conversions[c];
+		struct video_frame *in = video_frame_create(
+			conv->src_format, conv->src_width, conv->src_height);
+		struct video_frame *out = video_frame_create(
+			conv->dst_format, conv->dst_width, conv->dst_height);
+
+		fill_pattern(in, conv->src_format, conv->src_height);
+
+		for (size_t t = 0; t < NUM_THREAD_COUNTS; t++) {
+			video_scaler_t *scaler =
+				create_scaler(conv, thread_counts[t]);
+
+			/* first frame warms up the worker threads */
+			scale_frame(scaler, out, in);
+
+			uint64_t start = os_gettime_ns();
+			for (int i = 0; i < BENCH_FRAMES; i++)
+				scale_frame(scaler, out, in);
+			uint64_t elapsed = os_gettime_ns() - start;
+
+			print_message("%-18s %d thread(s) (%d used): "
+				      "%6.2f ms/frame\n",
+				      conv->name, thread_counts[t],
+				      video_scaler_get_threads(scaler),
+				      (double)elapsed / BENCH_FRAMES /
+					      1000000.0);
+
+			video_scaler_destroy(scaler);
+		}
+
+		video_frame_destroy(in);
+		video_frame_destroy(out);
+	}
+}
+
+int main()
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(threaded_matches_single_test),
+		cmocka_unit_test(scaler_benchmark),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <inttypes.h>
+#include <util/bmem.h>
+#include <util/threading.h>
+#include <util/platform.h>
+#include <util/util_uint64.h>
+#include <obs.h>
+
+/*
+ * Pushes audio in small blocks of random size from its own thread, with a
+ * timestamp jump every few seconds, and logs how long the worst call to
+ * obs_source_output_audio took.  Add a few dozen of these to a scene to
+ * check that capture threads never wait on the audio thread.
+ */
+
+#define STRESS_CHANNELS 2
+#define STRESS_MAX_FRAMES 512
+#define STRESS_REPORT_INTERVAL 10000000000ULL
+#define STRESS_JUMP_INTERVAL 3000000000ULL
+
+struct audio_stress {
+	bool initialized_thread;
+	pthread_t thread;
+	os_event_t *event;
+	obs_source_t *source;
+};
+
+static void *audio_stress_thread(void *pdata)
+{
+	struct audio_stress *as = pdata;
+	uint32_t sample_rate = audio_output_get_sample_rate(obs_get_audio());
+	float *samples = bzalloc(STRESS_MAX_FRAMES * sizeof(float));
+	uint64_t start_time = os_gettime_ns();
+	uint64_t last_report = start_time;
+	uint64_t last_jump = start_time;
+	uint64_t ts = start_time;
+	uint64_t jump = 0;
+	uint64_t worst = 0;
+	uint64_t total = 0;
+	uint64_t calls = 0;
+
+	os_set_thread_name("test-audio-stress");
+
+	for (size_t i = 0; i < STRESS_MAX_FRAMES; i++)
+		samples[i] = ((float)rand() / (float)RAND_MAX - 0.5f) * 0.1f;
+
+	while (os_event_try(as->event) == EAGAIN) {
+		uint32_t frames =
+			16 + (uint32_t)rand() % (STRESS_MAX_FRAMES - 16);
+		uint64_t duration =
+			util_mul_div64(frames, 1000000000ULL, sample_rate);
+		uint64_t now;
+
+		/* make the timing code reset the source's buffered audio */
+		if (ts - last_jump > STRESS_JUMP_INTERVAL) {
+			jump += 5000000000ULL;
+			last_jump = ts;
+		}
+
+		struct obs_source_audio data = {0};
+		for (size_t ch = 0; ch < STRESS_CHANNELS; ch++)
+			data.data[ch] = (const uint8_t *)samples;
+		data.frames = frames;
+		data.speakers = SPEAKERS_STEREO;
+		data.samples_per_sec = sample_rate;
+		data.timestamp = ts + jump;
+		data.format = AUDIO_FORMAT_FLOAT_PLANAR;
+
+		uint64_t call_start = os_gettime_ns();
+		obs_source_output_audio(as->source, &data);
+		uint64_t call_time = os_gettime_ns() - call_start;
+
+		if (call_time > worst)
+			worst = call_time;
+		total += call_time;
+		calls++;
+
+		ts += duration;
+		if (!os_sleepto_ns(ts))
+			ts = os_gettime_ns();
+
+		now = os_gettime_ns();
+		if (now - last_report >= STRESS_REPORT_INTERVAL) {
+			blog(LOG_INFO,
+			     "[test-audio-stress] '%s': %" PRIu64 " calls, "
+			     "avg %" PRIu64 " ns, worst %" PRIu64 " ns",
+			     obs_source_get_name(as->source), calls,
+			     total / calls, worst);
+			last_report = now;
+			worst = 0;
+			total = 0;
+			calls = 0;
+		}
+	}
+
+	bfree(samples);
+	return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static const char *audio_stress_getname(void *unused)
+{
+	UNUSED_PARAMETER(unused);
+	return "Audio Input Stress (Test)";
+}
+
+static void audio_stress_destroy(void *data)
+{
+	struct audio_stress *as = data;
+
+	if (as) {
+		if (as->initialized_thread) {
+			void *ret;
+			os_event_signal(as->event);
+			pthread_join(as->thread, &ret);
+		}
+
+		os_event_destroy(as->event);
+		bfree(as);
+	}
+}
+
+static void *audio_stress_create(obs_data_t *settings, obs_source_t *source)
+{
+	struct audio_stress *as = bzalloc(sizeof(struct audio_stress));
+	as->source = source;
+
+	if (os_event_init(&as->event, OS_EVENT_TYPE_MANUAL) != 0)
+		goto fail;
+	if (pthread_create(&as->thread, NULL, audio_stress_thread, as) != 0)
+		goto fail;
+
+	as->initialized_thread = true;
+
+	UNUSED_PARAMETER(settings);
+	return as;
+
+fail:
+	audio_stress_destroy(as);
+	return NULL;
+}
+
+struct obs_source_info test_audio_stress = {
+	.id = "test_audio_stress",
+	.type = OBS_SOURCE_TYPE_INPUT,
+	.output_flags = OBS_SOURCE_AUDIO,
+	.get_name = audio_stress_getname,
+	.create = audio_stress_create,
+	.destroy = audio_stress_destroy,
+};